@@ -39,6 +39,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <network/core/protocol_binary.h>
+#include <network/core/conn_framing.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +48,13 @@ extern "C" {
 /* Inlined from memcached.h - should go into sub header */
 typedef unsigned int rel_time_t;
 
+/*
+ * Callback appending one "STAT <key> <val>" entry to a stats response,
+ * cookie is the connection the response is for.
+ */
+typedef void (*ADD_STAT)(const char *key, const uint16_t klen, const char *val,
+		const uint32_t vlen, const void *cookie);
+
 /** Maximum length of a key. */
 #define KEY_MAX_LENGTH 250
 
@@ -61,10 +69,10 @@ typedef unsigned int rel_time_t;
 /* Up to 3 numbers (2 32bit, 1 64bit), spaces, newlines, null 0 */
 #define SUFFIX_SIZE 50
 
-/** Initial size of list of items being returned by "get". */
+/** Initial size of list of item references being written out. */
 #define ITEM_LIST_INITIAL 200
 
-/** Initial size of list of CAS suffixes appended to "gets" lines. */
+/** Initial size of list of suffix buffers written out with them. */
 #define SUFFIX_LIST_INITIAL 100
 
 /** Initial size of the sendmsg() scatter/gather array. */
@@ -111,7 +119,8 @@ enum conn_states {
 	conn_closing, /**< closing this connection */
 	conn_mwrite, /**< writing out many items sequentially */
 	conn_closed, /**< connection is closed */
-	conn_watch, /**< held by the logger thread as a watcher */
+	conn_watch, /**< held off the event loop, see conn_client_hold */
+	conn_tls_handshake, /**< TLS handshake of an accepted connection */
 	conn_max_state /**< Max state value (used for assertion) */
 };
 
@@ -137,11 +146,19 @@ enum protocol {
 
 enum network_transport {
 	local_transport, /* Unix sockets*/
-	tcp_transport, udp_transport
+	tcp_transport, udp_transport,
+	shm_transport /* shared memory rings set up over a Unix socket */
+};
+
+enum sched_mode {
+	sched_off, /* fixed number of requests per event (-R) */
+	sched_bytes, /* deficit round robin charging bytes moved */
+	sched_time /* deficit round robin charging microseconds of service */
 };
 
 #define IS_TCP(x) (x == tcp_transport)
 #define IS_UDP(x) (x == udp_transport)
+#define IS_SHM(x) (x == shm_transport)
 
 /**
  * Global stats. Only resettable stats should go into this structure.
@@ -152,6 +169,8 @@ struct stats {
 	uint64_t rejected_conns;
 	uint64_t malloc_fails;
 	uint64_t listen_disabled_num;
+	uint64_t steered_conns; /* dispatched to the worker on their rx CPU */
+	uint64_t steer_misses; /* rx CPU had no worker, load based fallback */
 	uint64_t time_in_listen_disabled_us; /* elapsed time in microseconds while server unable to process new connections */
 	struct timeval maxconns_entered; /* last time maxconns entered */
 };
@@ -185,12 +204,31 @@ struct settings {
 	int num_threads; /* number of worker (without dispatcher) libevent threads to run */
 	int num_threads_per_udp; /* number of worker threads serving each udp socket */
 	int reqs_per_event; /* Maximum number of io to process on each io-event. */
+	bool reqs_adaptive; /* tune reqs_per_event per worker at runtime */
+	int reqs_target_us; /* event loop iteration time to aim for */
+	int *worker_cpus; /* CPUs workers are pinned to round robin (-C) */
+	int num_worker_cpus; /* entries in worker_cpus, 0 to not pin */
+	int main_cpu; /* CPU of the accept thread, -1 to not pin */
+	int idle_cpu; /* CPU of the idle timeout thread, -1 to not pin */
+	bool numa_local; /* keep worker memory on the worker's NUMA node */
+	bool steer_cpu; /* dispatch to the worker on SO_INCOMING_CPU */
+	int busy_poll_us; /* workers spin this long before blocking, 0 is off */
+	int trace_size; /* trace records kept per thread, 0 is off */
+	char *trace_path; /* trace dumps go to <trace_path>.<pid> */
+	int tls_port; /* TCP port speaking TLS, 0 is none */
+	char *tls_cert; /* PEM certificate chain of tls_port */
+	char *tls_key; /* PEM private key of tls_port */
+	int shm_size; /* bytes per ring of shared memory conns, 0 is off */
+	int proxy_timeout; /* ms a proxied backend may owe a reply, 0 is off */
 	bool use_cas;
 	enum protocol binding_protocol;
 	int backlog;
 	bool sasl; /* SASL on/off */
 	bool maxconns_fast; /* Whether or not to early close connections */
 	int idle_timeout; /* Number of seconds to let connections idle */
+	int max_frame_size; /* largest request frame accepted (-I) */
+	enum sched_mode sched_mode; /* how requests are shared on a worker (-Q) */
+	int sched_quantum; /* credit per event and unit of weight */
 };
 
 extern struct stats stats;
@@ -203,6 +241,15 @@ struct LIBEVENT_THREAD;
  * The structure representing a connection into memcached.
  */
 typedef struct conn conn;
+
+/* gives back a reference of a response, see conn_add_item_release() */
+typedef void (*conn_item_release)(conn *c, void *it);
+
+typedef struct {
+	void *it;
+	conn_item_release release; /* NULL for the callback's onItemRelease() */
+} conn_item_ref;
+
 struct conn {
 	int sfd;
 #if 0
@@ -255,17 +302,19 @@ struct conn {
 	int msgused; /* number of elements used in msglist[] */
 	int msgcurr; /* element in msglist[] being transmitted now */
 	int msgbytes; /* number of bytes in current msg */
-#if 0
-	item **ilist; /* list of items to write out */
+	/* data for conn_mwrite responses pointing into the callback's memory */
+	conn_item_ref *ilist; /* references to release once written out */
 	int isize;
-	item **icurr;
+	conn_item_ref *icurr;
 	int ileft;
 
-	char **suffixlist;
+	char **suffixlist; /* suffix_cache buffers written out with them */
 	int suffixsize;
 	char **suffixcurr;
 	int suffixleft;
-#endif
+	void *write_resume; /* response written in parts, see onWriteResume() */
+	enum conn_states park_state; /* to go on in, see conn_worker_park() */
+	bool close_on_resume; /* its client left while it was parked */
 	enum protocol protocol; /* which protocol this connection speaks */
 	enum network_transport transport; /* what transport is used by this connection */
 
@@ -287,17 +336,125 @@ struct conn {
 	/* This is where the binary header goes */
 	protocol_binary_request_header binary_header;
 	uint64_t cas; /* the cas to return */
+	uint64_t log_seq; /* mutation log record its next response waits for */
 	short cmd; /* current command being processed */
 	int opaque;
 	int keylen;
+	/* framing state, see conn_framing.h */
+	const conn_framing *framing; /* custom framing, NULL for ascii/binary */
+	conn_frame frames[FRAME_BATCH_MAX]; /* complete frames found in rbuf */
+	int nframes; /* frames found by the last scan */
+	int framecurr; /* next frame to dispatch */
+	char *frame_anchor; /* where frames[framecurr] starts */
+	/* fair scheduling state, see conn_sched.h */
+	struct {
+		int weight;
+		int64_t deficit; /* credit left for this event */
+		bool inflight; /* a request is being served */
+		uint64_t bytes; /* bytes consumed and written so far */
+		uint64_t start_bytes; /* bytes when the request started */
+		uint64_t start_us; /* when the request started */
+		uint64_t service_us; /* total service time charged */
+		uint64_t service_bytes; /* total bytes charged */
+	} sched;
+	/* service time of the current request, see conn_latency.h */
+	int lat_op; /* what the request was, -1 until it is dispatched */
+	uint64_t lat_start_ns; /* when parsing it started, 0 if idle */
 	conn *next; /* Used for generating a list of conn structures */
 	LIBEVENT_THREAD *thread; /* Pointer to the thread object serving this connection */
+	int numa_node; /* node the buffers were allocated on, -1 if unknown */
+	/* TLS, see conn_tls.h */
+	bool tls; /* listening: accepts TLS, otherwise: speaks it */
+	struct ssl_st *ssl; /* the TLS session, NULL for plain connections */
+	bool ktls_tx; /* the kernel encrypts what we send */
+	struct conn_shm *shm; /* rings of a shm_transport conn, see conn_shm.h */
 };
 
 typedef struct msg_callback{
 	virtual ~msg_callback(){};
 	virtual void onBinaryEventDispatch(conn *c) = 0;
 	virtual void onAsciiEventDispatch(conn *c) = 0;
+	/* framing used for every connection, NULL keeps ascii/binary */
+	virtual const conn_framing *getFraming() {
+		return NULL;
+	}
+	/* one frame of a custom framing, it starts at c->rcurr */
+	virtual void onFrameDispatch(conn *c, const conn_frame *frame) {
+	}
+	/*
+	 * all complete frames of one read, starting at c->rcurr. Return false
+	 * to have them dispatched one by one instead.
+	 */
+	virtual bool onFrameBatchDispatch(conn *c, const conn_frame *frames,
+			int nframes) {
+		return false;
+	}
+	/*
+	 * a binary request over -I: c->binary_header is set up and its c->sbytes
+	 * body bytes are still to come. Answer it with c->write_and_go set to
+	 * conn_swallow to go on after the body; c is closed otherwise.
+	 */
+	virtual void onFrameTooLarge(conn *c) {
+	}
+	/*
+	 * getopt letters of the callback's own command line options, added
+	 * to the server's
+	 */
+	virtual const char *getOptions() {
+		return "";
+	}
+	/*
+	 * one of those options and its argument, or with opt 'o' a -o
+	 * suboption the server doesn't know, arg being "name" or "name=value".
+	 * Return 1 if taken, 0 if it isn't the callback's and -1 if it is but
+	 * arg is bad.
+	 */
+	virtual int onOption(int opt, const char *arg) {
+		return 0;
+	}
+	/* -h lines of those options */
+	virtual void onUsage() {
+	}
+	/*
+	 * once the settings are parsed, before workers start. Return non-zero
+	 * to refuse to start.
+	 */
+	virtual int onServerStart() {
+		return 0;
+	}
+	/*
+	 * SIGINT or SIGTERM stopped the event loop, start_server() returns
+	 * next. Workers are still running.
+	 */
+	virtual void onServerStop() {
+	}
+	/*
+	 * stats of the callback's own, "" being plain "stats" and "settings"
+	 * following the server's settings. Return false if the subcommand is
+	 * unknown to it too.
+	 */
+	virtual bool onStats(conn *c, const char *subcommand, ADD_STAT add_stats) {
+		return false;
+	}
+	/*
+	 * a reference added with conn_add_item() was written out, or the
+	 * response was dropped. Called on c's worker. References added with a
+	 * release function of their own go to it instead.
+	 */
+	virtual void onItemRelease(conn *c, void *it) {
+	}
+	/*
+	 * a conn_mwrite response queued with c->write_resume set was written
+	 * out and its references released. Build the next part into the
+	 * emptied msghdrs and go to conn_mwrite again, or clear write_resume
+	 * and move on. A response can stream this way without being built
+	 * whole.
+	 */
+	virtual void onWriteResume(conn *c) {
+	}
+	/* c is closed halfway through such a response, free write_resume */
+	virtual void onWriteAbort(conn *c) {
+	}
 } msg_callback_t;
 
 /* array of conn structures, indexed by file descriptor */
@@ -328,7 +485,18 @@ conn *conn_new(const int sfd, const enum conn_states init_state,
 void conn_new_listen_add(const int sfd, enum network_transport transport);
 
 void conn_worker_readd(conn *c);
+/*
+ * Takes c off its worker's event loop from within a callback, e.g. while
+ * a side thread finishes the request. The response queued so far stays;
+ * conn_worker_resume(), from any thread, has the worker carry on with it.
+ * A parked conn must not be closed: set close_on_resume instead, and the
+ * worker closes it once it is handed back.
+ */
+void conn_worker_park(conn *c);
+void conn_worker_resume(conn *c);
 void conn_close_idle(conn *c);
+/* "stats conns", one group of lines per open connection */
+void process_stats_conns(ADD_STAT add_stats, conn *c);
 int start_server(int argc, char **argv,
 		msg_callback_t *callback);
 /******************start call back in thread_libevent_process **/
@@ -0,0 +1,76 @@
+/*
+ * conn_cache.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_CACHE_H_
+#define CONN_CACHE_H_
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cache of fixed size buffers. Freed buffers are kept on a stack and
+ * handed out again, so a worker building many small responses doesn't go
+ * to malloc for each. Workers own one each, see suffix_cache.
+ */
+
+/*
+ * Called on a buffer fresh from malloc, before it is handed out the first
+ * time. Returns 0 on success.
+ */
+typedef int cache_constructor_t(void *obj, void *notused1, int notused2);
+/*
+ * Called on a buffer before it goes back to the system.
+ */
+typedef void cache_destructor_t(void *obj, void *notused);
+
+typedef struct {
+	pthread_mutex_t mutex;
+	char *name;
+	void **ptr; /* free buffers */
+	size_t bufsize;
+	int freetotal; /* room in ptr */
+	int freecurr; /* buffers in ptr */
+	cache_constructor_t *constructor;
+	cache_destructor_t *destructor;
+} cache_t;
+
+/*
+ * Creates a cache of bufsize byte buffers aligned to align, which must be
+ * a power of two. Constructor and destructor may be NULL.
+ * Returns NULL when out of memory.
+ */
+cache_t *cache_create(const char *name, size_t bufsize, size_t align,
+		cache_constructor_t *constructor, cache_destructor_t *destructor);
+
+/*
+ * Frees the cache and the buffers in it, not those handed out.
+ */
+void cache_destroy(cache_t *handle);
+
+/*
+ * Returns a buffer, NULL when out of memory.
+ */
+void *cache_alloc(cache_t *handle);
+
+/*
+ * Gives ptr back to the cache.
+ */
+void cache_free(cache_t *handle, void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_CACHE_H_ */
@@ -0,0 +1,101 @@
+/*
+ * conn_client.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_CLIENT_H_
+#define CONN_CLIENT_H_
+#include <network/core/conn_thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Outbound binary protocol requests from handlers, without blocking the
+ * worker.
+ *
+ * A pool names one upstream server. Each worker keeps its own persistent
+ * connections to it, up to conns_per_worker, connected asynchronously on
+ * the worker's event base and only ever touched by that worker. Requests
+ * are pipelined, up to max_inflight on one connection; the pool overwrites
+ * their opaque and finds the callback of a response by it, so responses may
+ * come back in any order. Every request must draw a response, quiet
+ * opcodes are not supported.
+ *
+ * A request not answered within the pool's timeout, connecting included,
+ * fails: its connection is closed, which fails the requests pipelined on
+ * it too, and the next request opens a new one.
+ *
+ * A handler that answers its client from the callback parks the client
+ * conn with conn_client_hold() before it returns, and hands it back with
+ * conn_client_resume() once the response has been set up:
+ *
+ *   void Handler::onBinaryEventDispatch(conn *c) {
+ *       if (conn_client_request(pool, c->thread, req, len, on_reply, c) == 0)
+ *           conn_client_hold(c);
+ *       else
+ *           ... answer with an error
+ *   }
+ *   static void on_reply(void *arg, const protocol_binary_response_header *rsp,
+ *           const char *body) {
+ *       conn *c = (conn *) arg;
+ *       ... write_and_free(c, copy, len) or out_string(c, "SERVER_ERROR")
+ *       conn_client_resume(c);
+ *   }
+ */
+
+#define CLIENT_CONNS_DEFAULT 2
+#define CLIENT_INFLIGHT_DEFAULT 128
+#define CLIENT_TIMEOUT_DEFAULT 1000 /* milliseconds */
+
+typedef struct conn_client_pool conn_client_pool;
+
+/*
+ * Called on the worker that sent the request. rsp is the response header,
+ * body its extras, key and value; both are only valid during the call.
+ * rsp is NULL if the upstream connection failed or timed out before the
+ * response came.
+ */
+typedef void (*conn_client_cb)(void *arg,
+		const protocol_binary_response_header *rsp, const char *body);
+
+/*
+ * Creates a pool for host:port, resolving host now. 0 for conns_per_worker,
+ * max_inflight or timeout_ms uses the default. Returns NULL if host doesn't
+ * resolve.
+ */
+conn_client_pool *conn_client_pool_new(const char *host, int port,
+		int conns_per_worker, int max_inflight, int timeout_ms);
+
+/*
+ * Sends a binary request of len bytes, header included, on worker me.
+ * cb runs once with its response, never before this returns. Returns -1
+ * if the request is malformed or every connection of me is full.
+ */
+int conn_client_request(conn_client_pool *pool, LIBEVENT_THREAD *me,
+		const void *req, size_t len, conn_client_cb cb, void *arg);
+
+/*
+ * Takes TCP conn c off the event loop until conn_client_resume().
+ */
+void conn_client_hold(conn *c);
+
+/*
+ * Puts c back on the event loop; it writes what was set up for it, or
+ * goes on with its next command.
+ */
+void conn_client_resume(conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_CLIENT_H_ */
@@ -0,0 +1,99 @@
+/*
+ * conn_framing.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_FRAMING_H_
+#define CONN_FRAMING_H_
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of complete frames extracted from rbuf per scan. */
+#define FRAME_BATCH_MAX 64
+
+/** Default upper bound of a single frame (header included). */
+#define FRAME_SIZE_MAX_DEFAULT (1024 * 1024)
+
+/**
+ * How a byte stream is cut into frames.
+ */
+enum framing_type {
+	framing_delimiter, /**< frames end with a delimiter byte (ASCII lines) */
+	framing_length_prefixed, /**< fixed header carrying the body length */
+	framing_varint /**< LEB128 varint length followed by the body */
+};
+
+/**
+ * Description of a framing. The builtin ASCII and binary protocols are
+ * just two instances of it; a msg_callback may hand out its own.
+ */
+typedef struct conn_framing conn_framing;
+struct conn_framing {
+	enum framing_type type;
+	int max_frame; /* largest acceptable frame, 0 for unlimited */
+
+	/* framing_delimiter */
+	char delim; /* byte terminating a frame */
+	bool strip_cr; /* drop a '\r' right before the delimiter */
+
+	/* framing_length_prefixed */
+	int hdr_size; /* fixed header bytes in front of the body */
+	int len_offset; /* offset of the length field inside the header */
+	int len_size; /* 1, 2, 4 or 8 bytes */
+	bool len_big_endian; /* network order length field */
+	int len_adjust; /* added to the decoded length to get the body size */
+};
+
+/**
+ * One complete frame inside rbuf. Frames are contiguous, so only the
+ * lengths are kept; the first pending frame always starts at c->rcurr.
+ */
+typedef struct conn_frame conn_frame;
+struct conn_frame {
+	int hdrlen; /* bytes of header/prefix in front of the payload */
+	int trailer; /* bytes after it: the delimiter and a stripped '\r' */
+	int len; /* total frame length, header and delimiter included */
+};
+
+/** Builtin framings, configured by framing_init(). */
+extern conn_framing framing_ascii;
+extern conn_framing framing_binary;
+
+/*
+ * Initializes the builtin framings, max_frame is the largest frame accepted.
+ */
+void framing_init(int max_frame);
+
+/*
+ * Finds the first occurrence of delim in buf, vectorized where the
+ * platform allows it.
+ * Returns a pointer to the delimiter or NULL.
+ */
+const char *framing_find_delim(const char *buf, size_t len, char delim);
+
+/*
+ * Scans buf once and records up to max_frames complete frames.
+ *
+ * Returns the number of complete frames found (0 means more data is
+ * needed), or -1 if the stream violates the framing (oversized frame,
+ * malformed varint).
+ */
+int framing_scan(const conn_framing *f, const char *buf, int len,
+		conn_frame *frames, int max_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_FRAMING_H_ */
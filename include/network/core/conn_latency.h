@@ -0,0 +1,144 @@
+/*
+ * conn_latency.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_LATENCY_H_
+#define CONN_LATENCY_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Service time histograms, from the moment a request starts being parsed
+ * until its response is transmitted, kept per worker and per binary
+ * opcode or ASCII command verb.
+ *
+ * Buckets are log-linear: every power of two is split into LAT_SUB equal
+ * slots, so a reported value is at most 1/LAT_SUB above the real one.
+ * Only the owning worker writes a histogram; readers merge them with
+ * relaxed loads and never stop it.
+ */
+
+#define LAT_SUB_BITS 3
+#define LAT_SUB (1 << LAT_SUB_BITS)
+/* values are clamped below 2^LAT_MAX_BITS ns, about 4.8 hours */
+#define LAT_MAX_BITS 44
+#define LAT_BUCKETS ((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB)
+
+/* One histogram, values in nanoseconds. */
+struct latency_hist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t buckets[LAT_BUCKETS];
+};
+
+/* ASCII command verbs that get their own histogram. */
+#define LAT_ASCII_VERBS \
+    X(get) \
+    X(gets) \
+    X(set) \
+    X(add) \
+    X(replace) \
+    X(append) \
+    X(prepend) \
+    X(cas) \
+    X(incr) \
+    X(decr) \
+    X(delete) \
+    X(touch) \
+    X(gat) \
+    X(gats) \
+    X(stats) \
+    X(flush_all) \
+    X(version) \
+    X(verbosity) \
+    X(quit) \
+    X(other) /* any other verb */
+
+/* Histogram slots: binary opcodes first, then ASCII verbs, then frames of
+ * a custom framing. */
+enum latency_op {
+	LAT_OP_BINARY = 0,
+#define X(name) LAT_OP_ASCII_##name,
+	LAT_OP_BINARY_LAST = 255, /* one slot per opcode, the verbs follow */
+	LAT_ASCII_VERBS
+#undef X
+	LAT_OP_FRAME,
+	LAT_OPS
+};
+
+/*
+ * Returns the bucket of value v, the last one for v of 2^LAT_MAX_BITS or
+ * more.
+ */
+int hist_bucket(uint64_t v);
+
+/*
+ * Returns the largest value that falls into bucket b, which is what a
+ * percentile in b reports.
+ */
+uint64_t hist_bucket_top(int b);
+
+/*
+ * Adds one value to h. Only the worker owning h may call it.
+ */
+void hist_record(struct latency_hist *h, uint64_t ns);
+
+/*
+ * Adds a consistent enough copy of src to dst; src may be written
+ * concurrently.
+ */
+void hist_merge(struct latency_hist *dst, const struct latency_hist *src);
+
+/*
+ * Returns the value below which a fraction q (0 < q <= 1) of the samples
+ * fall, 0 for an empty histogram.
+ */
+uint64_t hist_value_at(const struct latency_hist *h, double q);
+
+/*
+ * Returns the slot of an ASCII command line.
+ */
+int latency_ascii_op(const char *line);
+
+/*
+ * Writes a printable name of slot op into buf, e.g. "bin_get" or
+ * "ascii_get". Returns buf.
+ */
+const char *latency_op_name(int op, char *buf, size_t len);
+
+/*
+ * Request lifecycle, driven by drive_machine() and the dispatchers.
+ */
+void latency_request_start(conn *c);
+void latency_request_op(conn *c, int op);
+void latency_request_done(conn *c);
+
+/*
+ * Merges the histograms of slot op across all workers into out.
+ * Returns false if no sample was recorded yet.
+ */
+bool latency_snapshot(int op, struct latency_hist *out);
+
+/*
+ * Appends count, p50, p99, p999 and max (in microseconds) of every slot
+ * with samples as "lat_<name>_<field>" stats.
+ */
+void latency_append_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_LATENCY_H_ */
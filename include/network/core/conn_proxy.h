@@ -0,0 +1,59 @@
+/*
+ * conn_proxy.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_PROXY_H_
+#define CONN_PROXY_H_
+#include <network/core/conn_base.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Transparent TCP proxying of a client connection to a backend.
+ *
+ * Once a handler has picked the backend for a client, conn_proxy_start()
+ * connects to it on the client's worker and bridges the two sockets in
+ * that worker's event loop: each direction is moved with splice() through
+ * a pipe of its own, so the proxied bytes never enter user space. A side
+ * closing its write half is passed on with shutdown(); the client conn is
+ * closed when both directions are done or either side fails. Bytes moved
+ * are counted in the proxy_client_bytes and proxy_upstream_bytes thread
+ * stats.
+ *
+ * A backend that hasn't connected, or hasn't sent anything back for
+ * settings.proxy_timeout ms since it was sent bytes, is taken for hung:
+ * the client conn is closed and proxy_timeouts counts it. The clock stops
+ * whenever the backend sends, so a slow stream or an idle pair is fine.
+ */
+
+/* most bytes spliced into a pipe at once */
+#define PROXY_CHUNK_SIZE 65536
+#define PROXY_TIMEOUT_DEFAULT 5000 /* milliseconds */
+
+/*
+ * Proxies TCP conn c to the backend at addr, from the handler that is
+ * dispatching its current request. first (may be NULL) is sent to the
+ * backend ahead of whatever the client sent after the current request,
+ * typically the current request itself. The conn is the proxy's from here
+ * on; the handler must not answer it. Returns -1 if the backend can't be
+ * reached at all, c is left as it was then.
+ */
+int conn_proxy_start(conn *c, const struct sockaddr *addr, socklen_t addrlen,
+		const void *first, size_t firstlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_PROXY_H_ */
@@ -0,0 +1,88 @@
+/*
+ * conn_sched.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_SCHED_H_
+#define CONN_SCHED_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Deficit round robin across the connections of a worker.
+ *
+ * Every time libevent hands a connection to its worker it is credited
+ * quantum * weight units; each finished request is charged what it cost
+ * (bytes moved or microseconds of service, see -Q). The connection keeps
+ * going while it has credit left and yields otherwise, so a pipelining
+ * client gets the same share per loop iteration as a light one instead of
+ * a fixed -R requests. Credit is dropped once a connection runs dry.
+ */
+
+#define SCHED_WEIGHT_DEFAULT 1
+#define SCHED_WEIGHT_MAX 1000
+#define SCHED_QUANTUM_BYTES_DEFAULT 16384
+#define SCHED_QUANTUM_TIME_DEFAULT 500
+
+/*
+ * Parses -Q "<bytes|time>[:<quantum>]", "off" disables the scheduler.
+ * Returns false on a malformed value.
+ */
+bool sched_parse_quantum(const char *str);
+
+/*
+ * Parses -W, a comma separated list of "<selector>:<weight>" where the
+ * selector is a listening port or a client class in CIDR notation
+ * ("10.0.0.0/8"). The first matching client class wins over the port.
+ * Returns false on a malformed value.
+ */
+bool sched_parse_weights(const char *str);
+
+/*
+ * Picks the weight of a freshly accepted connection.
+ */
+void sched_conn_init(conn *c);
+
+/*
+ * Overrides the weight of a connection, e.g. once a handler classified
+ * its client.
+ */
+void sched_set_weight(conn *c, int weight);
+
+/*
+ * Credits a connection that was just handed to us by libevent.
+ */
+void sched_visit(conn *c);
+
+/*
+ * Marks the start of a request.
+ */
+void sched_request_start(conn *c);
+
+/*
+ * Charges the request that just finished, if any. nreqs is what is left
+ * of the -R budget, which decides when the scheduler is off.
+ * Returns true if the connection may process another request now.
+ */
+bool sched_request_done(conn *c, int nreqs);
+
+/*
+ * The connection ran out of input, its unused credit is dropped.
+ */
+void sched_idle(conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_SCHED_H_ */
@@ -0,0 +1,120 @@
+/*
+ * conn_shm.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_SHM_H_
+#define CONN_SHM_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shared memory transport for clients on the same host.
+ *
+ * A client connected to the Unix socket (-s) sends the line "shm". The
+ * server answers "SHM <size>" and passes along, with SCM_RIGHTS, a memfd
+ * holding two single producer, single consumer byte rings of size bytes
+ * (requests and responses) and two eventfds, one each side waits on. From
+ * then on the connection is shm_transport: requests and responses, in
+ * either protocol, go through the rings and the socket is only watched
+ * for the client going away.
+ *
+ * A side only rings the other's eventfd when the other said, in the ring
+ * header, that it is about to sleep on it, so a busy connection moves
+ * bytes without system calls.
+ */
+
+#define SHM_MAGIC 0x53484d31 /* "SHM1" */
+#define SHM_SIZE_MAX (1 << 30)
+
+/* one direction, head and tail on cache lines of their own */
+struct shm_ring {
+	uint64_t head; /* bytes ever produced */
+	char pad1[56];
+	uint64_t tail; /* bytes ever consumed */
+	char pad2[56];
+	uint32_t consumer_waiting; /* consumer sleeps until head moves */
+	uint32_t producer_waiting; /* producer sleeps until tail moves */
+	char pad3[56];
+};
+
+/* start of the memfd, followed by the request and response data */
+struct shm_layout {
+	uint32_t magic;
+	uint32_t size; /* bytes of each ring, a power of two */
+	char pad[56];
+	struct shm_ring req; /* client -> server */
+	struct shm_ring rsp; /* server -> client */
+};
+
+/*
+ * True if line is the upgrade request.
+ */
+bool is_shm_command(const char *line);
+
+/*
+ * Switches Unix socket conn c to the shared memory transport, from the
+ * dispatch of its "shm" line. Returns -1, c untouched, if it can't be.
+ */
+int conn_shm_upgrade(conn *c);
+
+/*
+ * read() and sendmsg() of a shared memory conn, -1 with EAGAIN when the
+ * ring is empty or full; sendmsg then waits for EV_READ, not EV_WRITE.
+ */
+ssize_t conn_shm_read(conn *c, void *buf, size_t len);
+ssize_t conn_shm_sendmsg(conn *c, const struct msghdr *m);
+
+/*
+ * Called before c waits for input. Returns false if input came in the
+ * meantime and it must not sleep.
+ */
+bool conn_shm_may_sleep(conn *c);
+
+/*
+ * Releases the rings and the socket of c, if it has them.
+ */
+void conn_shm_close(conn *c);
+
+/*
+ * Client side, blocking.
+ */
+typedef struct conn_shm_client conn_shm_client;
+
+/*
+ * Connects to the Unix socket at path and upgrades. NULL on failure.
+ */
+conn_shm_client *conn_shm_client_open(const char *path);
+
+/*
+ * Writes all of buf. Returns len, or -1 if the server went away. Like a
+ * blocking socket, it waits while the request ring is full, and the server
+ * stops taking requests while the response ring is: a client pipelining
+ * more than a ring of requests must read responses in between.
+ */
+ssize_t conn_shm_client_write(conn_shm_client *cl, const void *buf,
+		size_t len);
+
+/*
+ * Reads what is there, waiting for at least one byte. Returns 0 if the
+ * server went away.
+ */
+ssize_t conn_shm_client_read(conn_shm_client *cl, void *buf, size_t len);
+
+void conn_shm_client_close(conn_shm_client *cl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_SHM_H_ */
@@ -0,0 +1,77 @@
+/*
+ * conn_stats.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_STATS_H_
+#define CONN_STATS_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Builtin "stats" command, answered for both protocols before the
+ * msg_callback sees the request:
+ *
+ *   stats            server, connection and aggregated worker counters
+ *   stats settings   the settings in effect
+ *   stats conns      one group of lines per open connection
+ *   stats latency    service time percentiles, see conn_latency.h
+ *   stats trace      state transition tracing, see conn_trace.h
+ *
+ * Plain stats and unknown groups are also offered to the msg_callback's
+ * onStats(), so a callback such as the storage engine adds its own.
+ *
+ * The binary protocol asks with PROTOCOL_BINARY_CMD_STAT, the subcommand
+ * being the key. The whole response is built in c->stats.buffer and sent
+ * with write_and_free(), workers keep running while it is gathered.
+ */
+
+/*
+ * Makes room for needed more bytes in c->stats.buffer.
+ * Returns false when out of memory.
+ */
+bool grow_stats_buf(conn *c, size_t needed);
+
+/*
+ * ADD_STAT writing one entry in the wire format of c's protocol. An empty
+ * key and value terminate the response.
+ */
+void append_stats(const char *key, const uint16_t klen, const char *val,
+		const uint32_t vlen, const void *cookie);
+
+/*
+ * Formats a value and hands it to add_stats under name.
+ */
+void append_stat(const char *name, ADD_STAT add_stats, conn *c,
+		const char *fmt, ...);
+
+void server_stats(ADD_STAT add_stats, conn *c);
+void process_stat_settings(ADD_STAT add_stats, conn *c);
+
+/*
+ * Runs the stats subcommand (NULL or "" for plain stats) and sets c up to
+ * write the response.
+ */
+void process_stats(conn *c, const char *subcommand);
+
+/*
+ * Returns true if the NUL terminated ASCII line is a stats command, and
+ * points *subcommand at its argument.
+ */
+bool is_stats_command(char *line, char **subcommand);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_STATS_H_ */
@@ -15,19 +15,27 @@
 #include <event.h>
 #include <pthread.h>
 #include <network/core/conn_base.h>
+#include <network/core/conn_cache.h>
+#include <network/core/conn_latency.h>
+#include <network/core/conn_trace.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define THREAD_STATS_FIELDS \
     X(get_cmds) \
+    X(get_hits) \
     X(get_misses) \
     X(get_expired) \
     X(get_flushed) \
     X(touch_cmds) \
     X(touch_misses) \
+    X(set_cmds) \
+    X(delete_hits) \
     X(delete_misses) \
+    X(incr_hits) \
     X(incr_misses) \
+    X(decr_hits) \
     X(decr_misses) \
     X(cas_misses) \
     X(bytes_read) \
@@ -36,7 +44,23 @@ extern "C" {
     X(conn_yields) /* # of yields for connections (-R option)*/ \
     X(auth_cmds) \
     X(auth_errors) \
-    X(idle_kicks) /* idle connections killed */
+    X(idle_kicks) /* idle connections killed */ \
+    X(busy_poll_spin_us) /* time spun without finding work (-o busy_poll) */ \
+    X(busy_poll_sleep_us) /* time blocked after the spin budget ran out */ \
+    X(busy_poll_hits) /* spins that ended with work */ \
+    X(busy_poll_sleeps) /* spins that ended blocking */ \
+    X(upstream_connects) /* outbound connections opened */ \
+    X(upstream_requests) /* requests sent upstream */ \
+    X(upstream_failures) /* requests failed by a broken upstream */ \
+    X(upstream_timeouts) /* upstream connections closed as overdue */ \
+    X(proxy_conns) /* client connections handed to a backend */ \
+    X(proxy_timeouts) /* proxied conns closed on a hung backend */ \
+    X(proxy_client_bytes) /* spliced from proxied clients to backends */ \
+    X(proxy_upstream_bytes) /* spliced from backends to proxied clients */ \
+    X(tls_handshakes) /* TLS handshakes completed */ \
+    X(tls_ktls_tx) /* of those, with sends encrypted by the kernel */ \
+    X(tls_failures) /* TLS handshakes that failed */ \
+    X(shm_conns) /* Unix socket connections moved to shared memory */
 
 /**
  * Stats stored per-thread.
@@ -51,25 +75,107 @@ struct thread_stats {
 #endif
 };
 
+/* Largest number of CPUs in a -C list. */
+#define CPU_LIST_MAX 1024
+
+/* Bounds and memory of the adaptive reqs_per_event (-R auto). */
+#define REQS_ADAPT_MIN 1
+#define REQS_ADAPT_MAX 1000
+#define REQS_ADAPT_TARGET_DEFAULT 1000
+#define REQS_HISTORY_SIZE 16
+
+/* One change of a worker's reqs_per_event. */
+struct reqs_history {
+	rel_time_t time; /* when it changed */
+	int value; /* the new value */
+	uint64_t loop_us; /* smoothed loop busy time that caused it */
+};
+
+/* Snapshot of a worker's adaptive reqs_per_event. */
+struct reqs_adapt_stats {
+	int current; /* value in use */
+	uint64_t loop_us; /* smoothed loop busy time */
+	uint64_t loop_events; /* smoothed ready connections per iteration */
+	int nhistory; /* valid entries in history, oldest first */
+	struct reqs_history history[REQS_HISTORY_SIZE];
+};
+
 typedef struct LIBEVENT_THREAD LIBEVENT_THREAD;
 struct LIBEVENT_THREAD {
 	pthread_t thread_id; /* unique ID of this thread */
+	int cpu; /* CPU the thread is pinned to, -1 if it isn't */
+	int numa_node; /* NUMA node of that CPU, -1 if unknown */
 	struct event_base *base; /* libevent handle this thread uses */
 	struct event notify_event; /* listen event for notify pipe */
 	int notify_receive_fd; /* receiving end of notify pipe */
 	int notify_send_fd; /* sending end of notify pipe */
 	struct thread_stats stats; /* Stats generated by this thread */
 	struct conn_queue *new_conn_queue; /* queue of new connections to handle */
+	int curr_conns; /* connections dispatched here and still open */
+	/* adaptive reqs_per_event, see -R auto */
+	int reqs_per_event; /* per connection batch currently used */
+	uint64_t loop_start_us; /* first callback of the current iteration */
+	int loop_events; /* callbacks run in the current iteration */
+	int loop_yields; /* connections cut short in the current iteration */
+	uint64_t loop_ewma_us; /* smoothed busy time per iteration */
+	uint64_t loop_ewma_events; /* smoothed callbacks per iteration */
+	struct reqs_history reqs_history[REQS_HISTORY_SIZE];
+	int reqs_history_count; /* changes recorded so far */
+	/* service time per request kind, allocated on first use */
+	struct latency_hist *lat_hist[LAT_OPS];
+	conn_trace_ring *trace; /* state transitions, NULL when tracing is off */
+	void *lru_bump_buf; /* storage engine's async LRU bumps, made on first use */
+	cache_t *suffix_cache; /* SUFFIX_SIZE buffers, see conn_add_suffix() */
 #if 0
-	cache_t *suffix_cache; /* suffix cache */
 	logger *l; /* logger buffer */
-	void *lru_bump_buf; /* async LRU bump buffer */
 #endif
 
 };
 
 void conn_thread_init(int nthreads);
 
+/*
+ * Pins the calling thread to cpu.
+ * Returns 0 on success, -1 otherwise.
+ */
+int conn_thread_pin(int cpu);
+
+/*
+ * Returns the NUMA node cpu belongs to, -1 if unknown.
+ */
+int conn_cpu_node(int cpu);
+
+/*
+ * Notes that a callback of the worker's current loop iteration runs.
+ */
+void conn_thread_loop_event(LIBEVENT_THREAD *me);
+
+/*
+ * Fills in the adaptive reqs_per_event state of worker tid.
+ * Returns false if there is no such worker.
+ */
+bool conn_thread_reqs_stats(int tid, struct reqs_adapt_stats *out);
+
+/*
+ * Sums the stats of all workers into stats.
+ */
+void threadlocal_stats_aggregate(struct thread_stats *stats);
+
+/*
+ * Returns worker tid, NULL if there is no such worker.
+ */
+LIBEVENT_THREAD *conn_thread_worker(int tid);
+
+/*
+ * Returns the tid of worker me.
+ */
+int conn_thread_id(LIBEVENT_THREAD *me);
+
+/*
+ * A connection served by worker me was closed.
+ */
+void conn_thread_conn_closed(LIBEVENT_THREAD *me);
+
 void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
 		int read_buffer_size, enum network_transport transport);
 
@@ -0,0 +1,62 @@
+/*
+ * conn_tls.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_TLS_H_
+#define CONN_TLS_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * TLS termination on the listeners of -o tls_port.
+ *
+ * Connections accepted there start in conn_tls_handshake; the worker runs
+ * the handshake with OpenSSL, non-blocking, and asks it to push record
+ * encryption into the kernel (kTLS, TCP_ULP "tls") once it is done. When
+ * the kernel took the send side, transmit() keeps using sendmsg() on the
+ * socket unchanged, without copies. Otherwise, or when the kernel has no
+ * kTLS, sends go through SSL_write(). Reads always go through SSL_read(),
+ * which reads plain data from a kTLS socket.
+ *
+ * Without OpenSSL at build time conn_tls_init() fails and tls_port can't
+ * be used.
+ */
+
+/*
+ * Loads settings.tls_cert and settings.tls_key. Returns -1 on failure.
+ */
+int conn_tls_init(void);
+
+/*
+ * Advances the handshake of c. Returns 1 when done, 0 when it has to wait
+ * for the event in *want (EV_READ or EV_WRITE), -1 on failure.
+ */
+int conn_tls_accept(conn *c, short *want);
+
+/*
+ * read() and sendmsg() of a TLS connection, errno set as theirs.
+ */
+ssize_t conn_tls_read(conn *c, void *buf, size_t len);
+ssize_t conn_tls_sendmsg(conn *c, const struct msghdr *m);
+
+/*
+ * Frees the TLS session of c, if any.
+ */
+void conn_tls_close(conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_TLS_H_ */
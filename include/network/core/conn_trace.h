@@ -0,0 +1,104 @@
+/*
+ * conn_trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef CONN_TRACE_H_
+#define CONN_TRACE_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Always-on tracing of connection state transitions and I/O results.
+ *
+ * Every worker owns a ring of fixed size records it writes without locks
+ * or syscalls besides the clock; the accept thread has one of its own.
+ * The rings can be read as text with "stats trace", and are written to
+ * <trace_path>.<pid> as they are on SIGUSR2 or when the process crashes.
+ *
+ * Dump file layout, host byte order:
+ *   struct conn_trace_file_hdr
+ *   per ring: struct conn_trace_ring_hdr, then size records, oldest at
+ *   (head % size). Records not written yet have ts_ns 0.
+ * A record being written while the ring is read may show up torn.
+ */
+
+#define TRACE_SIZE_DEFAULT 4096
+#define TRACE_MAGIC 0x43525456 /* "VTRC" */
+#define TRACE_VERSION 1
+
+enum trace_kind {
+	trace_state, /* from -> to */
+	trace_read, /* bytes read, or -errno */
+	trace_write, /* bytes written, or -errno */
+};
+
+struct conn_trace_rec {
+	uint64_t ts_ns; /* CLOCK_MONOTONIC */
+	int32_t fd;
+	uint8_t kind; /* enum trace_kind */
+	uint8_t from; /* enum conn_states before */
+	uint8_t to; /* enum conn_states after */
+	uint8_t pad;
+	int64_t bytes;
+};
+
+struct conn_trace_file_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t rec_size;
+	uint32_t nrings;
+};
+
+struct conn_trace_ring_hdr {
+	int32_t tid; /* worker index, -1 for the accept thread */
+	uint32_t size; /* records, a power of two */
+	uint64_t head; /* records ever written */
+};
+
+typedef struct conn_trace_ring conn_trace_ring;
+
+/*
+ * Sets up tracing from settings, installs the dump signal handlers.
+ * Call from the main thread before workers start.
+ */
+void conn_trace_init(void);
+
+/*
+ * Creates the ring of worker tid (-1 for the accept thread), from the
+ * thread that will write it. Returns NULL when tracing is off.
+ */
+conn_trace_ring *conn_trace_ring_new(int tid);
+
+/*
+ * Records one event of c in the ring of the thread serving it.
+ */
+void conn_trace(conn *c, enum trace_kind kind, int from, int to,
+		int64_t bytes);
+
+/*
+ * Writes all rings to the dump file. Async signal safe.
+ * Returns 0 on success, -1 otherwise.
+ */
+int conn_trace_dump(void);
+
+/*
+ * "stats trace", the newest records of every ring as text.
+ */
+void conn_trace_append_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_TRACE_H_ */
@@ -37,6 +37,17 @@ bool safe_strtoul(const char *str, uint32_t *out);
 bool safe_strtol(const char *str, int32_t *out);
 bool safe_strtod(const char *str, double *out);
 
+/*
+ * Parses a CPU list such as "0-3,8,10-11".
+ *
+ * str   the list
+ * cpus  out parameter, receives at most max CPU numbers in list order
+ * count out parameter, number of CPUs stored
+ *
+ * returns true if the whole list was valid and fit.
+ */
+bool parse_cpu_list(const char *str, int *cpus, int max, int *count);
+
 #ifndef HAVE_HTONLL
 extern uint64_t htonll(uint64_t);
 extern uint64_t ntohll(uint64_t);
@@ -40,6 +40,32 @@ int add_iov(conn *c, const void *buf, int len);
  */
 int add_msghdr(conn *c);
 
+/*
+ * Keeps reference it until the response being built is written out, then
+ * hands it to the callback's onItemRelease(). The response may point into
+ * it with add_iov(). Returns 0 on success, -1 on out-of-memory.
+ */
+int conn_add_item(conn *c, void *it);
+
+/*
+ * Like conn_add_item(), but it is handed to release instead, so that a
+ * callback can keep its references apart from those of the callbacks it
+ * chains to.
+ */
+int conn_add_item_release(conn *c, void *it, conn_item_release release);
+
+/*
+ * Returns a SUFFIX_SIZE buffer from the worker's suffix_cache for text the
+ * response being built points at, freed with the references. NULL on
+ * out-of-memory.
+ */
+char *conn_add_suffix(conn *c);
+
+/*
+ * Releases the references and suffixes of the response, written out or not.
+ */
+void conn_release_items(conn *c);
+
 /* set up a connection to write a buffer then free it, used for stats */
 void write_and_free(conn *c, char *buf, int bytes);
 /*
@@ -49,7 +75,7 @@ int build_udp_headers(conn *c);
 
 void out_string(conn *c, const char *str);
 
-void out_of_memory(conn *c, char *ascii_error);
+void out_of_memory(conn *c, const char *ascii_error);
 
 int try_read_command(conn *c);
 
@@ -70,7 +70,9 @@ extern "C"
         PROTOCOL_BINARY_RESPONSE_AUTH_ERROR = 0x20,
         PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE = 0x21,
         PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND = 0x81,
-        PROTOCOL_BINARY_RESPONSE_ENOMEM = 0x82
+        PROTOCOL_BINARY_RESPONSE_ENOMEM = 0x82,
+        PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED = 0x83,
+        PROTOCOL_BINARY_RESPONSE_EINTERNAL = 0x84
     } protocol_binary_response_status;
 
     /**
@@ -141,7 +143,9 @@ extern "C"
      * See section 3.4 Data Types
      */
     typedef enum {
-        PROTOCOL_BINARY_RAW_BYTES = 0x00
+        PROTOCOL_BINARY_RAW_BYTES = 0x00,
+        /* the value is compressed, see network/storage/compress.h */
+        PROTOCOL_BINARY_DATATYPE_COMPRESSED = 0x02
     } protocol_binary_datatypes;
 
     /**
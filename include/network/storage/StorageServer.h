@@ -0,0 +1,90 @@
+/*
+ * StorageServer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+
+#ifndef STORAGESERVER_H_
+#define STORAGESERVER_H_
+#include <network/core/conn_base.h>
+#include <network/core/conn_thread.h>
+#include <network/core/conn_wrap.h>
+
+/*
+ * In-memory key-value engine behind the binary protocol.
+ *
+ * Answers GET, GETQ, GETK, GETKQ, SET, ADD, REPLACE, DELETE, INCREMENT,
+ * DECREMENT (and their quiet forms) and NOOP from items kept in a slab
+ * allocator and hash table, sized by -m, -f, -n and -o hashpower, and the
+ * ASCII "get" and "gets" of any number of keys. Hits are sent straight
+ * from the referenced items, see conn_add_item_release(), so references
+ * the next callback adds with conn_add_item() still reach its
+ * onItemRelease(). Once -m is used up, a store evicts the least recently
+ * used items of its slab class, or fails with -M, and pages move over time
+ * to the classes evicting the youngest items, unless -o slab_automove=0.
+ *
+ * With -o range_index it also answers the range opcodes on the keys in
+ * memcmp order: RGET streams a GETK like response per item, written a
+ * part at a time, then a closing response without extras whose key is
+ * the one to continue after, if max_results left some out. RSET, RDELETE,
+ * RINCR and RDECR (and quiet forms) change each key of the range and
+ * answer with how many they changed. RAPPEND and RPREPEND are not served.
+ * The request layout is described in StorageServer.cpp.
+ *
+ * A SET, ADD or REPLACE over -I is answered with E2BIG and its value
+ * swallowed, as memcached does. Items carry cas values (cas_enabled in
+ * "stats"), also as in memcached.
+ *
+ * Other binary opcodes, ASCII commands and custom framing go to the next
+ * callback, if one was given, so it can sit in front of an application's
+ * own callback:
+ *
+ *   SampleServer app;
+ *   StorageServer storage(&app);
+ *   start_server(argc, argv, &storage);
+ *
+ * Its "stats" and "stats settings" lines are added to the server's, "stats
+ * slabs" lists the slab classes in use and "stats items" their LRUs. Its
+ * options and their defaults are in storage_settings.h, -h lists them.
+ *
+ * With -o memory_file=<path> the items live in that file and survive a
+ * clean stop (SIGINT, SIGTERM): the next start with the same memory
+ * settings serves them again, see restart.h. With -o log_file=<path>
+ * every change is logged before it is acknowledged, and replayed at the
+ * next start whatever the stop, see persist.h. With -o ext_path=<path>
+ * values of cold items move to segment files there, and a get of one
+ * parks the connection while the value is read back, see flash.h. With
+ * -o compress_min=<bytes> larger values are stored compressed, and sent
+ * so to binary requests that set PROTOCOL_BINARY_DATATYPE_COMPRESSED,
+ * see compress.h.
+ */
+class StorageServer : public msg_callback {
+public:
+	StorageServer(msg_callback *next = NULL);
+	virtual ~StorageServer();
+protected:
+	virtual void onBinaryEventDispatch(conn *c);
+	virtual void onAsciiEventDispatch(conn *c);
+	virtual const conn_framing *getFraming();
+	virtual void onFrameDispatch(conn *c, const conn_frame *frame);
+	virtual bool onFrameBatchDispatch(conn *c, const conn_frame *frames,
+			int nframes);
+	virtual void onFrameTooLarge(conn *c);
+	virtual const char *getOptions();
+	virtual int onOption(int opt, const char *arg);
+	virtual void onUsage();
+	virtual int onServerStart();
+	virtual void onServerStop();
+	virtual bool onStats(conn *c, const char *subcommand, ADD_STAT add_stats);
+	virtual void onItemRelease(conn *c, void *it);
+	virtual void onWriteResume(conn *c);
+	virtual void onWriteAbort(conn *c);
+private:
+	void processBinary(conn *c);
+
+	msg_callback *mNext;
+	char mOptions[64]; /* getOptions(), the engine's and mNext's */
+};
+
+#endif /* STORAGESERVER_H_ */
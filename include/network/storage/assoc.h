@@ -0,0 +1,52 @@
+/*
+ * assoc.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef ASSOC_H_
+#define ASSOC_H_
+#include <network/storage/items.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash table of the linked items, a vmodule::ConcurrentHashTable starting
+ * at 2^hashpower buckets and doubling in the background as items are
+ * added. Its lock stripes are the item locks: callers of find, insert and
+ * delete hold assoc_lock(hv).
+ */
+
+int assoc_init(int hashpower);
+void assoc_lock(uint32_t hv);
+void assoc_unlock(uint32_t hv);
+bool assoc_trylock(uint32_t hv);
+/* every item lock, for good: the items won't change any more */
+void assoc_lock_all(void);
+item *assoc_find(const char *key, size_t nkey, uint32_t hv);
+void assoc_insert(item *it, uint32_t hv);
+void assoc_delete(const char *key, size_t nkey, uint32_t hv);
+
+/*
+ * true if it is linked under hv, assoc_lock(hv) held. it may be stale.
+ */
+bool assoc_contains(item *it, uint32_t hv);
+
+/*
+ * "stats" lines of the table and its expansion.
+ */
+void assoc_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASSOC_H_ */
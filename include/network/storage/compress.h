@@ -0,0 +1,78 @@
+/*
+ * compress.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+#include <network/storage/items.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Value compression, with -o compress_min=<bytes>: values of at least that
+ * size are stored compressed with vmodule::LZCodec when that saves an
+ * eighth of them or more, ITEM_COMPRESSED set. Such a value is its
+ * decompressed length, 4 bytes in network order, then the LZ block.
+ *
+ * Binary requests with PROTOCOL_BINARY_DATATYPE_COMPRESSED set may store a
+ * value compressed that way themselves, and get compressed values as they
+ * are, with that datatype; everyone else gets them decompressed.
+ */
+
+/* the decompressed length ahead of the block */
+#define COMPRESS_HDR_LEN 4
+
+/*
+ * Allocates an item for key holding vlen bytes of val, compressed if it
+ * is worth it, or as is with ITEM_COMPRESSED if compressed says val is a
+ * compressed value already. Returns NULL and sets *res to TOO_LARGE,
+ * OUT_OF_MEMORY or, for a compressed val that doesn't decompress,
+ * NOT_STORED.
+ */
+item *compress_alloc(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, const char *val, uint32_t vlen, bool compressed,
+		enum store_item_type *res);
+
+/* decompressed length of compressed value data of nbytes, 0 if bad */
+uint32_t compress_raw_length(const char *data, uint32_t nbytes);
+
+/* decompresses value data of nbytes into the raw_len bytes at raw */
+bool compress_expand_into(const char *data, uint32_t nbytes, char *raw,
+		uint32_t raw_len);
+
+/*
+ * Returns an unlinked copy of it, referenced, with the value decompressed
+ * and the same cas; it's reference is dropped. NULL if there is no memory
+ * for the copy, or the value doesn't decompress.
+ */
+item *compress_expand(item *it);
+
+/*
+ * Counts it, holding a compressed value, in the stats of its class until
+ * compress_forget() when it is freed. compress_alloc() counts its items.
+ */
+void compress_account(item *it);
+void compress_forget(item *it);
+
+/*
+ * "stats" lines of compression, and its "stats slabs" lines per class:
+ * the compressed values the class holds now.
+ */
+void compress_stats(ADD_STAT add_stats, conn *c);
+void compress_stats_slabs(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPRESS_H_ */
@@ -0,0 +1,91 @@
+/*
+ * flash.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef FLASH_H_
+#define FLASH_H_
+#include <network/storage/items.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Flash tier, with -o ext_path=<path>: values of cold items that sat idle
+ * for ext_item_age seconds, or any cold ones once memory is full, are
+ * appended to segment files <path>.<n> by a writer thread of their own.
+ * The item stays linked with its key, flags and cas, its value replaced by
+ * where the value went (ITEM_HDR). The segments are used round robin, the
+ * oldest one is cut off when the tier is full; each use of a segment has
+ * a new generation, so a location into an older use is known to be gone.
+ *
+ * A hit on such an item is answered with an item of the value's size that
+ * is read into by a pool of reader threads, the connection parked until
+ * all reads of its request are done. A value that is gone by then is a
+ * miss, its item unlinked. The segments start empty with every start.
+ */
+
+/* where a value is, the value of an ITEM_HDR item */
+typedef struct {
+	uint32_t segment;
+	uint32_t generation; /* of the segment when written */
+	uint32_t offset;
+	uint32_t nbytes; /* of the value */
+	uint32_t raw_nbytes; /* decompressed, of an ITEM_COMPRESSED value */
+} flash_loc;
+
+/* opens the segments and starts the writer and readers, in items_init() */
+int flash_init(void);
+
+/* loc may still be read */
+bool flash_loc_valid(const flash_loc *loc);
+
+/*
+ * On the writer thread: queues the value of it, *loc says where it goes.
+ * It is only on disk once flash_flush() returns true. -1 if it can't go.
+ */
+int flash_append(item *it, flash_loc *loc);
+bool flash_flush(void);
+
+/*
+ * A hit on header item hdr, referenced, was added to c's response as it,
+ * of the value's size, or its decompressed size to have it decompressed,
+ * in iovs [iov, iov + niov); quiet and with_key say how a binary response
+ * turns into a miss. Queues the read of the value
+ * into it, sent once flash_submit() parked c until it is there. The
+ * reference to hdr is the read's.
+ */
+void flash_read_queue(conn *c, item *hdr, item *it, int iov, int niov,
+		bool quiet, bool with_key);
+
+/*
+ * After a request of c: if it queued reads, parks c until they are done
+ * and returns true.
+ */
+bool flash_submit(conn *c);
+
+/*
+ * When the response a request was building is thrown away for an error:
+ * forgets the reads it queued, dropping their hdr references. Their items
+ * go with the response, in conn_release_items().
+ */
+void flash_read_drop(void);
+
+/*
+ * "stats" lines of the tier.
+ */
+void flash_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLASH_H_ */
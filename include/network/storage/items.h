@@ -0,0 +1,200 @@
+/*
+ * items.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef ITEMS_H_
+#define ITEMS_H_
+#include <network/core/conn_base.h>
+#include <vutils/ConcurrentHashTable.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Items of the storage engine, each one slab chunk holding the header, the
+ * key and the value.
+ *
+ * An item is found through the hash table and guarded by the item lock of
+ * its key's hash, the table's lock stripe: every lookup, store and delete
+ * takes that lock. Items are reference counted, the hash table holds one
+ * and so does every reader between item_get() and item_remove(), so the
+ * reader can send the item without copying or locking it. An item is
+ * freed when it is unlinked and the last reader lets go; its key and
+ * value don't change while it is linked or referenced.
+ *
+ * Linked items are also on one of three LRUs of their slab class, each with
+ * its own lock, taken after the item lock. New items start hot. A thread
+ * maintaining the LRUs moves items off the tail of hot and warm once those
+ * hold more than their share of the class (-o hot_lru_pct, warm_lru_pct):
+ * to warm, or to the warm head again, if they were fetched more than once
+ * while there, and to cold otherwise. GET never takes an LRU lock, it only
+ * sets the item's flags; a cold item fetched again is queued in the
+ * worker's bump buffer for the maintainer to move to warm.
+ *
+ * With -o range_index linked items are also kept in key order, see
+ * range.h. With -o ext_path the values of cold items may move to the
+ * flash tier, leaving header items behind, see flash.h. With -o
+ * compress_min large values are kept compressed, see compress.h.
+ */
+
+#define ITEM_LINKED 1
+#define ITEM_FETCHED 2 /* fetched since it was linked */
+#define ITEM_ACTIVE 4 /* fetched again since it last moved LRUs */
+#define ITEM_INDEXED 8 /* in the range index, which references it */
+#define ITEM_HDR 16 /* the value is in the flash tier, a flash_loc here */
+#define ITEM_COMPRESSED 32 /* the value is compressed, see compress.h */
+#define ITEM_ACCOUNTED 64 /* in the compressed stats of its class */
+
+/* LRU segments, kept in the top bits of slabs_clsid */
+#define HOT_LRU 0
+#define WARM_LRU 64
+#define COLD_LRU 128
+#define NUM_LRUS 256
+
+typedef struct _stritem {
+	vmodule::HashLink h; /* hash chain, first so links are items */
+	struct _stritem *next; /* LRU, towards the tail */
+	struct _stritem *prev; /* LRU, towards the head */
+	rel_time_t time; /* least recent access, ITEM_UPDATE_INTERVAL apart */
+	rel_time_t exptime; /* expire time, 0 for never */
+	uint32_t nbytes; /* size of the value */
+	uint32_t flags; /* client flags */
+	uint64_t cas;
+	uint8_t it_flags; /* ITEM_* above */
+	uint8_t slabs_clsid; /* slab class, ORed with the LRU segment */
+	uint8_t nkey; /* key length */
+	unsigned short refcount; /* the hash table's and the readers' */
+	char data[]; /* key, then value */
+} item;
+
+#define ITEM_key(it) ((it)->data)
+#define ITEM_data(it) ((it)->data + (it)->nkey)
+#define ITEM_ntotal(nkey, nbytes) (sizeof(item) + (nkey) + (nbytes))
+#define ITEM_clsid(it) ((it)->slabs_clsid & ~(3 << 6))
+#define ITEM_lruid(it) ((it)->slabs_clsid & (3 << 6))
+
+enum store_item_type {
+	NOT_STORED = 0, STORED, EXISTS, NOT_FOUND, DELETED, TOO_LARGE, OUT_OF_MEMORY
+};
+
+enum store_op {
+	STORE_SET, STORE_ADD, STORE_REPLACE
+};
+
+enum delta_result_type {
+	DELTA_OK, NON_NUMERIC, DELTA_EOM, DELTA_ITEM_NOT_FOUND, DELTA_ITEM_CAS_MISMATCH
+};
+
+/*
+ * Sets up the slabs, the hash table and the item locks from settings, and
+ * starts the LRU maintainer and the slab rebalancer. Returns -1 on failure.
+ */
+int items_init(void);
+
+/*
+ * Stops and joins the LRU maintainer and the slab rebalancer. Then, with
+ * -o memory_file or log_file, holds the items still for good and
+ * leaves them to the next start, see restart.h and persist.h. Called once
+ * the server stops.
+ */
+void items_stop(void);
+
+uint32_t item_hash(const void *key, size_t nkey);
+
+void item_lock(uint32_t hv);
+void item_unlock(uint32_t hv);
+
+/*
+ * Converts a protocol expiration time, relative seconds up to 30 days or
+ * else a unix time, to rel_time_t. 0 stays never.
+ */
+rel_time_t item_realtime(uint32_t exptime);
+
+/*
+ * Allocates an unlinked item for nbytes of value, referenced by the
+ * caller, evicting items of its slab class if memory is used up and
+ * storage_settings.evict_to_free. Returns NULL and sets *res to TOO_LARGE
+ * or OUT_OF_MEMORY.
+ */
+item *item_alloc(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, uint32_t nbytes, enum store_item_type *res);
+
+/*
+ * Finds key and returns it referenced, NULL on a miss, expired items count
+ * as one. The fetch counts for the LRU, bumps are queued on c's worker; c
+ * may be NULL.
+ */
+item *item_get(const char *key, size_t nkey, uint32_t hv, conn *c);
+
+/*
+ * Drops a reference from item_alloc() or item_get().
+ */
+void item_remove(item *it);
+
+/*
+ * Links it under its key as op says, checking cas if not 0. The new cas is
+ * returned in *cas_out. The caller's reference is dropped, so it is freed
+ * unless STORED.
+ */
+enum store_item_type item_store(item *it, enum store_op op, uint64_t cas,
+		uint64_t *cas_out);
+
+/*
+ * Links a value read back from the mutation log under key, with its
+ * logged cas, in place of the key's value; compressed if it was logged
+ * so. false if it doesn't fit.
+ */
+bool item_replay(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, const char *data, uint32_t nbytes, uint64_t cas,
+		bool compressed);
+
+/*
+ * Unlinks it if it still is linked, without logging a delete: a header
+ * item whose value is gone from the flash tier.
+ */
+void item_unlink(item *it);
+
+/*
+ * Deletes key, if cas is not 0 only when it matches. Returns DELETED,
+ * NOT_FOUND or EXISTS.
+ */
+enum store_item_type item_delete(const char *key, size_t nkey, uint64_t cas);
+
+/*
+ * Adds delta to (or subtracts from, decrementing stops at 0) the decimal
+ * value of key. The result is in *value, the new cas in *cas_out.
+ */
+enum delta_result_type item_add_delta(const char *key, size_t nkey,
+		bool incr, uint64_t delta, uint64_t cas, uint64_t *value,
+		uint64_t *cas_out);
+
+/*
+ * Moves values of idle cold items to the flash tier, returns how many.
+ * Run by its writer thread.
+ */
+int items_flash_pass(void);
+
+/*
+ * Plain "stats" lines of the engine.
+ */
+void items_stats(ADD_STAT add_stats, conn *c);
+
+/*
+ * "stats items", the LRUs of each slab class in use.
+ */
+void items_stats_lru(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ITEMS_H_ */
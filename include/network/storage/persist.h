@@ -0,0 +1,65 @@
+/*
+ * persist.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef PERSIST_H_
+#define PERSIST_H_
+#include <network/storage/items.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Mutation log, with -o log_file=<path>: every item linked and every
+ * delete is appended to a vmodule::AppendLog as the whole new item or
+ * the key, under the item lock, so the records of a key are in the order
+ * they happened. The log's writer thread syncs them in batches, and a
+ * binary response to a connection that changed something is held back,
+ * the connection parked, until its last record is on disk.
+ *
+ * At start the log is replayed before anything is served, on one thread
+ * per worker, and appended to from there on. Items that expired since are
+ * left out; nothing else ever shortens the log.
+ */
+
+/* replays the log into the engine and opens it, after items_init() */
+int persist_init(void);
+
+/* it was linked under hv, its item lock held */
+void persist_link(item *it, uint32_t hv);
+/* key was deleted, its item lock held */
+void persist_delete(const char *key, size_t nkey, uint32_t hv);
+
+/* last record logged by the calling worker, 0 if none */
+uint64_t persist_thread_seq(void);
+
+/*
+ * After a binary request of c, seq being persist_thread_seq() from
+ * before it: if it logged a record, or an earlier one still waits, and a
+ * response is ready, parks c until the records are on disk. Should they
+ * be lost, the response is replaced by an EINTERNAL one.
+ */
+void persist_wait(conn *c, uint64_t seq);
+
+/* writes out the last records, the items must not change any more */
+void persist_stop(void);
+
+/*
+ * "stats" lines of the log.
+ */
+void persist_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERSIST_H_ */
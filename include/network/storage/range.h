@@ -0,0 +1,76 @@
+/*
+ * range.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef RANGE_H_
+#define RANGE_H_
+#include <network/storage/items.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Key ordered index of the linked items, kept next to the hash table when
+ * -o range_index is given, a vmodule::ConcurrentSkipList. Items are added
+ * and removed as they are linked and unlinked, under their item lock, and
+ * the index holds a reference on each; scans take no lock at all.
+ */
+
+/* flags of a range request, protocol_binary_request_rangeop.flags */
+#define RANGE_START_EXCLUSIVE 1 /* start after the start key */
+#define RANGE_END_INCLUSIVE 2 /* up to the end key included */
+#define RANGE_PREFIX 4 /* keys starting with the start key, no end key */
+
+/*
+ * Keys from start, up to end unless nend is 0. An empty start is the
+ * first key.
+ */
+typedef struct {
+	const char *start;
+	size_t nstart;
+	const char *end;
+	size_t nend;
+	int flags; /* RANGE_START_EXCLUSIVE, RANGE_END_INCLUSIVE */
+} range_bounds;
+
+int range_init(void);
+
+/* it was linked / is being unlinked, its item lock held */
+void range_link(item *it);
+void range_unlink(item *it);
+
+/*
+ * Up to max live items of the range, in key order, each referenced for
+ * the caller to item_remove(). *more tells if the range goes on past them.
+ */
+int range_scan(const range_bounds *b, item **items, int max, bool *more);
+
+/*
+ * Turns prefix into the end of its range, the first key after every key
+ * starting with it, in end (KEY_MAX_LENGTH bytes). Returns its length, 0
+ * if no such key exists.
+ */
+size_t range_prefix_end(const char *prefix, size_t nprefix, char *end);
+
+/* releases the items unlinked lately that no scan sees any more */
+void range_collect(void);
+
+/*
+ * "stats" lines of the index.
+ */
+void range_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RANGE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * restart.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef RESTART_H_
+#define RESTART_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Warm restart. With -o memory_file the slab arena is a shared mapping of
+ * that file, behind a small header and one byte per page naming its slab
+ * class. A clean stop writes the mapping out and marks the header; the
+ * next start with the same -m, -f, -n finds the pages again and the
+ * engine relinks the items in them. Nothing holding a pointer is kept, the
+ * hash table, LRUs and free lists are built again from the pages, so the
+ * file may be mapped elsewhere. After a crash, or with other settings, the
+ * file starts empty.
+ */
+
+typedef struct {
+	uint64_t cas_id; /* last cas handed out */
+	uint64_t curr_items; /* items linked */
+	int64_t time_shift; /* turns the old process's rel_time_t into ours */
+} restart_state;
+
+/*
+ * Maps storage_settings.memory_file and gives it to the slabs as their arena,
+ * after slabs_init(). Returns 1 if it holds the items of a clean stop,
+ * described by *st, 0 if it starts empty and -1 on failure.
+ */
+int restart_open(restart_state *st);
+
+/*
+ * Writes the arena out and marks it clean with st. The items must not
+ * change any more.
+ */
+void restart_close(const restart_state *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RESTART_H_ */
@@ -0,0 +1,134 @@
+/*
+ * slabs.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef SLABS_H_
+#define SLABS_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Slab allocator of the storage engine.
+ *
+ * Memory is taken from the system a page at a time, up to
+ * storage_settings.maxbytes, and each page is cut into chunks of one size
+ * class. Class sizes grow by storage_settings.factor from the smallest item
+ * up to a whole page, so an item wastes at most that factor. Chunks are
+ * never given back to the system; a freed chunk goes on the free list of
+ * its class. Pages may also come from an arena mapped from a file instead,
+ * see restart.h.
+ *
+ * Once the limit is reached, a page can still move to another class: the
+ * mover takes one of the source class, whose chunks then aren't handed out
+ * again, gets the items in it out of the way, and cuts it anew for the
+ * destination once all of its chunks are back.
+ */
+
+/* Slab sizing definitions. */
+#define POWER_SMALLEST 1
+#define POWER_LARGEST 63
+#define MAX_NUMBER_OF_SLAB_CLASSES (POWER_LARGEST + 1)
+#define CHUNK_ALIGN_BYTES 8
+#define SLAB_PAGE_SIZE (1024 * 1024) /* also the largest item */
+
+/*
+ * Sets up the classes, items start at item_min bytes.
+ * Returns -1 on bad settings.
+ */
+int slabs_init(size_t limit, double factor, int item_min);
+
+/*
+ * Takes pages from base instead of the system, the class of the n-th page
+ * going to page_class[n] and the number of pages taken to *used. base
+ * holds at least the memory limit. Called after slabs_init().
+ */
+void slabs_set_arena(char *base, uint8_t *page_class, uint32_t *used);
+
+/*
+ * Takes back the pages the arena had handed out already, cutting each into
+ * chunks of its class again: keep() tells which chunks of class id are
+ * items in use, the rest are freed. Called once, before any slabs_alloc().
+ */
+void slabs_restore(bool (*keep)(void *chunk, unsigned int id));
+
+/*
+ * Returns the class of an item of size bytes, 0 if it is too large.
+ */
+unsigned int slabs_clsid(size_t size);
+
+/*
+ * Returns the chunk size of class id.
+ */
+unsigned int slabs_chunk_size(unsigned int id);
+
+/*
+ * Returns a chunk of class id, NULL when the class is empty and the memory
+ * limit is reached.
+ */
+void *slabs_alloc(unsigned int id);
+
+/*
+ * Gives chunk ptr back to class id.
+ */
+void slabs_free(void *ptr, unsigned int id);
+
+/*
+ * Bytes taken from the system so far.
+ */
+size_t slabs_malloced(void);
+
+/*
+ * Pages of class id and its free chunks.
+ */
+void slabs_usage(unsigned int id, unsigned int *pages,
+		unsigned int *free_chunks);
+
+/*
+ * Chunks of a page of class id.
+ */
+unsigned int slabs_perslab(unsigned int id);
+
+/*
+ * Starts moving a page away from class src, returns it. NULL if src has
+ * less than two pages, or a move is underway already. Moves are made by one
+ * thread at a time.
+ */
+char *slabs_reassign_begin(unsigned int src);
+
+/*
+ * Whether all chunks of the page being moved are free.
+ */
+bool slabs_reassign_done(void);
+
+/*
+ * Cuts the page being moved, done, into chunks of class dst. false if dst
+ * has no room to list it, the move goes on.
+ */
+bool slabs_reassign_end(unsigned int dst);
+
+/*
+ * Gives the page being moved back to its class.
+ */
+void slabs_reassign_abort(void);
+
+/*
+ * "stats slabs", one group of lines per class in use.
+ */
+void slabs_stats(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLABS_H_ */
@@ -0,0 +1,72 @@
+/*
+ * storage_settings.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef STORAGE_SETTINGS_H_
+#define STORAGE_SETTINGS_H_
+#include <network/core/conn_base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Settings of the storage engine. The server doesn't know them: the
+ * engine takes -m, -f, -n, -M and its -o suboptions through the option
+ * hooks of msg_callback, see StorageServer.h.
+ */
+struct storage_settings {
+	size_t maxbytes; /* memory of the items (-m) */
+	double factor; /* chunk size growth factor of the slab classes (-f) */
+	int chunk_size; /* room for key and value of the smallest items (-n) */
+	int hashpower_init; /* log2 of the initial hash table buckets */
+	int hot_lru_pct; /* share of a slab class's items kept in its hot LRU */
+	int warm_lru_pct; /* and in its warm LRU, the rest are cold */
+	bool range_index; /* keep the items in key order too, for range ops */
+	char *memory_file; /* file the item memory lives in, NULL for none */
+	char *log_file; /* mutation log of the items, NULL for none */
+	char *ext_path; /* flash tier segment files <ext_path>.<n>, NULL for none */
+	size_t ext_size; /* bytes of all the segments */
+	int ext_item_size; /* smallest value moved to them */
+	int ext_item_age; /* seconds a cold item sits idle before it moves */
+	int ext_threads; /* threads reading them back */
+	int compress_min; /* smallest value stored compressed, 0 is off */
+	bool evict_to_free; /* evict items when memory is full, not fail (-M) */
+	bool slab_automove; /* move pages between slab classes as needed */
+};
+
+extern struct storage_settings storage_settings;
+
+/* getopt letters of the engine's own options */
+#define STORAGE_OPTIONS "m:f:n:M"
+
+void storage_settings_init(void);
+
+/*
+ * One engine option, as msg_callback::onOption(): returns 1 if taken, 0
+ * if it isn't the engine's and -1 if arg is bad.
+ */
+int storage_option(int opt, const char *arg);
+
+/*
+ * Checks the options against each other once all are parsed. Returns -1
+ * if they don't go together.
+ */
+int storage_settings_check(void);
+
+void storage_usage(void);
+void storage_stat_settings(ADD_STAT add_stats, conn *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STORAGE_SETTINGS_H_ */
@@ -0,0 +1,132 @@
+/*
+ * AppendLog.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vutils/error.h>
+#include <vutils/StrongPointer.h>
+
+namespace vmodule {
+
+class LogWriter;
+
+/*
+ * Append-only file of records, written by a thread of its own with group
+ * commit: appends from any thread are copied into a batch, and while one
+ * batch is written and fdatasync()ed the next one fills up, so a single
+ * sync covers whatever came in meanwhile. Callers that need a record on
+ * disk before they go on ask to be called back once it is.
+ *
+ * A batch that fails to write or sync is cut off the file again and its
+ * records are lost: their waiters, and whoever asks about them later, get
+ * the error instead. Should the cut fail too, the log stops writing.
+ *
+ * Each record carries a hash picked by the caller. replay() reads the
+ * file back on several threads, all records of one hash on the same
+ * thread in file order, so records of one key go in order when the hash
+ * is the key's.
+ */
+class AppendLog {
+public:
+	/*
+	 * record seq, and all before it, are on disk, or err if seq never
+	 * will be; on the writer thread
+	 */
+	typedef void (*Synced)(void *arg, status_t err);
+	/* a record read back by replay(), on one of its threads */
+	typedef void (*Apply)(const void *rec, size_t len, void *arg);
+
+	struct Stats {
+		uint64_t records; /* appended */
+		uint64_t bytes; /* appended, headers included */
+		uint64_t batches; /* written, each with one fdatasync */
+		uint64_t largest_batch; /* in records */
+		uint64_t write_errors; /* batches that failed to write or sync */
+		uint64_t lost; /* records that never made it to disk */
+		uint64_t synced; /* seq of the last record on disk */
+	};
+
+	AppendLog(const char *path);
+	~AppendLog();
+
+	/*
+	 * Reads the file back, if there is one, before open(): calls apply on
+	 * every intact record with nthreads threads. A torn tail, left by a
+	 * crash in the middle of a write, is cut off. The records found are
+	 * added to *count.
+	 */
+	status_t replay(int nthreads, Apply apply, void *arg, uint64_t *count);
+
+	/* opens the file for appending and starts the writer */
+	status_t open();
+	/* writes out what is queued and stops the writer */
+	void close();
+
+	/*
+	 * Queues the record made of iov, returns its seq, counting from 1
+	 * since open().
+	 */
+	uint64_t append(uint32_t hash, const struct iovec *iov, int iovcnt);
+
+	/*
+	 * Has synced(arg, err) called once record seq is on disk or lost, and
+	 * returns WOULD_BLOCK. Otherwise synced won't be called: NO_ERROR if it
+	 * is on disk already, the error if it was lost or can't be waited for.
+	 */
+	status_t whenSynced(uint64_t seq, Synced synced, void *arg);
+
+	void getStats(Stats *out);
+
+private:
+	friend class LogWriter;
+
+	struct Waiter {
+		uint64_t seq;
+		Synced synced;
+		void *arg;
+	};
+
+	/* one batch, run by the writer; false once closed and drained */
+	bool writeBatch();
+	/* records first to last are lost with err, mLock held */
+	void lose(uint64_t first, uint64_t last, status_t err);
+	bool reserve(char **buf, size_t *size, size_t need);
+
+	char *mPath;
+	int mFd;
+	off_t mSize; /* of the file up to the last good batch, by the writer */
+	status_t mBroken; /* the file couldn't be cut back, by the writer */
+	sp<LogWriter> mWriter;
+
+	pthread_mutex_t mLock; /* all below */
+	pthread_cond_t mCond; /* a batch to write, or closing */
+	char *mBuf; /* batch filling up */
+	size_t mBufLen;
+	size_t mBufSize;
+	char *mSpare; /* batch being written */
+	size_t mSpareSize;
+	uint64_t mAppended; /* seq of the last record queued */
+	uint64_t mWritten; /* seq of the last record of the last batch */
+	uint64_t mSynced; /* seq of the last record on disk */
+	/*
+	 * records lost are within these, 0 if none: those in between that did
+	 * get to disk are taken as lost too, should anyone ask later
+	 */
+	uint64_t mLostFirst;
+	uint64_t mLostLast;
+	status_t mLostError;
+	Waiter *mWaiters;
+	size_t mNumWaiters;
+	size_t mMaxWaiters;
+	bool mClosing;
+	Stats mStats;
+};
+
+}
@@ -0,0 +1,109 @@
+/*
+ * ConcurrentHashTable.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vutils/error.h>
+#include <vutils/StrongPointer.h>
+
+namespace vmodule {
+
+/*
+ * Link embedded in the entries of a ConcurrentHashTable. It keeps the full
+ * hash of the entry's key, so buckets split without rehashing keys.
+ */
+struct HashLink {
+	HashLink *next;
+	uint32_t hv;
+};
+
+class HashExpander;
+
+/*
+ * Intrusive chained hash table shared by many threads.
+ *
+ * Buckets are guarded by 2^lockpower striped locks picked by the low bits
+ * of the hash; callers take lock(hv) around find/insert/remove and whatever
+ * they do with the entry. A thread must not block on a second lock while
+ * holding one (trylock is fine).
+ *
+ * Once there are 1.5 entries per bucket a background thread doubles the
+ * table without stopping the callers: it switches to the new table, then
+ * moves the old buckets over one at a time, each under the lock that
+ * guards it, while lookups of buckets not yet moved keep going to the old
+ * table. Only the switch itself, and dropping the old table at the end,
+ * take every lock, once, for a moment.
+ */
+class ConcurrentHashTable {
+public:
+	/* true if entry e has key */
+	typedef bool (*KeyEquals)(const HashLink *e, const void *key, size_t nkey);
+
+	struct Stats {
+		int hashpower; /* log2 of the buckets */
+		uint64_t items; /* entries linked */
+		bool expanding; /* buckets are being moved to a bigger table */
+		uint64_t expand_done; /* buckets of the old table moved so far */
+		uint64_t expand_total; /* buckets of the old table */
+		uint64_t expansions; /* times the table was doubled */
+		uint64_t moved_items; /* entries moved by those */
+	};
+
+	ConcurrentHashTable(KeyEquals equals);
+	~ConcurrentHashTable();
+
+	/*
+	 * Allocates 2^hashpower buckets and 2^lockpower locks, no more locks
+	 * than buckets, and starts the expander thread when expand is set.
+	 */
+	status_t init(int hashpower, int lockpower, bool expand);
+
+	void lock(uint32_t hv);
+	void unlock(uint32_t hv);
+	bool trylock(uint32_t hv);
+	/* every lock, in order; nothing else may hold one twice meanwhile */
+	void lockAll();
+	void unlockAll();
+
+	/* the entry with key, NULL if none; lock(hv) held */
+	HashLink *find(const void *key, size_t nkey, uint32_t hv);
+	/* links e, whose key must not be in the table; lock(hv) held */
+	void insert(HashLink *e, uint32_t hv);
+	/* unlinks and returns the entry with key, NULL if none; lock(hv) held */
+	HashLink *remove(const void *key, size_t nkey, uint32_t hv);
+	/*
+	 * true if e is linked under hv; lock(hv) held. Only compares pointers,
+	 * so e may be stale, even freed, as long as its memory stays mapped.
+	 */
+	bool contains(const HashLink *e, uint32_t hv);
+
+	void getStats(Stats *out);
+
+private:
+	friend class HashExpander;
+
+	HashLink **bucket(uint32_t hv);
+	/* doubles the table, run by the expander thread */
+	void expand();
+
+	KeyEquals mEquals;
+	HashLink **mPrimary; /* buckets in use */
+	HashLink **mOld; /* buckets being moved out of, while expanding */
+	int mHashpower; /* of mPrimary */
+	bool mExpanding;
+	uint64_t mExpandBucket; /* old buckets below it were moved */
+	bool mExpandRequested;
+	uint64_t mItems;
+	uint64_t mExpansions;
+	uint64_t mMovedItems;
+	pthread_mutex_t *mLocks;
+	uint32_t mLockMask;
+	sp<HashExpander> mExpander;
+};
+
+}
@@ -0,0 +1,109 @@
+/*
+ * ConcurrentSkipList.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vutils/error.h>
+
+namespace vmodule {
+
+/*
+ * Skip list ordering values by a byte string key, memcmp order with the
+ * shorter key first on a common prefix.
+ *
+ * Readers take no lock: between readBegin() and readEnd() they walk the
+ * list while writers link and unlink nodes under a single mutex. A node
+ * unlinked meanwhile keeps pointing forward into the list, so a reader
+ * standing on it carries on; the node and its value are only let go of,
+ * through the Retire callback, once every reader that could have seen it
+ * has ended its read (epoch based reclamation).
+ *
+ * The key of a node is not copied, it must stay valid until its value is
+ * retired, typically by pointing into the value.
+ */
+class ConcurrentSkipList {
+public:
+	struct Node {
+		const void *key;
+		size_t nkey;
+		void *value;
+		/* retired, waiting for the readers */
+		Node *retired_next;
+		uint64_t retired_epoch;
+		int height;
+		Node *next[];
+	};
+
+	/* the value of a node no reader sees any more */
+	typedef void (*Retire)(void *value);
+
+	struct Stats {
+		uint64_t nodes; /* linked */
+		uint64_t retired; /* unlinked, not yet released */
+		uint64_t reclaimed; /* released */
+	};
+
+	ConcurrentSkipList(Retire retire);
+	~ConcurrentSkipList();
+
+	status_t init();
+
+	/* links value under key, false if the key is there already */
+	bool insert(const void *key, size_t nkey, void *value);
+	/* unlinks key if it maps to value, false if it does not */
+	bool remove(const void *key, size_t nkey, void *value);
+
+	/*
+	 * A read section of the calling thread, which must not block in it.
+	 * Sections don't nest.
+	 */
+	void readBegin();
+	void readEnd();
+
+	/*
+	 * In a read section: the first node with a key from key on, or past
+	 * key if exclusive; NULL at the end. An empty key is the start.
+	 */
+	Node *seek(const void *key, size_t nkey, bool exclusive);
+	/* in a read section: the node after n */
+	Node *next(Node *n);
+
+	/* releases what no reader sees any more, without waiting for more */
+	void collect();
+
+	/* memcmp order of two keys, shorter first */
+	static int compare(const void *a, size_t na, const void *b, size_t nb);
+
+	void getStats(Stats *out);
+
+private:
+	Node *newNode(const void *key, size_t nkey, void *value, int height);
+	int randomHeight();
+	/* the last nodes before key on every level, mLock held */
+	Node *findPreds(const void *key, size_t nkey, Node **preds);
+	void retire(Node *n);
+	void reclaim();
+	uint64_t *readerSlot();
+
+	Retire mRetire;
+	Node *mHead;
+	int mHeight; /* levels in use */
+	uint32_t mRandom;
+	pthread_mutex_t mLock; /* writers */
+	uint64_t mNodes;
+
+	/* reclamation, see the .cpp */
+	uint64_t mEpoch;
+	uint64_t *mSlots; /* epoch each reader thread is in, 0 outside */
+	Node *mRetired; /* newest first */
+	uint64_t mRetiredCount;
+	uint32_t mSinceReclaim; /* retired since the last reclaim() */
+	uint64_t mReclaimed;
+};
+
+}
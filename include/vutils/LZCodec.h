@@ -0,0 +1,44 @@
+/*
+ * LZCodec.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vmodule {
+
+/*
+ * Fast LZ77 block codec in the LZ4 block layout: sequences of a token
+ * (literal length and match length, 4 bits each, longer ones continued in
+ * bytes of 255), the literals, and a 2 byte little endian offset back into
+ * the output, 64KB at most. The last sequence is literals only. A block
+ * doesn't record its decompressed size, the caller keeps it.
+ *
+ * It finds matches through a small hash table of 4 byte sequences, one
+ * pass and no entropy coding, trading ratio for speed: text such as JSON
+ * typically shrinks 3-5x at several hundred MB/s.
+ */
+class LZCodec {
+public:
+	/* largest compress() output for n bytes */
+	static size_t bound(size_t n);
+
+	/*
+	 * Compresses n bytes of src into dst, which has room for dstlen.
+	 * Returns the block's size, 0 if it doesn't fit.
+	 */
+	static size_t compress(const void *src, size_t n, void *dst,
+			size_t dstlen);
+
+	/*
+	 * Decompresses block src of n bytes into dst, which it must fill
+	 * exactly. false if the block is corrupt or of another size.
+	 */
+	static bool decompress(const void *src, size_t n, void *dst,
+			size_t dstlen);
+};
+
+}
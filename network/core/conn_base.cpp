@@ -9,6 +9,13 @@
 #include <network/core/conn_wrap.h>
 #include <network/core/conn_base.h>
 #include <network/core/conn_thread.h>
+#include <network/core/conn_sched.h>
+#include <network/core/conn_latency.h>
+#include <network/core/conn_stats.h>
+#include <network/core/conn_trace.h>
+#include <network/core/conn_tls.h>
+#include <network/core/conn_shm.h>
+#include <network/core/conn_proxy.h>
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -87,7 +94,7 @@ const char *state_text(enum conn_states state) {
 	const char* const statenames[] = { "conn_listening", "conn_new_cmd",
 			"conn_waiting", "conn_read", "conn_parse_cmd", "conn_write",
 			"conn_nread", "conn_swallow", "conn_closing", "conn_mwrite",
-			"conn_closed", "conn_watch" };
+			"conn_closed", "conn_watch", "conn_tls_handshake" };
 	return statenames[state];
 }
 
@@ -121,6 +128,7 @@ void conn_set_state(conn *c, enum conn_states state) {
 			MY_LOGE( "%d: going from %s to %s\n",
 					c->sfd, state_text(c->state), state_text(state));
 		}
+		conn_trace(c, trace_state, c->state, state, 0);
 #if 0
 		if (state == conn_write || state == conn_mwrite) {
 			MEMCACHED_PROCESS_COMMAND_END(c->sfd, c->wbuf, c->wbytes);
@@ -195,6 +203,11 @@ static void *conn_timeout_thread(void *arg) {
 	int sleep_time;
 	useconds_t timeslice = 1000000 / (max_fds / CONNS_PER_SLICE);
 
+	if (settings.idle_cpu >= 0 && conn_thread_pin(settings.idle_cpu) == 0) {
+		MY_LOGD("idle timeout thread: cpu %d, numa node %d", settings.idle_cpu,
+				conn_cpu_node(settings.idle_cpu));
+	}
+
 	while (1) {
 		if (settings.verbose > 2)
 			MY_LOGE( "idle timeout thread at top of connection list\n");
@@ -218,7 +231,8 @@ static void *conn_timeout_thread(void *arg) {
 				continue;
 
 			if (c->state != conn_states::conn_new_cmd
-					&& c->state != conn_states::conn_read)
+					&& c->state != conn_states::conn_read
+					&& c->state != conn_states::conn_tls_handshake)
 				continue;
 
 			if ((current_time - c->last_cmd_time) > settings.idle_timeout) {
@@ -353,7 +367,7 @@ static void drive_machine(conn *c) {
 	int sfd;
 	socklen_t addrlen;
 	struct sockaddr_storage addr;
-	int nreqs = settings.reqs_per_event;
+	int nreqs = c->thread ? c->thread->reqs_per_event : settings.reqs_per_event;
 	int res;
 	const char *str;
 #ifdef HAVE_ACCEPT4
@@ -416,13 +430,19 @@ static void drive_machine(conn *c) {
 				stats.rejected_conns++;
 				STATS_UNLOCK();
 			} else {
-				dispatch_conn_new(sfd, conn_new_cmd, EV_READ | EV_PERSIST,
-						DATA_BUFFER_SIZE, c->transport);
+				dispatch_conn_new(sfd,
+						c->tls ? conn_tls_handshake : conn_new_cmd,
+						EV_READ | EV_PERSIST, DATA_BUFFER_SIZE, c->transport);
 			}
 			stop = true;
 			break;
 
 		case conn_waiting:
+			sched_idle(c);
+			if (IS_SHM(c->transport) && !conn_shm_may_sleep(c)) {
+				conn_set_state(c, conn_read);
+				break;
+			}
 			if (!update_event(c, EV_READ | EV_PERSIST)) {
 				if (settings.verbose > 0)
 					MY_LOGE( "Couldn't update event\n");
@@ -454,6 +474,8 @@ static void drive_machine(conn *c) {
 			break;
 
 		case conn_parse_cmd:
+			sched_request_start(c);
+			latency_request_start(c);
 			if (try_read_command(c) == 0) {
 				/* wee need more data! */
 				conn_set_state(c, conn_waiting);
@@ -461,16 +483,20 @@ static void drive_machine(conn *c) {
 			break;
 
 		case conn_new_cmd:
-			/* Only process nreqs at a time to avoid starving other
-			 connections */
+			/* Only process nreqs at a time, or as much as the scheduler
+			 credited us, to avoid starving other connections */
 			--nreqs;
-			if (nreqs >= 0) {
+			latency_request_done(c);
+			if (sched_request_done(c, nreqs)) {
 				reset_cmd_handler(c);
 			} else {
 				pthread_mutex_lock(&c->thread->stats.mutex);
 				c->thread->stats.conn_yields++;
 				pthread_mutex_unlock(&c->thread->stats.mutex);
-				if (c->rbytes > 0) {
+				/* reset by reqs_adapt(), the only one to look */
+				if (settings.reqs_adaptive)
+					c->thread->loop_yields++;
+				if (c->rbytes > 0 || IS_SHM(c->transport)) {
 					/* We have already read in data into the input buffer,
 					 so libevent will most likely not signal read events
 					 on the socket (unless more data is available. As a
@@ -509,8 +535,15 @@ static void drive_machine(conn *c) {
 			}
 
 			/*  now try reading from the socket */
-			res = read(c->sfd, c->rbuf,
-					c->rsize > c->sbytes ? c->sbytes : c->rsize);
+			if (IS_SHM(c->transport))
+				res = conn_shm_read(c, c->rbuf,
+						c->rsize > c->sbytes ? c->sbytes : c->rsize);
+			else if (c->ssl)
+				res = conn_tls_read(c, c->rbuf,
+						c->rsize > c->sbytes ? c->sbytes : c->rsize);
+			else
+				res = read(c->sfd, c->rbuf,
+						c->rsize > c->sbytes ? c->sbytes : c->rsize);
 			if (res > 0) {
 				pthread_mutex_lock(&c->thread->stats.mutex);
 				c->thread->stats.bytes_read += res;
@@ -523,6 +556,8 @@ static void drive_machine(conn *c) {
 				break;
 			}
 			if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				if (IS_SHM(c->transport) && !conn_shm_may_sleep(c))
+					break;
 				if (!update_event(c, EV_READ | EV_PERSIST)) {
 					if (settings.verbose > 0)
 						fprintf(stderr, "Couldn't update event\n");
@@ -566,11 +601,19 @@ static void drive_machine(conn *c) {
 			switch (transmit(c)) {
 			case TRANSMIT_COMPLETE:
 				if (c->state == conn_mwrite) {
-#if 0
 					conn_release_items(c);
-#endif
+					if (c->write_resume != NULL) {
+						/* on to the next part of the response */
+						c->msgcurr = 0;
+						c->msgused = 0;
+						c->iovused = 0;
+						if (add_msghdr(c) != 0) {
+							conn_set_state(c, conn_closing);
+							break;
+						}
+						m_callback->onWriteResume(c);
 					/* XXX:  I don't know why this wasn't the general case */
-					if (c->protocol == binary_prot) {
+					} else if (c->protocol == binary_prot) {
 						conn_set_state(c, c->write_and_go);
 					} else {
 						conn_set_state(c, conn_new_cmd);
@@ -612,9 +655,28 @@ static void drive_machine(conn *c) {
 			break;
 
 		case conn_watch:
-			/* We handed off our connection to the logger thread. */
+			/* Someone else resumes it, e.g. an upstream reply. */
 			stop = true;
 			break;
+
+		case conn_tls_handshake: {
+			short want = EV_READ;
+			int res = conn_tls_accept(c, &want);
+			if (res > 0) {
+				conn_set_state(c, conn_new_cmd);
+			} else if (res < 0) {
+				conn_set_state(c, conn_closing);
+			} else {
+				if (!update_event(c, want | EV_PERSIST)) {
+					if (settings.verbose > 0)
+						MY_LOGE( "Couldn't update event\n");
+					conn_set_state(c, conn_closing);
+					break;
+				}
+				stop = true;
+			}
+			break;
+		}
 		case conn_max_state:
 			assert(false);
 			break;
@@ -631,6 +693,9 @@ static void event_handler(const int fd, const short which, void *arg) {
 	assert(c != NULL);
 
 	c->which = which;
+	if (c->thread)
+		conn_thread_loop_event(c->thread);
+	sched_visit(c);
 
 	/* sanity */
 	if (fd != c->sfd) {
@@ -649,9 +714,11 @@ static void event_handler(const int fd, const short which, void *arg) {
 /*************************************************************/
 void conn_cleanup(conn *c) {
 	assert(c != NULL);
-#if 0
 	conn_release_items(c);
-#endif
+	if (c->write_resume != NULL) {
+		m_callback->onWriteAbort(c);
+		c->write_resume = NULL;
+	}
 	if (c->write_and_free) {
 		free(c->write_and_free);
 		c->write_and_free = 0;
@@ -685,12 +752,10 @@ void conn_free(conn *c) {
 			free(c->rbuf);
 		if (c->wbuf)
 			free(c->wbuf);
-#if 0
 		if (c->ilist)
-		free(c->ilist);
+			free(c->ilist);
 		if (c->suffixlist)
-		free(c->suffixlist);
-#endif
+			free(c->suffixlist);
 		if (c->iov)
 			free(c->iov);
 		free(c);
@@ -709,7 +774,11 @@ void conn_close(conn *c) {
 	conn_cleanup(c);
 
 	conn_set_state(c, conn_closed);
+	conn_tls_close(c);
+	conn_shm_close(c);
 	close(c->sfd);
+	if (c->thread)
+		conn_thread_conn_closed(c->thread);
 
 	pthread_mutex_lock(&conn_lock);
 	allow_new_conns = true;
@@ -751,9 +820,8 @@ void conn_shrink(conn *c) {
 		/* TODO check other branch... */
 		c->rcurr = c->rbuf;
 	}
-#if 0
 	if (c->isize > ITEM_LIST_HIGHWAT) {
-		item **newbuf = (item**) realloc((void *) c->ilist,
+		conn_item_ref *newbuf = (conn_item_ref *) realloc(c->ilist,
 				ITEM_LIST_INITIAL * sizeof(c->ilist[0]));
 		if (newbuf) {
 			c->ilist = newbuf;
@@ -761,7 +829,6 @@ void conn_shrink(conn *c) {
 		}
 		/* TODO check error condition? */
 	}
-#endif
 	if (c->msgsize > MSG_LIST_HIGHWAT) {
 		struct msghdr *newbuf = (struct msghdr *) realloc((void *) c->msglist,
 				MSG_LIST_INITIAL * sizeof(c->msglist[0]));
@@ -786,7 +853,8 @@ void conn_shrink(conn *c) {
 void conn_close_idle(conn *c) {
 	if (settings.idle_timeout > 0
 			&& (current_time - c->last_cmd_time) > settings.idle_timeout) {
-		if (c->state != conn_new_cmd && c->state != conn_read) {
+		if (c->state != conn_new_cmd && c->state != conn_read
+				&& c->state != conn_tls_handshake) {
 			if (settings.verbose > 1)
 				MY_LOGE( "fd %d wants to timeout, but isn't in read state",
 						c->sfd);
@@ -803,8 +871,102 @@ void conn_close_idle(conn *c) {
 	}
 }
 
+static void conn_to_str(const conn *c, char *buf, size_t len) {
+	char addr_text[INET6_ADDRSTRLEN];
+	const struct sockaddr *addr = (const struct sockaddr *) &c->request_addr;
+	const char *protoname = IS_UDP(c->transport) ? "udp" : "tcp";
+	int port = 0;
+
+	if (c->transport == local_transport || settings.socketpath) {
+		snprintf(buf, len, "%s:%s", IS_SHM(c->transport) ? "shm" : "unix",
+				settings.socketpath ? settings.socketpath : "");
+		return;
+	}
+	if (c->state == conn_listening || c->request_addr_size == 0) {
+		snprintf(buf, len, "%s:listening", protoname);
+		return;
+	}
+	if (addr->sa_family == AF_INET) {
+		const struct sockaddr_in *in = (const struct sockaddr_in *) addr;
+		inet_ntop(AF_INET, &in->sin_addr, addr_text, sizeof(addr_text));
+		port = ntohs(in->sin_port);
+		snprintf(buf, len, "%s:%s:%d", protoname, addr_text, port);
+	} else if (addr->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *) addr;
+		inet_ntop(AF_INET6, &in6->sin6_addr, addr_text, sizeof(addr_text));
+		port = ntohs(in6->sin6_port);
+		snprintf(buf, len, "%s:[%s]:%d", protoname, addr_text, port);
+	} else {
+		snprintf(buf, len, "%s", protoname);
+	}
+}
+
+/*
+ * "stats conns". The conns of other workers are read without stopping
+ * them, so a line may be a little behind.
+ */
+void process_stats_conns(ADD_STAT add_stats, conn *c) {
+	char key[64];
+	char conn_name[INET6_ADDRSTRLEN + 16];
+	int i;
+
+	for (i = 0; i < max_fds; i++) {
+		conn *other = conns[i];
+		if (other == NULL || other->state == conn_closed)
+			continue;
+
+		conn_to_str(other, conn_name, sizeof(conn_name));
+		snprintf(key, sizeof(key), "%d:addr", i);
+		append_stat(key, add_stats, c, "%s", conn_name);
+		snprintf(key, sizeof(key), "%d:state", i);
+		append_stat(key, add_stats, c, "%s", state_text(other->state));
+		if (other->state == conn_listening)
+			continue;
+		snprintf(key, sizeof(key), "%d:protocol", i);
+		append_stat(key, add_stats, c, "%s", prot_text(other->protocol));
+		snprintf(key, sizeof(key), "%d:secs_since_last_cmd", i);
+		append_stat(key, add_stats, c, "%u",
+				current_time - other->last_cmd_time);
+		snprintf(key, sizeof(key), "%d:numa_node", i);
+		append_stat(key, add_stats, c, "%d", other->numa_node);
+		snprintf(key, sizeof(key), "%d:sched_weight", i);
+		append_stat(key, add_stats, c, "%d", other->sched.weight);
+		snprintf(key, sizeof(key), "%d:sched_deficit", i);
+		append_stat(key, add_stats, c, "%lld",
+				(long long) other->sched.deficit);
+		snprintf(key, sizeof(key), "%d:service_bytes", i);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) other->sched.service_bytes);
+		snprintf(key, sizeof(key), "%d:service_us", i);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) other->sched.service_us);
+	}
+}
+
+void conn_worker_park(conn *c) {
+	event_del(&c->event);
+	c->ev_flags = 0;
+	c->park_state = c->state;
+	c->close_on_resume = false;
+	conn_set_state(c, conn_watch);
+}
+
 /* bring conn back from a sidethread. could have had its event base moved. */
 void conn_worker_readd(conn *c) {
+	if (c->state == conn_watch) {
+		if (c->close_on_resume) {
+			/* the side thread is done with it, nothing uses c any more */
+			conn_close(c);
+			return;
+		}
+		/* parked: carry on, the socket is writable right away */
+		conn_set_state(c, c->park_state);
+		if (!update_event(c, EV_WRITE | EV_PERSIST)) {
+			MY_LOGE("Couldn't resume fd %d", c->sfd);
+			conn_close(c);
+		}
+		return;
+	}
 	c->ev_flags = EV_READ | EV_PERSIST;
 	event_set(&c->event, c->sfd, c->ev_flags, event_handler, (void *) c);
 	event_base_set(c->thread->base, &c->event);
@@ -833,36 +995,32 @@ conn *conn_new(const int sfd, enum conn_states init_state,
 		}
 
 		c->rbuf = c->wbuf = 0;
-#if 0
 		c->ilist = 0;
 		c->suffixlist = 0;
-#endif
 		c->iov = 0;
 		c->msglist = 0;
 		c->hdrbuf = 0;
+		c->stats.buffer = NULL;
+		c->stats.size = c->stats.offset = 0;
 
 		c->rsize = read_buffer_size;
 		c->wsize = DATA_BUFFER_SIZE;
-#if 0
 		c->isize = ITEM_LIST_INITIAL;
 		c->suffixsize = SUFFIX_LIST_INITIAL;
-#endif
 		c->iovsize = IOV_LIST_INITIAL;
 		c->msgsize = MSG_LIST_INITIAL;
 		c->hdrsize = 0;
 
 		c->rbuf = (char *) malloc((size_t) c->rsize);
 		c->wbuf = (char *) malloc((size_t) c->wsize);
-#if 0
-		c->ilist = (item **) malloc(sizeof(item *) * c->isize);
+		c->ilist = (conn_item_ref *) malloc(sizeof(conn_item_ref) * c->isize);
 		c->suffixlist = (char **) malloc(sizeof(char *) * c->suffixsize);
-#endif
 		c->iov = (struct iovec *) malloc(sizeof(struct iovec) * c->iovsize);
 		c->msglist = (struct msghdr *) malloc(
 				sizeof(struct msghdr) * c->msgsize);
 
-		if (c->rbuf == 0 || c->wbuf == 0/* || c->ilist == 0*/|| c->iov == 0
-				|| c->msglist == 0/* || c->suffixlist == 0*/) {
+		if (c->rbuf == 0 || c->wbuf == 0 || c->ilist == 0 || c->iov == 0
+				|| c->msglist == 0 || c->suffixlist == 0) {
 			conn_free(c);
 			STATS_LOCK();
 			stats.malloc_fails++;
@@ -935,11 +1093,13 @@ conn *conn_new(const int sfd, enum conn_states init_state,
 	c->rcurr = c->rbuf;
 #if 0
 	c->ritem = 0;
+#endif
 	c->icurr = c->ilist;
 	c->suffixcurr = c->suffixlist;
 	c->ileft = 0;
 	c->suffixleft = 0;
-#endif
+	c->write_resume = NULL;
+	c->log_seq = 0;
 	c->iovused = 0;
 	c->msgcurr = 0;
 	c->msgused = 0;
@@ -948,6 +1108,17 @@ conn *conn_new(const int sfd, enum conn_states init_state,
 
 	c->write_and_go = init_state;
 	c->write_and_free = 0;
+	c->numa_node = -1;
+	c->framing = m_callback ? m_callback->getFraming() : NULL;
+	sched_conn_init(c);
+	c->lat_op = -1;
+	c->lat_start_ns = 0;
+	c->tls = false;
+	c->ssl = NULL;
+	c->ktls_tx = false;
+	c->shm = NULL;
+	c->nframes = c->framecurr = 0;
+	c->frame_anchor = NULL;
 #if 0
 	c->item = 0;
 #endif
@@ -995,11 +1166,31 @@ static void settings_init(void) {
 	settings.num_threads = 10; /* N workers */
 	settings.num_threads_per_udp = 0;
 	settings.reqs_per_event = 20;
+	settings.reqs_adaptive = false;
+	settings.reqs_target_us = REQS_ADAPT_TARGET_DEFAULT;
 	settings.binding_protocol = ascii_prot;
 	settings.backlog = 1024;
 	settings.maxconns_fast = false;
 	settings.idle_timeout = 0; /* disabled */
 	settings.sasl = false;
+	settings.max_frame_size = FRAME_SIZE_MAX_DEFAULT;
+	settings.sched_mode = sched_off;
+	settings.sched_quantum = 0;
+	settings.worker_cpus = NULL;
+	settings.num_worker_cpus = 0;
+	settings.main_cpu = -1;
+	settings.idle_cpu = -1;
+	settings.numa_local = false;
+	settings.steer_cpu = false;
+	settings.busy_poll_us = 0;
+	settings.trace_size = TRACE_SIZE_DEFAULT;
+	settings.trace_path = (char *) "/tmp/vnetwork-trace";
+	settings.tls_port = 0;
+	settings.tls_cert = NULL;
+	settings.tls_key = NULL;
+	settings.shm_size = 0;
+	settings.proxy_timeout = PROXY_TIMEOUT_DEFAULT;
+	settings.use_cas = true;
 }
 
 /*
@@ -1054,6 +1245,27 @@ static void sig_handler(const int sig) {
 	exit(EXIT_SUCCESS);
 }
 
+/*
+ * SIGINT and SIGTERM once the main base runs: leave the event loop, so
+ * the callback's onServerStop() runs before the process exits.
+ */
+static struct event sigint_event;
+static struct event sigterm_event;
+
+static void stop_handler(const int sig, const short which, void *arg) {
+	printf("Signal handled: %s.\n", strsignal(sig));
+	event_base_loopbreak(main_base);
+}
+
+static void stop_handler_init(void) {
+	evsignal_set(&sigint_event, SIGINT, stop_handler, NULL);
+	event_base_set(main_base, &sigint_event);
+	evsignal_add(&sigint_event, NULL);
+	evsignal_set(&sigterm_event, SIGTERM, stop_handler, NULL);
+	event_base_set(main_base, &sigterm_event);
+	evsignal_add(&sigterm_event, NULL);
+}
+
 static void usage(void) {
 	MY_LOGD("-p <num>      TCP port number to listen on (default: 11211)\n"
 			"-U <num>      UDP port number to listen on (default: 11211, 0 is off)\n"
@@ -1078,14 +1290,51 @@ static void usage(void) {
 
 	MY_LOGD("-R            Maximum number of requests per event, limits the number of\n"
 			"              requests process for a given connection to prevent \n"
-			"              starvation (default: 20)\n");
+			"              starvation (default: 20)\n"
+			"-R auto[:<usec>] Adapt it per worker at runtime, aiming for event loop\n"
+			"              iterations of <usec> microseconds (default: 1000)\n");
+
+	MY_LOGD("-Q <mode>     Fair scheduling of requests on a worker, replaces -R:\n"
+			"              bytes[:<quantum>] or time[:<usec>] (default: off)\n"
+			"-W <list>     Scheduler weights, comma separated <port>:<weight> or\n"
+			"              <addr>/<prefix>:<weight> client classes (default: 1)\n");
 
 	MY_LOGD("-b <num>      Set the backlog queue limit (default: 1024)\n");
 
+	MY_LOGD("-I <num>      Largest request frame accepted, header included\n"
+			"              (default: 1048576, 0 is unlimited)\n");
+
 	MY_LOGD("-B            Binding protocol - one of ascii, binary, or auto (default)\n");MY_LOGD("-o            Comma separated list of extended or experimental options\n"
 			"              - maxconns_fast: immediately close new\n"
 			"                connections if over maxconns limit\n"
-			"          - idle_timeout: Timeout for idle connections\n");
+			"          - idle_timeout: Timeout for idle connections\n"
+			"              - main_cpu: pin the accept thread to this cpu\n"
+			"              - idle_cpu: pin the idle timeout thread to this cpu\n"
+			"              - numa_local: keep each pinned worker's event base,\n"
+			"                connections and buffers on its NUMA node\n"
+			"              - steer_cpu: hand new connections to the worker\n"
+			"                pinned to the cpu their packets arrive on\n"
+			"              - busy_poll: workers spin this many usec for work,\n"
+			"                with SO_BUSY_POLL on their sockets, before they\n"
+			"                block (default: 0, off)\n"
+			"              - trace_size: records kept per thread of connection\n"
+			"                state and I/O tracing (default: %d, 0 is off)\n"
+			"              - trace_path: SIGUSR2 or a crash dumps the trace to\n"
+			"                <trace_path>.<pid> (default: %s)\n"
+			"              - tls_port: also listen on this TCP port for TLS,\n"
+			"                encrypting with kTLS where the kernel has it\n"
+			"              - tls_cert: PEM certificate chain for tls_port\n"
+			"              - tls_key: PEM private key for tls_port\n"
+			"              - shm_size: let Unix socket clients move to shared\n"
+			"                memory rings of this many bytes (default: 0, off)\n"
+			"              - proxy_timeout: close a proxied connection whose\n"
+			"                backend hasn't connected or answered what it was\n"
+			"                sent for this many ms (default: %d, 0 is off)\n",
+			TRACE_SIZE_DEFAULT, settings.trace_path, PROXY_TIMEOUT_DEFAULT);
+
+	MY_LOGD("-C <cpus>     Pin workers round robin to a cpu list, e.g. 0-7,16-23\n");
+
+	m_callback->onUsage();
 	return;
 }
 
@@ -1104,10 +1353,17 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 
 	char *subopts, *subopts_orig;
 	char *subopts_value;
+	char optstring[128];
+	int taken;
 	enum {
-		MAXCONNS_FAST = 0, IDLE_TIMEOUT, MAX_UNKNOW,
+		MAXCONNS_FAST = 0, IDLE_TIMEOUT, MAIN_CPU, IDLE_CPU, NUMA_LOCAL,
+		STEER_CPU, BUSY_POLL, TRACE_SIZE, TRACE_PATH, TLS_PORT, TLS_CERT,
+		TLS_KEY, SHM_SIZE, PROXY_TIMEOUT, MAX_UNKNOW,
 	};
-	char * const subopts_tokens[] = { "maxconns_fast", "idle_timeout", NULL };
+	const char * const subopts_tokens[] = { "maxconns_fast", "idle_timeout",
+			"main_cpu", "idle_cpu", "numa_local", "steer_cpu", "busy_poll",
+			"trace_size", "trace_path", "tls_port", "tls_cert", "tls_key",
+			"shm_size", "proxy_timeout", NULL };
 
 	/* handle SIGINT and SIGTERM */
 	signal(SIGINT, sig_handler);
@@ -1121,8 +1377,8 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 	/* init settings */
 	settings_init();
 
-	/* process arguments */
-	while (-1 != (c = getopt(argc, argv,
+	/* process arguments, the server's and then the callback's own */
+	snprintf(optstring, sizeof(optstring), "%s%s",
 			"a:" /* access mask for unix socket */
 			"p:" /* TCP port number to listen on */
 			"s:" /* unix socket path to listen on */
@@ -1136,9 +1392,14 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 			"r" /* maximize core file limit */
 			"R:" /* max requests per event */
 			"b:" /* backlog queue limit */
+			"I:" /* max frame size */
+			"Q:" /* fair scheduling mode */
+			"W:" /* fair scheduling weights */
 			"B:" /* Binding protocol */
-			"o:" /* Extended generic options */
-	))) {
+			"C:" /* worker cpus */
+			"o:", /* Extended generic options */
+			callback->getOptions());
+	while (-1 != (c = getopt(argc, argv, optstring))) {
 		switch (c) {
 		case 'a':
 			/* access for unix domain socket, as octal mask (like chmod)*/
@@ -1217,6 +1478,19 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 			maxcore = 1;
 			break;
 		case 'R':
+			if (strncmp(optarg, "auto", 4) == 0) {
+				settings.reqs_adaptive = true;
+				if (optarg[4] == ':') {
+					settings.reqs_target_us = atoi(optarg + 5);
+				} else if (optarg[4] != '\0') {
+					settings.reqs_target_us = 0;
+				}
+				if (settings.reqs_target_us <= 0) {
+					MY_LOGD("Target loop latency must be greater than 0\n");
+					return 1;
+				}
+				break;
+			}
 			settings.reqs_per_event = atoi(optarg);
 			if (settings.reqs_per_event == 0) {
 				MY_LOGD("Number of requests per event must be greater than 0\n");
@@ -1227,6 +1501,27 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 		case 'b':
 			settings.backlog = atoi(optarg);
 			break;
+		case 'Q':
+			if (!sched_parse_quantum(optarg)) {
+				MY_LOGD("Invalid value for -Q: %s\n"
+						" -- should be off, bytes[:<quantum>] or time[:<usec>]\n",
+						optarg);
+				exit(EX_USAGE);
+			}
+			break;
+		case 'W':
+			if (!sched_parse_weights(optarg)) {
+				MY_LOGD("Invalid scheduler weights: %s\n", optarg);
+				exit(EX_USAGE);
+			}
+			break;
+		case 'I':
+			settings.max_frame_size = atoi(optarg);
+			if (settings.max_frame_size < 0) {
+				MY_LOGD("Max frame size must not be negative\n");
+				return 1;
+			}
+			break;
 		case 'B':
 			protocol_specified = true;
 			if (strcmp(optarg, "auto") == 0) {
@@ -1246,12 +1541,146 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 			settings.maxconns_fast = true;
 			break;
 
+		case 'C':
+			free(settings.worker_cpus);
+			settings.worker_cpus = (int *) calloc(CPU_LIST_MAX, sizeof(int));
+			if (settings.worker_cpus == NULL
+					|| !parse_cpu_list(optarg, settings.worker_cpus,
+							CPU_LIST_MAX, &settings.num_worker_cpus)) {
+				MY_LOGD("Invalid cpu list: %s\n", optarg);
+				exit(EX_USAGE);
+			}
+			break;
+
+		case 'o': /* It's sub-opts time! */
+			subopts_orig = subopts = strdup(optarg); /* getsubopt() changes the original args */
+			if (subopts == NULL) {
+				MY_LOGD("Failed to allocate memory\n");
+				return 1;
+			}
+			while (*subopts != '\0') {
+				switch (getsubopt(&subopts, (char * const *) subopts_tokens,
+						&subopts_value)) {
+				case MAXCONNS_FAST:
+					settings.maxconns_fast = true;
+					break;
+				case IDLE_TIMEOUT:
+					if (subopts_value == NULL) {
+						MY_LOGD("Missing numeric argument for idle_timeout\n");
+						return 1;
+					}
+					settings.idle_timeout = atoi(subopts_value);
+					break;
+				case MAIN_CPU:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.main_cpu)
+							|| settings.main_cpu < 0) {
+						MY_LOGD("Invalid cpu for main_cpu\n");
+						return 1;
+					}
+					break;
+				case IDLE_CPU:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.idle_cpu)
+							|| settings.idle_cpu < 0) {
+						MY_LOGD("Invalid cpu for idle_cpu\n");
+						return 1;
+					}
+					break;
+				case NUMA_LOCAL:
+					settings.numa_local = true;
+					break;
+				case STEER_CPU:
+					settings.steer_cpu = true;
+					break;
+				case BUSY_POLL:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.busy_poll_us)
+							|| settings.busy_poll_us < 0) {
+						MY_LOGD("Invalid usec for busy_poll\n");
+						return 1;
+					}
+					break;
+				case TRACE_SIZE:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.trace_size)
+							|| settings.trace_size < 0
+							|| settings.trace_size > (1 << 24)) {
+						MY_LOGD("Invalid record count for trace_size\n");
+						return 1;
+					}
+					break;
+				case TRACE_PATH:
+					if (subopts_value == NULL || *subopts_value == '\0') {
+						MY_LOGD("Missing path for trace_path\n");
+						return 1;
+					}
+					settings.trace_path = strdup(subopts_value);
+					break;
+				case TLS_PORT:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.tls_port)
+							|| settings.tls_port <= 0
+							|| settings.tls_port > 65535) {
+						MY_LOGD("Invalid port for tls_port\n");
+						return 1;
+					}
+					break;
+				case TLS_CERT:
+					if (subopts_value == NULL) {
+						MY_LOGD("Missing file for tls_cert\n");
+						return 1;
+					}
+					settings.tls_cert = strdup(subopts_value);
+					break;
+				case TLS_KEY:
+					if (subopts_value == NULL) {
+						MY_LOGD("Missing file for tls_key\n");
+						return 1;
+					}
+					settings.tls_key = strdup(subopts_value);
+					break;
+				case SHM_SIZE:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.shm_size)
+							|| settings.shm_size < 0
+							|| settings.shm_size > SHM_SIZE_MAX) {
+						MY_LOGD("Invalid bytes for shm_size\n");
+						return 1;
+					}
+					break;
+				case PROXY_TIMEOUT:
+					if (subopts_value == NULL
+							|| !safe_strtol(subopts_value, &settings.proxy_timeout)
+							|| settings.proxy_timeout < 0) {
+						MY_LOGD("Invalid ms for proxy_timeout\n");
+						return 1;
+					}
+					break;
+				default:
+					taken = m_callback->onOption('o', subopts_value);
+					if (taken == 0)
+						MY_LOGD("Illegal suboption \"%s\"\n", subopts_value);
+					if (taken <= 0)
+						return 1;
+					break;
+				}
+			}
+			free(subopts_orig);
+			break;
+
 		default:
-			MY_LOGD("Illegal argument \"%c\"\n", c);
-			return 1;
+			taken = m_callback->onOption(c, optarg);
+			if (taken == 0)
+				MY_LOGD("Illegal argument \"%c\"\n", c);
+			if (taken <= 0)
+				return 1;
+			break;
 		}
 	}
 
+	framing_init(settings.max_frame_size);
+
 	/*
 	 * Use one workerthread to serve each UDP port if the user specified
 	 * multiple ports
@@ -1358,11 +1787,36 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 	}
 #endif
 
+	if (settings.numa_local && settings.num_worker_cpus == 0) {
+		MY_LOGE("numa_local needs pinned workers (-C), ignoring it");
+		settings.numa_local = false;
+	}
+	if (settings.steer_cpu && settings.num_worker_cpus == 0) {
+		MY_LOGE("steer_cpu needs pinned workers (-C), ignoring it");
+		settings.steer_cpu = false;
+	}
+
+	/* pin before the main base and conns array are allocated */
+	if (settings.main_cpu >= 0 && conn_thread_pin(settings.main_cpu) == 0) {
+		MY_LOGD("accept thread: cpu %d, numa node %d", settings.main_cpu,
+				conn_cpu_node(settings.main_cpu));
+	}
+
 	/* initialize main thread libevent instance */
 	main_base = event_init();
 
+	conn_trace_init();
+
 	stats_init();
 
+	/* initialise clock event, the callback may look at current_time */
+	clock_handler(0, 0, 0);
+
+	if (m_callback->onServerStart() != 0) {
+		MY_LOGE("failed to start the message callback\n");
+		exit(EX_CONFIG);
+	}
+
 	conn_init();
 	/*
 	 * ignore SIGPIPE signals; we can use errno == EPIPE if we
@@ -1379,9 +1833,6 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 		exit(EXIT_FAILURE);
 	}
 
-	/* initialise clock event */
-	clock_handler(0, 0, 0);
-
 	/* create unix mode sockets after dropping privileges */
 	if (settings.socketpath != NULL) {
 		errno = 0;
@@ -1419,6 +1870,22 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 			exit(EX_OSERR);
 		}
 
+		if (settings.tls_port) {
+			conn *prev = listen_conn;
+			errno = 0;
+			if (conn_tls_init() != 0) {
+				exit(EX_CONFIG);
+			}
+			if (server_sockets(settings.tls_port, tcp_transport,
+					portnumber_file)) {
+				vperror("failed to listen on TLS port %d", settings.tls_port);
+				exit(EX_OSERR);
+			}
+			/* the listeners just added are the TLS ones */
+			for (conn *l = listen_conn; l != prev; l = l->next)
+				l->tls = true;
+		}
+
 		/*
 		 * initialization order: first create the listening sockets
 		 * (may need root on low ports), then drop root if needed,
@@ -1457,9 +1924,11 @@ int start_server(int argc, char **argv, msg_callback_t *callback) {
 #endif
 
 	/* enter the event loop */
+	stop_handler_init();
 	if (event_base_loop(main_base, 0) != 0) {
 		retval = EXIT_FAILURE;
 	}
+	m_callback->onServerStop();
 #if 0
 	/* remove the PID file if we're a daemon */
 	if (do_daemonize)
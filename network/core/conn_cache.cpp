@@ -0,0 +1,96 @@
+/*
+ * conn_cache.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_cache.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* free buffers kept at first, the stack doubles as needed */
+#define CACHE_INITIAL_NELEMS 64
+
+cache_t *cache_create(const char *name, size_t bufsize, size_t align,
+		cache_constructor_t *constructor, cache_destructor_t *destructor) {
+	cache_t *ret = (cache_t *) calloc(1, sizeof(cache_t));
+	char *nm = strdup(name);
+	void **ptr = (void **) calloc(CACHE_INITIAL_NELEMS, sizeof(void *));
+
+	if (ret == NULL || nm == NULL || ptr == NULL
+			|| pthread_mutex_init(&ret->mutex, NULL) == -1) {
+		free(ret);
+		free(nm);
+		free(ptr);
+		return NULL;
+	}
+
+	ret->name = nm;
+	ret->ptr = ptr;
+	ret->freetotal = CACHE_INITIAL_NELEMS;
+	ret->constructor = constructor;
+	ret->destructor = destructor;
+	/* round up, so buffers carved from malloc keep the alignment */
+	if (align > 0)
+		bufsize = (bufsize + align - 1) & ~(align - 1);
+	ret->bufsize = bufsize;
+	return ret;
+}
+
+void cache_destroy(cache_t *handle) {
+	while (handle->freecurr > 0) {
+		void *ptr = handle->ptr[--handle->freecurr];
+		if (handle->destructor)
+			handle->destructor(ptr, NULL);
+		free(ptr);
+	}
+	free(handle->name);
+	free(handle->ptr);
+	pthread_mutex_destroy(&handle->mutex);
+	free(handle);
+}
+
+void *cache_alloc(cache_t *handle) {
+	void *ret;
+
+	pthread_mutex_lock(&handle->mutex);
+	if (handle->freecurr > 0) {
+		ret = handle->ptr[--handle->freecurr];
+	} else {
+		ret = malloc(handle->bufsize);
+		if (ret != NULL && handle->constructor != NULL
+				&& handle->constructor(ret, NULL, 0) != 0) {
+			free(ret);
+			ret = NULL;
+		}
+	}
+	pthread_mutex_unlock(&handle->mutex);
+	return ret;
+}
+
+void cache_free(cache_t *handle, void *ptr) {
+	pthread_mutex_lock(&handle->mutex);
+	if (handle->freecurr == handle->freetotal) {
+		int newtotal = handle->freetotal * 2;
+		void **newptr = (void **) realloc(handle->ptr,
+				sizeof(void *) * newtotal);
+		if (newptr == NULL) {
+			/* keep what we have, this one goes back to the system */
+			if (handle->destructor)
+				handle->destructor(ptr, NULL);
+			free(ptr);
+			pthread_mutex_unlock(&handle->mutex);
+			return;
+		}
+		handle->ptr = newptr;
+		handle->freetotal = newtotal;
+	}
+	handle->ptr[handle->freecurr++] = ptr;
+	pthread_mutex_unlock(&handle->mutex);
+}
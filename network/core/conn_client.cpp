@@ -0,0 +1,493 @@
+/*
+ * conn_client.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_client.h>
+#include <vutils/Logger.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_client"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+#define UPSTREAM_BUFFER_SIZE 4096
+
+/* a request waiting for its response */
+struct client_req {
+	uint32_t opaque; /* as sent */
+	uint64_t deadline_ms; /* failed if not answered by then */
+	conn_client_cb cb;
+	void *arg;
+	struct client_req *next;
+};
+
+typedef struct upstream_conn upstream_conn;
+struct upstream_conn {
+	conn_client_pool *pool;
+	LIBEVENT_THREAD *thread;
+	int fd;
+	bool connected;
+	struct event event;
+	short ev_flags;
+	char *wbuf; /* requests not sent yet are wbuf[wcurr, wbytes) */
+	size_t wsize;
+	size_t wbytes;
+	size_t wcurr;
+	char *rbuf; /* partial responses */
+	size_t rsize;
+	size_t rbytes;
+	struct client_req *head; /* in flight, oldest first */
+	struct client_req *tail;
+	int ninflight;
+	uint32_t next_opaque;
+	upstream_conn *next;
+};
+
+/* the connections of one worker, only that worker touches them */
+struct client_worker {
+	upstream_conn *conns;
+	int nconns;
+};
+
+struct conn_client_pool {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int conns_per_worker;
+	int max_inflight;
+	struct timeval timeout;
+	int timeout_ms;
+	struct client_worker *workers; /* settings.num_threads, on first use */
+};
+
+conn_client_pool *conn_client_pool_new(const char *host, int port,
+		int conns_per_worker, int max_inflight, int timeout_ms) {
+	struct addrinfo hints, *ai;
+	conn_client_pool *pool;
+	char service[NI_MAXSERV];
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%d", port);
+	error = getaddrinfo(host, service, &hints, &ai);
+	if (error != 0) {
+		MY_LOGE("getaddrinfo(%s): %s", host, gai_strerror(error));
+		return NULL;
+	}
+
+	pool = (conn_client_pool *) calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		freeaddrinfo(ai);
+		return NULL;
+	}
+	memcpy(&pool->addr, ai->ai_addr, ai->ai_addrlen);
+	pool->addrlen = ai->ai_addrlen;
+	freeaddrinfo(ai);
+	pool->conns_per_worker =
+			conns_per_worker > 0 ? conns_per_worker : CLIENT_CONNS_DEFAULT;
+	pool->max_inflight =
+			max_inflight > 0 ? max_inflight : CLIENT_INFLIGHT_DEFAULT;
+	pool->timeout_ms = timeout_ms > 0 ? timeout_ms : CLIENT_TIMEOUT_DEFAULT;
+	pool->timeout.tv_sec = pool->timeout_ms / 1000;
+	pool->timeout.tv_usec = (pool->timeout_ms % 1000) * 1000;
+	return pool;
+}
+
+static struct client_worker *client_worker(conn_client_pool *pool,
+		LIBEVENT_THREAD *me) {
+	struct client_worker *workers, *expected = NULL;
+	int tid = conn_thread_id(me);
+
+	if (tid < 0 || tid >= settings.num_threads)
+		return NULL;
+	workers = __atomic_load_n(&pool->workers, __ATOMIC_ACQUIRE);
+	if (workers == NULL) {
+		workers = (struct client_worker *) calloc(settings.num_threads,
+				sizeof(*workers));
+		if (workers == NULL)
+			return NULL;
+		if (!__atomic_compare_exchange_n(&pool->workers, &expected, workers,
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			free(workers);
+			workers = expected;
+		}
+	}
+	return &workers[tid];
+}
+
+static void upstream_event(int fd, short which, void *arg);
+
+static uint64_t client_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void upstream_set_events(upstream_conn *u, short flags) {
+	if (u->ev_flags == flags)
+		return;
+	if (u->ev_flags != 0)
+		event_del(&u->event);
+	event_set(&u->event, u->fd, flags, upstream_event, (void *) u);
+	event_base_set(u->thread->base, &u->event);
+	u->ev_flags = flags;
+	/* a quiet upstream still wakes us, to fail what is overdue */
+	if (event_add(&u->event, &u->pool->timeout) == -1)
+		MY_LOGE("event_add");
+}
+
+static void upstream_stats(LIBEVENT_THREAD *me, uint64_t connects,
+		uint64_t requests, uint64_t failures, uint64_t timeouts) {
+	pthread_mutex_lock(&me->stats.mutex);
+	me->stats.upstream_connects += connects;
+	me->stats.upstream_requests += requests;
+	me->stats.upstream_failures += failures;
+	me->stats.upstream_timeouts += timeouts;
+	pthread_mutex_unlock(&me->stats.mutex);
+}
+
+/*
+ * Drops u from its worker and fails everything still in flight on it.
+ */
+static void upstream_close(upstream_conn *u, int err) {
+	struct client_worker *w = client_worker(u->pool, u->thread);
+	LIBEVENT_THREAD *me = u->thread;
+	struct client_req *req, *next;
+	upstream_conn **pp;
+	int failed = u->ninflight;
+
+	for (pp = &w->conns; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == u) {
+			*pp = u->next;
+			w->nconns--;
+			break;
+		}
+	}
+	if (u->ev_flags != 0)
+		event_del(&u->event);
+	close(u->fd);
+	if (settings.verbose > 0 || failed > 0) {
+		MY_LOGE("upstream fd %d closed (%s), failing %d requests", u->fd,
+				err ? strerror(err) : "eof", failed);
+	}
+
+	req = u->head;
+	free(u->wbuf);
+	free(u->rbuf);
+	free(u);
+	if (failed > 0)
+		upstream_stats(me, 0, 0, failed, 0);
+
+	/* callbacks may send again, u is gone by now */
+	for (; req != NULL; req = next) {
+		next = req->next;
+		req->cb(req->arg, NULL, NULL);
+		free(req);
+	}
+}
+
+static upstream_conn *upstream_open(conn_client_pool *pool,
+		LIBEVENT_THREAD *me, struct client_worker *w) {
+	upstream_conn *u;
+	int fd, flags, on = 1;
+
+	fd = socket(pool->addr.ss_family, SOCK_STREAM, 0);
+	if (fd == -1) {
+		MY_LOGE("socket(): %s", strerror(errno));
+		return NULL;
+	}
+	if ((flags = fcntl(fd, F_GETFL, 0)) < 0
+			|| fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		MY_LOGE("setting O_NONBLOCK: %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *) &on, sizeof(on));
+	if (connect(fd, (struct sockaddr *) &pool->addr, pool->addrlen) == -1
+			&& errno != EINPROGRESS) {
+		MY_LOGE("connect(): %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	u = (upstream_conn *) calloc(1, sizeof(*u));
+	if (u == NULL) {
+		close(fd);
+		return NULL;
+	}
+	u->pool = pool;
+	u->thread = me;
+	u->fd = fd;
+	u->wsize = u->rsize = UPSTREAM_BUFFER_SIZE;
+	u->wbuf = (char *) malloc(u->wsize);
+	u->rbuf = (char *) malloc(u->rsize);
+	if (u->wbuf == NULL || u->rbuf == NULL) {
+		free(u->wbuf);
+		free(u->rbuf);
+		free(u);
+		close(fd);
+		return NULL;
+	}
+	/* writable once connected, requests queue up until then */
+	upstream_set_events(u, EV_READ | EV_WRITE | EV_PERSIST);
+	u->next = w->conns;
+	w->conns = u;
+	w->nconns++;
+	upstream_stats(me, 1, 0, 0, 0);
+	return u;
+}
+
+/*
+ * Writes what is queued. Returns false if u was closed.
+ */
+static bool upstream_flush(upstream_conn *u) {
+	while (u->wcurr < u->wbytes) {
+		ssize_t res = write(u->fd, u->wbuf + u->wcurr, u->wbytes - u->wcurr);
+		if (res > 0) {
+			u->wcurr += res;
+			continue;
+		}
+		if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			upstream_set_events(u, EV_READ | EV_WRITE | EV_PERSIST);
+			return true;
+		}
+		if (res == -1 && errno == EINTR)
+			continue;
+		upstream_close(u, res == -1 ? errno : 0);
+		return false;
+	}
+	u->wcurr = u->wbytes = 0;
+	upstream_set_events(u, EV_READ | EV_PERSIST);
+	return true;
+}
+
+/*
+ * Hands every complete response in rbuf to its request's callback.
+ * Returns false if u was closed.
+ */
+static bool upstream_dispatch(upstream_conn *u) {
+	protocol_binary_response_header hdr;
+	struct client_req *req, *prev;
+	size_t off = 0, len;
+
+	while (u->rbytes - off >= sizeof(hdr.bytes)) {
+		memcpy(&hdr, u->rbuf + off, sizeof(hdr.bytes));
+		if (hdr.response.magic != PROTOCOL_BINARY_RES) {
+			MY_LOGE("upstream fd %d: invalid magic %x", u->fd,
+					hdr.response.magic);
+			upstream_close(u, EPROTO);
+			return false;
+		}
+		len = sizeof(hdr.bytes) + ntohl(hdr.response.bodylen);
+		if (u->rbytes - off < len)
+			break;
+
+		/* responses mostly come back in order, the head is the usual hit */
+		prev = NULL;
+		for (req = u->head; req != NULL; prev = req, req = req->next) {
+			if (req->opaque == hdr.response.opaque)
+				break;
+		}
+		if (req == NULL) {
+			MY_LOGE("upstream fd %d: response to unknown opaque %u", u->fd,
+					hdr.response.opaque);
+			upstream_close(u, EPROTO);
+			return false;
+		}
+		if (prev != NULL)
+			prev->next = req->next;
+		else
+			u->head = req->next;
+		if (u->tail == req)
+			u->tail = prev;
+		u->ninflight--;
+
+		req->cb(req->arg, &hdr, u->rbuf + off + sizeof(hdr.bytes));
+		free(req);
+		off += len;
+	}
+
+	if (off > 0) {
+		memmove(u->rbuf, u->rbuf + off, u->rbytes - off);
+		u->rbytes -= off;
+	}
+	return true;
+}
+
+/*
+ * Reads what the upstream sent. Returns false if u was closed.
+ */
+static bool upstream_read(upstream_conn *u) {
+	ssize_t res;
+
+	if (u->rbytes == u->rsize) {
+		char *new_rbuf = (char *) realloc(u->rbuf, u->rsize * 2);
+		if (new_rbuf == NULL) {
+			upstream_close(u, ENOMEM);
+			return false;
+		}
+		u->rbuf = new_rbuf;
+		u->rsize *= 2;
+	}
+	res = read(u->fd, u->rbuf + u->rbytes, u->rsize - u->rbytes);
+	if (res > 0) {
+		u->rbytes += res;
+		return upstream_dispatch(u);
+	}
+	if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+	upstream_close(u, res == -1 ? errno : 0);
+	return false;
+}
+
+static void upstream_event(int fd, short which, void *arg) {
+	upstream_conn *u = (upstream_conn *) arg;
+
+	/* the head is the oldest request, overdue before any other */
+	if (u->head != NULL && client_now_ms() >= u->head->deadline_ms) {
+		upstream_stats(u->thread, 0, 0, 0, 1);
+		upstream_close(u, ETIMEDOUT);
+		return;
+	}
+	if (!u->connected) {
+		if ((which & (EV_READ | EV_WRITE)) == 0)
+			return;
+		int err = 0;
+		socklen_t errlen = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0)
+			err = errno;
+		if (err != 0) {
+			upstream_close(u, err);
+			return;
+		}
+		u->connected = true;
+	}
+	if ((which & EV_READ) && !upstream_read(u))
+		return;
+	upstream_flush(u);
+}
+
+int conn_client_request(conn_client_pool *pool, LIBEVENT_THREAD *me,
+		const void *req, size_t len, conn_client_cb cb, void *arg) {
+	const protocol_binary_request_header *hdr =
+			(const protocol_binary_request_header *) req;
+	struct client_worker *w;
+	struct client_req *r;
+	upstream_conn *u, *best = NULL;
+
+	if (len < sizeof(hdr->bytes) || hdr->request.magic != PROTOCOL_BINARY_REQ
+			|| len != sizeof(hdr->bytes) + ntohl(hdr->request.bodylen))
+		return -1;
+	w = client_worker(pool, me);
+	if (w == NULL)
+		return -1;
+
+	for (u = w->conns; u != NULL; u = u->next) {
+		if (u->ninflight < pool->max_inflight
+				&& (best == NULL || u->ninflight < best->ninflight))
+			best = u;
+	}
+	/* spread over the pool before pipelining on one connection */
+	if ((best == NULL || best->ninflight > 0)
+			&& w->nconns < pool->conns_per_worker) {
+		u = upstream_open(pool, me, w);
+		if (u != NULL)
+			best = u;
+	}
+	if (best == NULL)
+		return -1;
+	u = best;
+
+	r = (struct client_req *) malloc(sizeof(*r));
+	if (r == NULL)
+		return -1;
+	if (u->wcurr == u->wbytes) {
+		u->wcurr = u->wbytes = 0;
+	} else if (u->wbytes + len > u->wsize && u->wcurr > 0) {
+		memmove(u->wbuf, u->wbuf + u->wcurr, u->wbytes - u->wcurr);
+		u->wbytes -= u->wcurr;
+		u->wcurr = 0;
+	}
+	if (u->wbytes + len > u->wsize) {
+		size_t nsize = u->wsize;
+		char *new_wbuf;
+		while (nsize < u->wbytes + len)
+			nsize *= 2;
+		new_wbuf = (char *) realloc(u->wbuf, nsize);
+		if (new_wbuf == NULL) {
+			free(r);
+			return -1;
+		}
+		u->wbuf = new_wbuf;
+		u->wsize = nsize;
+	}
+
+	r->opaque = ++u->next_opaque;
+	r->deadline_ms = client_now_ms() + pool->timeout_ms;
+	r->cb = cb;
+	r->arg = arg;
+	r->next = NULL;
+	memcpy(u->wbuf + u->wbytes, req, len);
+	memcpy(u->wbuf + u->wbytes
+			+ offsetof(protocol_binary_request_header, request.opaque),
+			&r->opaque, sizeof(r->opaque));
+	u->wbytes += len;
+	if (u->tail != NULL)
+		u->tail->next = r;
+	else
+		u->head = r;
+	u->tail = r;
+	u->ninflight++;
+	upstream_stats(me, 0, 1, 0, 0);
+
+	/* never write from here, a failure would run callbacks under the
+	 * caller; requests of one loop iteration go out in one write */
+	upstream_set_events(u, EV_READ | EV_WRITE | EV_PERSIST);
+	return 0;
+}
+
+void conn_client_hold(conn *c) {
+	assert(IS_TCP(c->transport));
+	event_del(&c->event);
+	c->ev_flags = 0;
+	conn_set_state(c, conn_watch);
+}
+
+void conn_client_resume(conn *c) {
+	if (c->state == conn_watch)
+		conn_set_state(c, conn_new_cmd);
+	/* writable right away, that runs the state machine again */
+	if (!update_event(c, EV_WRITE | EV_PERSIST)) {
+		MY_LOGE("Couldn't resume fd %d", c->sfd);
+		conn_close(c);
+	}
+}
@@ -0,0 +1,172 @@
+/*
+ * conn_framing.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <string.h>
+#include <network/core/conn_framing.h>
+#include <network/core/protocol_binary.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+conn_framing framing_ascii;
+conn_framing framing_binary;
+
+/*
+ * Initializes the builtin framings, max_frame is the largest frame accepted.
+ */
+void framing_init(int max_frame) {
+	memset(&framing_ascii, 0, sizeof(framing_ascii));
+	framing_ascii.type = framing_delimiter;
+	framing_ascii.max_frame = max_frame;
+	framing_ascii.delim = '\n';
+	framing_ascii.strip_cr = true;
+
+	/* 24 byte header, bodylen is the 32 bit big endian word at offset 8 */
+	memset(&framing_binary, 0, sizeof(framing_binary));
+	framing_binary.type = framing_length_prefixed;
+	framing_binary.max_frame = max_frame;
+	framing_binary.hdr_size = sizeof(protocol_binary_request_header);
+	framing_binary.len_offset = 8;
+	framing_binary.len_size = 4;
+	framing_binary.len_big_endian = true;
+	framing_binary.len_adjust = 0;
+}
+
+/*
+ * Finds the first occurrence of delim in buf, 32 or 16 bytes per compare
+ * when AVX2/SSE2 are available, memchr() for the tail and elsewhere.
+ */
+const char *framing_find_delim(const char *buf, size_t len, char delim) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i needle32 = _mm256_set1_epi8(delim);
+	for (; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *) (buf + i));
+		unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(chunk, needle32));
+		if (mask)
+			return buf + i + __builtin_ctz(mask);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i needle16 = _mm_set1_epi8(delim);
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *) (buf + i));
+		unsigned int mask = (unsigned int) _mm_movemask_epi8(
+				_mm_cmpeq_epi8(chunk, needle16));
+		if (mask)
+			return buf + i + __builtin_ctz(mask);
+	}
+#endif
+	return (const char *) memchr(buf + i, delim, len - i);
+}
+
+static uint64_t decode_length(const conn_framing *f, const unsigned char *p) {
+	uint64_t v = 0;
+	int i;
+	if (f->len_big_endian) {
+		for (i = 0; i < f->len_size; i++)
+			v = (v << 8) | p[i];
+	} else {
+		for (i = f->len_size - 1; i >= 0; i--)
+			v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+/*
+ * Decodes a LEB128 varint of at most 10 bytes.
+ * Returns the number of bytes used, 0 if buf ends first, -1 if malformed.
+ */
+static int decode_varint(const unsigned char *p, int len, uint64_t *out) {
+	uint64_t v = 0;
+	int i;
+	for (i = 0; i < len && i < 10; i++) {
+		v |= (uint64_t) (p[i] & 0x7f) << (7 * i);
+		if ((p[i] & 0x80) == 0) {
+			*out = v;
+			return i + 1;
+		}
+	}
+	return i == 10 ? -1 : 0;
+}
+
+/*
+ * Scans buf once and records up to max_frames complete frames.
+ */
+int framing_scan(const conn_framing *f, const char *buf, int len,
+		conn_frame *frames, int max_frames) {
+	const char *p = buf;
+	int left = len;
+	int n = 0;
+	bool bad = false;
+
+	while (n < max_frames && left > 0) {
+		int64_t flen;
+		int hdrlen = 0, trailer = 0;
+
+		if (f->type == framing_delimiter) {
+			const char *e = framing_find_delim(p, left, f->delim);
+			if (e == NULL) {
+				bad = f->max_frame > 0 && left > f->max_frame;
+				break;
+			}
+			flen = e - p + 1;
+			trailer = 1;
+			if (f->strip_cr && flen > 1 && e[-1] == '\r')
+				trailer++;
+		} else if (f->type == framing_length_prefixed) {
+			if (left < f->hdr_size)
+				break;
+			hdrlen = f->hdr_size;
+			uint64_t body = decode_length(f,
+					(const unsigned char *) p + f->len_offset);
+			if (body > INT32_MAX) {
+				bad = true;
+				break;
+			}
+			flen = (int64_t) body + f->len_adjust;
+			if (flen < 0) {
+				bad = true;
+				break;
+			}
+			flen += hdrlen;
+		} else {
+			uint64_t body;
+			hdrlen = decode_varint((const unsigned char *) p, left, &body);
+			if (hdrlen <= 0 || body > INT32_MAX) {
+				bad = hdrlen != 0;
+				break;
+			}
+			flen = (int64_t) (body + hdrlen);
+		}
+
+		if ((f->max_frame > 0 && flen > f->max_frame) || flen > INT32_MAX) {
+			bad = true;
+			break;
+		}
+		if (flen > left)
+			break;
+
+		frames[n].hdrlen = hdrlen;
+		frames[n].trailer = trailer;
+		frames[n].len = (int) flen;
+		n++;
+		p += flen;
+		left -= (int) flen;
+	}
+
+	/* hand out what is complete first, the error shows up on the next scan */
+	if (bad && n == 0)
+		return -1;
+	return n;
+}
@@ -0,0 +1,256 @@
+/*
+ * conn_latency.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_latency.h>
+#include <network/core/conn_thread.h>
+#include <vutils/Logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_latency"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+static const char *ascii_verbs[] = {
+#define X(name) #name,
+	LAT_ASCII_VERBS
+#undef X
+};
+
+static const char *binary_names[256] = {
+	"get", "set", "add", "replace", "delete", "incr", "decr", "quit",
+	"flush", "getq", "noop", "version", "getk", "getkq", "append",
+	"prepend", "stat", "setq", "addq", "replaceq", "deleteq", "incrq",
+	"decrq", "quitq", "flushq", "appendq", "prependq", "verbosity", "touch",
+	"gat", "gatq", NULL, "sasl_list_mechs", "sasl_auth", "sasl_step",
+	"gatk", "gatkq",
+};
+
+static uint64_t latency_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Returns the bucket of value v.
+ */
+int hist_bucket(uint64_t v) {
+	int msb;
+
+	if (v < LAT_SUB)
+		return (int) v;
+	msb = 63 - __builtin_clzll(v);
+	if (msb >= LAT_MAX_BITS)
+		return LAT_BUCKETS - 1;
+	return (msb - LAT_SUB_BITS + 1) * LAT_SUB
+			+ (int) ((v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * Returns the largest value that falls into bucket b.
+ */
+uint64_t hist_bucket_top(int b) {
+	int group = b / LAT_SUB;
+	uint64_t slot = b % LAT_SUB;
+
+	if (group == 0)
+		return slot;
+	return ((LAT_SUB + slot + 1) << (group - 1)) - 1;
+}
+
+/*
+ * Adds one value to h. Only the worker owning h may call it.
+ */
+void hist_record(struct latency_hist *h, uint64_t ns) {
+	int b = hist_bucket(ns);
+
+	__atomic_store_n(&h->buckets[b], h->buckets[b] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum_ns, h->sum_ns + ns, __ATOMIC_RELAXED);
+	if (ns > h->max_ns)
+		__atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Adds a copy of src to dst. Samples recorded while we copy may be
+ * counted in the buckets but not in count, which only skews a percentile
+ * by those few samples.
+ */
+void hist_merge(struct latency_hist *dst, const struct latency_hist *src) {
+	uint64_t max;
+	int b;
+
+	dst->count += __atomic_load_n(&src->count, __ATOMIC_ACQUIRE);
+	dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+	if (max > dst->max_ns)
+		dst->max_ns = max;
+	for (b = 0; b < LAT_BUCKETS; b++)
+		dst->buckets[b] += __atomic_load_n(&src->buckets[b],
+				__ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the value below which a fraction q of the samples fall.
+ */
+uint64_t hist_value_at(const struct latency_hist *h, double q) {
+	uint64_t total = 0, rank, seen = 0;
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS; b++)
+		total += h->buckets[b];
+	if (total == 0)
+		return 0;
+	rank = (uint64_t) (q * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > total)
+		rank = total;
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= rank) {
+			uint64_t top = hist_bucket_top(b);
+			return top < h->max_ns ? top : h->max_ns;
+		}
+	}
+	return h->max_ns;
+}
+
+/*
+ * Returns the slot of an ASCII command line.
+ */
+int latency_ascii_op(const char *line) {
+	size_t len = strcspn(line, " ");
+	int i;
+
+	for (i = 0; i < LAT_OP_ASCII_other - LAT_OP_ASCII_get; i++) {
+		if (strlen(ascii_verbs[i]) == len
+				&& memcmp(ascii_verbs[i], line, len) == 0)
+			return LAT_OP_ASCII_get + i;
+	}
+	return LAT_OP_ASCII_other;
+}
+
+const char *latency_op_name(int op, char *buf, size_t len) {
+	if (op < LAT_OP_ASCII_get) {
+		if (binary_names[op])
+			snprintf(buf, len, "bin_%s", binary_names[op]);
+		else
+			snprintf(buf, len, "bin_0x%02x", op);
+	} else if (op < LAT_OP_FRAME) {
+		snprintf(buf, len, "ascii_%s", ascii_verbs[op - LAT_OP_ASCII_get]);
+	} else {
+		snprintf(buf, len, "frame");
+	}
+	return buf;
+}
+
+void latency_request_start(conn *c) {
+	if (c->lat_start_ns == 0) {
+		c->lat_start_ns = latency_now_ns();
+		c->lat_op = -1;
+	}
+}
+
+void latency_request_op(conn *c, int op) {
+	c->lat_op = op;
+}
+
+/*
+ * Records the request that just finished, if any. The histogram of a slot
+ * is allocated by its worker the first time it is used.
+ */
+void latency_request_done(conn *c) {
+	LIBEVENT_THREAD *me = c->thread;
+	struct latency_hist *h;
+
+	if (c->lat_start_ns == 0)
+		return;
+	if (c->lat_op >= 0 && me != NULL) {
+		h = me->lat_hist[c->lat_op];
+		if (h == NULL) {
+			h = (struct latency_hist *) calloc(1, sizeof(*h));
+			if (h != NULL)
+				__atomic_store_n(&me->lat_hist[c->lat_op], h, __ATOMIC_RELEASE);
+		}
+		if (h != NULL)
+			hist_record(h, latency_now_ns() - c->lat_start_ns);
+	}
+	c->lat_start_ns = 0;
+	c->lat_op = -1;
+}
+
+/*
+ * Merges the histograms of slot op across all workers into out.
+ */
+bool latency_snapshot(int op, struct latency_hist *out) {
+	LIBEVENT_THREAD *me;
+	struct latency_hist *h;
+	int tid;
+
+	memset(out, 0, sizeof(*out));
+	for (tid = 0; (me = conn_thread_worker(tid)) != NULL; tid++) {
+		h = __atomic_load_n(&me->lat_hist[op], __ATOMIC_ACQUIRE);
+		if (h != NULL)
+			hist_merge(out, h);
+	}
+	return out->count > 0;
+}
+
+/*
+ * Appends the percentiles of every slot with samples.
+ */
+void latency_append_stats(ADD_STAT add_stats, conn *c) {
+	static const struct {
+		const char *name;
+		double q;
+	} fields[] = { { "p50", 0.5 }, { "p99", 0.99 }, { "p999", 0.999 } };
+	struct latency_hist *h;
+	char name[32], key[64], val[32];
+	int op, i, klen, vlen;
+
+	h = (struct latency_hist *) malloc(sizeof(*h));
+	if (h == NULL)
+		return;
+	for (op = 0; op < LAT_OPS; op++) {
+		if (!latency_snapshot(op, h))
+			continue;
+		latency_op_name(op, name, sizeof(name));
+
+		klen = snprintf(key, sizeof(key), "lat_%s_count", name);
+		vlen = snprintf(val, sizeof(val), "%llu",
+				(unsigned long long) h->count);
+		add_stats(key, klen, val, vlen, c);
+		for (i = 0; i < (int) (sizeof(fields) / sizeof(fields[0])); i++) {
+			klen = snprintf(key, sizeof(key), "lat_%s_%s_us", name,
+					fields[i].name);
+			vlen = snprintf(val, sizeof(val), "%.1f",
+					hist_value_at(h, fields[i].q) / 1000.0);
+			add_stats(key, klen, val, vlen, c);
+		}
+		klen = snprintf(key, sizeof(key), "lat_%s_max_us", name);
+		vlen = snprintf(val, sizeof(val), "%.1f", h->max_ns / 1000.0);
+		add_stats(key, klen, val, vlen, c);
+	}
+	free(h);
+}
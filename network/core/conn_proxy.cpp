@@ -0,0 +1,358 @@
+/*
+ * conn_proxy.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <network/core/conn_proxy.h>
+#include <network/core/conn_thread.h>
+#include <vutils/Logger.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_proxy"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/* splices per direction and event, so one busy proxy can't starve a worker */
+#define PROXY_SPLICES_PER_EVENT 16
+
+/* one direction: bytes read from src wait in pipe for dst */
+struct proxy_dir {
+	int pipe[2];
+	size_t inpipe; /* bytes in the pipe */
+	bool eof; /* src has closed its write half */
+};
+
+typedef struct conn_proxy conn_proxy;
+struct conn_proxy {
+	conn *c;
+	int ufd; /* backend socket */
+	bool connected;
+	struct event cevent; /* client side */
+	struct event uevent; /* backend side */
+	short cflags;
+	short uflags;
+	struct event timer; /* the backend owes a connect or a reply */
+	bool timer_set;
+	char *pending; /* written to the backend before splicing starts */
+	size_t npending;
+	size_t pendoff;
+	struct proxy_dir c2u;
+	struct proxy_dir u2c;
+};
+
+static void proxy_event(int fd, short which, void *arg);
+
+static void proxy_set_events(conn_proxy *p, struct event *ev, short *cur,
+		int fd, short flags) {
+	if (*cur == flags)
+		return;
+	if (*cur != 0)
+		event_del(ev);
+	*cur = flags;
+	if (flags == 0)
+		return;
+	event_set(ev, fd, flags | EV_PERSIST, proxy_event, (void *) p);
+	event_base_set(p->c->thread->base, ev);
+	if (event_add(ev, 0) == -1)
+		MY_LOGE("event_add");
+}
+
+static void proxy_timeout_event(int fd, short which, void *arg);
+
+/* starts the clock, unless it already runs for earlier bytes */
+static void proxy_arm(conn_proxy *p) {
+	struct timeval t;
+
+	if (settings.proxy_timeout == 0 || p->timer_set)
+		return;
+	t.tv_sec = settings.proxy_timeout / 1000;
+	t.tv_usec = (settings.proxy_timeout % 1000) * 1000;
+	evtimer_set(&p->timer, proxy_timeout_event, (void *) p);
+	event_base_set(p->c->thread->base, &p->timer);
+	if (evtimer_add(&p->timer, &t) == -1) {
+		MY_LOGE("evtimer_add");
+		return;
+	}
+	p->timer_set = true;
+}
+
+static void proxy_disarm(conn_proxy *p) {
+	if (!p->timer_set)
+		return;
+	evtimer_del(&p->timer);
+	p->timer_set = false;
+}
+
+static void proxy_free(conn_proxy *p) {
+	int i;
+
+	proxy_disarm(p);
+	if (p->cflags != 0)
+		event_del(&p->cevent);
+	if (p->uflags != 0)
+		event_del(&p->uevent);
+	if (p->ufd >= 0)
+		close(p->ufd);
+	for (i = 0; i < 2; i++) {
+		if (p->c2u.pipe[i] >= 0)
+			close(p->c2u.pipe[i]);
+		if (p->u2c.pipe[i] >= 0)
+			close(p->u2c.pipe[i]);
+	}
+	free(p->pending);
+	free(p);
+}
+
+static void proxy_done(conn_proxy *p) {
+	conn *c = p->c;
+
+	if (settings.verbose > 1)
+		MY_LOGE("<%d proxy to fd %d done", c->sfd, p->ufd);
+	proxy_free(p);
+	conn_close(c);
+}
+
+static void proxy_timeout_event(int fd, short which, void *arg) {
+	conn_proxy *p = (conn_proxy *) arg;
+	conn *c = p->c;
+
+	p->timer_set = false;
+	if (settings.verbose > 0)
+		MY_LOGE("<%d backend fd %d timed out", c->sfd, p->ufd);
+	pthread_mutex_lock(&c->thread->stats.mutex);
+	c->thread->stats.proxy_timeouts++;
+	pthread_mutex_unlock(&c->thread->stats.mutex);
+	proxy_done(p);
+}
+
+/*
+ * Moves what it can from src to dst. Returns false on a socket error.
+ */
+static bool proxy_pump(conn_proxy *p, struct proxy_dir *d, int src, int dst,
+		uint64_t *moved) {
+	int i;
+
+	for (i = 0; i < PROXY_SPLICES_PER_EVENT; i++) {
+		ssize_t res;
+
+		if (d->inpipe > 0) {
+			res = splice(d->pipe[0], NULL, dst, NULL, d->inpipe,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (res > 0) {
+				d->inpipe -= res;
+				*moved += res;
+				continue;
+			}
+			if (res == -1 && (errno == EAGAIN || errno == EINTR))
+				return true;
+			return false;
+		}
+		if (d->eof)
+			return true;
+
+		res = splice(src, NULL, d->pipe[1], NULL, PROXY_CHUNK_SIZE,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (res > 0) {
+			d->inpipe += res;
+		} else if (res == 0) {
+			d->eof = true;
+			shutdown(dst, SHUT_WR);
+			return true;
+		} else if (errno == EAGAIN || errno == EINTR) {
+			return true;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Writes the bytes queued ahead of the client's. Returns false on error.
+ */
+static bool proxy_flush_pending(conn_proxy *p, uint64_t *moved) {
+	while (p->pendoff < p->npending) {
+		ssize_t res = write(p->ufd, p->pending + p->pendoff,
+				p->npending - p->pendoff);
+		if (res > 0) {
+			p->pendoff += res;
+			*moved += res;
+			continue;
+		}
+		if (res == -1 && (errno == EAGAIN || errno == EINTR))
+			return true;
+		return false;
+	}
+	free(p->pending);
+	p->pending = NULL;
+	p->npending = p->pendoff = 0;
+	return true;
+}
+
+/*
+ * Queues what the client sent after the request that started the proxy.
+ * Done once connected, when the dispatch that started us has returned and
+ * moved rcurr past its request.
+ */
+static bool proxy_take_rbuf(conn_proxy *p) {
+	conn *c = p->c;
+	char *pending;
+
+	if (c->rbytes <= 0)
+		return true;
+	pending = (char *) realloc(p->pending, p->npending + c->rbytes);
+	if (pending == NULL)
+		return false;
+	memcpy(pending + p->npending, c->rcurr, c->rbytes);
+	p->pending = pending;
+	p->npending += c->rbytes;
+	c->rcurr += c->rbytes;
+	c->rbytes = 0;
+	return true;
+}
+
+static void proxy_event(int fd, short which, void *arg) {
+	conn_proxy *p = (conn_proxy *) arg;
+	conn *c = p->c;
+	uint64_t to_upstream = 0, to_client = 0;
+	bool ok = true;
+	short cflags, uflags;
+
+	if (!p->connected) {
+		int err = 0;
+		socklen_t errlen = sizeof(err);
+		if (getsockopt(p->ufd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0)
+			err = errno;
+		if (err != 0) {
+			MY_LOGE("<%d backend connect: %s", c->sfd, strerror(err));
+			proxy_done(p);
+			return;
+		}
+		p->connected = true;
+		ok = proxy_take_rbuf(p);
+	}
+
+	/* backend to client first: what it sent can't answer what follows */
+	if (ok)
+		ok = proxy_pump(p, &p->u2c, p->ufd, c->sfd, &to_client);
+	if (ok && p->pending != NULL)
+		ok = proxy_flush_pending(p, &to_upstream);
+	if (ok && p->pending == NULL)
+		ok = proxy_pump(p, &p->c2u, c->sfd, p->ufd, &to_upstream);
+
+	if (to_upstream || to_client) {
+		pthread_mutex_lock(&c->thread->stats.mutex);
+		c->thread->stats.proxy_client_bytes += to_upstream;
+		c->thread->stats.proxy_upstream_bytes += to_client;
+		pthread_mutex_unlock(&c->thread->stats.mutex);
+	}
+	/* the backend is alive; bytes it hasn't answered yet restart the clock */
+	if (to_client)
+		proxy_disarm(p);
+	if (to_upstream)
+		proxy_arm(p);
+	if (!ok || (p->c2u.eof && p->u2c.eof && p->c2u.inpipe == 0
+			&& p->u2c.inpipe == 0)) {
+		if (!ok && settings.verbose > 0)
+			MY_LOGE("<%d proxy: %s", c->sfd, strerror(errno));
+		proxy_done(p);
+		return;
+	}
+
+	/* wait on the source while a pipe is empty, on the sink otherwise */
+	cflags = 0;
+	uflags = 0;
+	if (!p->c2u.eof && p->c2u.inpipe == 0 && p->pending == NULL)
+		cflags |= EV_READ;
+	if (p->u2c.inpipe > 0)
+		cflags |= EV_WRITE;
+	if (!p->u2c.eof && p->u2c.inpipe == 0)
+		uflags |= EV_READ;
+	if (p->c2u.inpipe > 0 || p->pending != NULL)
+		uflags |= EV_WRITE;
+	proxy_set_events(p, &p->cevent, &p->cflags, c->sfd, cflags);
+	proxy_set_events(p, &p->uevent, &p->uflags, p->ufd, uflags);
+}
+
+int conn_proxy_start(conn *c, const struct sockaddr *addr, socklen_t addrlen,
+		const void *first, size_t firstlen) {
+	conn_proxy *p;
+	int flags, on = 1;
+
+	assert(IS_TCP(c->transport));
+	p = (conn_proxy *) calloc(1, sizeof(*p));
+	if (p == NULL)
+		return -1;
+	p->c = c;
+	p->ufd = -1;
+	p->c2u.pipe[0] = p->c2u.pipe[1] = -1;
+	p->u2c.pipe[0] = p->u2c.pipe[1] = -1;
+
+	if (firstlen > 0) {
+		p->pending = (char *) malloc(firstlen);
+		if (p->pending == NULL) {
+			proxy_free(p);
+			return -1;
+		}
+		memcpy(p->pending, first, firstlen);
+		p->npending = firstlen;
+	}
+	if (pipe2(p->c2u.pipe, O_NONBLOCK | O_CLOEXEC) != 0
+			|| pipe2(p->u2c.pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+		MY_LOGE("pipe2(): %s", strerror(errno));
+		proxy_free(p);
+		return -1;
+	}
+
+	p->ufd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (p->ufd == -1 || (flags = fcntl(p->ufd, F_GETFL, 0)) < 0
+			|| fcntl(p->ufd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		MY_LOGE("backend socket: %s", strerror(errno));
+		proxy_free(p);
+		return -1;
+	}
+	setsockopt(p->ufd, IPPROTO_TCP, TCP_NODELAY, (void *) &on, sizeof(on));
+	if (connect(p->ufd, addr, addrlen) == -1 && errno != EINPROGRESS) {
+		MY_LOGE("<%d backend connect: %s", c->sfd, strerror(errno));
+		proxy_free(p);
+		return -1;
+	}
+
+	/* the proxy owns both sockets from here, drive_machine stops */
+	event_del(&c->event);
+	c->ev_flags = 0;
+	conn_set_state(c, conn_watch);
+	pthread_mutex_lock(&c->thread->stats.mutex);
+	c->thread->stats.proxy_conns++;
+	pthread_mutex_unlock(&c->thread->stats.mutex);
+
+	/* writable once connected; the client waits until then */
+	proxy_set_events(p, &p->uevent, &p->uflags, p->ufd, EV_WRITE);
+	proxy_arm(p);
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * conn_sched.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_sched.h>
+#include <network/core/conn_utils.h>
+#include <vutils/Logger.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_sched"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+#define SCHED_WEIGHTS_MAX 32
+
+/* One -W entry: either a listening port or a client address class. */
+struct sched_weight {
+	int port; /* 0 for a client class */
+	int family; /* AF_INET or AF_INET6 for a client class */
+	unsigned char addr[16];
+	int prefix; /* CIDR prefix length in bits */
+	int weight;
+};
+
+static struct sched_weight weights[SCHED_WEIGHTS_MAX];
+static int nweights = 0;
+
+static uint64_t sched_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Parses -Q "<bytes|time>[:<quantum>]", "off" disables the scheduler.
+ */
+bool sched_parse_quantum(const char *str) {
+	const char *colon = strchr(str, ':');
+	size_t len = colon ? (size_t) (colon - str) : strlen(str);
+	int32_t quantum = 0;
+
+	if (len == 3 && strncmp(str, "off", len) == 0) {
+		settings.sched_mode = sched_off;
+		return colon == NULL;
+	} else if (len == 5 && strncmp(str, "bytes", len) == 0) {
+		settings.sched_mode = sched_bytes;
+		quantum = SCHED_QUANTUM_BYTES_DEFAULT;
+	} else if (len == 4 && strncmp(str, "time", len) == 0) {
+		settings.sched_mode = sched_time;
+		quantum = SCHED_QUANTUM_TIME_DEFAULT;
+	} else {
+		return false;
+	}
+
+	if (colon && (!safe_strtol(colon + 1, &quantum) || quantum <= 0))
+		return false;
+	settings.sched_quantum = quantum;
+	return true;
+}
+
+static bool parse_weight_entry(char *entry, struct sched_weight *w) {
+	char *colon = strrchr(entry, ':');
+	char *slash;
+	int32_t val;
+
+	if (colon == NULL)
+		return false;
+	*colon = '\0';
+	if (!safe_strtol(colon + 1, &val) || val <= 0 || val > SCHED_WEIGHT_MAX)
+		return false;
+	memset(w, 0, sizeof(*w));
+	w->weight = val;
+
+	slash = strchr(entry, '/');
+	if (slash == NULL) {
+		if (!safe_strtol(entry, &val) || val <= 0 || val > 65535)
+			return false;
+		w->port = val;
+		return true;
+	}
+
+	*slash = '\0';
+	if (!safe_strtol(slash + 1, &val) || val < 0)
+		return false;
+	if (inet_pton(AF_INET, entry, w->addr) == 1) {
+		w->family = AF_INET;
+		if (val > 32)
+			return false;
+	} else if (inet_pton(AF_INET6, entry, w->addr) == 1) {
+		w->family = AF_INET6;
+		if (val > 128)
+			return false;
+	} else {
+		return false;
+	}
+	w->prefix = val;
+	return true;
+}
+
+/*
+ * Parses -W, a comma separated list of "<selector>:<weight>".
+ */
+bool sched_parse_weights(const char *str) {
+	char *list = strdup(str);
+	char *b;
+	bool ok = true;
+
+	if (list == NULL)
+		return false;
+	for (char *p = strtok_r(list, ",", &b); p != NULL && ok;
+			p = strtok_r(NULL, ",", &b)) {
+		if (nweights == SCHED_WEIGHTS_MAX) {
+			MY_LOGE("Too many scheduler weights, at most %d",
+					SCHED_WEIGHTS_MAX);
+			ok = false;
+			break;
+		}
+		ok = parse_weight_entry(p, &weights[nweights]);
+		if (ok)
+			nweights++;
+	}
+	free(list);
+	return ok;
+}
+
+static bool prefix_match(const unsigned char *a, const unsigned char *b,
+		int prefix) {
+	int bytes = prefix / 8;
+	int bits = prefix % 8;
+
+	if (memcmp(a, b, bytes) != 0)
+		return false;
+	if (bits == 0)
+		return true;
+	unsigned char mask = (unsigned char) (0xff << (8 - bits));
+	return (a[bytes] & mask) == (b[bytes] & mask);
+}
+
+static bool class_match(const struct sched_weight *w,
+		const struct sockaddr *peer) {
+	if (peer->sa_family == AF_INET && w->family == AF_INET) {
+		const struct sockaddr_in *in = (const struct sockaddr_in *) peer;
+		return prefix_match((const unsigned char *) &in->sin_addr, w->addr,
+				w->prefix);
+	}
+	if (peer->sa_family == AF_INET6 && w->family == AF_INET6) {
+		const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *) peer;
+		return prefix_match((const unsigned char *) &in6->sin6_addr, w->addr,
+				w->prefix);
+	}
+	return false;
+}
+
+/*
+ * Picks the weight of a freshly accepted connection.
+ */
+void sched_conn_init(conn *c) {
+	int port = 0;
+	int port_weight = 0;
+	int i;
+
+	memset(&c->sched, 0, sizeof(c->sched));
+	c->sched.weight = SCHED_WEIGHT_DEFAULT;
+	if (nweights == 0 || !IS_TCP(c->transport))
+		return;
+
+	struct sockaddr_storage local;
+	socklen_t len = sizeof(local);
+	if (getsockname(c->sfd, (struct sockaddr *) &local, &len) == 0) {
+		if (local.ss_family == AF_INET)
+			port = ntohs(((struct sockaddr_in *) &local)->sin_port);
+		else if (local.ss_family == AF_INET6)
+			port = ntohs(((struct sockaddr_in6 *) &local)->sin6_port);
+	}
+
+	for (i = 0; i < nweights; i++) {
+		if (weights[i].port == 0) {
+			if (class_match(&weights[i],
+					(const struct sockaddr *) &c->request_addr)) {
+				c->sched.weight = weights[i].weight;
+				return;
+			}
+		} else if (weights[i].port == port && port_weight == 0) {
+			port_weight = weights[i].weight;
+		}
+	}
+	if (port_weight)
+		c->sched.weight = port_weight;
+}
+
+void sched_set_weight(conn *c, int weight) {
+	if (weight < 1)
+		weight = 1;
+	if (weight > SCHED_WEIGHT_MAX)
+		weight = SCHED_WEIGHT_MAX;
+	c->sched.weight = weight;
+}
+
+/*
+ * Credits a connection that was just handed to us by libevent.
+ */
+void sched_visit(conn *c) {
+	if (settings.sched_mode == sched_off)
+		return;
+	c->sched.deficit += (int64_t) settings.sched_quantum * c->sched.weight;
+}
+
+void sched_request_start(conn *c) {
+	if (c->sched.inflight)
+		return;
+	c->sched.inflight = true;
+	c->sched.start_bytes = c->sched.bytes;
+	if (settings.sched_mode == sched_time)
+		c->sched.start_us = sched_now_us();
+}
+
+/*
+ * Charges the request that just finished, if any.
+ */
+bool sched_request_done(conn *c, int nreqs) {
+	if (c->sched.inflight) {
+		uint64_t bytes = c->sched.bytes - c->sched.start_bytes;
+		c->sched.inflight = false;
+		c->sched.service_bytes += bytes;
+		if (settings.sched_mode == sched_time) {
+			uint64_t us = sched_now_us() - c->sched.start_us;
+			c->sched.service_us += us;
+			if (us == 0)
+				us = 1;
+			c->sched.deficit -= (int64_t) us;
+		} else if (settings.sched_mode == sched_bytes) {
+			c->sched.deficit -= (int64_t) (bytes ? bytes : 1);
+		}
+	}
+	if (settings.sched_mode == sched_off)
+		return nreqs >= 0;
+	return c->sched.deficit > 0;
+}
+
+/*
+ * The connection ran out of input: unused credit is dropped, debt from an
+ * expensive request is kept.
+ */
+void sched_idle(conn *c) {
+	if (c->sched.deficit > 0)
+		c->sched.deficit = 0;
+}
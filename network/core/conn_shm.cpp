@@ -0,0 +1,470 @@
+/*
+ * conn_shm.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <network/core/conn_shm.h>
+#include <network/core/conn_thread.h>
+#include <vutils/Logger.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_shm"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+#define SHM_FDS 3 /* memfd, server eventfd, client eventfd */
+
+/* what both ends map */
+struct shm_map {
+	struct shm_layout *hdr;
+	size_t len;
+	char *req; /* request data */
+	char *rsp; /* response data */
+};
+
+struct conn_shm {
+	struct shm_map map;
+	int sock; /* the Unix socket, only watched for hangups */
+	int peer_efd; /* the client sleeps on this one */
+	struct event sock_event;
+};
+
+struct conn_shm_client {
+	struct shm_map map;
+	int sock;
+	int efd; /* we sleep on this one */
+	int peer_efd; /* the server sleeps on this one */
+};
+
+static size_t ring_write(struct shm_ring *r, char *data, uint32_t size,
+		const char *src, size_t len) {
+	uint64_t head = r->head;
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t n = size - (head - tail), off, first;
+
+	if (n > len)
+		n = len;
+	off = head & (size - 1);
+	first = size - off < n ? size - off : n;
+	memcpy(data + off, src, first);
+	memcpy(data, src + first, n - first);
+	__atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+static size_t ring_read(struct shm_ring *r, const char *data, uint32_t size,
+		char *dst, size_t len) {
+	uint64_t tail = r->tail;
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	size_t n = head - tail, off, first;
+
+	if (n > len)
+		n = len;
+	off = tail & (size - 1);
+	first = size - off < n ? size - off : n;
+	memcpy(dst, data + off, first);
+	memcpy(dst + first, data, n - first);
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+static bool ring_empty(struct shm_ring *r) {
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+			== __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static bool ring_full(struct shm_ring *r, uint32_t size) {
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+			- __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == size;
+}
+
+/*
+ * Announces we are about to sleep on *flag, then checks the condition
+ * once more; the other side checks the flag after it moved the ring, so
+ * one of the two always sees the other.
+ */
+static bool ring_prepare_sleep(uint32_t *flag, struct shm_ring *r,
+		uint32_t size, bool for_space) {
+	__atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+	if (for_space ? ring_full(r, size) : ring_empty(r))
+		return true;
+	__atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+	return false;
+}
+
+/*
+ * Rings efd if the other side sleeps on *flag.
+ */
+static void ring_notify(uint32_t *flag, int efd) {
+	uint64_t one = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(flag, __ATOMIC_RELAXED)) {
+		__atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+		if (write(efd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+			MY_LOGE("eventfd write: %s", strerror(errno));
+	}
+}
+
+static void drain_eventfd(int efd) {
+	uint64_t count;
+
+	if (read(efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		MY_LOGE("eventfd read: %s", strerror(errno));
+}
+
+static int shm_map_fd(struct shm_map *map, int fd, uint32_t size) {
+	map->len = sizeof(struct shm_layout) + 2 * (size_t) size;
+	map->hdr = (struct shm_layout *) mmap(NULL, map->len,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map->hdr == MAP_FAILED) {
+		map->hdr = NULL;
+		return -1;
+	}
+	map->req = (char *) (map->hdr + 1);
+	map->rsp = map->req + size;
+	return 0;
+}
+
+bool is_shm_command(const char *line) {
+	return strcmp(line, "shm") == 0;
+}
+
+static void shm_sock_handler(const int fd, const short which, void *arg) {
+	conn *c = (conn *) arg;
+	char buf[256];
+	ssize_t res = read(fd, buf, sizeof(buf));
+
+	/* anything past the upgrade is ignored, the rings carry requests */
+	if (res > 0 || (res == -1 && (errno == EAGAIN || errno == EINTR)))
+		return;
+	if (settings.verbose > 1)
+		MY_LOGE("<%d shm client went away", c->sfd);
+	if (c->state == conn_watch) {
+		/* parked, a side thread still has c until it hands it back */
+		event_del(&c->shm->sock_event);
+		c->close_on_resume = true;
+		return;
+	}
+	conn_close(c);
+}
+
+int conn_shm_upgrade(conn *c) {
+	struct conn_shm *shm;
+	uint32_t size = 1;
+	int fds[SHM_FDS] = { -1, -1, -1 };
+	char line[64];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int sock, i;
+
+	if (c->transport != local_transport || settings.shm_size <= 0
+			|| c->thread == NULL)
+		return -1;
+	while (size < (uint32_t) settings.shm_size)
+		size <<= 1;
+
+	shm = (struct conn_shm *) calloc(1, sizeof(*shm));
+	if (shm == NULL)
+		return -1;
+	fds[0] = memfd_create("vnetwork-shm", MFD_CLOEXEC);
+	fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0
+			|| ftruncate(fds[0], sizeof(struct shm_layout) + 2 * (off_t) size)
+					!= 0 || shm_map_fd(&shm->map, fds[0], size) != 0) {
+		MY_LOGE("<%d shm setup: %s", c->sfd, strerror(errno));
+		goto fail;
+	}
+	shm->map.hdr->magic = SHM_MAGIC;
+	shm->map.hdr->size = size;
+
+	/* the answer carries the descriptors */
+	snprintf(line, sizeof(line), "SHM %u\r\n", size);
+	iov.iov_base = line;
+	iov.iov_len = strlen(line);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if (sendmsg(c->sfd, &msg, 0) != (ssize_t) iov.iov_len) {
+		MY_LOGE("<%d shm handoff: %s", c->sfd, strerror(errno));
+		goto fail;
+	}
+
+	/* the server's eventfd takes the socket's place, so conns[] and all
+	 * the event code keep working on c->sfd */
+	sock = fcntl(c->sfd, F_DUPFD_CLOEXEC, 0);
+	if (sock < 0) {
+		MY_LOGE("<%d dup: %s", c->sfd, strerror(errno));
+		goto fail;
+	}
+	event_del(&c->event);
+	c->ev_flags = 0;
+	if (dup2(fds[1], c->sfd) < 0) {
+		/* the client has the rings already, it sees the hangup */
+		MY_LOGE("<%d dup2: %s", c->sfd, strerror(errno));
+		close(sock);
+		goto fail;
+	}
+	close(fds[0]);
+	close(fds[1]);
+	shm->sock = sock;
+	shm->peer_efd = fds[2];
+	event_set(&shm->sock_event, sock, EV_READ | EV_PERSIST, shm_sock_handler,
+			(void *) c);
+	event_base_set(c->thread->base, &shm->sock_event);
+	event_add(&shm->sock_event, 0);
+
+	c->shm = shm;
+	c->transport = shm_transport;
+	c->protocol = settings.binding_protocol;
+	c->nframes = c->framecurr = 0;
+	conn_set_state(c, conn_new_cmd);
+
+	pthread_mutex_lock(&c->thread->stats.mutex);
+	c->thread->stats.shm_conns++;
+	pthread_mutex_unlock(&c->thread->stats.mutex);
+	return 0;
+
+fail:
+	if (shm->map.hdr != NULL)
+		munmap(shm->map.hdr, shm->map.len);
+	for (i = 0; i < SHM_FDS; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+	free(shm);
+	return -1;
+}
+
+ssize_t conn_shm_read(conn *c, void *buf, size_t len) {
+	struct shm_layout *hdr = c->shm->map.hdr;
+	size_t n;
+
+	drain_eventfd(c->sfd);
+	n = ring_read(&hdr->req, c->shm->map.req, hdr->size, (char *) buf, len);
+	if (n == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	ring_notify(&hdr->req.producer_waiting, c->shm->peer_efd);
+	return n;
+}
+
+ssize_t conn_shm_sendmsg(conn *c, const struct msghdr *m) {
+	struct shm_layout *hdr = c->shm->map.hdr;
+	ssize_t total = 0;
+	size_t i;
+
+	for (i = 0; i < m->msg_iovlen; i++) {
+		const struct iovec *iov = &m->msg_iov[i];
+		size_t n = ring_write(&hdr->rsp, c->shm->map.rsp, hdr->size,
+				(const char *) iov->iov_base, iov->iov_len);
+		total += n;
+		if (n < iov->iov_len)
+			break;
+	}
+	if (total > 0) {
+		ring_notify(&hdr->rsp.consumer_waiting, c->shm->peer_efd);
+		return total;
+	}
+
+	/* full, have the client ring us once it made room */
+	drain_eventfd(c->sfd);
+	if (!ring_prepare_sleep(&hdr->rsp.producer_waiting, &hdr->rsp, hdr->size,
+			true))
+		return conn_shm_sendmsg(c, m);
+	errno = EAGAIN;
+	return -1;
+}
+
+bool conn_shm_may_sleep(conn *c) {
+	struct shm_layout *hdr = c->shm->map.hdr;
+
+	return ring_prepare_sleep(&hdr->req.consumer_waiting, &hdr->req,
+			hdr->size, false);
+}
+
+void conn_shm_close(conn *c) {
+	struct conn_shm *shm = c->shm;
+
+	if (shm == NULL)
+		return;
+	event_del(&shm->sock_event);
+	close(shm->sock);
+	close(shm->peer_efd);
+	munmap(shm->map.hdr, shm->map.len);
+	free(shm);
+	c->shm = NULL;
+}
+
+conn_shm_client *conn_shm_client_open(const char *path) {
+	conn_shm_client *cl;
+	struct sockaddr_un addr;
+	char line[64];
+	int fds[SHM_FDS];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	unsigned int size;
+	ssize_t res;
+	int i;
+
+	cl = (conn_shm_client *) calloc(1, sizeof(*cl));
+	if (cl == NULL)
+		return NULL;
+	cl->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (cl->sock < 0
+			|| connect(cl->sock, (struct sockaddr *) &addr, sizeof(addr)) != 0
+			|| write(cl->sock, "shm\r\n", 5) != 5) {
+		MY_LOGE("%s: %s", path, strerror(errno));
+		goto fail;
+	}
+
+	iov.iov_base = line;
+	iov.iov_len = sizeof(line) - 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	res = recvmsg(cl->sock, &msg, MSG_CMSG_CLOEXEC);
+	cmsg = res > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+	if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+			|| cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+		if (res > 0) {
+			line[res] = '\0';
+			MY_LOGE("%s: no shm upgrade, got %s", path, line);
+		}
+		goto fail;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	line[res] = '\0';
+	if (sscanf(line, "SHM %u", &size) != 1 || shm_map_fd(&cl->map, fds[0],
+			size) != 0 || cl->map.hdr->magic != SHM_MAGIC) {
+		MY_LOGE("%s: bad shm handoff", path);
+		for (i = 0; i < SHM_FDS; i++)
+			close(fds[i]);
+		goto fail;
+	}
+	close(fds[0]);
+	cl->peer_efd = fds[1];
+	cl->efd = fds[2];
+	return cl;
+
+fail:
+	if (cl->map.hdr != NULL)
+		munmap(cl->map.hdr, cl->map.len);
+	if (cl->sock >= 0)
+		close(cl->sock);
+	free(cl);
+	return NULL;
+}
+
+/*
+ * Sleeps until the server rings. Returns false if it went away.
+ */
+static bool client_sleep(conn_shm_client *cl) {
+	struct pollfd pfd[2];
+	char buf[64];
+
+	pfd[0].fd = cl->efd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = cl->sock;
+	pfd[1].events = POLLIN;
+	while (poll(pfd, 2, -1) < 0) {
+		if (errno != EINTR)
+			return false;
+	}
+	if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+		if (recv(cl->sock, buf, sizeof(buf), MSG_DONTWAIT) <= 0)
+			return false;
+	}
+	drain_eventfd(cl->efd);
+	return true;
+}
+
+ssize_t conn_shm_client_write(conn_shm_client *cl, const void *buf,
+		size_t len) {
+	struct shm_layout *hdr = cl->map.hdr;
+	size_t done = 0;
+
+	while (done < len) {
+		size_t n = ring_write(&hdr->req, cl->map.req, hdr->size,
+				(const char *) buf + done, len - done);
+		if (n > 0) {
+			done += n;
+			ring_notify(&hdr->req.consumer_waiting, cl->peer_efd);
+			continue;
+		}
+		if (ring_prepare_sleep(&hdr->req.producer_waiting, &hdr->req,
+				hdr->size, true) && !client_sleep(cl))
+			return -1;
+	}
+	return len;
+}
+
+ssize_t conn_shm_client_read(conn_shm_client *cl, void *buf, size_t len) {
+	struct shm_layout *hdr = cl->map.hdr;
+
+	for (;;) {
+		size_t n = ring_read(&hdr->rsp, cl->map.rsp, hdr->size, (char *) buf,
+				len);
+		if (n > 0) {
+			ring_notify(&hdr->rsp.producer_waiting, cl->peer_efd);
+			return n;
+		}
+		if (ring_prepare_sleep(&hdr->rsp.consumer_waiting, &hdr->rsp,
+				hdr->size, false) && !client_sleep(cl))
+			return 0;
+	}
+}
+
+void conn_shm_client_close(conn_shm_client *cl) {
+	munmap(cl->map.hdr, cl->map.len);
+	close(cl->sock);
+	close(cl->efd);
+	close(cl->peer_efd);
+	free(cl);
+}
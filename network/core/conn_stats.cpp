@@ -0,0 +1,377 @@
+/*
+ * conn_stats.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_stats.h>
+#include <network/core/conn_thread.h>
+#include <network/core/conn_wrap.h>
+#include <network/core/conn_latency.h>
+#include <network/core/conn_trace.h>
+#include <vutils/Logger.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_stats"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/*
+ * Makes room for needed more bytes in c->stats.buffer.
+ */
+bool grow_stats_buf(conn *c, size_t needed) {
+	size_t nsize = c->stats.size;
+	size_t available = nsize - c->stats.offset;
+	bool rv = true;
+
+	/* Special case: No buffer -- need to allocate fresh */
+	if (c->stats.buffer == NULL) {
+		nsize = 1024;
+		available = c->stats.size = c->stats.offset = 0;
+	}
+
+	while (needed > available) {
+		assert(nsize > 0);
+		nsize = nsize << 1;
+		available = nsize - c->stats.offset;
+	}
+
+	if (nsize != c->stats.size) {
+		char *ptr = (char *) realloc(c->stats.buffer, nsize);
+		if (ptr) {
+			c->stats.buffer = ptr;
+			c->stats.size = nsize;
+		} else {
+			STATS_LOCK();
+			stats.malloc_fails++;
+			STATS_UNLOCK();
+			rv = false;
+		}
+	}
+
+	return rv;
+}
+
+static void append_bin_stats(const char *key, const uint16_t klen,
+		const char *val, const uint32_t vlen, conn *c) {
+	char *buf = c->stats.buffer + c->stats.offset;
+	uint32_t bodylen = klen + vlen;
+	protocol_binary_response_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header.response.opcode = PROTOCOL_BINARY_CMD_STAT;
+	header.response.keylen = (uint16_t) htons(klen);
+	header.response.bodylen = htonl(bodylen);
+	/* opaque is echoed as it came in */
+	header.response.opaque = c->opaque;
+
+	memcpy(buf, header.bytes, sizeof(header.response));
+	buf += sizeof(header.response);
+	if (klen > 0) {
+		memcpy(buf, key, klen);
+		buf += klen;
+		if (vlen > 0)
+			memcpy(buf, val, vlen);
+	}
+
+	c->stats.offset += sizeof(header.response) + bodylen;
+}
+
+static void append_ascii_stats(const char *key, const uint16_t klen,
+		const char *val, const uint32_t vlen, conn *c) {
+	char *pos = c->stats.buffer + c->stats.offset;
+	uint32_t nbytes = 0;
+	int remaining = c->stats.size - c->stats.offset;
+	int room = remaining - 1;
+
+	if (klen == 0 && vlen == 0) {
+		nbytes = snprintf(pos, room, "END\r\n");
+	} else if (vlen == 0) {
+		nbytes = snprintf(pos, room, "STAT %s\r\n", key);
+	} else {
+		nbytes = snprintf(pos, room, "STAT %s %s\r\n", key, val);
+	}
+
+	c->stats.offset += nbytes;
+}
+
+/*
+ * ADD_STAT writing one entry in the wire format of c's protocol.
+ */
+void append_stats(const char *key, const uint16_t klen, const char *val,
+		const uint32_t vlen, const void *cookie) {
+	/* value without a key is invalid */
+	if (klen == 0 && vlen > 0) {
+		return;
+	}
+
+	conn *c = (conn*) cookie;
+
+	if (c->protocol == binary_prot) {
+		size_t needed = vlen + klen + sizeof(protocol_binary_response_header);
+		if (!grow_stats_buf(c, needed)) {
+			return;
+		}
+		append_bin_stats(key, klen, val, vlen, c);
+	} else {
+		size_t needed = vlen + klen + 10; // 10 == "STAT = \r\n"
+		if (!grow_stats_buf(c, needed)) {
+			return;
+		}
+		append_ascii_stats(key, klen, val, vlen, c);
+	}
+
+	assert(c->stats.offset <= c->stats.size);
+}
+
+/*
+ * Formats a value and hands it to add_stats under name.
+ */
+void append_stat(const char *name, ADD_STAT add_stats, conn *c,
+		const char *fmt, ...) {
+	char val_str[256];
+	int vlen;
+	va_list ap;
+
+	assert(name);
+	assert(add_stats);
+	assert(c);
+	assert(fmt);
+
+	va_start(ap, fmt);
+	vlen = vsnprintf(val_str, sizeof(val_str) - 1, fmt, ap);
+	va_end(ap);
+
+	add_stats(name, strlen(name), val_str, vlen, c);
+}
+
+#define APPEND_STAT(name, fmt, ...) \
+	append_stat(name, add_stats, c, fmt, __VA_ARGS__);
+
+void server_stats(ADD_STAT add_stats, conn *c) {
+	pid_t pid = getpid();
+	rel_time_t now = current_time;
+	struct thread_stats thread_stats;
+	struct rusage usage;
+	struct stats s;
+	struct stats_state ss;
+	struct reqs_adapt_stats reqs;
+	char key[64];
+	int i, j;
+
+	threadlocal_stats_aggregate(&thread_stats);
+
+	STATS_LOCK();
+	s = stats;
+	ss = stats_state;
+	STATS_UNLOCK();
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	APPEND_STAT("pid", "%lu", (long)pid);
+	APPEND_STAT("uptime", "%u", now);
+	APPEND_STAT("time", "%ld", now + (long)process_started);
+	APPEND_STAT("pointer_size", "%d", (int)(8 * sizeof(void *)));
+
+	append_stat("rusage_user", add_stats, c, "%ld.%06ld",
+			(long)usage.ru_utime.tv_sec, (long)usage.ru_utime.tv_usec);
+	append_stat("rusage_system", add_stats, c, "%ld.%06ld",
+			(long)usage.ru_stime.tv_sec, (long)usage.ru_stime.tv_usec);
+
+	APPEND_STAT("max_connections", "%d", settings.maxconns);
+	APPEND_STAT("curr_connections", "%llu",
+			(unsigned long long)ss.curr_conns);
+	APPEND_STAT("total_connections", "%llu",
+			(unsigned long long)s.total_conns);
+	if (settings.maxconns_fast) {
+		APPEND_STAT("rejected_connections", "%llu",
+				(unsigned long long)s.rejected_conns);
+	}
+	APPEND_STAT("connection_structures", "%u", ss.conn_structs);
+	APPEND_STAT("reserved_fds", "%u", ss.reserved_fds);
+	APPEND_STAT("accepting_conns", "%u", ss.accepting_conns);
+	APPEND_STAT("listen_disabled_num", "%llu",
+			(unsigned long long)s.listen_disabled_num);
+	APPEND_STAT("malloc_fails", "%llu", (unsigned long long)s.malloc_fails);
+	if (settings.steer_cpu) {
+		APPEND_STAT("steered_connections", "%llu",
+				(unsigned long long)s.steered_conns);
+		APPEND_STAT("steer_misses", "%llu",
+				(unsigned long long)s.steer_misses);
+	}
+	APPEND_STAT("threads", "%d", settings.num_threads);
+
+#define X(name) \
+	APPEND_STAT(#name, "%llu", (unsigned long long)thread_stats.name);
+	THREAD_STATS_FIELDS
+#undef X
+
+	if (settings.reqs_adaptive) {
+		for (i = 0; conn_thread_reqs_stats(i, &reqs); i++) {
+			snprintf(key, sizeof(key), "worker_%d_reqs_per_event", i);
+			APPEND_STAT(key, "%d", reqs.current);
+			snprintf(key, sizeof(key), "worker_%d_loop_us", i);
+			APPEND_STAT(key, "%llu", (unsigned long long)reqs.loop_us);
+			/* the last changes, oldest first: time, new value, loop_us */
+			for (j = 0; j < reqs.nhistory; j++) {
+				snprintf(key, sizeof(key), "worker_%d_reqs_history_%d", i, j);
+				APPEND_STAT(key, "%u:%d:%llu", reqs.history[j].time,
+						reqs.history[j].value,
+						(unsigned long long)reqs.history[j].loop_us);
+			}
+		}
+	}
+}
+
+static const char *sched_mode_text(enum sched_mode mode) {
+	switch (mode) {
+	case sched_bytes:
+		return "bytes";
+	case sched_time:
+		return "time";
+	default:
+		return "off";
+	}
+}
+
+void process_stat_settings(ADD_STAT add_stats, conn *c) {
+	char cpus[256];
+	int i, len = 0;
+
+	assert(add_stats);
+	APPEND_STAT("maxconns", "%d", settings.maxconns);
+	APPEND_STAT("tcpport", "%d", settings.port);
+	APPEND_STAT("udpport", "%d", settings.udpport);
+	APPEND_STAT("inter", "%s", settings.inter ? settings.inter : "NULL");
+	APPEND_STAT("verbosity", "%d", settings.verbose);
+	APPEND_STAT("domain_socket", "%s",
+			settings.socketpath ? settings.socketpath : "NULL");
+	APPEND_STAT("umask", "%o", settings.access);
+	APPEND_STAT("num_threads", "%d", settings.num_threads);
+	APPEND_STAT("num_threads_per_udp", "%d", settings.num_threads_per_udp);
+	APPEND_STAT("reqs_per_event", "%d", settings.reqs_per_event);
+	APPEND_STAT("reqs_adaptive", "%s", settings.reqs_adaptive ? "yes" : "no");
+	APPEND_STAT("reqs_target_us", "%d", settings.reqs_target_us);
+	APPEND_STAT("cas_enabled", "%s", settings.use_cas ? "yes" : "no");
+	APPEND_STAT("binding_protocol", "%s",
+			prot_text(settings.binding_protocol));
+	APPEND_STAT("tcp_backlog", "%d", settings.backlog);
+	APPEND_STAT("maxconns_fast", "%s", settings.maxconns_fast ? "yes" : "no");
+	APPEND_STAT("idle_timeout", "%d", settings.idle_timeout);
+	APPEND_STAT("max_frame_size", "%d", settings.max_frame_size);
+	APPEND_STAT("sched_mode", "%s", sched_mode_text(settings.sched_mode));
+	APPEND_STAT("sched_quantum", "%d", settings.sched_quantum);
+
+	cpus[0] = '\0';
+	for (i = 0; i < settings.num_worker_cpus && len < (int) sizeof(cpus) - 8;
+			i++) {
+		len += snprintf(cpus + len, sizeof(cpus) - len, "%s%d",
+				i ? "," : "", settings.worker_cpus[i]);
+	}
+	APPEND_STAT("worker_cpus", "%s", len ? cpus : "none");
+	APPEND_STAT("main_cpu", "%d", settings.main_cpu);
+	APPEND_STAT("idle_cpu", "%d", settings.idle_cpu);
+	APPEND_STAT("numa_local", "%s", settings.numa_local ? "yes" : "no");
+	APPEND_STAT("steer_cpu", "%s", settings.steer_cpu ? "yes" : "no");
+	APPEND_STAT("busy_poll_us", "%d", settings.busy_poll_us);
+	APPEND_STAT("trace_size", "%d", settings.trace_size);
+	APPEND_STAT("trace_path", "%s", settings.trace_path);
+	APPEND_STAT("tls_port", "%d", settings.tls_port);
+	APPEND_STAT("tls_cert", "%s",
+			settings.tls_cert ? settings.tls_cert : "NULL");
+	APPEND_STAT("tls_key", "%s", settings.tls_key ? settings.tls_key : "NULL");
+	APPEND_STAT("shm_size", "%d", settings.shm_size);
+	APPEND_STAT("proxy_timeout", "%d", settings.proxy_timeout);
+}
+
+/*
+ * Tells a binary client there is no such stats group.
+ */
+static void write_bin_stats_error(conn *c) {
+	protocol_binary_response_header *header;
+	char *buf = (char *) calloc(1, sizeof(header->response));
+
+	if (buf == NULL) {
+		out_of_memory(c, "SERVER_ERROR out of memory writing stats");
+		return;
+	}
+	header = (protocol_binary_response_header *) buf;
+	header->response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header->response.opcode = PROTOCOL_BINARY_CMD_STAT;
+	header->response.status = (uint16_t) htons(
+			PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+	header->response.opaque = c->opaque;
+	write_and_free(c, buf, sizeof(header->response));
+}
+
+/*
+ * Runs the stats subcommand and sets c up to write the response.
+ */
+void process_stats(conn *c, const char *subcommand) {
+	if (subcommand == NULL || *subcommand == '\0') {
+		server_stats(&append_stats, c);
+		if (m_callback)
+			m_callback->onStats(c, "", &append_stats);
+	} else if (strcmp(subcommand, "settings") == 0) {
+		process_stat_settings(&append_stats, c);
+		if (m_callback)
+			m_callback->onStats(c, "settings", &append_stats);
+	} else if (strcmp(subcommand, "conns") == 0) {
+		process_stats_conns(&append_stats, c);
+	} else if (strcmp(subcommand, "latency") == 0) {
+		latency_append_stats(&append_stats, c);
+	} else if (strcmp(subcommand, "trace") == 0) {
+		conn_trace_append_stats(&append_stats, c);
+	} else if (m_callback && m_callback->onStats(c, subcommand, &append_stats)) {
+		/* the callback's own group */
+	} else {
+		if (c->protocol == binary_prot)
+			write_bin_stats_error(c);
+		else
+			out_string(c, "ERROR");
+		return;
+	}
+
+	/* append terminator and start the transfer */
+	append_stats(NULL, 0, NULL, 0, c);
+
+	if (c->stats.buffer == NULL) {
+		out_of_memory(c, "SERVER_ERROR out of memory writing stats");
+	} else {
+		write_and_free(c, c->stats.buffer, c->stats.offset);
+		c->stats.buffer = NULL;
+	}
+}
+
+/*
+ * Returns true if the ASCII line is a stats command.
+ */
+bool is_stats_command(char *line, char **subcommand) {
+	if (strncmp(line, "stats", 5) != 0 || (line[5] != '\0' && line[5] != ' '))
+		return false;
+	line += 5;
+	while (*line == ' ')
+		line++;
+	*subcommand = line;
+	return true;
+}
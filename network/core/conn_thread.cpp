@@ -15,6 +15,16 @@
 #include <vutils/Logger.h>
 #include <pthread.h>
 #include <event.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -42,6 +52,13 @@ static int init_count = 0;
 static pthread_mutex_t init_lock;
 static pthread_cond_t init_cond;
 
+/*
+ * NUMA node of every configured CPU, read from sysfs once by
+ * conn_thread_init() so steering an accepted conn needn't.
+ */
+static int *cpu_nodes;
+static int ncpu_nodes = 0;
+
 static void thread_libevent_process(int fd, short which, void *arg);
 
 static void wait_for_thread_registration(int nthreads) {
@@ -64,6 +81,93 @@ static void register_thread_initialized(void) {
 
 /****************************** LIBEVENT THREADS *****************************/
 
+/*
+ * Pins the calling thread to cpu.
+ */
+int conn_thread_pin(int cpu) {
+	cpu_set_t set;
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return -1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		MY_LOGE("Can't pin thread to cpu %d: %s", cpu, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Reads the NUMA node of cpu, -1 if unknown. sysfs lists it as a "nodeN"
+ * entry in the cpu's directory.
+ */
+static int read_cpu_node(int cpu) {
+	char path[64];
+	DIR *dir;
+	struct dirent *ent;
+	int node = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	if ((dir = opendir(path)) == NULL)
+		return -1;
+	while ((ent = readdir(dir)) != NULL) {
+		if (strncmp(ent->d_name, "node", 4) == 0
+				&& isdigit((unsigned char) ent->d_name[4])) {
+			node = atoi(ent->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+/*
+ * Fills in cpu_nodes, left empty if it can't be allocated.
+ */
+static void cpu_nodes_init(void) {
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	int cpu;
+
+	if (ncpus <= 0)
+		return;
+	if (ncpus > CPU_SETSIZE)
+		ncpus = CPU_SETSIZE;
+	cpu_nodes = (int *) malloc(ncpus * sizeof(int));
+	if (cpu_nodes == NULL) {
+		MY_LOGE("Can't allocate the cpu to node map");
+		return;
+	}
+	for (cpu = 0; cpu < ncpus; cpu++)
+		cpu_nodes[cpu] = read_cpu_node(cpu);
+	ncpu_nodes = (int) ncpus;
+}
+
+/*
+ * Returns the NUMA node cpu belongs to, -1 if unknown. Before
+ * conn_thread_init() it reads sysfs.
+ */
+int conn_cpu_node(int cpu) {
+	if (cpu < 0)
+		return -1;
+	if (cpu < ncpu_nodes)
+		return cpu_nodes[cpu];
+	return read_cpu_node(cpu);
+}
+
+/*
+ * Makes the calling thread allocate from its local node. This is the
+ * kernel default, but the process may have been started under a
+ * different policy (numactl --interleave).
+ */
+static void use_local_memory(void) {
+#if defined(__linux__) && defined(SYS_set_mempolicy) && defined(MPOL_LOCAL)
+	if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) != 0) {
+		MY_LOGE("Can't set local memory policy: %s", strerror(errno));
+	}
+#endif
+}
+
 /*
  * Creates a worker thread.
  */
@@ -84,7 +188,7 @@ static void create_worker(void *(*func)(void *), void *arg) {
  * Set up a thread's information.
  */
 static void setup_thread(LIBEVENT_THREAD *me) {
-	me->base = event_init();
+	me->base = event_base_new();
 	if (!me->base) {
 		MY_LOGE( "Can't allocate event base\n");
 		exit(1);
@@ -111,14 +215,135 @@ static void setup_thread(LIBEVENT_THREAD *me) {
 		MY_LOGE("Failed to initialize mutex");
 		exit(EXIT_FAILURE);
 	}
-#if 0
+	me->reqs_per_event = settings.reqs_per_event;
 	me->suffix_cache = cache_create("suffix", SUFFIX_SIZE, sizeof(char*), NULL,
 			NULL);
 	if (me->suffix_cache == NULL) {
 		MY_LOGE( "Failed to create suffix cache\n");
 		exit(EXIT_FAILURE);
 	}
-#endif
+}
+
+static uint64_t loop_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Notes that a callback of the worker's current loop iteration runs. Only
+ * -R auto and busy_poll look at the count, and only their loops reset it.
+ */
+void conn_thread_loop_event(LIBEVENT_THREAD *me) {
+	if (!settings.reqs_adaptive && settings.busy_poll_us == 0)
+		return;
+	if (me->loop_events++ == 0 && settings.reqs_adaptive)
+		me->loop_start_us = loop_now_us();
+}
+
+/*
+ * Called after every loop iteration with -R auto. Shrinks the per
+ * connection batch while the smoothed time spent running callbacks is
+ * above target, grows it again when there is headroom and connections
+ * were cut short.
+ */
+static void reqs_adapt(LIBEVENT_THREAD *me) {
+	uint64_t busy;
+	int old, val;
+
+	if (me->loop_events == 0)
+		return;
+	busy = loop_now_us() - me->loop_start_us;
+
+	pthread_mutex_lock(&me->stats.mutex);
+	if (me->loop_ewma_us == 0) {
+		me->loop_ewma_us = busy;
+		me->loop_ewma_events = me->loop_events;
+	} else {
+		me->loop_ewma_us = (me->loop_ewma_us * 7 + busy) / 8;
+		me->loop_ewma_events = (me->loop_ewma_events * 7 + me->loop_events)
+				/ 8;
+	}
+
+	old = val = me->reqs_per_event;
+	if (me->loop_ewma_us > (uint64_t) settings.reqs_target_us) {
+		val = old - (old / 4 > 1 ? old / 4 : 1);
+		if (val < REQS_ADAPT_MIN)
+			val = REQS_ADAPT_MIN;
+	} else if (me->loop_ewma_us < (uint64_t) settings.reqs_target_us / 2
+			&& me->loop_yields > 0) {
+		val = old + (old / 8 > 1 ? old / 8 : 1);
+		if (val > REQS_ADAPT_MAX)
+			val = REQS_ADAPT_MAX;
+	}
+
+	if (val != old) {
+		struct reqs_history *h = &me->reqs_history[me->reqs_history_count
+				% REQS_HISTORY_SIZE];
+		h->time = current_time;
+		h->value = val;
+		h->loop_us = me->loop_ewma_us;
+		me->reqs_history_count++;
+		me->reqs_per_event = val;
+	}
+	pthread_mutex_unlock(&me->stats.mutex);
+
+	me->loop_events = 0;
+	me->loop_yields = 0;
+}
+
+/*
+ * Event loop with -o busy_poll: polls without blocking while work keeps
+ * showing up and for busy_poll_us after the last of it, then blocks in
+ * epoll like the regular loop. Spin and sleep time land in the thread
+ * stats so the cost of the mode shows.
+ */
+static void busy_poll_loop(LIBEVENT_THREAD *me) {
+	uint64_t last_work = loop_now_us();
+	uint64_t spin_us = 0;
+	uint64_t now, start;
+
+	for (;;) {
+		start = loop_now_us();
+		if (event_base_loop(me->base, EVLOOP_NONBLOCK) == -1)
+			return;
+		now = loop_now_us();
+
+		if (me->loop_events > 0) {
+			if (settings.reqs_adaptive)
+				reqs_adapt(me);
+			me->loop_events = 0;
+			me->loop_yields = 0;
+			if (spin_us > 0) {
+				pthread_mutex_lock(&me->stats.mutex);
+				me->stats.busy_poll_spin_us += spin_us;
+				me->stats.busy_poll_hits++;
+				pthread_mutex_unlock(&me->stats.mutex);
+				spin_us = 0;
+			}
+			last_work = now;
+			continue;
+		}
+
+		spin_us += now - start;
+		if (now - last_work < (uint64_t) settings.busy_poll_us)
+			continue;
+
+		/* budget spent, sleep until the next event */
+		if (event_base_loop(me->base, EVLOOP_ONCE) == -1)
+			return;
+		last_work = loop_now_us();
+		pthread_mutex_lock(&me->stats.mutex);
+		me->stats.busy_poll_spin_us += spin_us;
+		me->stats.busy_poll_sleep_us += last_work - now;
+		me->stats.busy_poll_sleeps++;
+		pthread_mutex_unlock(&me->stats.mutex);
+		spin_us = 0;
+		if (settings.reqs_adaptive)
+			reqs_adapt(me);
+		me->loop_events = 0;
+		me->loop_yields = 0;
+	}
 }
 
 /*
@@ -126,6 +351,17 @@ static void setup_thread(LIBEVENT_THREAD *me) {
  */
 static void *worker_libevent(void *arg) {
 	LIBEVENT_THREAD *me = (LIBEVENT_THREAD *)arg;
+
+	/* Pin first and set up from here, so the event base, queue and every
+	 * conn this worker allocates are first touched on its own node. */
+	if (me->cpu >= 0 && conn_thread_pin(me->cpu) != 0) {
+		me->cpu = -1;
+		me->numa_node = -1;
+	}
+	if (settings.numa_local && me->cpu >= 0)
+		use_local_memory();
+	setup_thread(me);
+	me->trace = conn_trace_ring_new(conn_thread_id(me));
 #if 0
 	/* Any per-thread setup can happen here; memcached_thread_init() will block until
 	 * all threads have finished initializing.
@@ -138,10 +374,43 @@ static void *worker_libevent(void *arg) {
 #endif
 	register_thread_initialized();
 
-	event_base_loop(me->base, 0);
+	if (settings.busy_poll_us > 0) {
+		busy_poll_loop(me);
+		return NULL;
+	}
+	if (!settings.reqs_adaptive) {
+		event_base_loop(me->base, 0);
+		return NULL;
+	}
+
+	/* one iteration at a time so each can be measured */
+	while (event_base_loop(me->base, EVLOOP_ONCE) != -1) {
+		reqs_adapt(me);
+	}
 	return NULL;
 }
 
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+/*
+ * Lets reads on sfd poll the device queue for busy_poll_us before they
+ * sleep. Raising it above net.core.busy_read needs CAP_NET_ADMIN, which
+ * is reported once.
+ */
+static void set_busy_poll(int sfd) {
+	static bool warned = false;
+	int usec = settings.busy_poll_us;
+
+	if (setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0
+			&& !warned) {
+		warned = true;
+		MY_LOGE("setsockopt(SO_BUSY_POLL): %s, spinning in user space only",
+				strerror(errno));
+	}
+}
+
 /*
  * Processes an incoming "handle a new connection" item. This is called when
  * input arrives on the libevent wakeup pipe.
@@ -157,12 +426,27 @@ static void thread_libevent_process(int fd, short which, void *arg) {
 			MY_LOGE( "Can't read from libevent pipe\n");
 		return;
 	}
+	conn_thread_loop_event(me);
 
 	switch (buf[0]) {
 	case 'c':
+	case 'r':
+		/* new and parked conns share the queue, the item tells which */
 		item = cq_pop(me->new_conn_queue);
 
-		if (NULL != item) {
+		if (NULL != item && item->c != NULL) {
+			conn_worker_readd(item->c);
+			cqi_free(item);
+		} else if (NULL != item) {
+			if (settings.numa_local && conns[item->sfd] != NULL
+					&& conns[item->sfd]->numa_node != me->numa_node) {
+				/* the fd was last served from another node, don't reuse
+				 * its buffers */
+				conn_free(conns[item->sfd]);
+				STATS_LOCK();
+				stats_state.conn_structs--;
+				STATS_UNLOCK();
+			}
 			conn *c = conn_new(item->sfd, item->init_state, item->event_flags,
 					item->read_buffer_size, item->transport, me->base);
 			if (c == NULL) {
@@ -176,20 +460,16 @@ static void thread_libevent_process(int fd, short which, void *arg) {
 					}
 					close(item->sfd);
 				}
+				conn_thread_conn_closed(me);
 			} else {
 				c->thread = me;
+				c->numa_node = me->numa_node;
+				if (settings.busy_poll_us > 0 && IS_TCP(item->transport))
+					set_busy_poll(item->sfd);
 			}
 			cqi_free(item);
 		}
 		break;
-	case 'r':
-		item = cq_pop(me->new_conn_queue);
-
-		if (NULL != item) {
-			conn_worker_readd(item->c);
-			cqi_free(item);
-		}
-		break;
 		/* we were told to pause and report in */
 	case 'p':
 		register_thread_initialized();
@@ -209,6 +489,100 @@ static void thread_libevent_process(int fd, short which, void *arg) {
 /* Which thread we assigned a connection to most recently. */
 static int last_thread = -1;
 
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+/*
+ * Sums the stats of all workers into stats, one worker lock at a time.
+ */
+void threadlocal_stats_aggregate(struct thread_stats *stats) {
+	int tid;
+
+	memset(stats, 0, sizeof(*stats));
+	if (threads == NULL)
+		return;
+	for (tid = 0; tid < settings.num_threads; tid++) {
+		pthread_mutex_lock(&threads[tid].stats.mutex);
+#define X(name) stats->name += threads[tid].stats.name;
+		THREAD_STATS_FIELDS
+#undef X
+		pthread_mutex_unlock(&threads[tid].stats.mutex);
+	}
+}
+
+/*
+ * Returns worker tid, NULL if there is no such worker.
+ */
+LIBEVENT_THREAD *conn_thread_worker(int tid) {
+	if (threads == NULL || tid < 0 || tid >= settings.num_threads)
+		return NULL;
+	return threads + tid;
+}
+
+int conn_thread_id(LIBEVENT_THREAD *me) {
+	return (int) (me - threads);
+}
+
+/*
+ * A connection served by worker me was closed.
+ */
+void conn_thread_conn_closed(LIBEVENT_THREAD *me) {
+	__sync_fetch_and_sub(&me->curr_conns, 1);
+}
+
+/*
+ * Picks the least loaded worker, preferring those pinned to cpu and then
+ * those on node. Returns -1 if none of them qualifies.
+ */
+static int least_loaded(int cpu, int node) {
+	int best = -1;
+	int i;
+
+	for (i = 0; i < settings.num_threads; i++) {
+		int tid = (last_thread + 1 + i) % settings.num_threads;
+		if (cpu >= 0 && threads[tid].cpu != cpu)
+			continue;
+		if (node >= 0 && threads[tid].numa_node != node)
+			continue;
+		if (best < 0 || threads[tid].curr_conns < threads[best].curr_conns)
+			best = tid;
+	}
+	return best;
+}
+
+/*
+ * Chooses the worker of a new TCP connection from the CPU the kernel
+ * processed its packets on (RSS/RPS), so the worker never wakes up a
+ * remote core. A CPU without a worker falls back to the least loaded
+ * worker of its NUMA node, then of the whole process.
+ */
+static int steer_conn(int sfd) {
+	int cpu = -1;
+	socklen_t len = sizeof(cpu);
+	int tid;
+
+	if (getsockopt(sfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0
+			&& cpu >= 0) {
+		tid = least_loaded(cpu, -1);
+		if (tid >= 0) {
+			STATS_LOCK();
+			stats.steered_conns++;
+			STATS_UNLOCK();
+			return tid;
+		}
+		tid = least_loaded(-1, conn_cpu_node(cpu));
+	} else {
+		tid = -1;
+	}
+	if (tid < 0)
+		tid = least_loaded(-1, -1);
+	STATS_LOCK();
+	stats.steer_misses++;
+	STATS_UNLOCK();
+	return tid;
+}
+
 /*
  * Dispatches a new connection to another thread. This is only ever called
  * from the main thread, either during initialization (for UDP) or because
@@ -225,17 +599,23 @@ void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
 		return;
 	}
 
-	int tid = (last_thread + 1) % settings.num_threads;
+	int tid;
+	if (settings.steer_cpu && IS_TCP(transport))
+		tid = steer_conn(sfd);
+	else
+		tid = (last_thread + 1) % settings.num_threads;
 
 	LIBEVENT_THREAD *thread = threads + tid;
 
 	last_thread = tid;
+	__sync_fetch_and_add(&thread->curr_conns, 1);
 
 	item->sfd = sfd;
 	item->init_state = init_state;
 	item->event_flags = event_flags;
 	item->read_buffer_size = read_buffer_size;
 	item->transport = transport;
+	item->c = NULL;
 
 	cq_push(thread->new_conn_queue, item);
 
@@ -245,6 +625,52 @@ void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
 	}
 }
 
+/*
+ * Hands parked conn c back to its worker, from any thread.
+ */
+void conn_worker_resume(conn *c) {
+	CQ_ITEM *item = cqi_new();
+	char buf[1];
+
+	if (item == NULL) {
+		/* nothing else would ever wake it up */
+		MY_LOGE("Can't resume fd %d", c->sfd);
+		abort();
+	}
+	item->c = c;
+	cq_push(c->thread->new_conn_queue, item);
+
+	buf[0] = 'r';
+	if (write(c->thread->notify_send_fd, buf, 1) != 1) {
+		perror("Writing to thread notify pipe");
+	}
+}
+
+/*
+ * Fills in the adaptive reqs_per_event state of worker tid.
+ */
+bool conn_thread_reqs_stats(int tid, struct reqs_adapt_stats *out) {
+	LIBEVENT_THREAD *me;
+	int i, first;
+
+	if (threads == NULL || tid < 0 || tid >= settings.num_threads)
+		return false;
+	me = threads + tid;
+
+	pthread_mutex_lock(&me->stats.mutex);
+	out->current = me->reqs_per_event;
+	out->loop_us = me->loop_ewma_us;
+	out->loop_events = me->loop_ewma_events;
+	out->nhistory = me->reqs_history_count < REQS_HISTORY_SIZE ?
+			me->reqs_history_count : REQS_HISTORY_SIZE;
+	first = me->reqs_history_count - out->nhistory;
+	for (i = 0; i < out->nhistory; i++) {
+		out->history[i] = me->reqs_history[(first + i) % REQS_HISTORY_SIZE];
+	}
+	pthread_mutex_unlock(&me->stats.mutex);
+	return true;
+}
+
 /*
  * Initializes the thread subsystem, creating various worker threads.
  *
@@ -257,6 +683,7 @@ void conn_thread_init(int nthreads) {
 	pthread_cond_init(&init_cond, NULL);
 
 	cq_freelist_init();
+	cpu_nodes_init();
 
 	threads = (LIBEVENT_THREAD *)calloc(nthreads, sizeof(LIBEVENT_THREAD));
 	if (!threads) {
@@ -274,12 +701,18 @@ void conn_thread_init(int nthreads) {
 		threads[i].notify_receive_fd = fds[0];
 		threads[i].notify_send_fd = fds[1];
 
-		setup_thread(&threads[i]);
+		if (settings.num_worker_cpus > 0) {
+			threads[i].cpu = settings.worker_cpus[i % settings.num_worker_cpus];
+			threads[i].numa_node = conn_cpu_node(threads[i].cpu);
+		} else {
+			threads[i].cpu = -1;
+			threads[i].numa_node = -1;
+		}
 		/* Reserve three fds for the libevent base, and two for the pipe */
 		stats_state.reserved_fds += 5;
 	}
 
-	/* Create threads after we've done all the libevent setup. */
+	/* Each worker does its own libevent setup once it is placed. */
 	for (i = 0; i < nthreads; i++) {
 		create_worker(worker_libevent, &threads[i]);
 	}
@@ -288,5 +721,12 @@ void conn_thread_init(int nthreads) {
 	pthread_mutex_lock(&init_lock);
 	wait_for_thread_registration(nthreads);
 	pthread_mutex_unlock(&init_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		MY_LOGD("worker %d: cpu %d, numa node %d%s", i, threads[i].cpu,
+				threads[i].numa_node,
+				settings.numa_local && threads[i].cpu >= 0 ?
+						", local memory" : "");
+	}
 }
 
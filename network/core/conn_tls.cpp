@@ -0,0 +1,225 @@
+/*
+ * conn_tls.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_tls.h>
+#include <network/core/conn_thread.h>
+#include <vutils/Logger.h>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_tls"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+#ifdef HAVE_OPENSSL
+
+static SSL_CTX *tls_ctx;
+
+static void tls_log_errors(const char *what) {
+	unsigned long err;
+	char buf[256];
+
+	while ((err = ERR_get_error()) != 0) {
+		ERR_error_string_n(err, buf, sizeof(buf));
+		MY_LOGE("%s: %s", what, buf);
+	}
+}
+
+int conn_tls_init(void) {
+	if (settings.tls_cert == NULL || settings.tls_key == NULL) {
+		MY_LOGE("tls_port needs tls_cert and tls_key");
+		return -1;
+	}
+	tls_ctx = SSL_CTX_new(TLS_server_method());
+	if (tls_ctx == NULL) {
+		tls_log_errors("SSL_CTX_new");
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+	/* kTLS takes over records once the handshake is done, OpenSSL 3.0 on;
+	 * partial writes let transmit() handle SSL_write() like sendmsg() */
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+	SSL_CTX_set_mode(tls_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE
+			| SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+	if (SSL_CTX_use_certificate_chain_file(tls_ctx, settings.tls_cert) != 1
+			|| SSL_CTX_use_PrivateKey_file(tls_ctx, settings.tls_key,
+					SSL_FILETYPE_PEM) != 1
+			|| SSL_CTX_check_private_key(tls_ctx) != 1) {
+		tls_log_errors(settings.tls_cert);
+		SSL_CTX_free(tls_ctx);
+		tls_ctx = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Maps an SSL error to errno, EAGAIN when it only has to wait.
+ */
+static int tls_errno(conn *c, int ret) {
+	switch (SSL_get_error(c->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+	case SSL_ERROR_WANT_WRITE:
+		return EAGAIN;
+	case SSL_ERROR_ZERO_RETURN:
+		return 0;
+	case SSL_ERROR_SYSCALL:
+		return errno ? errno : ECONNRESET;
+	default:
+		if (settings.verbose > 0)
+			tls_log_errors("TLS");
+		else
+			ERR_clear_error();
+		return EPROTO;
+	}
+}
+
+int conn_tls_accept(conn *c, short *want) {
+	int ret;
+
+	if (c->ssl == NULL) {
+		c->ssl = SSL_new(tls_ctx);
+		if (c->ssl == NULL || SSL_set_fd(c->ssl, c->sfd) != 1) {
+			tls_log_errors("SSL_new");
+			return -1;
+		}
+		c->tls = true;
+		c->ktls_tx = false;
+	}
+
+	ret = SSL_accept(c->ssl);
+	if (ret == 1) {
+#ifdef BIO_get_ktls_send
+		c->ktls_tx = BIO_get_ktls_send(SSL_get_wbio(c->ssl)) > 0;
+#endif
+		pthread_mutex_lock(&c->thread->stats.mutex);
+		c->thread->stats.tls_handshakes++;
+		if (c->ktls_tx)
+			c->thread->stats.tls_ktls_tx++;
+		pthread_mutex_unlock(&c->thread->stats.mutex);
+		if (settings.verbose > 1) {
+			MY_LOGE("<%d %s %s, sends encrypted by the %s", c->sfd,
+					SSL_get_version(c->ssl), SSL_get_cipher_name(c->ssl),
+					c->ktls_tx ? "kernel" : "library");
+		}
+		return 1;
+	}
+
+	switch (SSL_get_error(c->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		*want = EV_READ;
+		return 0;
+	case SSL_ERROR_WANT_WRITE:
+		*want = EV_WRITE;
+		return 0;
+	default:
+		if (settings.verbose > 0)
+			tls_log_errors("SSL_accept");
+		else
+			ERR_clear_error();
+		pthread_mutex_lock(&c->thread->stats.mutex);
+		c->thread->stats.tls_failures++;
+		pthread_mutex_unlock(&c->thread->stats.mutex);
+		return -1;
+	}
+}
+
+ssize_t conn_tls_read(conn *c, void *buf, size_t len) {
+	int ret = SSL_read(c->ssl, buf, len);
+
+	if (ret > 0)
+		return ret;
+	errno = tls_errno(c, ret);
+	return errno == 0 ? 0 : -1;
+}
+
+ssize_t conn_tls_sendmsg(conn *c, const struct msghdr *m) {
+	ssize_t total = 0;
+	size_t i;
+
+	if (c->ktls_tx)
+		return sendmsg(c->sfd, m, 0);
+
+	for (i = 0; i < m->msg_iovlen; i++) {
+		const struct iovec *iov = &m->msg_iov[i];
+		int ret;
+
+		if (iov->iov_len == 0)
+			continue;
+		ret = SSL_write(c->ssl, iov->iov_base, iov->iov_len);
+		if (ret <= 0) {
+			if (total > 0)
+				break;
+			errno = tls_errno(c, ret);
+			if (errno == 0)
+				errno = EPIPE;
+			return -1;
+		}
+		total += ret;
+		if ((size_t) ret < iov->iov_len)
+			break;
+	}
+	return total;
+}
+
+void conn_tls_close(conn *c) {
+	if (c->ssl == NULL)
+		return;
+	/* one non-blocking close_notify, we don't wait for the peer's */
+	if (SSL_is_init_finished(c->ssl))
+		SSL_shutdown(c->ssl);
+	ERR_clear_error();
+	SSL_free(c->ssl);
+	c->ssl = NULL;
+	c->ktls_tx = false;
+}
+
+#else /* !HAVE_OPENSSL */
+
+int conn_tls_init(void) {
+	MY_LOGE("built without OpenSSL, tls_port can't be used");
+	return -1;
+}
+
+int conn_tls_accept(conn *c, short *want) {
+	return -1;
+}
+
+ssize_t conn_tls_read(conn *c, void *buf, size_t len) {
+	errno = EPROTO;
+	return -1;
+}
+
+ssize_t conn_tls_sendmsg(conn *c, const struct msghdr *m) {
+	errno = EPROTO;
+	return -1;
+}
+
+void conn_tls_close(conn *c) {
+}
+
+#endif /* HAVE_OPENSSL */
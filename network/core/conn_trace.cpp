@@ -0,0 +1,252 @@
+/*
+ * conn_trace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/core/conn_trace.h>
+#include <network/core/conn_thread.h>
+#include <network/core/conn_stats.h>
+#include <vutils/Logger.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "conn_trace"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/* one per worker and one for the accept thread */
+#define TRACE_RINGS_MAX 1025
+
+struct conn_trace_ring {
+	struct conn_trace_ring_hdr hdr;
+	struct conn_trace_rec recs[];
+};
+
+static conn_trace_ring *rings[TRACE_RINGS_MAX];
+static int nrings = 0;
+static conn_trace_ring *main_ring;
+static uint32_t ring_size = 0;
+static char dump_path[PATH_MAX];
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+static void trace_dump_handler(int sig) {
+	int saved = errno;
+	conn_trace_dump();
+	errno = saved;
+}
+
+/* dump, then let the default action produce the core */
+static void trace_crash_handler(int sig) {
+	conn_trace_dump();
+	raise(sig);
+}
+
+/*
+ * Sets up tracing from settings, installs the dump signal handlers.
+ */
+void conn_trace_init(void) {
+	struct sigaction sa;
+	size_t i;
+
+	if (settings.trace_size <= 0)
+		return;
+	ring_size = 1;
+	while (ring_size < (uint32_t) settings.trace_size)
+		ring_size <<= 1;
+	snprintf(dump_path, sizeof(dump_path), "%s.%ld", settings.trace_path,
+			(long) getpid());
+
+	main_ring = conn_trace_ring_new(-1);
+
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = trace_dump_handler;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &sa, NULL);
+
+	sa.sa_handler = trace_crash_handler;
+	sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+	for (i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+		sigaction(crash_signals[i], &sa, NULL);
+
+	MY_LOGD("tracing %u records per thread, SIGUSR2 dumps to %s", ring_size,
+			dump_path);
+}
+
+/*
+ * Creates the ring of worker tid, from the thread that will write it.
+ */
+conn_trace_ring *conn_trace_ring_new(int tid) {
+	conn_trace_ring *ring;
+	int slot;
+
+	if (ring_size == 0)
+		return NULL;
+	ring = (conn_trace_ring *) calloc(1,
+			sizeof(*ring) + ring_size * sizeof(struct conn_trace_rec));
+	if (ring == NULL) {
+		MY_LOGE("Can't allocate trace ring, thread %d is not traced", tid);
+		return NULL;
+	}
+	ring->hdr.tid = tid;
+	ring->hdr.size = ring_size;
+
+	slot = __sync_fetch_and_add(&nrings, 1);
+	if (slot >= TRACE_RINGS_MAX) {
+		free(ring);
+		return NULL;
+	}
+	__atomic_store_n(&rings[slot], ring, __ATOMIC_RELEASE);
+	return ring;
+}
+
+/*
+ * Records one event of c in the ring of the thread serving it.
+ */
+void conn_trace(conn *c, enum trace_kind kind, int from, int to,
+		int64_t bytes) {
+	conn_trace_ring *ring = c->thread ? c->thread->trace : main_ring;
+	struct conn_trace_rec *rec;
+	struct timespec ts;
+	uint64_t head;
+
+	if (ring == NULL)
+		return;
+	head = ring->hdr.head;
+	rec = &ring->recs[head & (ring->hdr.size - 1)];
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->ts_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	rec->fd = c->sfd;
+	rec->kind = kind;
+	rec->from = from;
+	rec->to = to;
+	rec->bytes = bytes;
+	__atomic_store_n(&ring->hdr.head, head + 1, __ATOMIC_RELEASE);
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+	const char *p = (const char *) buf;
+	while (len > 0) {
+		ssize_t res = write(fd, p, len);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			return false;
+		p += res;
+		len -= res;
+	}
+	return true;
+}
+
+/*
+ * Writes all rings to the dump file. Only uses async signal safe calls.
+ */
+int conn_trace_dump(void) {
+	struct conn_trace_file_hdr fhdr;
+	int n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+	int fd, i;
+	bool ok;
+
+	if (ring_size == 0)
+		return -1;
+	if (n > TRACE_RINGS_MAX)
+		n = TRACE_RINGS_MAX;
+	fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+
+	fhdr.magic = TRACE_MAGIC;
+	fhdr.version = TRACE_VERSION;
+	fhdr.rec_size = sizeof(struct conn_trace_rec);
+	fhdr.nrings = 0;
+	for (i = 0; i < n; i++) {
+		if (__atomic_load_n(&rings[i], __ATOMIC_ACQUIRE) != NULL)
+			fhdr.nrings++;
+	}
+	ok = write_all(fd, &fhdr, sizeof(fhdr));
+	for (i = 0; i < n && ok; i++) {
+		conn_trace_ring *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+		struct conn_trace_ring_hdr hdr;
+		if (ring == NULL)
+			continue;
+		hdr = ring->hdr;
+		hdr.head = __atomic_load_n(&ring->hdr.head, __ATOMIC_ACQUIRE);
+		ok = write_all(fd, &hdr, sizeof(hdr))
+				&& write_all(fd, ring->recs,
+						hdr.size * sizeof(struct conn_trace_rec));
+	}
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+static const char *trace_kind_text(int kind) {
+	switch (kind) {
+	case trace_state:
+		return "state";
+	case trace_read:
+		return "read";
+	case trace_write:
+		return "write";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * "stats trace": "<tid>:<seq>" -> "<ts_ns> <fd> <kind> <detail>", oldest
+ * first per ring.
+ */
+void conn_trace_append_stats(ADD_STAT add_stats, conn *c) {
+	int n = __atomic_load_n(&nrings, __ATOMIC_ACQUIRE);
+	char key[64];
+	int i;
+
+	if (n > TRACE_RINGS_MAX)
+		n = TRACE_RINGS_MAX;
+	for (i = 0; i < n; i++) {
+		conn_trace_ring *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+		uint64_t head, seq;
+		if (ring == NULL)
+			continue;
+		head = __atomic_load_n(&ring->hdr.head, __ATOMIC_ACQUIRE);
+		seq = head > ring->hdr.size ? head - ring->hdr.size : 0;
+		for (; seq < head; seq++) {
+			struct conn_trace_rec rec = ring->recs[seq & (ring->hdr.size - 1)];
+			snprintf(key, sizeof(key), "%d:%llu", ring->hdr.tid,
+					(unsigned long long) seq);
+			if (rec.kind == trace_state && rec.from < conn_max_state
+					&& rec.to < conn_max_state) {
+				append_stat(key, add_stats, c, "%llu %d state %s %s",
+						(unsigned long long) rec.ts_ns, rec.fd,
+						state_text((enum conn_states) rec.from),
+						state_text((enum conn_states) rec.to));
+			} else {
+				append_stat(key, add_stats, c, "%llu %d %s %lld",
+						(unsigned long long) rec.ts_ns, rec.fd,
+						trace_kind_text(rec.kind), (long long) rec.bytes);
+			}
+		}
+	}
+}
@@ -163,6 +163,39 @@ bool safe_strtod(const char *str, double *out) {
 	return false;
 }
 
+bool parse_cpu_list(const char *str, int *cpus, int max, int *count) {
+	const char *p = str;
+	char *end;
+	*count = 0;
+
+	while (*p != '\0') {
+		long first, last;
+		errno = 0;
+		first = strtol(p, &end, 10);
+		if (end == p || errno == ERANGE || first < 0)
+			return false;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p || errno == ERANGE || last < first)
+				return false;
+			p = end;
+		}
+		for (long cpu = first; cpu <= last; cpu++) {
+			if (*count == max)
+				return false;
+			cpus[(*count)++] = (int) cpu;
+		}
+		if (*p == ',')
+			p++;
+		else if (*p != '\0')
+			return false;
+	}
+	return *count > 0;
+}
+
 void vperror(const char *fmt, ...) {
 	int old_errno = errno;
 	char buf[1024];
@@ -181,16 +214,11 @@ void vperror(const char *fmt, ...) {
 
 #ifndef HAVE_HTONLL
 static uint64_t mc_swap64(uint64_t in) {
-#ifdef ENDIAN_LITTLE
-	/* Little endian, flip the bytes around until someone makes a faster/better
-	 * way to do this. */
-	int64_t rv = 0;
-	int i = 0;
-	for(i = 0; i<8; i++) {
-		rv = (rv << 8) | (in & 0xff);
-		in >>= 8;
-	}
-	return rv;
+	/* nothing defines ENDIAN_LITTLE in this build, ask the compiler too,
+	 * or 64 bit fields (cas, incr deltas) go out in host order */
+#if defined(ENDIAN_LITTLE) || (defined(__BYTE_ORDER__) \
+		&& __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	return __builtin_bswap64(in);
 #else
 	/* big-endian machines don't need byte swapping */
 	return in;
@@ -13,6 +13,10 @@
 #include <network/core/conn_wrap.h>
 #include <network/core/conn_utils.h>
 #include <network/core/conn_thread.h>
+#include <network/core/conn_stats.h>
+#include <network/core/conn_trace.h>
+#include <network/core/conn_tls.h>
+#include <network/core/conn_shm.h>
 #include <vutils/Logger.h>
 #include <sys/stat.h>
 
@@ -42,7 +46,17 @@
 enum transmit_result transmit(conn *c) {
 	assert(c != NULL);
 
-	if (c->msgcurr < c->msgused && c->msglist[c->msgcurr].msg_iovlen == 0) {
+	while (c->msgcurr < c->msgused) {
+		struct msghdr *m = &c->msglist[c->msgcurr];
+
+		/* entries emptied after they were queued, e.g. a value that is
+		 gone from the flash tier, would make a zero length write */
+		while (m->msg_iovlen > 0 && m->msg_iov->iov_len == 0) {
+			m->msg_iovlen--;
+			m->msg_iov++;
+		}
+		if (m->msg_iovlen > 0)
+			break;
 		/* Finished writing the current msg; advance to the next. */
 		c->msgcurr++;
 	}
@@ -50,11 +64,18 @@ enum transmit_result transmit(conn *c) {
 		ssize_t res;
 		struct msghdr *m = &c->msglist[c->msgcurr];
 
-		res = sendmsg(c->sfd, m, 0);
+		if (IS_SHM(c->transport))
+			res = conn_shm_sendmsg(c, m);
+		else if (c->ssl)
+			res = conn_tls_sendmsg(c, m);
+		else
+			res = sendmsg(c->sfd, m, 0);
+		conn_trace(c, trace_write, c->state, c->state, res < 0 ? -errno : res);
 		if (res > 0) {
 			pthread_mutex_lock(&c->thread->stats.mutex);
 			c->thread->stats.bytes_written += res;
 			pthread_mutex_unlock(&c->thread->stats.mutex);
+			c->sched.bytes += res;
 
 			/* We've written some of the data. Remove the completed
 			 iovec entries from the list of pending writes. */
@@ -73,7 +94,9 @@ enum transmit_result transmit(conn *c) {
 			return TRANSMIT_INCOMPLETE;
 		}
 		if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			if (!update_event(c, EV_WRITE | EV_PERSIST)) {
+			/* a full shm ring is signalled on the conn's eventfd */
+			if (!update_event(c, (IS_SHM(c->transport) ? EV_READ : EV_WRITE)
+					| EV_PERSIST)) {
 				if (settings.verbose > 0)
 					fprintf(stderr, "Couldn't update event\n");
 				conn_set_state(c, conn_closing);
@@ -249,6 +272,76 @@ int add_msghdr(conn *c) {
 	return 0;
 }
 
+int conn_add_item(conn *c, void *it) {
+	return conn_add_item_release(c, it, NULL);
+}
+
+int conn_add_item_release(conn *c, void *it, conn_item_release release) {
+	int used = c->icurr - c->ilist + c->ileft;
+
+	if (used == c->isize) {
+		conn_item_ref *newbuf = (conn_item_ref *) realloc(c->ilist,
+				sizeof(c->ilist[0]) * c->isize * 2);
+		if (newbuf == NULL) {
+			STATS_LOCK();
+			stats.malloc_fails++;
+			STATS_UNLOCK();
+			return -1;
+		}
+		c->icurr = newbuf + (c->icurr - c->ilist);
+		c->ilist = newbuf;
+		c->isize *= 2;
+	}
+	c->ilist[used].it = it;
+	c->ilist[used].release = release;
+	c->ileft++;
+	return 0;
+}
+
+char *conn_add_suffix(conn *c) {
+	int used = c->suffixcurr - c->suffixlist + c->suffixleft;
+	char *suffix;
+
+	if (used == c->suffixsize) {
+		char **newbuf = (char **) realloc(c->suffixlist,
+				sizeof(c->suffixlist[0]) * c->suffixsize * 2);
+		if (newbuf == NULL) {
+			STATS_LOCK();
+			stats.malloc_fails++;
+			STATS_UNLOCK();
+			return NULL;
+		}
+		c->suffixcurr = newbuf + (c->suffixcurr - c->suffixlist);
+		c->suffixlist = newbuf;
+		c->suffixsize *= 2;
+	}
+	suffix = (char *) cache_alloc(c->thread->suffix_cache);
+	if (suffix == NULL) {
+		STATS_LOCK();
+		stats.malloc_fails++;
+		STATS_UNLOCK();
+		return NULL;
+	}
+	c->suffixlist[used] = suffix;
+	c->suffixleft++;
+	return suffix;
+}
+
+void conn_release_items(conn *c) {
+	assert(c != NULL);
+
+	for (; c->ileft > 0; c->ileft--, c->icurr++) {
+		if (c->icurr->release != NULL)
+			c->icurr->release(c, c->icurr->it);
+		else
+			m_callback->onItemRelease(c, c->icurr->it);
+	}
+	for (; c->suffixleft > 0; c->suffixleft--, c->suffixcurr++)
+		cache_free(c->thread->suffix_cache, *(c->suffixcurr));
+	c->icurr = c->ilist;
+	c->suffixcurr = c->suffixlist;
+}
+
 /* set up a connection to write a buffer then free it, used for stats */
 void write_and_free(conn *c, char *buf, int bytes) {
 	if (buf) {
@@ -325,6 +418,7 @@ void out_string(conn *c, const char *str) {
 		MY_LOGE( ">%d %s\n", c->sfd, str);
 
 	/* Nuke a partial output... */
+	conn_release_items(c);
 	c->msgcurr = 0;
 	c->msgused = 0;
 	c->iovused = 0;
@@ -351,7 +445,7 @@ void out_string(conn *c, const char *str) {
  * Outputs a protocol-specific "out of memory" error. For ASCII clients,
  * this is equivalent to out_string().
  */
-void out_of_memory(conn *c, char *ascii_error) {
+void out_of_memory(conn *c, const char *ascii_error) {
 	const static char error_prefix[] = "SERVER_ERROR ";
 	const static int error_prefix_len = sizeof(error_prefix) - 1;
 #if 0
@@ -370,14 +464,182 @@ void out_of_memory(conn *c, char *ascii_error) {
 }
 
 /*
- * if we have a complete line in the buffer, process it.
+ * Dispatches one binary frame, c->rcurr points at its header.
+ */
+static int dispatch_bin_frame(conn *c, const conn_frame *frame) {
+#ifdef NEED_ALIGN
+	if (((long) (c->rcurr)) % 8 != 0) {
+		/* must realign input buffer */
+		memmove(c->rbuf, c->rcurr, c->rbytes);
+		c->rcurr = c->rbuf;
+		c->frame_anchor = c->rcurr;
+		if (settings.verbose > 1) {
+			MY_LOGE( "%d: Realign input buffer\n", c->sfd);
+		}
+	}
+#endif
+	protocol_binary_request_header* req;
+	req = (protocol_binary_request_header*) c->rcurr;
+
+	if (settings.verbose > 1) {
+		/* Dump the packet before we convert it to host order */
+		int ii;
+		MY_LOGE( "<%d Read binary protocol data:", c->sfd);
+		for (ii = 0; ii < sizeof(req->bytes); ++ii) {
+			if (ii % 4 == 0) {
+				MY_LOGE( "\n<%d   ", c->sfd);
+			}
+			MY_LOGE( " 0x%02x", req->bytes[ii]);
+		}
+		MY_LOGE( "\n");
+	}
+
+	c->binary_header = *req;
+	c->binary_header.request.keylen = ntohs(req->request.keylen);
+	c->binary_header.request.bodylen = ntohl(req->request.bodylen);
+	c->binary_header.request.cas = ntohll(req->request.cas);
+
+	if (c->binary_header.request.magic != PROTOCOL_BINARY_REQ) {
+		if (settings.verbose) {
+			MY_LOGE( "Invalid magic:  %x\n",
+					c->binary_header.request.magic);
+		}
+		conn_set_state(c, conn_closing);
+		return -1;
+	}
+
+	c->msgcurr = 0;
+	c->msgused = 0;
+	c->iovused = 0;
+	if (add_msghdr(c) != 0) {
+		out_of_memory(c,
+				"SERVER_ERROR Out of memory allocating headers");
+		c->nframes = 0;
+		return 0;
+	}
+
+	c->cmd = c->binary_header.request.opcode;
+	latency_request_op(c, LAT_OP_BINARY + c->cmd);
+	c->keylen = c->binary_header.request.keylen;
+	c->opaque = c->binary_header.request.opaque;
+	/* clear the returned cas value */
+	c->cas = 0;
+
+	/* the whole frame is in rbuf, the body follows the header */
+	if (c->cmd == PROTOCOL_BINARY_CMD_STAT) {
+		char subcommand[KEY_MAX_LENGTH + 1];
+		int keylen = c->keylen;
+		if (keylen > KEY_MAX_LENGTH
+				|| keylen + c->binary_header.request.extlen
+						> (int) c->binary_header.request.bodylen) {
+			keylen = 0;
+		}
+		memcpy(subcommand, c->rcurr + frame->hdrlen
+				+ c->binary_header.request.extlen, keylen);
+		subcommand[keylen] = '\0';
+		process_stats(c, subcommand);
+	} else if (m_callback)
+		m_callback->onBinaryEventDispatch(c);
+	//dispatch_bin_command(c);
+
+	c->rbytes -= frame->len;
+	c->rcurr += frame->len;
+	return 1;
+}
+
+/*
+ * Hands a binary request whose frame is over -I to the callback, header
+ * only, so it can answer it while the body is swallowed. Returns false if
+ * the header itself is bad, or too little of it is in.
+ */
+static bool dispatch_bin_too_large(conn *c) {
+	protocol_binary_request_header *req =
+			(protocol_binary_request_header *) c->rcurr;
+
+	if (c->rbytes < (int) sizeof(req->bytes)
+			|| req->request.magic != PROTOCOL_BINARY_REQ
+			|| ntohl(req->request.bodylen) > INT32_MAX || IS_UDP(c->transport))
+		return false;
+
+	c->binary_header = *req;
+	c->binary_header.request.keylen = ntohs(req->request.keylen);
+	c->binary_header.request.bodylen = ntohl(req->request.bodylen);
+	c->binary_header.request.cas = ntohll(req->request.cas);
+	c->msgcurr = 0;
+	c->msgused = 0;
+	c->iovused = 0;
+	if (add_msghdr(c) != 0)
+		return false;
+	c->cmd = c->binary_header.request.opcode;
+	c->keylen = c->binary_header.request.keylen;
+	c->opaque = c->binary_header.request.opaque;
+	c->cas = 0;
+	c->sbytes = c->binary_header.request.bodylen;
+	c->rcurr += sizeof(req->bytes);
+	c->rbytes -= sizeof(req->bytes);
+	c->frame_anchor = c->rcurr;
+	c->last_cmd_time = current_time;
+
+	conn_set_state(c, conn_closing);
+	if (m_callback)
+		m_callback->onFrameTooLarge(c);
+	return c->state != conn_closing;
+}
+
+/*
+ * Dispatches one ASCII line, the line is handed out NUL terminated.
+ */
+static int dispatch_ascii_frame(conn *c, const conn_frame *frame) {
+	char *el, *cont, *subcommand;
+
+	/* the line without its "\r\n", framing_scan() found where it ends */
+	cont = c->rcurr + frame->len;
+	el = cont - frame->trailer;
+	*el = '\0';
+
+	assert(cont <= (c->rcurr + c->rbytes));
+
+	c->last_cmd_time = current_time;
+	latency_request_op(c, latency_ascii_op(c->rcurr));
+	if (is_stats_command(c->rcurr, &subcommand)) {
+		c->msgcurr = 0;
+		c->msgused = 0;
+		c->iovused = 0;
+		if (add_msghdr(c) != 0)
+			out_of_memory(c, "SERVER_ERROR out of memory preparing response");
+		else
+			process_stats(c, subcommand);
+	} else if (is_shm_command(c->rcurr)) {
+		if (conn_shm_upgrade(c) != 0)
+			out_string(c, "ERROR");
+	} else if (m_callback)
+		m_callback->onAsciiEventDispatch(c);
+
+	c->rbytes -= (cont - c->rcurr);
+	c->rcurr = cont;
+	assert(c->rcurr <= (c->rbuf + c->rsize));
+	return 1;
+}
+
+/*
+ * if we have complete frames in the buffer, process them.
+ *
+ * rbuf is scanned once per read: the frames found are cached in the conn
+ * and handed to the callback as a batch, or one per call when the callback
+ * doesn't take batches.
  */
 int try_read_command(conn *c) {
+	const conn_framing *f;
+	const conn_frame *frame;
+	int res;
+
 	assert(c != NULL);
 	assert(c->rcurr <= (c->rbuf + c->rsize));
 	assert(c->rbytes > 0);
 
-	if (c->protocol == negotiating_prot || c->transport == udp_transport) {
+	if (c->framing == NULL
+			&& (c->protocol == negotiating_prot
+					|| c->transport == udp_transport)) {
 		if ((unsigned char) c->rbuf[0] == (unsigned char) PROTOCOL_BINARY_REQ) {
 			c->protocol = binary_prot;
 		} else {
@@ -390,123 +652,72 @@ int try_read_command(conn *c) {
 		}
 	}
 
-	if (c->protocol == binary_prot) {
-		/* Do we have the complete packet header? */
-		if (c->rbytes < sizeof(c->binary_header)) {
-			/* need more data! */
-			return 0;
-		} else {
-#ifdef NEED_ALIGN
-			if (((long) (c->rcurr)) % 8 != 0) {
-				/* must realign input buffer */
-				memmove(c->rbuf, c->rcurr, c->rbytes);
-				c->rcurr = c->rbuf;
-				if (settings.verbose > 1) {
-					MY_LOGE( "%d: Realign input buffer\n", c->sfd);
-				}
-			}
-#endif
-			protocol_binary_request_header* req;
-			req = (protocol_binary_request_header*) c->rcurr;
-
-			if (settings.verbose > 1) {
-				/* Dump the packet before we convert it to host order */
-				int ii;
-				MY_LOGE( "<%d Read binary protocol data:", c->sfd);
-				for (ii = 0; ii < sizeof(req->bytes); ++ii) {
-					if (ii % 4 == 0) {
-						MY_LOGE( "\n<%d   ", c->sfd);
-					}
-					MY_LOGE( " 0x%02x", req->bytes[ii]);
-				}
-				MY_LOGE( "\n");
-			}
-
-			c->binary_header = *req;
-			c->binary_header.request.keylen = ntohs(req->request.keylen);
-			c->binary_header.request.bodylen = ntohl(req->request.bodylen);
-			c->binary_header.request.cas = ntohll(req->request.cas);
-
-			if (c->binary_header.request.magic != PROTOCOL_BINARY_REQ) {
-				if (settings.verbose) {
-					MY_LOGE( "Invalid magic:  %x\n",
-							c->binary_header.request.magic);
-				}
-				conn_set_state(c, conn_closing);
-				return -1;
-			}
-
-			c->msgcurr = 0;
-			c->msgused = 0;
-			c->iovused = 0;
-			if (add_msghdr(c) != 0) {
-				out_of_memory(c,
-						"SERVER_ERROR Out of memory allocating headers");
-				return 0;
-			}
-
-			c->cmd = c->binary_header.request.opcode;
-			c->keylen = c->binary_header.request.keylen;
-			c->opaque = c->binary_header.request.opaque;
-			/* clear the returned cas value */
-			c->cas = 0;
-
-			if (m_callback)
-				m_callback->onBinaryEventDispatch(c);
-			//dispatch_bin_command(c);
-
-			c->rbytes -= sizeof(c->binary_header);
-			c->rcurr += sizeof(c->binary_header);
-		}
+	if (c->framing != NULL) {
+		f = c->framing;
 	} else {
+		f = c->protocol == binary_prot ? &framing_binary : &framing_ascii;
+	}
 
-		char *el, *cont;
-
-		if (c->rbytes == 0)
-			return 0;
-
-		el = (char *) memchr((void *) c->rcurr, '\n', c->rbytes);
-		if (!el) {
-#if 0
-			if (c->rbytes > 1024) {
-				/*
-				 * We didn't have a '\n' in the first k. This _has_ to be a
-				 * large multiget, if not we should just nuke the connection.
-				 */
-				char *ptr = c->rcurr;
-				while (*ptr == ' ') { /* ignore leading whitespaces */
-					++ptr;
-				}
-
-				if (ptr - c->rcurr > 100
-						|| (strncmp(ptr, "get ", 4) && strncmp(ptr, "gets ", 5))) {
-
-					conn_set_state(c, conn_closing);
-					return 1;
-				}
+	/* frames cached from the last scan are only good while rcurr is where
+	 * we left it; conn_shrink() or a handler may have moved it */
+	if (c->framecurr >= c->nframes || c->frame_anchor != c->rcurr) {
+		c->nframes = c->framecurr = 0;
+		res = framing_scan(f, c->rcurr, c->rbytes, c->frames,
+				FRAME_BATCH_MAX);
+		if (res < 0) {
+			if (c->framing == NULL && c->protocol == binary_prot
+					&& dispatch_bin_too_large(c))
+				return 1;
+			if (settings.verbose) {
+				MY_LOGE( "%d: Invalid or oversized frame\n", c->sfd);
 			}
-#endif
+			conn_set_state(c, conn_closing);
+			return -1;
+		}
+		if (res == 0) {
+			/* need more data! */
 			return 0;
 		}
-		cont = el + 1;
-		if ((el - c->rcurr) > 1 && *(el - 1) == '\r') {
-			el--;
+		c->nframes = res;
+		c->frame_anchor = c->rcurr;
+
+		if (m_callback
+				&& m_callback->onFrameBatchDispatch(c, c->frames, c->nframes)) {
+			int i, total = 0;
+			for (i = 0; i < c->nframes; i++)
+				total += c->frames[i].len;
+			c->last_cmd_time = current_time;
+			c->rbytes -= total;
+			c->rcurr += total;
+			c->sched.bytes += total;
+			c->nframes = c->framecurr = 0;
+			if (c->state == conn_parse_cmd)
+				conn_set_state(c, conn_new_cmd);
+			return 1;
 		}
-		*el = '\0';
-
-		assert(cont <= (c->rcurr + c->rbytes));
+	}
 
+	frame = &c->frames[c->framecurr++];
+	if (c->framing != NULL) {
 		c->last_cmd_time = current_time;
+		latency_request_op(c, LAT_OP_FRAME);
 		if (m_callback)
-			m_callback->onAsciiEventDispatch(c);
-
-		c->rbytes -= (cont - c->rcurr);
-		c->rcurr = cont;
-		assert(c->rcurr <= (c->rbuf + c->rsize));
-
+			m_callback->onFrameDispatch(c, frame);
+		c->rbytes -= frame->len;
+		c->rcurr += frame->len;
+		if (c->state == conn_parse_cmd)
+			conn_set_state(c, conn_new_cmd);
+		res = 1;
+	} else if (c->protocol == binary_prot) {
+		res = dispatch_bin_frame(c, frame);
+	} else {
+		res = dispatch_ascii_frame(c, frame);
 	}
+	if (res > 0)
+		c->sched.bytes += frame->len;
+	c->frame_anchor = c->rcurr;
 
-	return 1;
+	return res;
 }
 
 /*
@@ -520,6 +731,7 @@ enum try_read_result try_read_udp(conn *c) {
 	c->request_addr_size = sizeof(c->request_addr);
 	res = recvfrom(c->sfd, c->rbuf, c->rsize, 0,
 			(struct sockaddr *) &c->request_addr, &c->request_addr_size);
+	conn_trace(c, trace_read, c->state, c->state, res < 0 ? -errno : res);
 	if (res > 8) {
 		unsigned char *buf = (unsigned char *) c->rbuf;
 		pthread_mutex_lock(&c->thread->stats.mutex);
@@ -541,6 +753,7 @@ enum try_read_result try_read_udp(conn *c) {
 
 		c->rbytes = res;
 		c->rcurr = c->rbuf;
+		c->nframes = 0;
 		return READ_DATA_RECEIVED;
 	}
 	return READ_NO_DATA_RECEIVED;
@@ -594,13 +807,20 @@ enum try_read_result try_read_network(conn *c) {
 		}
 
 		int avail = c->rsize - c->rbytes;
-		res = read(c->sfd, c->rbuf + c->rbytes, avail);
+		if (IS_SHM(c->transport))
+			res = conn_shm_read(c, c->rbuf + c->rbytes, avail);
+		else if (c->ssl)
+			res = conn_tls_read(c, c->rbuf + c->rbytes, avail);
+		else
+			res = read(c->sfd, c->rbuf + c->rbytes, avail);
+		conn_trace(c, trace_read, c->state, c->state, res < 0 ? -errno : res);
 		if (res > 0) {
 			pthread_mutex_lock(&c->thread->stats.mutex);
 			c->thread->stats.bytes_read += res;
 			pthread_mutex_unlock(&c->thread->stats.mutex);
 			gotdata = READ_DATA_RECEIVED;
 			c->rbytes += res;
+			c->nframes = 0;
 			if (res == avail) {
 				continue;
 			} else {
@@ -0,0 +1,1083 @@
+/*
+ * StorageServer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+
+#include <network/storage/StorageServer.h>
+#include <network/storage/compress.h>
+#include <network/storage/flash.h>
+#include <network/storage/items.h>
+#include <network/storage/persist.h>
+#include <network/storage/range.h>
+#include <network/storage/slabs.h>
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_utils.h>
+#include <vutils/Logger.h>
+#include <string.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "StorageServer"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/* expiration of an incr/decr that must not create a missing key */
+#define INCR_NO_CREATE 0xffffffff
+
+#define BIN_HDR_LEN sizeof(protocol_binary_request_header)
+
+/* items taken per scan of a range, and bytes queued per part of an RGET */
+#define RANGE_SCAN_ITEMS 64
+#define RANGE_PART_BYTES (256 * 1024)
+
+#define THREAD_STAT_INCR(c, name) \
+	do { \
+		pthread_mutex_lock(&(c)->thread->stats.mutex); \
+		(c)->thread->stats.name++; \
+		pthread_mutex_unlock(&(c)->thread->stats.mutex); \
+	} while (0)
+
+/*
+ * Sets c up to write one response. Extras, key and value may be NULL.
+ */
+static void write_bin_response(conn *c, uint16_t status, uint64_t cas,
+		const void *ext, uint8_t extlen, const void *key, uint16_t keylen,
+		const void *val, uint32_t vlen) {
+	protocol_binary_response_header *header;
+	size_t len = sizeof(header->response) + extlen + keylen + vlen;
+	char *buf = (char *) malloc(len), *pos;
+
+	if (buf == NULL) {
+		out_of_memory(c, "SERVER_ERROR out of memory writing response");
+		return;
+	}
+	header = (protocol_binary_response_header *) buf;
+	memset(header, 0, sizeof(header->response));
+	header->response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header->response.opcode = c->binary_header.request.opcode;
+	header->response.keylen = (uint16_t) htons(keylen);
+	header->response.extlen = extlen;
+	header->response.status = (uint16_t) htons(status);
+	header->response.bodylen = htonl(extlen + keylen + vlen);
+	header->response.opaque = c->opaque;
+	header->response.cas = htonll(cas);
+
+	pos = buf + sizeof(header->response);
+	if (extlen > 0)
+		memcpy(pos, ext, extlen);
+	pos += extlen;
+	if (keylen > 0)
+		memcpy(pos, key, keylen);
+	pos += keylen;
+	if (vlen > 0)
+		memcpy(pos, val, vlen);
+	write_and_free(c, buf, len);
+}
+
+static void write_bin_error(conn *c, uint16_t status) {
+	const char *errstr;
+
+	switch (status) {
+	case PROTOCOL_BINARY_RESPONSE_KEY_ENOENT:
+		errstr = "Not found";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS:
+		errstr = "Data exists for key.";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_E2BIG:
+		errstr = "Too large.";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_EINVAL:
+		errstr = "Invalid arguments";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_NOT_STORED:
+		errstr = "Not stored.";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL:
+		errstr = "Non-numeric server-side value for incr or decr";
+		break;
+	case PROTOCOL_BINARY_RESPONSE_ENOMEM:
+		errstr = "Out of memory";
+		break;
+	default:
+		errstr = "Unknown command";
+		break;
+	}
+	if (settings.verbose > 1)
+		MY_LOGE(">%d Writing an error: %s", c->sfd, errstr);
+	write_bin_response(c, status, 0, NULL, 0, NULL, 0, errstr, strlen(errstr));
+}
+
+/*
+ * Quiet commands say nothing when they succeed.
+ */
+static void write_bin_success(conn *c, bool quiet, uint64_t cas) {
+	if (quiet)
+		conn_set_state(c, conn_new_cmd);
+	else
+		write_bin_response(c, PROTOCOL_BINARY_RESPONSE_SUCCESS, cas, NULL, 0,
+				NULL, 0, NULL, 0);
+}
+
+static uint16_t read_u16(const char *p) {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohs(v);
+}
+
+static uint32_t read_u32(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static uint64_t read_u64(const char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohll(v);
+}
+
+/*
+ * The request takes, and may send, compressed values as they are stored.
+ */
+static bool bin_takes_compressed(conn *c) {
+	return storage_settings.compress_min > 0
+			&& (c->binary_header.request.datatype
+					& PROTOCOL_BINARY_DATATYPE_COMPRESSED);
+}
+
+/* gives back a reference of a response, added with conn_add_item_release() */
+static void release_item(conn *c, void *it) {
+	item_remove((item *) it);
+}
+
+/*
+ * Adds hit it, which the caller referenced, to the response without
+ * copying it: header and flags go in a suffix buffer, key and value are
+ * sent from the item, which keeps the reference until it is written out.
+ * The reference belongs to the response even when -1 is returned.
+ */
+static int add_bin_item(conn *c, item *it, bool with_key) {
+	protocol_binary_response_header *header;
+	uint16_t keylen = with_key ? it->nkey : 0;
+	uint32_t flags = htonl(it->flags);
+	/* 24 bytes of header and 4 of flags fit SUFFIX_SIZE */
+	char *hdr = conn_add_suffix(c);
+
+	if (hdr == NULL || conn_add_item_release(c, it, release_item) != 0) {
+		item_remove(it);
+		return -1;
+	}
+	header = (protocol_binary_response_header *) hdr;
+	memset(header, 0, sizeof(header->response));
+	header->response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header->response.opcode = c->binary_header.request.opcode;
+	header->response.keylen = (uint16_t) htons(keylen);
+	header->response.extlen = sizeof(flags);
+	if (it->it_flags & ITEM_COMPRESSED)
+		header->response.datatype = PROTOCOL_BINARY_DATATYPE_COMPRESSED;
+	header->response.bodylen = htonl(sizeof(flags) + keylen + it->nbytes);
+	header->response.opaque = c->opaque;
+	header->response.cas = htonll(it->cas);
+	memcpy(hdr + sizeof(header->response), &flags, sizeof(flags));
+
+	if (add_iov(c, hdr, sizeof(header->response) + sizeof(flags)) != 0
+			|| (keylen > 0 && add_iov(c, ITEM_key(it), keylen) != 0)
+			|| (it->nbytes > 0 && add_iov(c, ITEM_data(it), it->nbytes) != 0))
+		return -1;
+	return 0;
+}
+
+static void write_bin_item(conn *c, item *it, bool with_key) {
+	if (add_bin_item(c, it, with_key) != 0) {
+		conn_release_items(c);
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		return;
+	}
+	conn_set_state(c, conn_mwrite);
+	c->write_and_go = conn_new_cmd;
+}
+
+/*
+ * A hit on hdr, a header item of the flash tier: returns an item of the
+ * value's size to answer with, which the value is read into once the
+ * response is queued, see flash_read_queue(). A compressed value is read
+ * as it is if compressed says the client takes it, decompressed if not.
+ * NULL for a miss, when the value is gone or c is UDP, which can't wait
+ * for it; hdr's reference is dropped then.
+ */
+static item *flash_hit(conn *c, item *hdr, bool compressed) {
+	enum store_item_type res;
+	flash_loc loc;
+	item *it = NULL;
+
+	memcpy(&loc, ITEM_data(hdr), sizeof(loc));
+	compressed = compressed && (hdr->it_flags & ITEM_COMPRESSED);
+	if (!flash_loc_valid(&loc))
+		item_unlink(hdr);
+	else if (!IS_UDP(c->transport))
+		it = item_alloc(ITEM_key(hdr), hdr->nkey, hdr->flags, hdr->exptime,
+				compressed ? loc.nbytes : loc.raw_nbytes, &res);
+	if (it == NULL) {
+		item_remove(hdr);
+		return NULL;
+	}
+	if (compressed)
+		it->it_flags |= ITEM_COMPRESSED;
+	it->cas = hdr->cas;
+	return it;
+}
+
+/*
+ * The item to answer a hit on it with: it, or if its value is compressed
+ * and the client doesn't take that, a decompressed copy. NULL if that
+ * can't be made, it's reference is dropped then.
+ */
+static item *hit_item(item *it, bool compressed) {
+	if ((it->it_flags & ITEM_COMPRESSED) && !compressed)
+		return compress_expand(it);
+	return it;
+}
+
+static void process_bin_get(conn *c, const char *key, int nkey, bool quiet,
+		bool with_key) {
+	item *it = item_get(key, nkey, item_hash(key, nkey), c), *hdr = NULL;
+	int iov;
+
+	if (it != NULL && (it->it_flags & ITEM_HDR)) {
+		hdr = it;
+		it = flash_hit(c, hdr, bin_takes_compressed(c));
+	} else if (it != NULL) {
+		it = hit_item(it, bin_takes_compressed(c));
+	}
+
+	pthread_mutex_lock(&c->thread->stats.mutex);
+	c->thread->stats.get_cmds++;
+	if (it != NULL)
+		c->thread->stats.get_hits++;
+	else
+		c->thread->stats.get_misses++;
+	pthread_mutex_unlock(&c->thread->stats.mutex);
+
+	if (it != NULL) {
+		iov = c->iovused;
+		write_bin_item(c, it, with_key);
+		if (hdr == NULL)
+			return;
+		if (c->state == conn_mwrite)
+			flash_read_queue(c, hdr, it, iov, c->iovused - iov, quiet,
+					with_key);
+		else
+			item_remove(hdr);
+	} else if (quiet) {
+		conn_set_state(c, conn_new_cmd);
+	} else if (with_key) {
+		write_bin_response(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0, NULL, 0,
+				key, nkey, NULL, 0);
+	} else {
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+	}
+}
+
+static void process_bin_update(conn *c, const char *key, int nkey,
+		enum store_op op, bool quiet) {
+	const char *extras = c->rcurr + BIN_HDR_LEN;
+	uint32_t flags = read_u32(extras);
+	uint32_t exptime = read_u32(extras + 4);
+	uint32_t vlen = c->binary_header.request.bodylen - nkey - 8;
+	enum store_item_type res;
+	uint64_t cas = 0;
+	item *it;
+
+	THREAD_STAT_INCR(c, set_cmds);
+	it = compress_alloc(key, nkey, flags, item_realtime(exptime), key + nkey,
+			vlen, bin_takes_compressed(c), &res);
+	if (it == NULL && res == NOT_STORED) {
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_EINVAL);
+		return;
+	}
+	if (it == NULL) {
+		/* a failed set must not leave the old value behind */
+		if (op == STORE_SET)
+			item_delete(key, nkey, 0);
+		write_bin_error(c, res == TOO_LARGE ? PROTOCOL_BINARY_RESPONSE_E2BIG
+				: PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		return;
+	}
+
+	switch (item_store(it, op, c->binary_header.request.cas, &cas)) {
+	case STORED:
+		write_bin_success(c, quiet, cas);
+		break;
+	case EXISTS:
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+		break;
+	case NOT_FOUND:
+		THREAD_STAT_INCR(c, cas_misses);
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+		break;
+	case NOT_STORED:
+		write_bin_error(c, op == STORE_ADD ? PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS
+				: PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+		break;
+	default:
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_NOT_STORED);
+		break;
+	}
+}
+
+static void process_bin_delete(conn *c, const char *key, int nkey,
+		bool quiet) {
+	switch (item_delete(key, nkey, c->binary_header.request.cas)) {
+	case DELETED:
+		THREAD_STAT_INCR(c, delete_hits);
+		write_bin_success(c, quiet, 0);
+		break;
+	case EXISTS:
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+		break;
+	default:
+		THREAD_STAT_INCR(c, delete_misses);
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+		break;
+	}
+}
+
+/*
+ * Stores initial under key for an incr/decr of a missing key, answering it
+ * unless quiet. Returns false if someone else created it first.
+ */
+static bool bin_delta_create(conn *c, const char *key, int nkey,
+		uint64_t initial, uint32_t exptime, bool quiet, uint64_t *cas) {
+	char buf[INCR_MAX_STORAGE_LEN];
+	enum store_item_type res;
+	int len;
+	item *it;
+
+	len = snprintf(buf, sizeof(buf), "%llu", (unsigned long long) initial);
+	it = item_alloc(key, nkey, 0, item_realtime(exptime), len, &res);
+	if (it == NULL) {
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		return true;
+	}
+	memcpy(ITEM_data(it), buf, len);
+	if (item_store(it, STORE_ADD, 0, cas) != STORED)
+		return false;
+	if (quiet) {
+		conn_set_state(c, conn_new_cmd);
+		return true;
+	}
+	initial = htonll(initial);
+	write_bin_response(c, PROTOCOL_BINARY_RESPONSE_SUCCESS, *cas, NULL, 0,
+			NULL, 0, &initial, sizeof(initial));
+	return true;
+}
+
+static void process_bin_delta(conn *c, const char *key, int nkey, bool incr,
+		bool quiet) {
+	const char *extras = c->rcurr + BIN_HDR_LEN;
+	uint64_t delta = read_u64(extras);
+	uint64_t initial = read_u64(extras + 8);
+	uint32_t exptime = read_u32(extras + 16);
+	uint64_t value = 0, cas = 0;
+	int tries;
+
+	for (tries = 0; tries < 2; tries++) {
+		switch (item_add_delta(key, nkey, incr, delta,
+				c->binary_header.request.cas, &value, &cas)) {
+		case DELTA_OK:
+			if (incr)
+				THREAD_STAT_INCR(c, incr_hits);
+			else
+				THREAD_STAT_INCR(c, decr_hits);
+			if (quiet) {
+				conn_set_state(c, conn_new_cmd);
+			} else {
+				value = htonll(value);
+				write_bin_response(c, PROTOCOL_BINARY_RESPONSE_SUCCESS, cas,
+						NULL, 0, NULL, 0, &value, sizeof(value));
+			}
+			return;
+		case NON_NUMERIC:
+			write_bin_error(c, PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL);
+			return;
+		case DELTA_EOM:
+			write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+			return;
+		case DELTA_ITEM_CAS_MISMATCH:
+			write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+			return;
+		case DELTA_ITEM_NOT_FOUND:
+			if (exptime == INCR_NO_CREATE || c->binary_header.request.cas) {
+				if (incr)
+					THREAD_STAT_INCR(c, incr_misses);
+				else
+					THREAD_STAT_INCR(c, decr_misses);
+				write_bin_error(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+				return;
+			}
+			if (bin_delta_create(c, key, nkey, initial, exptime, quiet,
+					&cas))
+				return;
+			/* lost a race with another creator, apply the delta to it */
+			break;
+		}
+	}
+	write_bin_error(c, PROTOCOL_BINARY_RESPONSE_NOT_STORED);
+}
+
+/*
+ * A range request: the key is the start key and the extras a
+ * protocol_binary_request_rangeop, whose size is the length of the end key
+ * following the start key; an RSET value or the 8 byte delta of RINCR and
+ * RDECR comes after it. max_results is 0 for no limit. RGET keeps the
+ * range in c->write_resume while its results stream out.
+ */
+typedef struct {
+	range_bounds b;
+	uint64_t left; /* results still allowed */
+	bool done; /* the last part is queued */
+	char start[KEY_MAX_LENGTH]; /* after the first part, the last key sent */
+	char end[KEY_MAX_LENGTH];
+} range_cursor;
+
+static void bin_range_parse(conn *c, range_cursor *rc) {
+	const char *extras = c->rcurr + BIN_HDR_LEN;
+	const char *key = extras + c->binary_header.request.extlen;
+	int nkey = c->binary_header.request.keylen;
+	uint16_t nend = read_u16(extras);
+	uint8_t flags = extras[3];
+	uint32_t max = read_u32(extras + 4);
+
+	memcpy(rc->start, key, nkey);
+	rc->b.start = rc->start;
+	rc->b.nstart = nkey;
+	rc->b.end = rc->end;
+	rc->b.flags = flags & (RANGE_START_EXCLUSIVE | RANGE_END_INCLUSIVE);
+	if (flags & RANGE_PREFIX) {
+		rc->b.nend = range_prefix_end(key, nkey, rc->end);
+		rc->b.flags &= ~RANGE_END_INCLUSIVE;
+	} else {
+		memcpy(rc->end, key + nkey, nend);
+		rc->b.nend = nend;
+	}
+	rc->left = max != 0 ? max : UINT64_MAX;
+	rc->done = false;
+}
+
+/* the next scan of rc starts after its last item */
+static void range_advance(range_cursor *rc, item *last) {
+	memcpy(rc->start, ITEM_key(last), last->nkey);
+	rc->b.nstart = last->nkey;
+	rc->b.flags |= RANGE_START_EXCLUSIVE;
+}
+
+/*
+ * Closes an RGET: no extras, the key to start after when results were
+ * left out, empty when the range was sent whole.
+ */
+static int add_bin_range_end(conn *c, range_cursor *rc, bool truncated) {
+	protocol_binary_response_header *header;
+	uint16_t keylen = truncated ? rc->b.nstart : 0;
+	char *hdr = conn_add_suffix(c);
+
+	if (hdr == NULL)
+		return -1;
+	header = (protocol_binary_response_header *) hdr;
+	memset(header, 0, sizeof(header->response));
+	header->response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header->response.opcode = c->binary_header.request.opcode;
+	header->response.keylen = (uint16_t) htons(keylen);
+	header->response.bodylen = htonl(keylen);
+	header->response.opaque = c->opaque;
+	rc->done = true;
+	if (add_iov(c, hdr, sizeof(header->response)) != 0
+			|| (keylen > 0 && add_iov(c, rc->start, keylen) != 0))
+		return -1;
+	return 0;
+}
+
+/*
+ * Queues the next part of an RGET: GETK like responses of the items from
+ * rc's start on, until RANGE_PART_BYTES are queued, and the closing
+ * response once the range or max_results run out. A UDP conn gets a
+ * single part.
+ */
+static int range_get_part(conn *c, range_cursor *rc) {
+	item *items[RANGE_SCAN_ITEMS];
+	uint64_t bytes = 0;
+	bool more;
+	int i, n;
+
+	for (;;) {
+		n = range_scan(&rc->b, items,
+				rc->left < RANGE_SCAN_ITEMS ? (int) rc->left : RANGE_SCAN_ITEMS,
+				&more);
+		for (i = 0; i < n; i++) {
+			items[i] = hit_item(items[i], bin_takes_compressed(c));
+			if (items[i] == NULL) {
+				while (++i < n)
+					item_remove(items[i]);
+				return -1;
+			}
+			bytes += BIN_HDR_LEN + items[i]->nkey + items[i]->nbytes;
+			if (add_bin_item(c, items[i], true) != 0) {
+				while (++i < n)
+					item_remove(items[i]);
+				return -1;
+			}
+		}
+		/* the response references the items, their keys stay */
+		if (n > 0)
+			range_advance(rc, items[n - 1]);
+		rc->left -= n;
+		if (!more || rc->left == 0 || IS_UDP(c->transport))
+			return add_bin_range_end(c, rc, more);
+		if (bytes >= RANGE_PART_BYTES)
+			return 0;
+	}
+}
+
+static void process_bin_rget(conn *c) {
+	range_cursor *rc = (range_cursor *) malloc(sizeof(range_cursor));
+
+	if (rc == NULL) {
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		return;
+	}
+	bin_range_parse(c, rc);
+	if (range_get_part(c, rc) != 0) {
+		conn_release_items(c);
+		free(rc);
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		return;
+	}
+	c->write_resume = rc;
+	conn_set_state(c, conn_mwrite);
+	c->write_and_go = conn_new_cmd;
+}
+
+/*
+ * Replaces the value of it, unless it changed meanwhile, keeping its
+ * flags and expiration.
+ */
+static enum store_item_type range_set(item *it, const char *value,
+		uint32_t vlen) {
+	enum store_item_type res;
+	uint64_t cas;
+	item *new_it;
+
+	new_it = compress_alloc(ITEM_key(it), it->nkey, it->flags, it->exptime,
+			value, vlen, false, &res);
+	if (new_it == NULL)
+		return res;
+	return item_store(new_it, STORE_REPLACE, it->cas, &cas);
+}
+
+/*
+ * RSET, RDELETE, RINCR and RDECR, applied to each key of the range up to
+ * max_results of them, a scan at a time. The answer's value is the 8 byte
+ * count of keys changed, its key the one to start after when max_results
+ * stopped it. Keys changed by others meanwhile, and values RINCR and RDECR
+ * can't parse, are skipped. RSET stops at the first value it can't
+ * allocate, with an error.
+ */
+static void process_bin_range_update(conn *c, bool quiet) {
+	const char *extras = c->rcurr + BIN_HDR_LEN;
+	int nkey = c->binary_header.request.keylen;
+	uint16_t nend = read_u16(extras);
+	const char *value = extras + c->binary_header.request.extlen + nkey + nend;
+	uint32_t vlen = c->binary_header.request.bodylen
+			- c->binary_header.request.extlen - nkey - nend;
+	uint8_t cmd = c->cmd;
+	item *items[RANGE_SCAN_ITEMS];
+	uint16_t status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+	enum store_item_type res;
+	uint64_t changed = 0, delta = 0, v, cas;
+	range_cursor rc;
+	bool more = true;
+	int i, n;
+
+	bin_range_parse(c, &rc);
+	if (cmd >= PROTOCOL_BINARY_CMD_RINCR)
+		delta = read_u64(value);
+
+	while (more && rc.left > 0 && status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+		n = range_scan(&rc.b, items,
+				rc.left < RANGE_SCAN_ITEMS ? (int) rc.left : RANGE_SCAN_ITEMS,
+				&more);
+		for (i = 0; i < n && status == PROTOCOL_BINARY_RESPONSE_SUCCESS; i++) {
+			item *it = items[i];
+
+			switch (cmd) {
+			case PROTOCOL_BINARY_CMD_RSET:
+			case PROTOCOL_BINARY_CMD_RSETQ:
+				res = range_set(it, value, vlen);
+				if (res == STORED)
+					changed++;
+				else if (res == TOO_LARGE)
+					status = PROTOCOL_BINARY_RESPONSE_E2BIG;
+				else if (res == OUT_OF_MEMORY)
+					status = PROTOCOL_BINARY_RESPONSE_ENOMEM;
+				break;
+			case PROTOCOL_BINARY_CMD_RDELETE:
+			case PROTOCOL_BINARY_CMD_RDELETEQ:
+				if (item_delete(ITEM_key(it), it->nkey, it->cas) == DELETED)
+					changed++;
+				break;
+			default:
+				if (item_add_delta(ITEM_key(it), it->nkey,
+						cmd <= PROTOCOL_BINARY_CMD_RINCRQ, delta, it->cas, &v,
+						&cas) == DELTA_OK)
+					changed++;
+				break;
+			}
+		}
+		if (n > 0)
+			range_advance(&rc, items[n - 1]);
+		for (i = 0; i < n; i++)
+			item_remove(items[i]);
+		rc.left -= n;
+	}
+
+	if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+		write_bin_error(c, status);
+	} else if (quiet) {
+		conn_set_state(c, conn_new_cmd);
+	} else {
+		changed = htonll(changed);
+		write_bin_response(c, PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, NULL, 0,
+				rc.start, more ? rc.b.nstart : 0, &changed, sizeof(changed));
+	}
+}
+
+/*
+ * Checks the lengths opcode needs. Returns false for a foreign opcode.
+ */
+static bool bin_lengths_ok(conn *c, bool *valid) {
+	const protocol_binary_request_header *req = &c->binary_header;
+	uint32_t bodylen = req->request.bodylen;
+	int keylen = req->request.keylen;
+	int extlen = req->request.extlen;
+
+	switch (req->request.opcode) {
+	case PROTOCOL_BINARY_CMD_GET:
+	case PROTOCOL_BINARY_CMD_GETQ:
+	case PROTOCOL_BINARY_CMD_GETK:
+	case PROTOCOL_BINARY_CMD_GETKQ:
+	case PROTOCOL_BINARY_CMD_DELETE:
+	case PROTOCOL_BINARY_CMD_DELETEQ:
+		*valid = extlen == 0 && keylen > 0 && bodylen == (uint32_t) keylen;
+		break;
+	case PROTOCOL_BINARY_CMD_SET:
+	case PROTOCOL_BINARY_CMD_SETQ:
+	case PROTOCOL_BINARY_CMD_ADD:
+	case PROTOCOL_BINARY_CMD_ADDQ:
+	case PROTOCOL_BINARY_CMD_REPLACE:
+	case PROTOCOL_BINARY_CMD_REPLACEQ:
+		*valid = extlen == 8 && keylen > 0
+				&& bodylen >= (uint32_t) (keylen + extlen);
+		break;
+	case PROTOCOL_BINARY_CMD_INCREMENT:
+	case PROTOCOL_BINARY_CMD_INCREMENTQ:
+	case PROTOCOL_BINARY_CMD_DECREMENT:
+	case PROTOCOL_BINARY_CMD_DECREMENTQ:
+		*valid = extlen == 20 && keylen > 0
+				&& bodylen == (uint32_t) (keylen + extlen);
+		break;
+	case PROTOCOL_BINARY_CMD_NOOP:
+		*valid = extlen == 0 && keylen == 0 && bodylen == 0;
+		break;
+	case PROTOCOL_BINARY_CMD_RGET:
+	case PROTOCOL_BINARY_CMD_RSET:
+	case PROTOCOL_BINARY_CMD_RSETQ:
+	case PROTOCOL_BINARY_CMD_RDELETE:
+	case PROTOCOL_BINARY_CMD_RDELETEQ:
+	case PROTOCOL_BINARY_CMD_RINCR:
+	case PROTOCOL_BINARY_CMD_RINCRQ:
+	case PROTOCOL_BINARY_CMD_RDECR:
+	case PROTOCOL_BINARY_CMD_RDECRQ: {
+		uint32_t nend, vlen;
+
+		if (!storage_settings.range_index)
+			return false;
+		if (extlen != 8 || bodylen < (uint32_t) (keylen + extlen)) {
+			*valid = false;
+			break;
+		}
+		nend = read_u16(c->rcurr + BIN_HDR_LEN);
+		vlen = bodylen - keylen - extlen;
+		if (req->request.opcode == PROTOCOL_BINARY_CMD_RSET
+				|| req->request.opcode == PROTOCOL_BINARY_CMD_RSETQ)
+			*valid = vlen >= nend;
+		else if (req->request.opcode >= PROTOCOL_BINARY_CMD_RINCR)
+			*valid = vlen == nend + 8;
+		else
+			*valid = vlen == nend;
+		if (nend > KEY_MAX_LENGTH)
+			*valid = false;
+		break;
+	}
+	default:
+		return false;
+	}
+	if (keylen > KEY_MAX_LENGTH)
+		*valid = false;
+	return true;
+}
+
+StorageServer::StorageServer(msg_callback *next) :
+		mNext(next) {
+	mOptions[0] = '\0';
+	storage_settings_init();
+}
+
+StorageServer::~StorageServer() {
+}
+
+void StorageServer::onBinaryEventDispatch(conn *c) {
+	uint64_t seq = persist_thread_seq();
+
+	processBinary(c);
+	/* a get waiting for the flash tier changed nothing to sync */
+	if (storage_settings.ext_path != NULL && flash_submit(c))
+		return;
+	if (storage_settings.log_file != NULL)
+		persist_wait(c, seq);
+}
+
+void StorageServer::processBinary(conn *c) {
+	const char *key;
+	int nkey;
+	bool valid;
+
+	if (!bin_lengths_ok(c, &valid)) {
+		if (mNext)
+			mNext->onBinaryEventDispatch(c);
+		else
+			write_bin_error(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND);
+		return;
+	}
+	if (!valid) {
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_EINVAL);
+		return;
+	}
+
+	/* the whole frame is in rbuf: header, extras, key, value */
+	key = c->rcurr + BIN_HDR_LEN + c->binary_header.request.extlen;
+	nkey = c->binary_header.request.keylen;
+
+	switch (c->cmd) {
+	case PROTOCOL_BINARY_CMD_GET:
+		process_bin_get(c, key, nkey, false, false);
+		break;
+	case PROTOCOL_BINARY_CMD_GETQ:
+		process_bin_get(c, key, nkey, true, false);
+		break;
+	case PROTOCOL_BINARY_CMD_GETK:
+		process_bin_get(c, key, nkey, false, true);
+		break;
+	case PROTOCOL_BINARY_CMD_GETKQ:
+		process_bin_get(c, key, nkey, true, true);
+		break;
+	case PROTOCOL_BINARY_CMD_SET:
+	case PROTOCOL_BINARY_CMD_SETQ:
+		process_bin_update(c, key, nkey, STORE_SET,
+				c->cmd == PROTOCOL_BINARY_CMD_SETQ);
+		break;
+	case PROTOCOL_BINARY_CMD_ADD:
+	case PROTOCOL_BINARY_CMD_ADDQ:
+		process_bin_update(c, key, nkey, STORE_ADD,
+				c->cmd == PROTOCOL_BINARY_CMD_ADDQ);
+		break;
+	case PROTOCOL_BINARY_CMD_REPLACE:
+	case PROTOCOL_BINARY_CMD_REPLACEQ:
+		process_bin_update(c, key, nkey, STORE_REPLACE,
+				c->cmd == PROTOCOL_BINARY_CMD_REPLACEQ);
+		break;
+	case PROTOCOL_BINARY_CMD_DELETE:
+	case PROTOCOL_BINARY_CMD_DELETEQ:
+		process_bin_delete(c, key, nkey, c->cmd == PROTOCOL_BINARY_CMD_DELETEQ);
+		break;
+	case PROTOCOL_BINARY_CMD_INCREMENT:
+	case PROTOCOL_BINARY_CMD_INCREMENTQ:
+		process_bin_delta(c, key, nkey, true,
+				c->cmd == PROTOCOL_BINARY_CMD_INCREMENTQ);
+		break;
+	case PROTOCOL_BINARY_CMD_DECREMENT:
+	case PROTOCOL_BINARY_CMD_DECREMENTQ:
+		process_bin_delta(c, key, nkey, false,
+				c->cmd == PROTOCOL_BINARY_CMD_DECREMENTQ);
+		break;
+	case PROTOCOL_BINARY_CMD_NOOP:
+		write_bin_success(c, false, 0);
+		break;
+	case PROTOCOL_BINARY_CMD_RGET:
+		process_bin_rget(c);
+		break;
+	case PROTOCOL_BINARY_CMD_RSETQ:
+	case PROTOCOL_BINARY_CMD_RDELETEQ:
+	case PROTOCOL_BINARY_CMD_RINCRQ:
+	case PROTOCOL_BINARY_CMD_RDECRQ:
+		process_bin_range_update(c, true);
+		break;
+	case PROTOCOL_BINARY_CMD_RSET:
+	case PROTOCOL_BINARY_CMD_RDELETE:
+	case PROTOCOL_BINARY_CMD_RINCR:
+	case PROTOCOL_BINARY_CMD_RDECR:
+		process_bin_range_update(c, false);
+		break;
+	}
+}
+
+/*
+ * The next part of an RGET, see range_get_part().
+ */
+void StorageServer::onWriteResume(conn *c) {
+	range_cursor *rc = (range_cursor *) c->write_resume;
+
+	if (c->cmd != PROTOCOL_BINARY_CMD_RGET) {
+		if (mNext)
+			mNext->onWriteResume(c);
+		return;
+	}
+	if (rc->done) {
+		free(rc);
+		c->write_resume = NULL;
+		conn_set_state(c, conn_new_cmd);
+	} else if (range_get_part(c, rc) != 0) {
+		/* ends the stream early, the client sees the error instead */
+		conn_release_items(c);
+		free(rc);
+		c->write_resume = NULL;
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+	} else {
+		conn_set_state(c, conn_mwrite);
+	}
+}
+
+void StorageServer::onWriteAbort(conn *c) {
+	if (c->cmd != PROTOCOL_BINARY_CMD_RGET) {
+		if (mNext)
+			mNext->onWriteAbort(c);
+		return;
+	}
+	free(c->write_resume);
+}
+
+/*
+ * "get <key>*" and "gets <key>*". Every hit is sent from the item itself:
+ * "VALUE ", its key, a " <flags> <bytes>[ <cas>]\r\n" suffix, its value and
+ * "\r\n", all gathered in one conn_mwrite with the items referenced. Hits
+ * in the flash tier are read in before it goes out; if a later key fails,
+ * their reads are dropped with the response, or they'd land in its freed
+ * items.
+ */
+static void process_get_command(conn *c, char *keys, bool return_cas) {
+	char *key, *save, *suffix;
+	uint64_t hits = 0, misses = 0;
+	size_t nkey;
+	item *it, *hdr;
+	int len, iov;
+
+	c->msgcurr = 0;
+	c->msgused = 0;
+	c->iovused = 0;
+	if (add_msghdr(c) != 0) {
+		out_of_memory(c, "SERVER_ERROR out of memory preparing response");
+		return;
+	}
+
+	for (key = strtok_r(keys, " ", &save); key != NULL;
+			key = strtok_r(NULL, " ", &save)) {
+		nkey = strlen(key);
+		if (nkey > KEY_MAX_LENGTH) {
+			flash_read_drop();
+			out_string(c, "CLIENT_ERROR bad command line format");
+			return;
+		}
+		it = item_get(key, nkey, item_hash(key, nkey), c);
+		hdr = NULL;
+		if (it != NULL && (it->it_flags & ITEM_HDR)) {
+			hdr = it;
+			it = flash_hit(c, hdr, false);
+		} else if (it != NULL) {
+			it = hit_item(it, false);
+		}
+		if (it == NULL) {
+			misses++;
+			continue;
+		}
+		iov = c->iovused;
+		suffix = conn_add_suffix(c);
+		if (suffix == NULL
+				|| conn_add_item_release(c, it, release_item) != 0) {
+			item_remove(it);
+			if (hdr != NULL)
+				item_remove(hdr);
+			flash_read_drop();
+			out_of_memory(c, "SERVER_ERROR out of memory writing get response");
+			return;
+		}
+		if (return_cas)
+			len = snprintf(suffix, SUFFIX_SIZE, " %u %u %llu\r\n", it->flags,
+					it->nbytes, (unsigned long long) it->cas);
+		else
+			len = snprintf(suffix, SUFFIX_SIZE, " %u %u\r\n", it->flags,
+					it->nbytes);
+		if (add_iov(c, "VALUE ", 6) != 0
+				|| add_iov(c, ITEM_key(it), it->nkey) != 0
+				|| add_iov(c, suffix, len) != 0
+				|| add_iov(c, ITEM_data(it), it->nbytes) != 0
+				|| add_iov(c, "\r\n", 2) != 0) {
+			if (hdr != NULL)
+				item_remove(hdr);
+			flash_read_drop();
+			out_of_memory(c, "SERVER_ERROR out of memory writing get response");
+			return;
+		}
+		if (hdr != NULL)
+			flash_read_queue(c, hdr, it, iov, c->iovused - iov, false, false);
+		hits++;
+	}
+
+	pthread_mutex_lock(&c->thread->stats.mutex);
+	c->thread->stats.get_cmds += hits + misses;
+	c->thread->stats.get_hits += hits;
+	c->thread->stats.get_misses += misses;
+	pthread_mutex_unlock(&c->thread->stats.mutex);
+
+	if (settings.verbose > 1)
+		MY_LOGD(">%d END, %llu hits", c->sfd, (unsigned long long) hits);
+	if (add_iov(c, "END\r\n", 5) != 0) {
+		flash_read_drop();
+		out_of_memory(c, "SERVER_ERROR out of memory writing get response");
+		return;
+	}
+	conn_set_state(c, conn_mwrite);
+}
+
+void StorageServer::onAsciiEventDispatch(conn *c) {
+	if (strncmp(c->rcurr, "get ", 4) == 0)
+		process_get_command(c, c->rcurr + 4, false);
+	else if (strncmp(c->rcurr, "gets ", 5) == 0)
+		process_get_command(c, c->rcurr + 5, true);
+	else if (mNext)
+		mNext->onAsciiEventDispatch(c);
+	else
+		out_string(c, "ERROR");
+	/* hits in the flash tier hold the response back until they are read */
+	if (storage_settings.ext_path != NULL)
+		flash_submit(c);
+}
+
+const conn_framing *StorageServer::getFraming() {
+	return mNext ? mNext->getFraming() : NULL;
+}
+
+void StorageServer::onFrameDispatch(conn *c, const conn_frame *frame) {
+	if (mNext)
+		mNext->onFrameDispatch(c, frame);
+}
+
+bool StorageServer::onFrameBatchDispatch(conn *c, const conn_frame *frames,
+		int nframes) {
+	return mNext ? mNext->onFrameBatchDispatch(c, frames, nframes) : false;
+}
+
+/*
+ * A store too large for -I. Like an item too large for the slabs, it is
+ * refused with E2BIG and its value read and dropped.
+ */
+void StorageServer::onFrameTooLarge(conn *c) {
+	switch (c->cmd) {
+	case PROTOCOL_BINARY_CMD_SET:
+	case PROTOCOL_BINARY_CMD_SETQ:
+	case PROTOCOL_BINARY_CMD_ADD:
+	case PROTOCOL_BINARY_CMD_ADDQ:
+	case PROTOCOL_BINARY_CMD_REPLACE:
+	case PROTOCOL_BINARY_CMD_REPLACEQ:
+		write_bin_error(c, PROTOCOL_BINARY_RESPONSE_E2BIG);
+		if (c->state == conn_write)
+			c->write_and_go = conn_swallow;
+		break;
+	default:
+		if (mNext)
+			mNext->onFrameTooLarge(c);
+		break;
+	}
+}
+
+/* the engine's own references go to release_item(), these are mNext's */
+void StorageServer::onItemRelease(conn *c, void *it) {
+	if (mNext)
+		mNext->onItemRelease(c, it);
+}
+
+/* the engine's options, then mNext's */
+const char *StorageServer::getOptions() {
+	snprintf(mOptions, sizeof(mOptions), "%s%s", STORAGE_OPTIONS,
+			mNext ? mNext->getOptions() : "");
+	return mOptions;
+}
+
+int StorageServer::onOption(int opt, const char *arg) {
+	int taken = storage_option(opt, arg);
+
+	if (taken == 0 && mNext)
+		return mNext->onOption(opt, arg);
+	return taken;
+}
+
+void StorageServer::onUsage() {
+	storage_usage();
+	if (mNext)
+		mNext->onUsage();
+}
+
+int StorageServer::onServerStart() {
+	if (storage_settings_check() != 0 || items_init() != 0)
+		return -1;
+	MY_LOGD("storage: %lluMB in slab classes from %d bytes, 2^%d buckets",
+			(unsigned long long) storage_settings.maxbytes / (1024 * 1024),
+			storage_settings.chunk_size, storage_settings.hashpower_init);
+	return mNext ? mNext->onServerStart() : 0;
+}
+
+void StorageServer::onServerStop() {
+	if (mNext)
+		mNext->onServerStop();
+	items_stop();
+}
+
+bool StorageServer::onStats(conn *c, const char *subcommand,
+		ADD_STAT add_stats) {
+	if (*subcommand == '\0') {
+		items_stats(add_stats, c);
+		if (storage_settings.compress_min > 0)
+			compress_stats(add_stats, c);
+	} else if (strcmp(subcommand, "slabs") == 0) {
+		slabs_stats(add_stats, c);
+		if (storage_settings.compress_min > 0)
+			compress_stats_slabs(add_stats, c);
+		return true;
+	} else if (strcmp(subcommand, "items") == 0) {
+		items_stats_lru(add_stats, c);
+		return true;
+	} else if (strcmp(subcommand, "settings") == 0) {
+		storage_stat_settings(add_stats, c);
+		if (mNext)
+			mNext->onStats(c, subcommand, add_stats);
+		return true;
+	}
+	return mNext ? mNext->onStats(c, subcommand, add_stats) : false;
+}
@@ -0,0 +1,87 @@
+/*
+ * assoc.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/assoc.h>
+#include <network/core/conn_stats.h>
+#include <string.h>
+
+using namespace vmodule;
+
+/* item locks, never more than there are buckets */
+#define ITEM_LOCKS_POWER 12
+
+static ConcurrentHashTable *hashtable;
+
+static bool item_key_equals(const HashLink *e, const void *key, size_t nkey) {
+	const item *it = (const item *) e;
+	return nkey == it->nkey && memcmp(key, ITEM_key(it), nkey) == 0;
+}
+
+int assoc_init(int hashpower) {
+	hashtable = new ConcurrentHashTable(item_key_equals);
+	return hashtable->init(hashpower, ITEM_LOCKS_POWER, true) == NO_ERROR ?
+			0 : -1;
+}
+
+void assoc_lock(uint32_t hv) {
+	hashtable->lock(hv);
+}
+
+void assoc_unlock(uint32_t hv) {
+	hashtable->unlock(hv);
+}
+
+bool assoc_trylock(uint32_t hv) {
+	return hashtable->trylock(hv);
+}
+
+void assoc_lock_all(void) {
+	hashtable->lockAll();
+}
+
+item *assoc_find(const char *key, size_t nkey, uint32_t hv) {
+	return (item *) hashtable->find(key, nkey, hv);
+}
+
+/* Note: this isn't an assoc_update. The key must not already exist. */
+void assoc_insert(item *it, uint32_t hv) {
+	assert(assoc_find(ITEM_key(it), it->nkey, hv) == NULL);
+	hashtable->insert(&it->h, hv);
+}
+
+void assoc_delete(const char *key, size_t nkey, uint32_t hv) {
+	hashtable->remove(key, nkey, hv);
+}
+
+bool assoc_contains(item *it, uint32_t hv) {
+	return hashtable->contains(&it->h, hv);
+}
+
+void assoc_stats(ADD_STAT add_stats, conn *c) {
+	ConcurrentHashTable::Stats st;
+
+	hashtable->getStats(&st);
+	append_stat("hash_power_level", add_stats, c, "%d", st.hashpower);
+	append_stat("hash_bytes", add_stats, c, "%llu",
+			(unsigned long long) sizeof(void *) << st.hashpower);
+	append_stat("hash_is_expanding", add_stats, c, "%d", st.expanding);
+	if (st.expanding) {
+		append_stat("hash_expand_buckets_done", add_stats, c, "%llu",
+				(unsigned long long) st.expand_done);
+		append_stat("hash_expand_buckets_total", add_stats, c, "%llu",
+				(unsigned long long) st.expand_total);
+	}
+	append_stat("hash_expansions", add_stats, c, "%llu",
+			(unsigned long long) st.expansions);
+	append_stat("hash_moved_items", add_stats, c, "%llu",
+			(unsigned long long) st.moved_items);
+}
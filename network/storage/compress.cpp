@@ -0,0 +1,236 @@
+/*
+ * compress.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/compress.h>
+#include <network/storage/slabs.h>
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_stats.h>
+#include <vutils/LZCodec.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace vmodule;
+
+/*
+ * Items of each slab class holding a compressed value, ITEM_ACCOUNTED set,
+ * updated with atomics.
+ */
+static struct {
+	uint64_t items;
+	uint64_t raw_bytes; /* decompressed */
+	uint64_t bytes; /* as stored */
+} compress_class_stats[MAX_NUMBER_OF_SLAB_CLASSES];
+
+static struct {
+	uint64_t compressed; /* values compressed here */
+	uint64_t client; /* values that came compressed */
+	uint64_t skipped; /* values that didn't shrink enough */
+	uint64_t expanded; /* values decompressed for a reader */
+	uint64_t errors; /* values that didn't decompress */
+} compress_stats_data;
+
+/* compress() output of the calling worker */
+static __thread char *scratch;
+static __thread size_t scratch_size;
+
+static char *compress_scratch(size_t size) {
+	char *p;
+
+	if (size > scratch_size) {
+		p = (char *) realloc(scratch, size);
+		if (p == NULL)
+			return NULL;
+		scratch = p;
+		scratch_size = size;
+	}
+	return scratch;
+}
+
+uint32_t compress_raw_length(const char *data, uint32_t nbytes) {
+	uint32_t len;
+
+	if (nbytes < COMPRESS_HDR_LEN)
+		return 0;
+	memcpy(&len, data, sizeof(len));
+	return ntohl(len);
+}
+
+bool compress_expand_into(const char *data, uint32_t nbytes, char *raw,
+		uint32_t raw_len) {
+	if (nbytes < COMPRESS_HDR_LEN
+			|| !LZCodec::decompress(data + COMPRESS_HDR_LEN,
+					nbytes - COMPRESS_HDR_LEN, raw, raw_len)) {
+		__atomic_add_fetch(&compress_stats_data.errors, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	return true;
+}
+
+void compress_account(item *it) {
+	unsigned int id = ITEM_clsid(it);
+
+	it->it_flags |= ITEM_ACCOUNTED;
+	__atomic_add_fetch(&compress_class_stats[id].items, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&compress_class_stats[id].raw_bytes,
+			compress_raw_length(ITEM_data(it), it->nbytes), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&compress_class_stats[id].bytes, it->nbytes,
+			__ATOMIC_RELAXED);
+}
+
+void compress_forget(item *it) {
+	unsigned int id = ITEM_clsid(it);
+
+	__atomic_sub_fetch(&compress_class_stats[id].items, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&compress_class_stats[id].raw_bytes,
+			compress_raw_length(ITEM_data(it), it->nbytes), __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&compress_class_stats[id].bytes, it->nbytes,
+			__ATOMIC_RELAXED);
+}
+
+/*
+ * Checks client compressed val: it must decompress, to a value that fits
+ * an item for key.
+ */
+static bool compress_check(size_t nkey, const char *val, uint32_t vlen,
+		uint32_t *raw_len, enum store_item_type *res) {
+	char *raw;
+
+	*raw_len = compress_raw_length(val, vlen);
+	if (vlen < COMPRESS_HDR_LEN) {
+		*res = NOT_STORED;
+		return false;
+	}
+	if (slabs_clsid(ITEM_ntotal(nkey, *raw_len)) == 0) {
+		*res = TOO_LARGE;
+		return false;
+	}
+	raw = compress_scratch(*raw_len);
+	if (raw == NULL && *raw_len > 0) {
+		*res = OUT_OF_MEMORY;
+		return false;
+	}
+	if (!compress_expand_into(val, vlen, raw, *raw_len)) {
+		*res = NOT_STORED;
+		return false;
+	}
+	return true;
+}
+
+item *compress_alloc(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, const char *val, uint32_t vlen, bool compressed,
+		enum store_item_type *res) {
+	uint32_t raw_len = vlen, len;
+	size_t clen = 0;
+	char *out;
+	item *it;
+
+	if (compressed) {
+		if (!compress_check(nkey, val, vlen, &raw_len, res))
+			return NULL;
+	} else if (slabs_clsid(ITEM_ntotal(nkey, vlen)) == 0) {
+		/* it must fit decompressed too, for readers that want it so */
+		*res = TOO_LARGE;
+		return NULL;
+	} else if (storage_settings.compress_min > 0
+			&& vlen >= (uint32_t) storage_settings.compress_min) {
+		out = compress_scratch(COMPRESS_HDR_LEN + LZCodec::bound(vlen));
+		if (out != NULL)
+			clen = LZCodec::compress(val, vlen, out + COMPRESS_HDR_LEN,
+					vlen - vlen / 8 - COMPRESS_HDR_LEN);
+		if (clen > 0) {
+			len = htonl(vlen);
+			memcpy(out, &len, sizeof(len));
+			val = out;
+			vlen = COMPRESS_HDR_LEN + clen;
+			compressed = true;
+		} else {
+			__atomic_add_fetch(&compress_stats_data.skipped, 1,
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	it = item_alloc(key, nkey, flags, exptime, vlen, res);
+	if (it == NULL)
+		return NULL;
+	memcpy(ITEM_data(it), val, vlen);
+	if (compressed) {
+		it->it_flags |= ITEM_COMPRESSED;
+		compress_account(it);
+		__atomic_add_fetch(clen > 0 ? &compress_stats_data.compressed
+				: &compress_stats_data.client, 1, __ATOMIC_RELAXED);
+	}
+	return it;
+}
+
+item *compress_expand(item *it) {
+	uint32_t raw_len = compress_raw_length(ITEM_data(it), it->nbytes);
+	enum store_item_type res;
+	item *raw;
+
+	raw = item_alloc(ITEM_key(it), it->nkey, it->flags, it->exptime, raw_len,
+			&res);
+	if (raw != NULL && !compress_expand_into(ITEM_data(it), it->nbytes,
+			ITEM_data(raw), raw_len)) {
+		item_remove(raw);
+		raw = NULL;
+	}
+	if (raw != NULL) {
+		raw->cas = it->cas;
+		__atomic_add_fetch(&compress_stats_data.expanded, 1, __ATOMIC_RELAXED);
+	}
+	item_remove(it);
+	return raw;
+}
+
+void compress_stats(ADD_STAT add_stats, conn *c) {
+	append_stat("compressed_values", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&compress_stats_data.compressed, __ATOMIC_RELAXED));
+	append_stat("compressed_client_values", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&compress_stats_data.client,
+					__ATOMIC_RELAXED));
+	append_stat("compress_skipped", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&compress_stats_data.skipped,
+					__ATOMIC_RELAXED));
+	append_stat("decompressed_values", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&compress_stats_data.expanded,
+					__ATOMIC_RELAXED));
+	append_stat("decompress_errors", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&compress_stats_data.errors,
+					__ATOMIC_RELAXED));
+}
+
+void compress_stats_slabs(ADD_STAT add_stats, conn *c) {
+	char key[64];
+	int id;
+
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++) {
+		uint64_t items = __atomic_load_n(&compress_class_stats[id].items,
+				__ATOMIC_RELAXED);
+		uint64_t raw = __atomic_load_n(&compress_class_stats[id].raw_bytes,
+				__ATOMIC_RELAXED);
+		uint64_t bytes = __atomic_load_n(&compress_class_stats[id].bytes,
+				__ATOMIC_RELAXED);
+
+		if (items == 0)
+			continue;
+		snprintf(key, sizeof(key), "%d:compressed_items", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) items);
+		snprintf(key, sizeof(key), "%d:compressed_raw_bytes", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) raw);
+		snprintf(key, sizeof(key), "%d:compressed_bytes", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) bytes);
+		snprintf(key, sizeof(key), "%d:compression_ratio", id);
+		append_stat(key, add_stats, c, "%.2f",
+				bytes > 0 ? (double) raw / bytes : 0.0);
+	}
+}
@@ -0,0 +1,450 @@
+/*
+ * flash.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/flash.h>
+#include <network/storage/compress.h>
+#include <network/storage/slabs.h>
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_stats.h>
+#include <vutils/Logger.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "flash"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/* segment files the tier is split in, the oldest is dropped when full */
+#define FLASH_SEGMENTS 16
+/* values gathered before a write, holds the largest item */
+#define FLASH_WBUF_SIZE (2 * SLAB_PAGE_SIZE)
+/* pause between writer passes, shorter while there is work */
+#define FLASH_WRITER_SLEEP_MIN 1000
+#define FLASH_WRITER_SLEEP_MAX 1000000
+
+/* a value on disk, after this header and the key */
+typedef struct {
+	uint32_t check; /* item_hash() of the value */
+	uint32_t nbytes;
+	uint64_t cas;
+	uint8_t nkey;
+	uint8_t unused[7];
+} flash_record;
+
+typedef struct {
+	conn *c;
+	int left; /* reads not done, the last one resumes c */
+} flash_batch;
+
+typedef struct flash_read {
+	struct flash_read *next;
+	flash_batch *batch;
+	conn *c;
+	item *hdr; /* found, referenced */
+	item *it; /* read into, referenced by c's response */
+	flash_loc loc;
+	int iov, niov;
+	bool quiet, with_key;
+} flash_read;
+
+static int fds[FLASH_SEGMENTS];
+/* current use of each segment, read without a lock */
+static uint32_t generations[FLASH_SEGMENTS];
+static size_t segment_size;
+
+/* writer thread only */
+static uint32_t next_generation = 1;
+static int segment; /* being written */
+static size_t segment_off; /* where wbuf goes in it */
+static char *wbuf;
+static size_t wlen;
+static bool write_failed; /* since the last flash_flush() */
+
+/* reads of the request a worker is on */
+static __thread flash_batch *building;
+static __thread flash_read *building_reads;
+
+static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
+static flash_read *read_head, *read_tail;
+
+/* updated with atomics */
+static struct {
+	uint64_t items_written;
+	uint64_t bytes_written;
+	uint64_t write_errors;
+	uint64_t segments_recycled;
+	uint64_t reads;
+	uint64_t read_bytes;
+	uint64_t read_misses; /* values gone by the time they were read */
+} flash_stats_data;
+
+static void *flash_writer_thread(void *arg);
+static void *flash_reader_thread(void *arg);
+
+int flash_init(void) {
+	char path[PATH_MAX];
+	pthread_t tid;
+	int i, ret;
+
+	segment_size = storage_settings.ext_size / FLASH_SEGMENTS;
+	for (i = 0; i < FLASH_SEGMENTS; i++) {
+		snprintf(path, sizeof(path), "%s.%d", storage_settings.ext_path, i);
+		fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fds[i] < 0) {
+			MY_LOGE("can't open flash segment %s: %s", path, strerror(errno));
+			return -1;
+		}
+	}
+	generations[0] = next_generation++;
+	wbuf = (char *) malloc(FLASH_WBUF_SIZE);
+	if (wbuf == NULL)
+		return -1;
+
+	if ((ret = pthread_create(&tid, NULL, flash_writer_thread, NULL)) != 0) {
+		MY_LOGE("Can't create flash writer thread: %s", strerror(ret));
+		return -1;
+	}
+	for (i = 0; i < storage_settings.ext_threads; i++) {
+		if ((ret = pthread_create(&tid, NULL, flash_reader_thread, NULL))
+				!= 0) {
+			MY_LOGE("Can't create flash reader thread: %s", strerror(ret));
+			return -1;
+		}
+	}
+	MY_LOGD("flash tier %s: %d segments of %lluMB", storage_settings.ext_path,
+			FLASH_SEGMENTS, (unsigned long long) segment_size / (1024 * 1024));
+	return 0;
+}
+
+bool flash_loc_valid(const flash_loc *loc) {
+	return loc->segment < FLASH_SEGMENTS
+			&& loc->generation == __atomic_load_n(&generations[loc->segment],
+					__ATOMIC_ACQUIRE);
+}
+
+/*
+ * Writes out what wbuf gathered, an error is only noted for flash_flush().
+ */
+static void flash_write_out(void) {
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < wlen) {
+		n = pwrite(fds[segment], wbuf + done, wlen - done, segment_off + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			MY_LOGE("can't write flash segment %d: %s", segment,
+					strerror(errno));
+			write_failed = true;
+			__atomic_add_fetch(&flash_stats_data.write_errors, 1,
+					__ATOMIC_RELAXED);
+			break;
+		}
+		done += n;
+	}
+	segment_off += wlen;
+	wlen = 0;
+}
+
+/*
+ * Moves on to the next segment, dropping what it held: its locations go
+ * stale before the file is cut, so a read that gets in between finds
+ * another record, or none, and counts as a miss.
+ */
+static void flash_next_segment(void) {
+	segment = (segment + 1) % FLASH_SEGMENTS;
+	if (__atomic_load_n(&generations[segment], __ATOMIC_RELAXED) != 0)
+		__atomic_add_fetch(&flash_stats_data.segments_recycled, 1,
+				__ATOMIC_RELAXED);
+	__atomic_store_n(&generations[segment], next_generation++,
+			__ATOMIC_RELEASE);
+	if (ftruncate(fds[segment], 0) != 0)
+		MY_LOGE("can't cut flash segment %d: %s", segment, strerror(errno));
+	segment_off = 0;
+}
+
+int flash_append(item *it, flash_loc *loc) {
+	size_t len = sizeof(flash_record) + it->nkey + it->nbytes;
+	flash_record rec;
+
+	if (len > FLASH_WBUF_SIZE || len > segment_size)
+		return -1;
+	if (wlen + len > FLASH_WBUF_SIZE)
+		flash_write_out();
+	if (segment_off + wlen + len > segment_size) {
+		flash_write_out();
+		flash_next_segment();
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.check = item_hash(ITEM_data(it), it->nbytes);
+	rec.nbytes = it->nbytes;
+	rec.cas = it->cas;
+	rec.nkey = it->nkey;
+	memcpy(wbuf + wlen, &rec, sizeof(rec));
+	memcpy(wbuf + wlen + sizeof(rec), ITEM_key(it), it->nkey + it->nbytes);
+
+	loc->segment = segment;
+	loc->generation = generations[segment];
+	loc->offset = segment_off + wlen;
+	loc->nbytes = it->nbytes;
+	loc->raw_nbytes = (it->it_flags & ITEM_COMPRESSED) ?
+			compress_raw_length(ITEM_data(it), it->nbytes) : it->nbytes;
+	wlen += len;
+	__atomic_add_fetch(&flash_stats_data.items_written, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&flash_stats_data.bytes_written, len, __ATOMIC_RELAXED);
+	return 0;
+}
+
+bool flash_flush(void) {
+	bool ok;
+
+	flash_write_out();
+	ok = !write_failed;
+	write_failed = false;
+	return ok;
+}
+
+static void *flash_writer_thread(void *arg) {
+	useconds_t to_sleep = FLASH_WRITER_SLEEP_MIN;
+	int did;
+
+	while (1) {
+		did = items_flash_pass();
+		if (did == 0 && to_sleep < FLASH_WRITER_SLEEP_MAX)
+			to_sleep *= 2;
+		else if (did > 0)
+			to_sleep = FLASH_WRITER_SLEEP_MIN;
+		if (to_sleep > FLASH_WRITER_SLEEP_MAX)
+			to_sleep = FLASH_WRITER_SLEEP_MAX;
+		usleep(to_sleep);
+	}
+	return NULL;
+}
+
+/*
+ * The value of r is gone: its part of the response becomes a miss. A get
+ * says nothing, a binary GETQ too; other binary gets answer "not found",
+ * with the key for GETK.
+ */
+static void flash_miss(flash_read *r) {
+	struct iovec *iov = &r->c->iov[r->iov];
+	protocol_binary_response_header *header;
+	int i = 0;
+
+	if (r->c->protocol == binary_prot && !r->quiet) {
+		header = (protocol_binary_response_header *) iov[0].iov_base;
+		header->response.status = (uint16_t) htons(
+				PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+		header->response.extlen = 0;
+		header->response.bodylen = htonl(r->with_key ? r->it->nkey : 0);
+		header->response.cas = 0;
+		iov[0].iov_len = sizeof(header->response);
+		i = r->with_key ? 2 : 1;
+	}
+	/* sent as nothing, see transmit() */
+	for (; i < r->niov; i++)
+		iov[i].iov_len = 0;
+	__atomic_add_fetch(&flash_stats_data.read_misses, 1, __ATOMIC_RELAXED);
+}
+
+void flash_read_queue(conn *c, item *hdr, item *it, int iov, int niov,
+		bool quiet, bool with_key) {
+	flash_read *r = (flash_read *) malloc(sizeof(flash_read));
+	flash_read failed;
+
+	if (r != NULL && building == NULL) {
+		building = (flash_batch *) calloc(1, sizeof(flash_batch));
+		if (building == NULL) {
+			free(r);
+			r = NULL;
+		}
+	}
+	if (r == NULL)
+		r = &failed;
+	r->c = c;
+	r->hdr = hdr;
+	r->it = it;
+	memcpy(&r->loc, ITEM_data(hdr), sizeof(r->loc));
+	r->iov = iov;
+	r->niov = niov;
+	r->quiet = quiet;
+	r->with_key = with_key;
+	if (r == &failed) {
+		flash_miss(r);
+		item_remove(hdr);
+		return;
+	}
+	r->batch = building;
+	r->next = building_reads;
+	building_reads = r;
+	building->left++;
+}
+
+bool flash_submit(conn *c) {
+	flash_read *r = building_reads, *next;
+
+	if (r == NULL)
+		return false;
+	building->c = c;
+	building = NULL;
+	building_reads = NULL;
+	conn_worker_park(c);
+
+	pthread_mutex_lock(&read_lock);
+	for (; r != NULL; r = next) {
+		next = r->next;
+		r->next = NULL;
+		if (read_tail != NULL)
+			read_tail->next = r;
+		else
+			read_head = r;
+		read_tail = r;
+	}
+	pthread_cond_broadcast(&read_cond);
+	pthread_mutex_unlock(&read_lock);
+	return true;
+}
+
+void flash_read_drop(void) {
+	flash_read *r, *next;
+
+	for (r = building_reads; r != NULL; r = next) {
+		next = r->next;
+		item_remove(r->hdr);
+		free(r);
+	}
+	building_reads = NULL;
+	free(building);
+	building = NULL;
+}
+
+/*
+ * Reads the value of r into data, false if it is gone: its segment was
+ * used again, or what is there now is another record.
+ */
+static bool flash_read_record(flash_read *r, char *data) {
+	item *it = r->it;
+	flash_record rec;
+	char key[KEY_MAX_LENGTH];
+	struct iovec iov[3];
+	ssize_t n;
+
+	if (!flash_loc_valid(&r->loc))
+		return false;
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = key;
+	iov[1].iov_len = it->nkey;
+	iov[2].iov_base = data;
+	iov[2].iov_len = r->loc.nbytes;
+	do {
+		n = preadv(fds[r->loc.segment], iov, 3, r->loc.offset);
+	} while (n < 0 && errno == EINTR);
+	__atomic_add_fetch(&flash_stats_data.reads, 1, __ATOMIC_RELAXED);
+	if (n != (ssize_t) (sizeof(rec) + it->nkey + r->loc.nbytes))
+		return false;
+	__atomic_add_fetch(&flash_stats_data.read_bytes, n, __ATOMIC_RELAXED);
+	return rec.nkey == it->nkey && rec.nbytes == r->loc.nbytes
+			&& rec.cas == it->cas && memcmp(key, ITEM_key(it), it->nkey) == 0
+			&& rec.check == item_hash(data, r->loc.nbytes);
+}
+
+/*
+ * Fills in the item of r, decompressing the value if the item was made
+ * for the decompressed one.
+ */
+static bool flash_read_value(flash_read *r) {
+	char *data;
+	bool ok;
+
+	if (r->it->nbytes == r->loc.nbytes)
+		return flash_read_record(r, ITEM_data(r->it));
+	data = (char *) malloc(r->loc.nbytes);
+	ok = data != NULL && flash_read_record(r, data)
+			&& compress_expand_into(data, r->loc.nbytes, ITEM_data(r->it),
+					r->it->nbytes);
+	free(data);
+	return ok;
+}
+
+static void *flash_reader_thread(void *arg) {
+	flash_batch *batch;
+	flash_read *r;
+	conn *c;
+
+	while (1) {
+		pthread_mutex_lock(&read_lock);
+		while (read_head == NULL)
+			pthread_cond_wait(&read_cond, &read_lock);
+		r = read_head;
+		read_head = r->next;
+		if (read_head == NULL)
+			read_tail = NULL;
+		pthread_mutex_unlock(&read_lock);
+
+		if (!flash_read_value(r)) {
+			flash_miss(r);
+			item_unlink(r->hdr);
+		}
+		item_remove(r->hdr);
+		batch = r->batch;
+		free(r);
+		/* the response is complete with the last read */
+		if (__atomic_sub_fetch(&batch->left, 1, __ATOMIC_ACQ_REL) == 0) {
+			c = batch->c;
+			free(batch);
+			conn_worker_resume(c);
+		}
+	}
+	return NULL;
+}
+
+void flash_stats(ADD_STAT add_stats, conn *c) {
+	append_stat("ext_items_written", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&flash_stats_data.items_written, __ATOMIC_RELAXED));
+	append_stat("ext_bytes_written", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&flash_stats_data.bytes_written, __ATOMIC_RELAXED));
+	append_stat("ext_write_errors", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&flash_stats_data.write_errors, __ATOMIC_RELAXED));
+	append_stat("ext_segments_recycled", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&flash_stats_data.segments_recycled, __ATOMIC_RELAXED));
+	append_stat("ext_reads", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&flash_stats_data.reads,
+					__ATOMIC_RELAXED));
+	append_stat("ext_read_bytes", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&flash_stats_data.read_bytes,
+					__ATOMIC_RELAXED));
+	append_stat("ext_read_misses", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(
+					&flash_stats_data.read_misses, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,1381 @@
+/*
+ * items.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/items.h>
+#include <network/storage/assoc.h>
+#include <network/storage/compress.h>
+#include <network/storage/flash.h>
+#include <network/storage/persist.h>
+#include <network/storage/range.h>
+#include <network/storage/restart.h>
+#include <network/storage/slabs.h>
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_stats.h>
+#include <network/core/conn_thread.h>
+#include <network/core/conn_utils.h>
+#include <vutils/Logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "items"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+/* relative expiration times go up to 30 days, larger ones are unix times */
+#define REALTIME_MAXDELTA 60*60*24*30
+
+/* bumps a worker can queue ahead of the maintainer, a power of two */
+#define LRU_BUMP_BUF_SIZE 8192
+/* items the maintainer moves off one LRU per pass */
+#define LRU_JUGGLE_MAX 500
+/* locked items skipped at a tail before giving up on it for the pass */
+#define LRU_TAIL_TRIES 5
+/* pause between maintainer passes, shorter while there is work */
+#define LRU_MAINTAINER_SLEEP_MIN 1000
+#define LRU_MAINTAINER_SLEEP_MAX 1000000
+/* cold items of a slab class looked at per pass of the flash writer */
+#define FLASH_PASS_MAX 256
+/* evictions an allocation tries before it fails */
+#define EVICT_TRIES 5
+/* pause between rebalancer decisions */
+#define REBAL_INTERVAL 1000000
+/* decisions in a row a class must evict the most in to get a page */
+#define REBAL_STREAK 3
+/* times older than its evicted items the oldest item of a donor must be */
+#define REBAL_AGE_RATIO 2
+/* seconds a page may take to empty before its move is given up */
+#define REBAL_TIMEOUT 30
+/* pause between sweeps of a page that isn't empty yet */
+#define REBAL_SWEEP_SLEEP 1000
+
+static uint64_t cas_id;
+
+/* LRUs, indexed by slab class | segment */
+static item *heads[NUM_LRUS];
+static item *tails[NUM_LRUS];
+static uint64_t sizes[NUM_LRUS];
+static pthread_mutex_t lru_locks[NUM_LRUS];
+
+/* maintainer counters of each slab class, updated with atomics */
+static struct {
+	uint64_t moves_to_cold;
+	uint64_t moves_to_warm;
+	uint64_t moves_within_lru;
+	uint64_t reclaimed; /* expired items found at a tail */
+	uint64_t evicted; /* live items freed for an allocation */
+	rel_time_t evicted_time; /* seconds the last of them sat unused */
+	uint64_t outofmemory; /* allocations that found nothing to evict */
+} lru_class_stats[MAX_NUMBER_OF_SLAB_CLASSES];
+
+/*
+ * Per worker ring of cold items fetched again, written by the worker and
+ * drained by the maintainer without a lock.
+ */
+typedef struct {
+	item *it;
+	uint32_t hv;
+} lru_bump_entry;
+
+typedef struct lru_bump_buf {
+	struct lru_bump_buf *next; /* all buffers, newest first */
+	uint64_t tail; /* entries queued, by the worker */
+	uint64_t dropped; /* bumps lost to a full ring */
+	uint64_t head __attribute__((aligned(64))); /* taken, by the maintainer */
+	lru_bump_entry entries[LRU_BUMP_BUF_SIZE];
+} lru_bump_buf;
+
+static lru_bump_buf *bump_bufs;
+static pthread_mutex_t bump_bufs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+	uint64_t juggles; /* maintainer passes */
+	uint64_t bumps; /* bumps moved to warm */
+	uint64_t bumps_stale; /* bumps of items gone or moved meanwhile */
+} lru_stats;
+
+static pthread_t lru_maintainer_tid;
+static pthread_t rebalance_tid;
+static bool lru_maintainer_started;
+static bool rebalance_started;
+
+/* the background threads sleep on it, woken early by items_stop() */
+static pthread_mutex_t bg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bg_cond = PTHREAD_COND_INITIALIZER;
+static bool bg_stop;
+
+/* pages moved between slab classes, by the rebalancer */
+static struct {
+	uint64_t moved; /* pages cut for another class */
+	uint64_t aborted; /* moves given up, the page stayed */
+	uint64_t rescues; /* items copied out of a page being moved */
+	uint64_t evictions; /* items unlinked from it, no room to copy them */
+} rebal_stats;
+
+/* engine counters, updated with atomics */
+static struct {
+	uint64_t curr_items;
+	uint64_t total_items;
+	uint64_t curr_bytes;
+	uint64_t restored; /* found in the memory_file at start */
+	uint64_t flash_items; /* header items linked */
+} item_stats;
+
+/* rel_time_t of the process that wrote the memory_file to ours */
+static int64_t restore_shift;
+
+static void *lru_maintainer_thread(void *arg);
+static void *rebalance_thread(void *arg);
+static bool item_restore(void *chunk, unsigned int id);
+static bool lru_evict(unsigned int id);
+
+int items_init(void) {
+	int power = storage_settings.hashpower_init;
+	restart_state rs;
+	int restored = 0;
+	int i, ret;
+
+	if (slabs_init(storage_settings.maxbytes, storage_settings.factor,
+			sizeof(item) + storage_settings.chunk_size) != 0) {
+		MY_LOGE("bad memory settings: -m %lluMB -f %.2f -n %d",
+				(unsigned long long) storage_settings.maxbytes / (1024 * 1024),
+				storage_settings.factor, storage_settings.chunk_size);
+		return -1;
+	}
+	if (storage_settings.memory_file != NULL
+			&& (restored = restart_open(&rs)) < 0)
+		return -1;
+	if (restored) {
+		/* big enough not to expand while the items come back */
+		while (power < 32 && (1ULL << power) * 3 / 2 < rs.curr_items)
+			power++;
+		cas_id = rs.cas_id;
+		restore_shift = rs.time_shift;
+	}
+	if (assoc_init(power) != 0) {
+		MY_LOGE("failed to allocate 2^%d hash buckets", power);
+		return -1;
+	}
+	if (storage_settings.range_index && range_init() != 0) {
+		MY_LOGE("failed to allocate the range index");
+		return -1;
+	}
+	for (i = 0; i < NUM_LRUS; i++)
+		pthread_mutex_init(&lru_locks[i], NULL);
+	if (restored) {
+		slabs_restore(item_restore);
+		MY_LOGD("memory_file %s: %llu of %llu items restored",
+				storage_settings.memory_file,
+				(unsigned long long) item_stats.restored,
+				(unsigned long long) rs.curr_items);
+	}
+	if ((ret = pthread_create(&lru_maintainer_tid, NULL, lru_maintainer_thread,
+			NULL)) != 0) {
+		MY_LOGE("Can't create LRU maintainer thread: %s", strerror(ret));
+		return -1;
+	}
+	lru_maintainer_started = true;
+	if (storage_settings.slab_automove) {
+		if ((ret = pthread_create(&rebalance_tid, NULL, rebalance_thread,
+				NULL)) != 0) {
+			MY_LOGE("Can't create slab rebalancer thread: %s", strerror(ret));
+			return -1;
+		}
+		rebalance_started = true;
+	}
+	if (storage_settings.log_file != NULL && persist_init() != 0)
+		return -1;
+	if (storage_settings.ext_path != NULL && flash_init() != 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * MurmurHash3 x86_32 by Austin Appleby, public domain.
+ */
+static inline uint32_t rotl32(uint32_t x, int8_t r) {
+	return (x << r) | (x >> (32 - r));
+}
+
+uint32_t item_hash(const void *key, size_t nkey) {
+	const uint8_t *data = (const uint8_t *) key;
+	const int nblocks = nkey / 4;
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	const uint8_t *tail;
+	uint32_t h1 = 0, k1 = 0;
+	int i;
+
+	for (i = 0; i < nblocks; i++) {
+		memcpy(&k1, data + i * 4, 4);
+		k1 *= c1;
+		k1 = rotl32(k1, 15);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = rotl32(h1, 13);
+		h1 = h1 * 5 + 0xe6546b64;
+	}
+
+	tail = data + nblocks * 4;
+	k1 = 0;
+	switch (nkey & 3) {
+	case 3:
+		k1 ^= tail[2] << 16;
+		/* fall through */
+	case 2:
+		k1 ^= tail[1] << 8;
+		/* fall through */
+	case 1:
+		k1 ^= tail[0];
+		k1 *= c1;
+		k1 = rotl32(k1, 15);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= nkey;
+	h1 ^= h1 >> 16;
+	h1 *= 0x85ebca6b;
+	h1 ^= h1 >> 13;
+	h1 *= 0xc2b2ae35;
+	h1 ^= h1 >> 16;
+	return h1;
+}
+
+void item_lock(uint32_t hv) {
+	assoc_lock(hv);
+}
+
+void item_unlock(uint32_t hv) {
+	assoc_unlock(hv);
+}
+
+rel_time_t item_realtime(uint32_t exptime) {
+	/* no. of seconds in 30 days - largest possible delta exptime */
+	if (exptime == 0)
+		return 0; /* 0 means never expire */
+	if (exptime > REALTIME_MAXDELTA) {
+		/* if item expiration is at/before the server started, give it an
+		 expiration time of 1 second after the server started. */
+		if ((time_t) exptime <= process_started)
+			return (rel_time_t) 1;
+		return (rel_time_t) (exptime - process_started);
+	}
+	return (rel_time_t) (exptime + current_time);
+}
+
+static uint64_t get_cas_id(void) {
+	return settings.use_cas ? __atomic_add_fetch(&cas_id, 1, __ATOMIC_RELAXED)
+			: 0;
+}
+
+item *item_alloc(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, uint32_t nbytes, enum store_item_type *res) {
+	size_t ntotal = ITEM_ntotal(nkey, nbytes);
+	unsigned int id = slabs_clsid(ntotal);
+	int tries;
+	item *it;
+
+	assert(nkey <= KEY_MAX_LENGTH);
+	if (id == 0) {
+		*res = TOO_LARGE;
+		return NULL;
+	}
+	it = (item *) slabs_alloc(id);
+	/* another thread may take the chunk freed first */
+	for (tries = 0; it == NULL && storage_settings.evict_to_free
+			&& tries < EVICT_TRIES; tries++) {
+		if (!lru_evict(id))
+			break;
+		/* the range index lets go of it at its next collect */
+		if (storage_settings.range_index)
+			range_collect();
+		it = (item *) slabs_alloc(id);
+	}
+	if (it == NULL) {
+		__atomic_add_fetch(&lru_class_stats[id].outofmemory, 1,
+				__ATOMIC_RELAXED);
+		*res = OUT_OF_MEMORY;
+		return NULL;
+	}
+	it->h.next = NULL;
+	it->time = current_time;
+	it->exptime = exptime;
+	it->nbytes = nbytes;
+	it->flags = flags;
+	it->cas = 0;
+	it->it_flags = 0;
+	it->slabs_clsid = id;
+	it->nkey = nkey;
+	it->refcount = 1;
+	memcpy(ITEM_key(it), key, nkey);
+	return it;
+}
+
+static void item_free(item *it) {
+	assert((it->it_flags & ITEM_LINKED) == 0);
+	assert(it->refcount == 0);
+	if (it->it_flags & ITEM_ACCOUNTED)
+		compress_forget(it);
+	slabs_free(it, ITEM_clsid(it));
+}
+
+void item_remove(item *it) {
+	if (__atomic_sub_fetch(&it->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		item_free(it);
+}
+
+/*
+ * Puts it at the head of its LRU, which is locked.
+ */
+static void do_lru_link(item *it) {
+	int id = it->slabs_clsid;
+
+	it->prev = NULL;
+	it->next = heads[id];
+	if (it->next != NULL)
+		it->next->prev = it;
+	heads[id] = it;
+	if (tails[id] == NULL)
+		tails[id] = it;
+	sizes[id]++;
+}
+
+static void do_lru_unlink(item *it) {
+	int id = it->slabs_clsid;
+
+	if (heads[id] == it)
+		heads[id] = it->next;
+	if (tails[id] == it)
+		tails[id] = it->prev;
+	if (it->next != NULL)
+		it->next->prev = it->prev;
+	if (it->prev != NULL)
+		it->prev->next = it->next;
+	it->next = it->prev = NULL;
+	sizes[id]--;
+}
+
+static void lru_link(item *it) {
+	pthread_mutex_lock(&lru_locks[it->slabs_clsid]);
+	do_lru_link(it);
+	pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
+}
+
+static void lru_unlink(item *it) {
+	pthread_mutex_lock(&lru_locks[it->slabs_clsid]);
+	do_lru_unlink(it);
+	pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
+}
+
+/*
+ * Moves it to the head of segment lru, item lock held.
+ */
+static void lru_move(item *it, int lru) {
+	lru_unlink(it);
+	it->slabs_clsid = ITEM_clsid(it) | lru;
+	lru_link(it);
+}
+
+static void do_item_link(item *it, uint32_t hv) {
+	it->it_flags |= ITEM_LINKED;
+	it->time = current_time;
+	it->cas = get_cas_id();
+	it->slabs_clsid = ITEM_clsid(it) | HOT_LRU;
+	__atomic_add_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+	assoc_insert(it, hv);
+	if (storage_settings.range_index)
+		range_link(it);
+	lru_link(it);
+	persist_link(it, hv);
+	__atomic_add_fetch(&item_stats.curr_items, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&item_stats.total_items, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&item_stats.curr_bytes,
+			ITEM_ntotal(it->nkey, it->nbytes), __ATOMIC_RELAXED);
+}
+
+/*
+ * Relinks the item in chunk, of slab class id, left by a clean stop. false
+ * if chunk holds none, or one expired since.
+ */
+static bool item_restore(void *chunk, unsigned int id) {
+	item *it = (item *) chunk;
+	int64_t t;
+	uint32_t hv;
+
+	if ((it->it_flags & ITEM_LINKED) == 0)
+		return false;
+	/* the flash tier starts empty, so do header items */
+	if ((it->it_flags & ITEM_HDR) || ITEM_clsid(it) != id
+			|| ITEM_ntotal(it->nkey, it->nbytes) > slabs_chunk_size(id)) {
+		/* not to be found again at the next start */
+		it->it_flags = 0;
+		return false;
+	}
+	if (it->exptime != 0) {
+		t = (int64_t) it->exptime + restore_shift;
+		if (t <= (int64_t) current_time) {
+			it->it_flags = 0;
+			return false;
+		}
+		it->exptime = t;
+	}
+	t = (int64_t) it->time + restore_shift;
+	it->time = t > 0 ? t : 0;
+	/* neither the range index nor the compressed stats know it yet */
+	it->it_flags &= ~(ITEM_INDEXED | ITEM_ACCOUNTED);
+	/* the hash table's */
+	it->refcount = 1;
+
+	hv = item_hash(ITEM_key(it), it->nkey);
+	item_lock(hv);
+	if (assoc_find(ITEM_key(it), it->nkey, hv) != NULL) {
+		item_unlock(hv);
+		it->it_flags = 0;
+		return false;
+	}
+	assoc_insert(it, hv);
+	if (storage_settings.range_index)
+		range_link(it);
+	/* back into the segment it was in */
+	lru_link(it);
+	item_unlock(hv);
+	if (it->it_flags & ITEM_COMPRESSED)
+		compress_account(it);
+
+	item_stats.curr_items++;
+	item_stats.total_items++;
+	item_stats.restored++;
+	item_stats.curr_bytes += ITEM_ntotal(it->nkey, it->nbytes);
+	if (it->cas > cas_id)
+		cas_id = it->cas;
+	return true;
+}
+
+void items_stop(void) {
+	restart_state rs;
+
+	pthread_mutex_lock(&bg_lock);
+	bg_stop = true;
+	pthread_cond_broadcast(&bg_cond);
+	pthread_mutex_unlock(&bg_lock);
+	if (lru_maintainer_started)
+		pthread_join(lru_maintainer_tid, NULL);
+	if (rebalance_started)
+		pthread_join(rebalance_tid, NULL);
+	lru_maintainer_started = rebalance_started = false;
+
+	if (storage_settings.memory_file == NULL
+			&& storage_settings.log_file == NULL)
+		return;
+	/* the workers block on their next item */
+	assoc_lock_all();
+	if (storage_settings.log_file != NULL)
+		persist_stop();
+	if (storage_settings.memory_file == NULL)
+		return;
+	rs.cas_id = __atomic_load_n(&cas_id, __ATOMIC_RELAXED);
+	rs.curr_items = __atomic_load_n(&item_stats.curr_items, __ATOMIC_RELAXED);
+	rs.time_shift = 0;
+	restart_close(&rs);
+}
+
+static void do_item_unlink(item *it, uint32_t hv) {
+	assert(it->it_flags & ITEM_LINKED);
+	assoc_delete(ITEM_key(it), it->nkey, hv);
+	range_unlink(it);
+	lru_unlink(it);
+	it->it_flags &= ~ITEM_LINKED;
+	if (it->it_flags & ITEM_HDR)
+		__atomic_sub_fetch(&item_stats.flash_items, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&item_stats.curr_items, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&item_stats.curr_bytes,
+			ITEM_ntotal(it->nkey, it->nbytes), __ATOMIC_RELAXED);
+	item_remove(it);
+}
+
+/*
+ * Finds key, unlinking it if it expired. Called with the item lock held.
+ */
+static item *do_item_get(const char *key, size_t nkey, uint32_t hv) {
+	item *it = assoc_find(key, nkey, hv);
+
+	if (it == NULL)
+		return NULL;
+	if (it->exptime != 0 && it->exptime <= current_time) {
+		do_item_unlink(it, hv);
+		return NULL;
+	}
+	return it;
+}
+
+/*
+ * Queues a move of cold item it to warm for the maintainer, never blocks:
+ * the bump is dropped when the ring is full, the maintainer still finds
+ * the item active once it reaches the cold tail.
+ */
+static void lru_bump_async(LIBEVENT_THREAD *me, item *it, uint32_t hv) {
+	lru_bump_buf *b = (lru_bump_buf *) me->lru_bump_buf;
+	lru_bump_entry *e;
+	uint64_t tail;
+
+	if (b == NULL) {
+		b = (lru_bump_buf *) calloc(1, sizeof(lru_bump_buf));
+		if (b == NULL)
+			return;
+		pthread_mutex_lock(&bump_bufs_lock);
+		b->next = bump_bufs;
+		__atomic_store_n(&bump_bufs, b, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&bump_bufs_lock);
+		me->lru_bump_buf = b;
+	}
+
+	tail = b->tail;
+	if (tail - __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) == LRU_BUMP_BUF_SIZE) {
+		__atomic_add_fetch(&b->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	e = &b->entries[tail & (LRU_BUMP_BUF_SIZE - 1)];
+	e->it = it;
+	e->hv = hv;
+	__atomic_store_n(&b->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Notes a fetch of it, item lock held. Only flags are set, the maintainer
+ * acts on them when the item reaches a tail, except for cold items fetched
+ * again which are queued to move to warm right away.
+ */
+static void do_item_bump(conn *c, item *it, uint32_t hv) {
+	if ((it->it_flags & ITEM_ACTIVE) == 0) {
+		if ((it->it_flags & ITEM_FETCHED) == 0) {
+			it->it_flags |= ITEM_FETCHED;
+		} else {
+			it->it_flags |= ITEM_ACTIVE;
+			if (ITEM_lruid(it) == COLD_LRU && c != NULL)
+				lru_bump_async(c->thread, it, hv);
+		}
+	}
+	if (it->time + ITEM_UPDATE_INTERVAL < current_time)
+		it->time = current_time;
+}
+
+item *item_get(const char *key, size_t nkey, uint32_t hv, conn *c) {
+	item *it;
+
+	item_lock(hv);
+	it = do_item_get(key, nkey, hv);
+	if (it != NULL) {
+		__atomic_add_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+		do_item_bump(c, it, hv);
+	}
+	item_unlock(hv);
+	return it;
+}
+
+enum store_item_type item_store(item *it, enum store_op op, uint64_t cas,
+		uint64_t *cas_out) {
+	uint32_t hv = item_hash(ITEM_key(it), it->nkey);
+	enum store_item_type res;
+	item *old;
+
+	item_lock(hv);
+	old = do_item_get(ITEM_key(it), it->nkey, hv);
+	if (old != NULL && op == STORE_ADD) {
+		res = NOT_STORED;
+	} else if (old == NULL && cas != 0) {
+		res = NOT_FOUND;
+	} else if (old == NULL && op == STORE_REPLACE) {
+		res = NOT_STORED;
+	} else if (old != NULL && cas != 0 && old->cas != cas) {
+		res = EXISTS;
+	} else {
+		if (old != NULL)
+			do_item_unlink(old, hv);
+		do_item_link(it, hv);
+		*cas_out = it->cas;
+		res = STORED;
+	}
+	item_unlock(hv);
+
+	item_remove(it);
+	return res;
+}
+
+bool item_replay(const char *key, size_t nkey, uint32_t flags,
+		rel_time_t exptime, const char *data, uint32_t nbytes, uint64_t cas,
+		bool compressed) {
+	uint32_t hv = item_hash(key, nkey);
+	enum store_item_type res;
+	uint64_t id;
+	item *it, *old;
+
+	it = item_alloc(key, nkey, flags, exptime, nbytes, &res);
+	if (it == NULL) {
+		/* an older value must not come back */
+		item_delete(key, nkey, 0);
+		return false;
+	}
+	memcpy(ITEM_data(it), data, nbytes);
+	if (compressed) {
+		it->it_flags |= ITEM_COMPRESSED;
+		compress_account(it);
+	}
+
+	item_lock(hv);
+	old = do_item_get(key, nkey, hv);
+	if (old != NULL)
+		do_item_unlink(old, hv);
+	do_item_link(it, hv);
+	it->cas = cas;
+	item_unlock(hv);
+	item_remove(it);
+
+	/* new cas values go on from the highest one logged */
+	id = __atomic_load_n(&cas_id, __ATOMIC_RELAXED);
+	while (id < cas && !__atomic_compare_exchange_n(&cas_id, &id, cas, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return true;
+}
+
+void item_unlink(item *it) {
+	uint32_t hv = item_hash(ITEM_key(it), it->nkey);
+
+	item_lock(hv);
+	if (it->it_flags & ITEM_LINKED)
+		do_item_unlink(it, hv);
+	item_unlock(hv);
+}
+
+enum store_item_type item_delete(const char *key, size_t nkey, uint64_t cas) {
+	uint32_t hv = item_hash(key, nkey);
+	enum store_item_type res;
+	item *it;
+
+	item_lock(hv);
+	it = do_item_get(key, nkey, hv);
+	if (it == NULL) {
+		res = NOT_FOUND;
+	} else if (cas != 0 && it->cas != cas) {
+		res = EXISTS;
+	} else {
+		do_item_unlink(it, hv);
+		persist_delete(key, nkey, hv);
+		res = DELETED;
+	}
+	item_unlock(hv);
+	return res;
+}
+
+enum delta_result_type item_add_delta(const char *key, size_t nkey,
+		bool incr, uint64_t delta, uint64_t cas, uint64_t *value,
+		uint64_t *cas_out) {
+	uint32_t hv = item_hash(key, nkey);
+	enum delta_result_type res = DELTA_OK;
+	enum store_item_type alloc_res;
+	char buf[INCR_MAX_STORAGE_LEN];
+	uint64_t value_in;
+	item *it, *new_it;
+	int len;
+
+	item_lock(hv);
+	it = do_item_get(key, nkey, hv);
+	if (it == NULL) {
+		res = DELTA_ITEM_NOT_FOUND;
+		goto out;
+	}
+	if (cas != 0 && it->cas != cas) {
+		res = DELTA_ITEM_CAS_MISMATCH;
+		goto out;
+	}
+
+	/* the value must be a decimal number, and fit the buffer */
+	if (it->nbytes == 0 || it->nbytes >= sizeof(buf)
+			|| (it->it_flags & (ITEM_HDR | ITEM_COMPRESSED))) {
+		res = NON_NUMERIC;
+		goto out;
+	}
+	memcpy(buf, ITEM_data(it), it->nbytes);
+	buf[it->nbytes] = '\0';
+	if (!safe_strtoull(buf, &value_in)) {
+		res = NON_NUMERIC;
+		goto out;
+	}
+
+	if (incr) {
+		value_in += delta;
+	} else if (delta > value_in) {
+		value_in = 0;
+	} else {
+		value_in -= delta;
+	}
+	len = snprintf(buf, sizeof(buf), "%llu", (unsigned long long) value_in);
+
+	if ((uint32_t) len == it->nbytes && (it->it_flags & ITEM_INDEXED) == 0
+			&& __atomic_load_n(&it->refcount, __ATOMIC_ACQUIRE) == 1) {
+		/*
+		 * same length and no reader, write it in place. Range scans
+		 * reference items without the lock, indexed ones are copied.
+		 */
+		memcpy(ITEM_data(it), buf, len);
+		it->cas = get_cas_id();
+		*cas_out = it->cas;
+		persist_link(it, hv);
+	} else {
+		new_it = item_alloc(key, nkey, it->flags, it->exptime, len,
+				&alloc_res);
+		if (new_it == NULL) {
+			res = DELTA_EOM;
+			goto out;
+		}
+		memcpy(ITEM_data(new_it), buf, len);
+		do_item_unlink(it, hv);
+		do_item_link(new_it, hv);
+		*cas_out = new_it->cas;
+		item_remove(new_it);
+	}
+	*value = value_in;
+
+out:
+	item_unlock(hv);
+	return res;
+}
+
+/*
+ * Applies the queued bumps. A queued item may have been deleted, even
+ * reused, since: it is only touched if it is still linked under hv.
+ */
+static int lru_maintainer_bumps(void) {
+	lru_bump_buf *b;
+	int did = 0;
+
+	for (b = __atomic_load_n(&bump_bufs, __ATOMIC_ACQUIRE); b != NULL;
+			b = b->next) {
+		uint64_t head = b->head;
+		uint64_t tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++) {
+			lru_bump_entry *e = &b->entries[head & (LRU_BUMP_BUF_SIZE - 1)];
+			item *it = e->it;
+
+			item_lock(e->hv);
+			if (assoc_contains(it, e->hv) && ITEM_lruid(it) == COLD_LRU
+					&& (it->it_flags & ITEM_ACTIVE)) {
+				it->it_flags &= ~ITEM_ACTIVE;
+				lru_move(it, WARM_LRU);
+				__atomic_add_fetch(&lru_class_stats[ITEM_clsid(it)].moves_to_warm,
+						1, __ATOMIC_RELAXED);
+				__atomic_add_fetch(&lru_stats.bumps, 1, __ATOMIC_RELAXED);
+			} else {
+				__atomic_add_fetch(&lru_stats.bumps_stale, 1, __ATOMIC_RELAXED);
+			}
+			item_unlock(e->hv);
+			did++;
+		}
+		__atomic_store_n(&b->head, head, __ATOMIC_RELEASE);
+	}
+	return did;
+}
+
+static uint64_t lru_size(int id) {
+	uint64_t size;
+
+	pthread_mutex_lock(&lru_locks[id]);
+	size = sizes[id];
+	pthread_mutex_unlock(&lru_locks[id]);
+	return size;
+}
+
+/*
+ * it is a header item whose value the flash tier dropped since.
+ */
+static bool item_flash_lost(const item *it) {
+	flash_loc loc;
+
+	if ((it->it_flags & ITEM_HDR) == 0)
+		return false;
+	memcpy(&loc, ITEM_data(it), sizeof(loc));
+	return !flash_loc_valid(&loc);
+}
+
+/*
+ * Works the tail of LRU id|lru while it holds more than limit items, up to
+ * LRU_JUGGLE_MAX of them: expired items are freed, items fetched again move
+ * to warm, the others to cold. On cold, the pass stops at the first item
+ * that stays; header items whose value is gone are freed there too. Returns the items handled.
+ */
+static int lru_pull_tail(int id, int lru, uint64_t limit) {
+	int did = 0, tries;
+	item *it;
+	uint32_t hv;
+
+	while (did < LRU_JUGGLE_MAX) {
+		pthread_mutex_lock(&lru_locks[id | lru]);
+		if (sizes[id | lru] <= limit) {
+			pthread_mutex_unlock(&lru_locks[id | lru]);
+			break;
+		}
+		/* the LRU lock is taken after item locks, only try those */
+		hv = 0;
+		for (it = tails[id | lru], tries = LRU_TAIL_TRIES;
+				it != NULL && tries > 0; it = it->prev, tries--) {
+			hv = it->h.hv;
+			if (assoc_trylock(hv))
+				break;
+		}
+		pthread_mutex_unlock(&lru_locks[id | lru]);
+		if (it == NULL || tries == 0)
+			break;
+
+		if ((it->exptime != 0 && it->exptime <= current_time)
+				|| item_flash_lost(it)) {
+			do_item_unlink(it, hv);
+			__atomic_add_fetch(&lru_class_stats[id].reclaimed, 1,
+					__ATOMIC_RELAXED);
+		} else if (it->it_flags & ITEM_ACTIVE) {
+			it->it_flags &= ~ITEM_ACTIVE;
+			lru_move(it, WARM_LRU);
+			if (lru == WARM_LRU)
+				__atomic_add_fetch(&lru_class_stats[id].moves_within_lru, 1,
+						__ATOMIC_RELAXED);
+			else
+				__atomic_add_fetch(&lru_class_stats[id].moves_to_warm, 1,
+						__ATOMIC_RELAXED);
+		} else if (lru != COLD_LRU) {
+			lru_move(it, COLD_LRU);
+			__atomic_add_fetch(&lru_class_stats[id].moves_to_cold, 1,
+					__ATOMIC_RELAXED);
+		} else {
+			item_unlock(hv);
+			break;
+		}
+		item_unlock(hv);
+		did++;
+	}
+	return did;
+}
+
+/*
+ * Frees the least recently used item of class id that nobody else
+ * references, from the tail of cold, then warm, then hot. false if none
+ * could be had.
+ */
+static bool lru_evict(unsigned int id) {
+	static const int lrus[] = { COLD_LRU, WARM_LRU, HOT_LRU };
+	int i, tries;
+	item *it;
+	uint32_t hv = 0;
+
+	for (i = 0; i < 3; i++) {
+		pthread_mutex_lock(&lru_locks[id | lrus[i]]);
+		for (it = tails[id | lrus[i]], tries = LRU_TAIL_TRIES;
+				it != NULL && tries > 0; it = it->prev, tries--) {
+			hv = it->h.hv;
+			if (!assoc_trylock(hv))
+				continue;
+			/*
+			 * only the hash table's, its chunk is free at once, or once the
+			 * maintainer collects what the range index let go of
+			 */
+			if (it->refcount == ((it->it_flags & ITEM_INDEXED) ? 2 : 1))
+				break;
+			item_unlock(hv);
+		}
+		pthread_mutex_unlock(&lru_locks[id | lrus[i]]);
+		if (it == NULL || tries == 0)
+			continue;
+
+		if (it->exptime != 0 && it->exptime <= current_time) {
+			__atomic_add_fetch(&lru_class_stats[id].reclaimed, 1,
+					__ATOMIC_RELAXED);
+		} else {
+			__atomic_add_fetch(&lru_class_stats[id].evicted, 1,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&lru_class_stats[id].evicted_time,
+					current_time - it->time, __ATOMIC_RELAXED);
+		}
+		do_item_unlink(it, hv);
+		item_unlock(hv);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Brings hot and warm of class id back to their share, returns the items
+ * moved.
+ */
+static int lru_juggle(int id) {
+	uint64_t total = lru_size(id | HOT_LRU) + lru_size(id | WARM_LRU)
+			+ lru_size(id | COLD_LRU);
+	int did = 0;
+
+	if (total == 0)
+		return 0;
+	did += lru_pull_tail(id, HOT_LRU,
+			total * storage_settings.hot_lru_pct / 100);
+	did += lru_pull_tail(id, WARM_LRU,
+			total * storage_settings.warm_lru_pct / 100);
+	did += lru_pull_tail(id, COLD_LRU, 0);
+	return did;
+}
+
+/* sleeps usec, false once items_stop() wants the threads gone */
+static bool bg_sleep(useconds_t usec) {
+	struct timespec ts;
+	bool run;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += usec / 1000000;
+	ts.tv_nsec += (long) (usec % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&bg_lock);
+	if (!bg_stop)
+		pthread_cond_timedwait(&bg_cond, &bg_lock, &ts);
+	run = !bg_stop;
+	pthread_mutex_unlock(&bg_lock);
+	return run;
+}
+
+static void *lru_maintainer_thread(void *arg) {
+	useconds_t to_sleep = LRU_MAINTAINER_SLEEP_MIN;
+	int id, did;
+
+	do {
+		did = lru_maintainer_bumps();
+		for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++)
+			did += lru_juggle(id);
+		__atomic_add_fetch(&lru_stats.juggles, 1, __ATOMIC_RELAXED);
+		if (storage_settings.range_index)
+			range_collect();
+
+		if (did == 0 && to_sleep < LRU_MAINTAINER_SLEEP_MAX)
+			to_sleep *= 2;
+		else if (did > 0 && to_sleep > LRU_MAINTAINER_SLEEP_MIN)
+			to_sleep /= 2;
+		if (to_sleep > LRU_MAINTAINER_SLEEP_MAX)
+			to_sleep = LRU_MAINTAINER_SLEEP_MAX;
+		if (to_sleep < LRU_MAINTAINER_SLEEP_MIN)
+			to_sleep = LRU_MAINTAINER_SLEEP_MIN;
+	} while (bg_sleep(to_sleep));
+	return NULL;
+}
+
+/*
+ * Seconds the least recently used item of class id sat unused, 0 if it has
+ * none.
+ */
+static rel_time_t lru_tail_age(unsigned int id) {
+	static const int lrus[] = { COLD_LRU, WARM_LRU, HOT_LRU };
+	rel_time_t oldest = current_time;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		pthread_mutex_lock(&lru_locks[id | lrus[i]]);
+		if (tails[id | lrus[i]] != NULL && tails[id | lrus[i]]->time < oldest)
+			oldest = tails[id | lrus[i]]->time;
+		pthread_mutex_unlock(&lru_locks[id | lrus[i]]);
+	}
+	return current_time - oldest;
+}
+
+/*
+ * Picks a page move, once a second: to the class that evicted the most for
+ * REBAL_STREAK seconds in a row, and every second after while it still
+ * does, from one with more than a page of free chunks, or else from the one
+ * whose oldest item is the oldest, if that is REBAL_AGE_RATIO times older
+ * than the items the other evicts. Classes that evict themselves don't give
+ * pages.
+ */
+static bool rebalance_pick(unsigned int *src, unsigned int *dst) {
+	static uint64_t seen[MAX_NUMBER_OF_SLAB_CLASSES];
+	static unsigned int winner, streak;
+	bool evicting[MAX_NUMBER_OF_SLAB_CLASSES];
+	unsigned int id, best = 0, donor = 0, pages, free_chunks;
+	uint64_t n, most = 0;
+	rel_time_t age, oldest = 0;
+	bool spare = false;
+
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++) {
+		n = __atomic_load_n(&lru_class_stats[id].evicted, __ATOMIC_RELAXED)
+				+ __atomic_load_n(&lru_class_stats[id].outofmemory,
+						__ATOMIC_RELAXED);
+		evicting[id] = n > seen[id];
+		if (n - seen[id] > most) {
+			most = n - seen[id];
+			best = id;
+		}
+		seen[id] = n;
+	}
+	streak = best != 0 && best == winner ? streak + 1 : 1;
+	winner = best;
+	if (best == 0 || streak < REBAL_STREAK)
+		return false;
+
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++) {
+		if (id == best || evicting[id])
+			continue;
+		slabs_usage(id, &pages, &free_chunks);
+		if (pages < 2)
+			continue;
+		if (free_chunks > slabs_perslab(id)) {
+			donor = id;
+			spare = true;
+			break;
+		}
+		age = lru_tail_age(id);
+		if (age > oldest) {
+			oldest = age;
+			donor = id;
+		}
+	}
+	if (donor == 0 || (!spare && oldest <= REBAL_AGE_RATIO
+			* __atomic_load_n(&lru_class_stats[best].evicted_time,
+					__ATOMIC_RELAXED)))
+		return false;
+	*src = donor;
+	*dst = best;
+	return true;
+}
+
+/*
+ * Puts a copy of linked item it, in a chunk of the same class, in its
+ * place: same LRU position, nothing logged as nothing changed. Called with
+ * the item lock held. false if the class has no free chunk, or it is in the
+ * range index, which holds on to it.
+ */
+static bool item_rescue(item *it, uint32_t hv) {
+	item *copy;
+	int id;
+
+	if (it->it_flags & ITEM_INDEXED)
+		return false;
+	copy = (item *) slabs_alloc(ITEM_clsid(it));
+	if (copy == NULL)
+		return false;
+	memcpy(copy, it, ITEM_ntotal(it->nkey, it->nbytes));
+	/* the hash table's */
+	copy->refcount = 1;
+	assoc_delete(ITEM_key(it), it->nkey, hv);
+	assoc_insert(copy, hv);
+
+	id = it->slabs_clsid;
+	pthread_mutex_lock(&lru_locks[id]);
+	copy->prev = it->prev;
+	copy->next = it->next;
+	if (copy->prev != NULL)
+		copy->prev->next = copy;
+	else
+		heads[id] = copy;
+	if (copy->next != NULL)
+		copy->next->prev = copy;
+	else
+		tails[id] = copy;
+	it->next = it->prev = NULL;
+	pthread_mutex_unlock(&lru_locks[id]);
+
+	/* the copy is counted in the compressed stats now */
+	it->it_flags &= ~(ITEM_LINKED | ITEM_ACCOUNTED);
+	item_remove(it);
+	return true;
+}
+
+/*
+ * One pass over the chunks of page, of class id, being moved: the items in
+ * the hash table are copied elsewhere, or unlinked. The others are free, or
+ * someone's who frees them; chunks whose item lock is taken wait for the
+ * next pass.
+ */
+static void rebalance_sweep(char *page, unsigned int id) {
+	unsigned int i, n = slabs_perslab(id), size = slabs_chunk_size(id);
+	item *it;
+	uint32_t hv;
+
+	for (i = 0; i < n; i++) {
+		it = (item *) (page + (size_t) i * size);
+		/* stale or being written, the hash table tells */
+		hv = __atomic_load_n(&it->h.hv, __ATOMIC_RELAXED);
+		if (!assoc_trylock(hv))
+			continue;
+		if (assoc_contains(it, hv)) {
+			if (item_rescue(it, hv)) {
+				__atomic_add_fetch(&rebal_stats.rescues, 1, __ATOMIC_RELAXED);
+			} else {
+				do_item_unlink(it, hv);
+				__atomic_add_fetch(&rebal_stats.evictions, 1, __ATOMIC_RELAXED);
+			}
+		}
+		item_unlock(hv);
+	}
+}
+
+/*
+ * Moves pages to the slab classes that need them, without stopping anyone:
+ * a page is emptied a chunk at a time under its item lock, and the move
+ * given up after REBAL_TIMEOUT if someone holds on to an item in it, or
+ * once the server stops.
+ */
+static void *rebalance_thread(void *arg) {
+	unsigned int src, dst;
+	rel_time_t started;
+	char *page;
+
+	while (bg_sleep(REBAL_INTERVAL)) {
+		if (!rebalance_pick(&src, &dst)
+				|| (page = slabs_reassign_begin(src)) == NULL)
+			continue;
+		started = current_time;
+		rebalance_sweep(page, src);
+		while (!slabs_reassign_done()
+				&& current_time - started < REBAL_TIMEOUT
+				&& bg_sleep(REBAL_SWEEP_SLEEP))
+			rebalance_sweep(page, src);
+		if (slabs_reassign_done() && slabs_reassign_end(dst)) {
+			__atomic_add_fetch(&rebal_stats.moved, 1, __ATOMIC_RELAXED);
+			MY_LOGD("slab page moved from class %u to %u", src, dst);
+		} else {
+			slabs_reassign_abort();
+			__atomic_add_fetch(&rebal_stats.aborted, 1, __ATOMIC_RELAXED);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Puts a header item for loc in the place of it, if it is still linked and
+ * cold: same key, flags, cas and times, and nothing logged, as the value
+ * didn't change.
+ */
+static bool item_flash_swap(item *it, const flash_loc *loc) {
+	uint32_t hv = item_hash(ITEM_key(it), it->nkey);
+	enum store_item_type res;
+	bool swapped = false;
+	item *hdr;
+
+	hdr = item_alloc(ITEM_key(it), it->nkey, it->flags, it->exptime,
+			sizeof(*loc), &res);
+	if (hdr == NULL)
+		return false;
+	memcpy(ITEM_data(hdr), loc, sizeof(*loc));
+
+	item_lock(hv);
+	if ((it->it_flags & (ITEM_LINKED | ITEM_ACTIVE)) == ITEM_LINKED
+			&& ITEM_lruid(it) == COLD_LRU) {
+		hdr->it_flags = ITEM_LINKED | ITEM_HDR
+				| (it->it_flags & (ITEM_FETCHED | ITEM_COMPRESSED));
+		hdr->time = it->time;
+		hdr->cas = it->cas;
+		hdr->slabs_clsid = ITEM_clsid(hdr) | COLD_LRU;
+		__atomic_add_fetch(&hdr->refcount, 1, __ATOMIC_RELAXED);
+		assoc_delete(ITEM_key(it), it->nkey, hv);
+		assoc_insert(hdr, hv);
+		lru_unlink(it);
+		lru_link(hdr);
+		it->it_flags &= ~ITEM_LINKED;
+		__atomic_add_fetch(&item_stats.flash_items, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&item_stats.curr_bytes,
+				ITEM_ntotal(it->nkey, it->nbytes)
+						- ITEM_ntotal(hdr->nkey, hdr->nbytes), __ATOMIC_RELAXED);
+		item_remove(it);
+		swapped = true;
+	}
+	item_unlock(hv);
+	item_remove(hdr);
+	return swapped;
+}
+
+int items_flash_pass(void) {
+	item *its[FLASH_PASS_MAX];
+	flash_loc locs[FLASH_PASS_MAX];
+	/* no page left for any class, age doesn't matter any more */
+	bool full = slabs_malloced() + SLAB_PAGE_SIZE > storage_settings.maxbytes;
+	rel_time_t idle =
+			current_time > (rel_time_t) storage_settings.ext_item_age ?
+					current_time - storage_settings.ext_item_age : 0;
+	int id, n, i, tries, did = 0;
+	item *it;
+
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++) {
+		if (slabs_chunk_size(id)
+				< ITEM_ntotal(0, storage_settings.ext_item_size))
+			continue;
+		/* referenced under the LRU lock, they can't be freed meanwhile */
+		n = 0;
+		pthread_mutex_lock(&lru_locks[id | COLD_LRU]);
+		for (it = tails[id | COLD_LRU], tries = FLASH_PASS_MAX;
+				it != NULL && tries > 0; it = it->prev, tries--) {
+			if (!full && it->time > idle)
+				break;
+			if ((it->it_flags & (ITEM_HDR | ITEM_INDEXED | ITEM_ACTIVE))
+					|| it->nbytes < (uint32_t) storage_settings.ext_item_size
+					|| (it->exptime != 0 && it->exptime <= current_time))
+				continue;
+			__atomic_add_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+			its[n++] = it;
+		}
+		pthread_mutex_unlock(&lru_locks[id | COLD_LRU]);
+		if (n == 0)
+			continue;
+
+		for (i = 0; i < n; i++) {
+			if (flash_append(its[i], &locs[i]) != 0) {
+				item_remove(its[i]);
+				its[i] = NULL;
+			}
+		}
+		if (!flash_flush()) {
+			for (i = 0; i < n; i++)
+				if (its[i] != NULL)
+					item_remove(its[i]);
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (its[i] == NULL)
+				continue;
+			if (item_flash_swap(its[i], &locs[i]))
+				did++;
+			item_remove(its[i]);
+		}
+	}
+	return did;
+}
+
+void items_stats(ADD_STAT add_stats, conn *c) {
+	lru_bump_buf *b;
+	uint64_t dropped = 0, evictions = 0;
+	int id;
+
+	append_stat("curr_items", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&item_stats.curr_items,
+					__ATOMIC_RELAXED));
+	append_stat("total_items", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&item_stats.total_items,
+					__ATOMIC_RELAXED));
+	append_stat("bytes", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&item_stats.curr_bytes,
+					__ATOMIC_RELAXED));
+	append_stat("limit_maxbytes", add_stats, c, "%llu",
+			(unsigned long long) storage_settings.maxbytes);
+	append_stat("total_malloced", add_stats, c, "%llu",
+			(unsigned long long) slabs_malloced());
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++)
+		evictions += __atomic_load_n(&lru_class_stats[id].evicted,
+				__ATOMIC_RELAXED);
+	append_stat("evictions", add_stats, c, "%llu",
+			(unsigned long long) evictions);
+	append_stat("slabs_moved", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&rebal_stats.moved,
+					__ATOMIC_RELAXED));
+	append_stat("slab_reassign_aborted", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&rebal_stats.aborted,
+					__ATOMIC_RELAXED));
+	append_stat("slab_reassign_rescues", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&rebal_stats.rescues,
+					__ATOMIC_RELAXED));
+	append_stat("slab_reassign_evictions", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&rebal_stats.evictions,
+					__ATOMIC_RELAXED));
+	if (storage_settings.memory_file != NULL)
+		append_stat("restored_items", add_stats, c, "%llu",
+				(unsigned long long) item_stats.restored);
+	assoc_stats(add_stats, c);
+	if (storage_settings.range_index)
+		range_stats(add_stats, c);
+	if (storage_settings.log_file != NULL)
+		persist_stats(add_stats, c);
+	if (storage_settings.ext_path != NULL) {
+		append_stat("ext_items", add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(&item_stats.flash_items,
+						__ATOMIC_RELAXED));
+		flash_stats(add_stats, c);
+	}
+
+	pthread_mutex_lock(&bump_bufs_lock);
+	for (b = bump_bufs; b != NULL; b = b->next)
+		dropped += __atomic_load_n(&b->dropped, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&bump_bufs_lock);
+	append_stat("lru_maintainer_juggles", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&lru_stats.juggles,
+					__ATOMIC_RELAXED));
+	append_stat("lru_bumps", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&lru_stats.bumps,
+					__ATOMIC_RELAXED));
+	append_stat("lru_bumps_stale", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&lru_stats.bumps_stale,
+					__ATOMIC_RELAXED));
+	append_stat("lru_bumps_dropped", add_stats, c, "%llu",
+			(unsigned long long) dropped);
+}
+
+void items_stats_lru(ADD_STAT add_stats, conn *c) {
+	char key[64];
+	int id;
+
+	for (id = POWER_SMALLEST; id <= POWER_LARGEST; id++) {
+		uint64_t hot = lru_size(id | HOT_LRU);
+		uint64_t warm = lru_size(id | WARM_LRU);
+		uint64_t cold = lru_size(id | COLD_LRU);
+
+		if (hot + warm + cold == 0)
+			continue;
+		snprintf(key, sizeof(key), "items:%d:number", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) (hot + warm + cold));
+		snprintf(key, sizeof(key), "items:%d:number_hot", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) hot);
+		snprintf(key, sizeof(key), "items:%d:number_warm", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) warm);
+		snprintf(key, sizeof(key), "items:%d:number_cold", id);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) cold);
+		snprintf(key, sizeof(key), "items:%d:moves_to_cold", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].moves_to_cold, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:moves_to_warm", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].moves_to_warm, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:moves_within_lru", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].moves_within_lru, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:reclaimed", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].reclaimed, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:evicted", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].evicted, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:evicted_time", id);
+		append_stat(key, add_stats, c, "%u", __atomic_load_n(
+				&lru_class_stats[id].evicted_time, __ATOMIC_RELAXED));
+		snprintf(key, sizeof(key), "items:%d:outofmemory", id);
+		append_stat(key, add_stats, c, "%llu",
+				(unsigned long long) __atomic_load_n(
+						&lru_class_stats[id].outofmemory, __ATOMIC_RELAXED));
+	}
+}
@@ -0,0 +1,277 @@
+/*
+ * persist.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/persist.h>
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_stats.h>
+#include <network/core/conn_utils.h>
+#include <network/core/conn_wrap.h>
+#include <vutils/AppendLog.h>
+#include <vutils/Logger.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "persist"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+using namespace vmodule;
+
+#define PERSIST_LINK 1
+#define PERSIST_DELETE 2
+
+/* a record, followed by the key and, for PERSIST_LINK, the value */
+typedef struct {
+	uint8_t op;
+	uint8_t nkey;
+	uint8_t compressed; /* ITEM_COMPRESSED was set */
+	uint8_t unused;
+	uint32_t flags;
+	int64_t exptime; /* unix time, 0 for never */
+	uint64_t cas;
+	uint32_t nbytes;
+	uint32_t unused2;
+} persist_record;
+
+static AppendLog *plog;
+/* appended to once replayed */
+static bool log_open;
+/* last record each worker appended */
+static __thread uint64_t thread_seq;
+
+static struct {
+	uint64_t replayed; /* records applied at start */
+	uint64_t replay_lost; /* values that didn't fit any more */
+	uint64_t replay_ms;
+	uint64_t waits; /* responses held back for a sync */
+	uint64_t failed; /* responses turned into errors, their records lost */
+} persist_stats_data;
+
+static void persist_apply(const void *rec, size_t len, void *arg) {
+	persist_record r;
+	const char *key = (const char *) rec + sizeof(r);
+	rel_time_t exptime = 0;
+
+	if (len < sizeof(r))
+		return;
+	memcpy(&r, rec, sizeof(r));
+	if (len != sizeof(r) + r.nkey
+			+ (r.op == PERSIST_LINK ? (size_t) r.nbytes : 0))
+		return;
+
+	if (r.op == PERSIST_LINK && r.exptime != 0) {
+		/* expired since: gone, like a delete */
+		if (r.exptime <= (int64_t) time(NULL))
+			r.op = PERSIST_DELETE;
+		else
+			exptime = r.exptime - process_started;
+	}
+	if (r.op == PERSIST_DELETE) {
+		item_delete(key, r.nkey, 0);
+	} else if (!item_replay(key, r.nkey, r.flags, exptime, key + r.nkey,
+			r.nbytes, r.cas, r.compressed != 0)) {
+		__atomic_add_fetch(&persist_stats_data.replay_lost, 1,
+				__ATOMIC_RELAXED);
+	}
+}
+
+static uint64_t now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int persist_init(void) {
+	uint64_t start = now_ms();
+
+	plog = new AppendLog(storage_settings.log_file);
+	if (plog->replay(settings.num_threads, persist_apply, NULL,
+			&persist_stats_data.replayed) != NO_ERROR) {
+		MY_LOGE("failed to replay %s", storage_settings.log_file);
+		return -1;
+	}
+	persist_stats_data.replay_ms = now_ms() - start;
+	if (persist_stats_data.replay_lost > 0)
+		MY_LOGE("%s: %llu values didn't fit in memory",
+				storage_settings.log_file,
+				(unsigned long long) persist_stats_data.replay_lost);
+	if (plog->open() != NO_ERROR)
+		return -1;
+	log_open = true;
+	MY_LOGD("%s: %llu records replayed in %llums", storage_settings.log_file,
+			(unsigned long long) persist_stats_data.replayed,
+			(unsigned long long) persist_stats_data.replay_ms);
+	return 0;
+}
+
+static void persist_append(persist_record *r, const char *key,
+		const char *data, uint32_t hv) {
+	struct iovec iov[3];
+
+	iov[0].iov_base = r;
+	iov[0].iov_len = sizeof(*r);
+	iov[1].iov_base = (void *) key;
+	iov[1].iov_len = r->nkey;
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = r->nbytes;
+	thread_seq = plog->append(hv, iov, data != NULL ? 3 : 2);
+}
+
+void persist_link(item *it, uint32_t hv) {
+	persist_record r;
+
+	if (!log_open)
+		return;
+	memset(&r, 0, sizeof(r));
+	r.op = PERSIST_LINK;
+	r.nkey = it->nkey;
+	r.compressed = (it->it_flags & ITEM_COMPRESSED) != 0;
+	r.flags = it->flags;
+	r.exptime = it->exptime ? (int64_t) it->exptime + process_started : 0;
+	r.cas = it->cas;
+	r.nbytes = it->nbytes;
+	persist_append(&r, ITEM_key(it), ITEM_data(it), hv);
+}
+
+void persist_delete(const char *key, size_t nkey, uint32_t hv) {
+	persist_record r;
+
+	if (!log_open)
+		return;
+	memset(&r, 0, sizeof(r));
+	r.op = PERSIST_DELETE;
+	r.nkey = nkey;
+	persist_append(&r, key, NULL, hv);
+}
+
+uint64_t persist_thread_seq(void) {
+	return thread_seq;
+}
+
+/*
+ * Puts an EINTERNAL response in the place of the one parked c holds back,
+ * as its records never made it to disk. The references of the old one are
+ * released with it. A response streamed in parts can't be taken back, c
+ * is closed instead.
+ */
+static void persist_fail(conn *c) {
+	protocol_binary_response_header *header;
+	static const char errstr[] = "Not logged";
+	size_t len = sizeof(header->response) + sizeof(errstr) - 1;
+
+	__atomic_add_fetch(&persist_stats_data.failed, 1, __ATOMIC_RELAXED);
+	if (c->write_resume != NULL) {
+		c->close_on_resume = true;
+		return;
+	}
+	if (c->write_and_free) {
+		free(c->write_and_free);
+		c->write_and_free = 0;
+	}
+	header = (protocol_binary_response_header *) c->wbuf;
+	memset(header, 0, sizeof(header->response));
+	header->response.magic = (uint8_t) PROTOCOL_BINARY_RES;
+	header->response.opcode = c->binary_header.request.opcode;
+	header->response.status = (uint16_t) htons(
+			PROTOCOL_BINARY_RESPONSE_EINTERNAL);
+	header->response.bodylen = htonl(sizeof(errstr) - 1);
+	header->response.opaque = c->opaque;
+	memcpy(c->wbuf + sizeof(header->response), errstr, sizeof(errstr) - 1);
+
+	c->msgcurr = 0;
+	c->msgused = 0;
+	c->iovused = 0;
+	if (add_msghdr(c) != 0 || add_iov(c, c->wbuf, len) != 0) {
+		c->close_on_resume = true;
+		return;
+	}
+	c->park_state = conn_mwrite;
+	c->write_and_go = conn_new_cmd;
+}
+
+static void persist_synced(void *arg, status_t err) {
+	conn *c = (conn *) arg;
+
+	if (err != NO_ERROR)
+		persist_fail(c);
+	conn_worker_resume(c);
+}
+
+void persist_wait(conn *c, uint64_t seq) {
+	status_t err;
+
+	if (thread_seq != seq)
+		c->log_seq = thread_seq;
+	/* quiet commands wait along with the next response */
+	if (c->log_seq == 0 || (c->state != conn_write && c->state != conn_mwrite))
+		return;
+	seq = c->log_seq;
+	c->log_seq = 0;
+	conn_worker_park(c);
+	err = plog->whenSynced(seq, persist_synced, c);
+	if (err == WOULD_BLOCK) {
+		__atomic_add_fetch(&persist_stats_data.waits, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (err != NO_ERROR)
+		persist_fail(c);
+	conn_worker_readd(c);
+}
+
+void persist_stop(void) {
+	if (!log_open)
+		return;
+	log_open = false;
+	plog->close();
+}
+
+void persist_stats(ADD_STAT add_stats, conn *c) {
+	AppendLog::Stats st;
+
+	plog->getStats(&st);
+	append_stat("log_records", add_stats, c, "%llu",
+			(unsigned long long) st.records);
+	append_stat("log_bytes", add_stats, c, "%llu",
+			(unsigned long long) st.bytes);
+	append_stat("log_batches", add_stats, c, "%llu",
+			(unsigned long long) st.batches);
+	append_stat("log_largest_batch", add_stats, c, "%llu",
+			(unsigned long long) st.largest_batch);
+	append_stat("log_synced", add_stats, c, "%llu",
+			(unsigned long long) st.synced);
+	append_stat("log_write_errors", add_stats, c, "%llu",
+			(unsigned long long) st.write_errors);
+	append_stat("log_lost", add_stats, c, "%llu",
+			(unsigned long long) st.lost);
+	append_stat("log_failed_responses", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&persist_stats_data.failed,
+					__ATOMIC_RELAXED));
+	append_stat("log_waits", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&persist_stats_data.waits,
+					__ATOMIC_RELAXED));
+	append_stat("log_replayed", add_stats, c, "%llu",
+			(unsigned long long) persist_stats_data.replayed);
+	append_stat("log_replay_lost", add_stats, c, "%llu",
+			(unsigned long long) persist_stats_data.replay_lost);
+	append_stat("log_replay_ms", add_stats, c, "%llu",
+			(unsigned long long) persist_stats_data.replay_ms);
+}
@@ -0,0 +1,116 @@
+/*
+ * range.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/range.h>
+#include <network/core/conn_stats.h>
+#include <vutils/ConcurrentSkipList.h>
+#include <string.h>
+
+using namespace vmodule;
+
+static ConcurrentSkipList *skiplist;
+
+/* items handed out by scans, updated with atomics */
+static uint64_t range_scanned;
+
+/* no reader sees the unlinked item any more, drop the index's reference */
+static void range_retire(void *value) {
+	item_remove((item *) value);
+}
+
+int range_init(void) {
+	skiplist = new ConcurrentSkipList(range_retire);
+	return skiplist->init() == NO_ERROR ? 0 : -1;
+}
+
+void range_link(item *it) {
+	__atomic_add_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+	if (skiplist->insert(ITEM_key(it), it->nkey, it))
+		it->it_flags |= ITEM_INDEXED;
+	else
+		__atomic_sub_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void range_unlink(item *it) {
+	if (it->it_flags & ITEM_INDEXED) {
+		skiplist->remove(ITEM_key(it), it->nkey, it);
+		it->it_flags &= ~ITEM_INDEXED;
+	}
+}
+
+static bool range_before_end(const range_bounds *b, const void *key,
+		size_t nkey) {
+	int r;
+
+	if (b->nend == 0)
+		return true;
+	r = ConcurrentSkipList::compare(key, nkey, b->end, b->nend);
+	return r < 0 || (r == 0 && (b->flags & RANGE_END_INCLUSIVE));
+}
+
+int range_scan(const range_bounds *b, item **items, int max, bool *more) {
+	ConcurrentSkipList::Node *n;
+	int count = 0;
+
+	*more = false;
+	skiplist->readBegin();
+	for (n = skiplist->seek(b->start, b->nstart,
+			b->flags & RANGE_START_EXCLUSIVE); n != NULL; n = skiplist->next(n)) {
+		item *it = (item *) n->value;
+
+		if (!range_before_end(b, n->key, n->nkey))
+			break;
+		/* the index's reference keeps it around until readEnd() */
+		if ((__atomic_load_n(&it->it_flags, __ATOMIC_RELAXED) & ITEM_LINKED)
+				== 0 || (it->exptime != 0 && it->exptime <= current_time))
+			continue;
+		if (count == max) {
+			*more = true;
+			break;
+		}
+		__atomic_add_fetch(&it->refcount, 1, __ATOMIC_RELAXED);
+		items[count++] = it;
+	}
+	skiplist->readEnd();
+	__atomic_add_fetch(&range_scanned, count, __ATOMIC_RELAXED);
+	return count;
+}
+
+size_t range_prefix_end(const char *prefix, size_t nprefix, char *end) {
+	/* drop the trailing 0xff, then bump the last byte */
+	while (nprefix > 0 && (unsigned char) prefix[nprefix - 1] == 0xff)
+		nprefix--;
+	if (nprefix == 0)
+		return 0;
+	memcpy(end, prefix, nprefix);
+	end[nprefix - 1]++;
+	return nprefix;
+}
+
+void range_collect(void) {
+	skiplist->collect();
+}
+
+void range_stats(ADD_STAT add_stats, conn *c) {
+	ConcurrentSkipList::Stats st;
+
+	skiplist->getStats(&st);
+	append_stat("range_index_items", add_stats, c, "%llu",
+			(unsigned long long) st.nodes);
+	append_stat("range_index_retired", add_stats, c, "%llu",
+			(unsigned long long) st.retired);
+	append_stat("range_index_reclaimed", add_stats, c, "%llu",
+			(unsigned long long) st.reclaimed);
+	append_stat("range_scanned_items", add_stats, c, "%llu",
+			(unsigned long long) __atomic_load_n(&range_scanned,
+					__ATOMIC_RELAXED));
+}
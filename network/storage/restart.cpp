@@ -0,0 +1,169 @@
+/*
+ * restart.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/restart.h>
+#include <network/storage/items.h>
+#include <network/storage/slabs.h>
+#include <network/storage/storage_settings.h>
+#include <vutils/Logger.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "restart"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+#define RESTART_MAGIC "vmstore"
+/* bump when the header or the item layout changes */
+#define RESTART_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t clean; /* set by a clean stop, cleared while running */
+	/* what the pages were cut with */
+	uint64_t maxbytes;
+	double factor;
+	int32_t chunk_size;
+	uint32_t item_header; /* sizeof(item) */
+	uint32_t pages_max;
+	uint32_t pages_used; /* handed out by the slabs so far */
+	/* state of the clean stop */
+	int64_t stop_time; /* unix time */
+	uint32_t stop_rel_time; /* current_time */
+	uint32_t unused;
+	uint64_t cas_id;
+	uint64_t curr_items;
+	uint8_t page_class[]; /* pages_max of them */
+} restart_header;
+
+static restart_header *header;
+static size_t meta_size; /* header and page classes, page aligned */
+static size_t map_size;
+
+/*
+ * Why hdr, read from the file, can't be restored from, NULL if it can.
+ */
+static const char *restart_mismatch(const restart_header *hdr,
+		uint32_t pages) {
+	if (memcmp(hdr->magic, RESTART_MAGIC, sizeof(hdr->magic)) != 0)
+		return "new file";
+	if (hdr->version != RESTART_VERSION
+			|| hdr->item_header != sizeof(item))
+		return "written by another version";
+	if (!hdr->clean)
+		return "no clean stop";
+	if (hdr->maxbytes != storage_settings.maxbytes
+			|| hdr->factor != storage_settings.factor
+			|| hdr->chunk_size != storage_settings.chunk_size
+			|| hdr->pages_max != pages || hdr->pages_used > pages)
+		return "other -m, -f or -n";
+	return NULL;
+}
+
+int restart_open(restart_state *st) {
+	uint32_t pages = storage_settings.maxbytes / SLAB_PAGE_SIZE;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	const char *mismatch;
+	restart_header hdr;
+	struct stat sb;
+	char *base;
+	int fd;
+
+	meta_size = sizeof(restart_header) + pages;
+	meta_size = (meta_size + pagesize - 1) / pagesize * pagesize;
+	map_size = meta_size + (size_t) pages * SLAB_PAGE_SIZE;
+
+	fd = open(storage_settings.memory_file, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		MY_LOGE("can't open memory_file %s: %s", storage_settings.memory_file,
+				strerror(errno));
+		return -1;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	if (fstat(fd, &sb) != 0 || (size_t) sb.st_size != map_size
+			|| pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		mismatch = "new file";
+	else
+		mismatch = restart_mismatch(&hdr, pages);
+
+	/* empty it out, no chunk may look like an item of the last run */
+	if (mismatch != NULL && (ftruncate(fd, 0) != 0
+			|| ftruncate(fd, map_size) != 0)) {
+		MY_LOGE("can't size memory_file %s: %s", storage_settings.memory_file,
+				strerror(errno));
+		close(fd);
+		return -1;
+	}
+	base = (char *) mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		MY_LOGE("can't map memory_file %s: %s", storage_settings.memory_file,
+				strerror(errno));
+		return -1;
+	}
+	header = (restart_header *) base;
+
+	if (mismatch != NULL) {
+		MY_LOGD("memory_file %s starts empty: %s", storage_settings.memory_file,
+				mismatch);
+		memcpy(header->magic, RESTART_MAGIC, sizeof(header->magic));
+		header->version = RESTART_VERSION;
+		header->maxbytes = storage_settings.maxbytes;
+		header->factor = storage_settings.factor;
+		header->chunk_size = storage_settings.chunk_size;
+		header->item_header = sizeof(item);
+		header->pages_max = pages;
+	} else {
+		st->cas_id = header->cas_id;
+		st->curr_items = header->curr_items;
+		st->time_shift = (int64_t) current_time - header->stop_rel_time
+				- ((int64_t) time(NULL) - header->stop_time);
+	}
+	/* until the next clean stop */
+	header->clean = 0;
+	msync(header, meta_size, MS_SYNC);
+
+	slabs_set_arena(base + meta_size, header->page_class, &header->pages_used);
+	return mismatch == NULL ? 1 : 0;
+}
+
+void restart_close(const restart_state *st) {
+	header->cas_id = st->cas_id;
+	header->curr_items = st->curr_items;
+	header->stop_time = time(NULL);
+	header->stop_rel_time = current_time;
+	if (msync(header, map_size, MS_SYNC) != 0) {
+		MY_LOGE("can't write memory_file %s out: %s",
+				storage_settings.memory_file, strerror(errno));
+		return;
+	}
+	/* only once everything else is on disk */
+	header->clean = 1;
+	msync(header, meta_size, MS_SYNC);
+	MY_LOGD("memory_file %s: %llu items kept", storage_settings.memory_file,
+			(unsigned long long) st->curr_items);
+}
@@ -0,0 +1,398 @@
+/*
+ * slabs.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/slabs.h>
+#include <network/core/conn_stats.h>
+#include <vutils/Logger.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "slabs"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+typedef struct {
+	pthread_mutex_t lock; /* free list and counters */
+	unsigned int size; /* sizes of items */
+	unsigned int perslab; /* how many items per slab */
+	void *slots; /* list of free chunks, linked through their first word */
+	unsigned int sl_curr; /* total free items in list */
+	unsigned int slabs; /* how many slabs were allocated for this class */
+	uint64_t used_chunks; /* chunks handed out and not freed */
+	char **pages; /* the slabs, list_size of room */
+	unsigned int list_size;
+	char *rebal_page; /* being moved away, its chunks freed aren't reused */
+	void *rebal_slots; /* those chunks */
+	unsigned int rebal_free; /* and how many */
+} slabclass_t;
+
+static slabclass_t slabclass[MAX_NUMBER_OF_SLAB_CLASSES];
+static int power_largest;
+static size_t mem_limit;
+static size_t mem_malloced;
+
+/* pages come from here instead of malloc() when set, see slabs_set_arena() */
+static char *arena;
+static uint8_t *arena_class;
+static uint32_t *arena_used;
+
+/* class of the page being moved, 0 for none, only the mover touches it */
+static unsigned int rebal_src;
+
+int slabs_init(size_t limit, double factor, int item_min) {
+	int i = POWER_SMALLEST - 1;
+	unsigned int size = item_min;
+
+	if (factor <= 1.0 || item_min <= 0 || limit < SLAB_PAGE_SIZE)
+		return -1;
+	mem_limit = limit;
+	memset(slabclass, 0, sizeof(slabclass));
+
+	if (size % CHUNK_ALIGN_BYTES)
+		size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+	while (++i < POWER_LARGEST && size <= SLAB_PAGE_SIZE / factor) {
+		slabclass[i].size = size;
+		slabclass[i].perslab = SLAB_PAGE_SIZE / size;
+		pthread_mutex_init(&slabclass[i].lock, NULL);
+		size *= factor;
+		if (size % CHUNK_ALIGN_BYTES)
+			size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+	}
+	/* the last class holds one item of a whole page */
+	power_largest = i;
+	slabclass[i].size = SLAB_PAGE_SIZE;
+	slabclass[i].perslab = 1;
+	pthread_mutex_init(&slabclass[i].lock, NULL);
+
+	if (settings.verbose > 1) {
+		for (i = POWER_SMALLEST; i <= power_largest; i++)
+			MY_LOGD("slab class %3d: chunk size %9u perslab %7u", i,
+					slabclass[i].size, slabclass[i].perslab);
+	}
+	return 0;
+}
+
+unsigned int slabs_clsid(size_t size) {
+	int res = POWER_SMALLEST;
+
+	if (size == 0 || size > SLAB_PAGE_SIZE)
+		return 0;
+	while (size > slabclass[res].size)
+		if (res++ == power_largest) /* won't fit in the biggest slab */
+			return 0;
+	return res;
+}
+
+unsigned int slabs_chunk_size(unsigned int id) {
+	return slabclass[id].size;
+}
+
+/*
+ * Reserves a page worth of the memory limit, false if it is used up.
+ */
+static bool mem_reserve_page(void) {
+	size_t cur = __atomic_load_n(&mem_malloced, __ATOMIC_RELAXED);
+
+	do {
+		if (cur + SLAB_PAGE_SIZE > mem_limit)
+			return false;
+	} while (!__atomic_compare_exchange_n(&mem_malloced, &cur,
+			cur + SLAB_PAGE_SIZE, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
+
+/*
+ * Makes room in the page list of p for one more. Called with p->lock held.
+ */
+static bool do_slabs_grow_list(slabclass_t *p) {
+	unsigned int size;
+	char **list;
+
+	if (p->slabs < p->list_size)
+		return true;
+	size = p->list_size ? p->list_size * 2 : 16;
+	list = (char **) realloc(p->pages, size * sizeof(*list));
+	if (list == NULL)
+		return false;
+	p->pages = list;
+	p->list_size = size;
+	return true;
+}
+
+/*
+ * Cuts page into the free list of p, as one more slab of it. Called with
+ * p->lock held and room in the page list.
+ */
+static void do_slabs_cut(slabclass_t *p, char *page) {
+	unsigned int i;
+
+	for (i = 0; i < p->perslab; i++) {
+		void *chunk = page + (size_t) i * p->size;
+		*(void **) chunk = p->slots;
+		p->slots = chunk;
+	}
+	p->sl_curr += p->perslab;
+	p->pages[p->slabs++] = page;
+}
+
+/*
+ * Cuts a new page into the free list of p. Called with p->lock held.
+ */
+static bool do_slabs_newslab(slabclass_t *p) {
+	char *page;
+
+	if (!do_slabs_grow_list(p) || !mem_reserve_page())
+		return false;
+	if (arena != NULL) {
+		/* the reservation keeps it within the arena */
+		uint32_t n = __atomic_fetch_add(arena_used, 1, __ATOMIC_RELAXED);
+		page = arena + (size_t) n * SLAB_PAGE_SIZE;
+		arena_class[n] = p - slabclass;
+	} else {
+		page = (char *) malloc(SLAB_PAGE_SIZE);
+	}
+	if (page == NULL) {
+		__atomic_sub_fetch(&mem_malloced, SLAB_PAGE_SIZE, __ATOMIC_RELAXED);
+		STATS_LOCK();
+		stats.malloc_fails++;
+		STATS_UNLOCK();
+		return false;
+	}
+	do_slabs_cut(p, page);
+	return true;
+}
+
+void slabs_set_arena(char *base, uint8_t *page_class, uint32_t *used) {
+	arena = base;
+	arena_class = page_class;
+	arena_used = used;
+}
+
+void slabs_restore(bool (*keep)(void *chunk, unsigned int id)) {
+	uint32_t n, i;
+
+	for (n = 0; n < *arena_used; n++) {
+		unsigned int id = arena_class[n];
+		char *page = arena + (size_t) n * SLAB_PAGE_SIZE;
+		slabclass_t *p;
+
+		/* the memory stays taken even if the page can't be used */
+		mem_malloced += SLAB_PAGE_SIZE;
+		if (id < POWER_SMALLEST || id > (unsigned int) power_largest)
+			continue;
+		p = &slabclass[id];
+		if (!do_slabs_grow_list(p))
+			continue;
+		for (i = 0; i < p->perslab; i++) {
+			void *chunk = page + (size_t) i * p->size;
+			if (keep(chunk, id)) {
+				p->used_chunks++;
+			} else {
+				*(void **) chunk = p->slots;
+				p->slots = chunk;
+				p->sl_curr++;
+			}
+		}
+		p->pages[p->slabs++] = page;
+	}
+}
+
+void *slabs_alloc(unsigned int id) {
+	slabclass_t *p;
+	void *ret = NULL;
+
+	if (id < POWER_SMALLEST || id > (unsigned int) power_largest)
+		return NULL;
+	p = &slabclass[id];
+	pthread_mutex_lock(&p->lock);
+	if (p->sl_curr > 0 || do_slabs_newslab(p)) {
+		ret = p->slots;
+		p->slots = *(void **) ret;
+		p->sl_curr--;
+		p->used_chunks++;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return ret;
+}
+
+void slabs_free(void *ptr, unsigned int id) {
+	slabclass_t *p;
+
+	assert(id >= POWER_SMALLEST && id <= (unsigned int) power_largest);
+	p = &slabclass[id];
+	pthread_mutex_lock(&p->lock);
+	if (p->rebal_page != NULL && (char *) ptr >= p->rebal_page
+			&& (char *) ptr < p->rebal_page + SLAB_PAGE_SIZE) {
+		*(void **) ptr = p->rebal_slots;
+		p->rebal_slots = ptr;
+		p->rebal_free++;
+	} else {
+		*(void **) ptr = p->slots;
+		p->slots = ptr;
+		p->sl_curr++;
+	}
+	p->used_chunks--;
+	pthread_mutex_unlock(&p->lock);
+}
+
+void slabs_usage(unsigned int id, unsigned int *pages,
+		unsigned int *free_chunks) {
+	slabclass_t *p = &slabclass[id];
+
+	pthread_mutex_lock(&p->lock);
+	*pages = p->slabs;
+	*free_chunks = p->sl_curr;
+	pthread_mutex_unlock(&p->lock);
+}
+
+unsigned int slabs_perslab(unsigned int id) {
+	return slabclass[id].perslab;
+}
+
+char *slabs_reassign_begin(unsigned int src) {
+	slabclass_t *p;
+	void **prev, *chunk;
+	char *page;
+
+	if (rebal_src != 0 || src < POWER_SMALLEST
+			|| src > (unsigned int) power_largest)
+		return NULL;
+	p = &slabclass[src];
+	pthread_mutex_lock(&p->lock);
+	if (p->slabs < 2) {
+		pthread_mutex_unlock(&p->lock);
+		return NULL;
+	}
+	/* the oldest, with the items least likely to be missed */
+	page = p->pages[0];
+	p->rebal_page = page;
+	p->rebal_slots = NULL;
+	p->rebal_free = 0;
+	/* its free chunks stop being handed out */
+	for (prev = &p->slots; (chunk = *prev) != NULL;) {
+		if ((char *) chunk >= page && (char *) chunk < page + SLAB_PAGE_SIZE) {
+			*prev = *(void **) chunk;
+			*(void **) chunk = p->rebal_slots;
+			p->rebal_slots = chunk;
+			p->rebal_free++;
+			p->sl_curr--;
+		} else {
+			prev = (void **) chunk;
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	rebal_src = src;
+	return page;
+}
+
+bool slabs_reassign_done(void) {
+	slabclass_t *p = &slabclass[rebal_src];
+	bool done;
+
+	pthread_mutex_lock(&p->lock);
+	done = p->rebal_free == p->perslab;
+	pthread_mutex_unlock(&p->lock);
+	return done;
+}
+
+bool slabs_reassign_end(unsigned int dst) {
+	slabclass_t *p = &slabclass[rebal_src], *d = &slabclass[dst];
+	char *page = p->rebal_page;
+	unsigned int i;
+
+	pthread_mutex_lock(&d->lock);
+	if (!do_slabs_grow_list(d)) {
+		pthread_mutex_unlock(&d->lock);
+		return false;
+	}
+	pthread_mutex_lock(&p->lock);
+	for (i = 0; p->pages[i] != page; i++)
+		;
+	p->pages[i] = p->pages[--p->slabs];
+	p->rebal_page = NULL;
+	p->rebal_slots = NULL;
+	p->rebal_free = 0;
+	pthread_mutex_unlock(&p->lock);
+	/* nothing of the old items is taken for one at the next start */
+	memset(page, 0, SLAB_PAGE_SIZE);
+	if (arena != NULL)
+		arena_class[(page - arena) / SLAB_PAGE_SIZE] = dst;
+	do_slabs_cut(d, page);
+	pthread_mutex_unlock(&d->lock);
+	rebal_src = 0;
+	return true;
+}
+
+void slabs_reassign_abort(void) {
+	slabclass_t *p = &slabclass[rebal_src];
+	void *chunk;
+
+	pthread_mutex_lock(&p->lock);
+	while ((chunk = p->rebal_slots) != NULL) {
+		p->rebal_slots = *(void **) chunk;
+		*(void **) chunk = p->slots;
+		p->slots = chunk;
+		p->sl_curr++;
+	}
+	p->rebal_page = NULL;
+	p->rebal_free = 0;
+	pthread_mutex_unlock(&p->lock);
+	rebal_src = 0;
+}
+
+size_t slabs_malloced(void) {
+	return __atomic_load_n(&mem_malloced, __ATOMIC_RELAXED);
+}
+
+void slabs_stats(ADD_STAT add_stats, conn *c) {
+	char key[64];
+	int i, active = 0;
+
+	for (i = POWER_SMALLEST; i <= power_largest; i++) {
+		slabclass_t *p = &slabclass[i];
+		unsigned int slabs, free_chunks;
+		uint64_t used;
+
+		pthread_mutex_lock(&p->lock);
+		slabs = p->slabs;
+		free_chunks = p->sl_curr;
+		used = p->used_chunks;
+		pthread_mutex_unlock(&p->lock);
+		if (slabs == 0)
+			continue;
+		active++;
+		snprintf(key, sizeof(key), "%d:chunk_size", i);
+		append_stat(key, add_stats, c, "%u", p->size);
+		snprintf(key, sizeof(key), "%d:chunks_per_page", i);
+		append_stat(key, add_stats, c, "%u", p->perslab);
+		snprintf(key, sizeof(key), "%d:total_pages", i);
+		append_stat(key, add_stats, c, "%u", slabs);
+		snprintf(key, sizeof(key), "%d:total_chunks", i);
+		append_stat(key, add_stats, c, "%u", slabs * p->perslab);
+		snprintf(key, sizeof(key), "%d:used_chunks", i);
+		append_stat(key, add_stats, c, "%llu", (unsigned long long) used);
+		snprintf(key, sizeof(key), "%d:free_chunks", i);
+		append_stat(key, add_stats, c, "%u", free_chunks);
+	}
+	append_stat("active_slabs", add_stats, c, "%d", active);
+	append_stat("total_malloced", add_stats, c, "%llu",
+			(unsigned long long) slabs_malloced());
+}
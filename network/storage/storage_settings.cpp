@@ -0,0 +1,286 @@
+/*
+ * storage_settings.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+/*
+ * Copyright (c) <2017>, Memcached
+ * All rights reserved.
+ * This source code copy from Memcached Open Source
+ * format for Network bu Jeffrey..
+ */
+#include <network/storage/storage_settings.h>
+#include <network/core/conn_stats.h>
+#include <network/core/conn_utils.h>
+#include <vutils/Logger.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "storage_settings"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+struct storage_settings storage_settings;
+
+void storage_settings_init(void) {
+	storage_settings.maxbytes = 64 * 1024 * 1024; /* default is 64MB */
+	storage_settings.factor = 1.25;
+	storage_settings.chunk_size = 48; /* space for a modest key and value */
+	storage_settings.hashpower_init = HASHPOWER_DEFAULT;
+	storage_settings.hot_lru_pct = 20;
+	storage_settings.warm_lru_pct = 40;
+	storage_settings.range_index = false;
+	storage_settings.memory_file = NULL;
+	storage_settings.log_file = NULL;
+	storage_settings.ext_path = NULL;
+	storage_settings.ext_size = 1024ULL * 1024 * 1024;
+	storage_settings.ext_item_size = 512;
+	storage_settings.ext_item_age = 3600;
+	storage_settings.ext_threads = 4;
+	storage_settings.compress_min = 0;
+	storage_settings.evict_to_free = true;
+	storage_settings.slab_automove = true;
+}
+
+/* -m, -f, -n and -M */
+static int storage_flag(int opt, const char *arg) {
+	switch (opt) {
+	case 'm':
+		storage_settings.maxbytes = ((size_t) atoi(arg)) * 1024 * 1024;
+		if (storage_settings.maxbytes == 0) {
+			MY_LOGD("Memory limit must be at least 1 megabyte\n");
+			return -1;
+		}
+		return 1;
+	case 'f':
+		if (!safe_strtod(arg, &storage_settings.factor)
+				|| storage_settings.factor <= 1.0) {
+			MY_LOGD("Factor must be greater than 1\n");
+			return -1;
+		}
+		return 1;
+	case 'n':
+		storage_settings.chunk_size = atoi(arg);
+		if (storage_settings.chunk_size <= 0) {
+			MY_LOGD("Chunk size must be greater than 0\n");
+			return -1;
+		}
+		return 1;
+	case 'M':
+		storage_settings.evict_to_free = false;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* a -o suboption, value NULL if it has none */
+static int storage_suboption(const char *name, const char *value) {
+	if (strcmp(name, "hashpower") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.hashpower_init)
+				|| storage_settings.hashpower_init < 12
+				|| storage_settings.hashpower_init > 32) {
+			MY_LOGD("Invalid hashpower, it goes from 12 to 32\n");
+			return -1;
+		}
+	} else if (strcmp(name, "hot_lru_pct") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.hot_lru_pct)
+				|| storage_settings.hot_lru_pct < 1
+				|| storage_settings.hot_lru_pct > 80) {
+			MY_LOGD("Invalid hot_lru_pct, it goes from 1 to 80\n");
+			return -1;
+		}
+	} else if (strcmp(name, "warm_lru_pct") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.warm_lru_pct)
+				|| storage_settings.warm_lru_pct < 0
+				|| storage_settings.warm_lru_pct > 80) {
+			MY_LOGD("Invalid warm_lru_pct, it goes from 0 to 80\n");
+			return -1;
+		}
+	} else if (strcmp(name, "range_index") == 0) {
+		storage_settings.range_index = true;
+	} else if (strcmp(name, "memory_file") == 0) {
+		if (value == NULL || *value == '\0') {
+			MY_LOGD("Missing path for memory_file\n");
+			return -1;
+		}
+		storage_settings.memory_file = strdup(value);
+	} else if (strcmp(name, "log_file") == 0) {
+		if (value == NULL || *value == '\0') {
+			MY_LOGD("Missing path for log_file\n");
+			return -1;
+		}
+		storage_settings.log_file = strdup(value);
+	} else if (strcmp(name, "ext_path") == 0) {
+		if (value == NULL || *value == '\0') {
+			MY_LOGD("Missing path for ext_path\n");
+			return -1;
+		}
+		storage_settings.ext_path = strdup(value);
+	} else if (strcmp(name, "ext_size") == 0) {
+		int mb;
+		if (value == NULL || !safe_strtol(value, &mb) || mb < 16) {
+			MY_LOGD("Invalid ext_size, at least 16 megabytes\n");
+			return -1;
+		}
+		storage_settings.ext_size = (size_t) mb * 1024 * 1024;
+	} else if (strcmp(name, "ext_item_size") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.ext_item_size)
+				|| storage_settings.ext_item_size < INCR_MAX_STORAGE_LEN) {
+			MY_LOGD("Invalid ext_item_size, at least %d bytes\n",
+					INCR_MAX_STORAGE_LEN);
+			return -1;
+		}
+	} else if (strcmp(name, "ext_item_age") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.ext_item_age)
+				|| storage_settings.ext_item_age < 0) {
+			MY_LOGD("Invalid ext_item_age\n");
+			return -1;
+		}
+	} else if (strcmp(name, "ext_threads") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.ext_threads)
+				|| storage_settings.ext_threads < 1
+				|| storage_settings.ext_threads > 64) {
+			MY_LOGD("Invalid ext_threads, it goes from 1 to 64\n");
+			return -1;
+		}
+	} else if (strcmp(name, "compress_min") == 0) {
+		if (value == NULL
+				|| !safe_strtol(value, &storage_settings.compress_min)
+				|| storage_settings.compress_min < 64) {
+			MY_LOGD("Invalid compress_min, at least 64 bytes\n");
+			return -1;
+		}
+	} else if (strcmp(name, "slab_automove") == 0) {
+		if (value == NULL || (strcmp(value, "0") != 0
+				&& strcmp(value, "1") != 0)) {
+			MY_LOGD("Invalid slab_automove, 0 or 1\n");
+			return -1;
+		}
+		storage_settings.slab_automove = value[0] == '1';
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+int storage_option(int opt, const char *arg) {
+	char name[32];
+	const char *value;
+	size_t len;
+
+	if (opt != 'o')
+		return storage_flag(opt, arg);
+
+	/* "name" or "name=value" */
+	value = strchr(arg, '=');
+	len = value != NULL ? (size_t) (value - arg) : strlen(arg);
+	if (len >= sizeof(name))
+		return 0;
+	memcpy(name, arg, len);
+	name[len] = '\0';
+	return storage_suboption(name, value != NULL ? value + 1 : NULL);
+}
+
+int storage_settings_check(void) {
+	if (storage_settings.hot_lru_pct + storage_settings.warm_lru_pct > 80) {
+		MY_LOGE("hot_lru_pct + warm_lru_pct must not exceed 80\n");
+		return -1;
+	}
+	return 0;
+}
+
+void storage_usage(void) {
+	MY_LOGD("-m <num>      item memory of the storage engine in megabytes\n"
+			"              (default: 64)\n"
+			"-f <factor>   chunk size growth factor of its slab classes\n"
+			"              (default: 1.25)\n"
+			"-n <bytes>    minimum space allocated for key+value+flags\n"
+			"              (default: 48)\n"
+			"-M            return error on memory exhausted instead of evicting\n");
+
+	MY_LOGD("-o            Storage engine options, with the server's\n"
+			"              - hashpower: log2 of the storage engine's initial\n"
+			"                hash table buckets, it grows as needed (default: %d)\n"
+			"              - hot_lru_pct: share of each slab class's items\n"
+			"                kept in its hot LRU (default: 20)\n"
+			"              - warm_lru_pct: and in its warm LRU, the two add\n"
+			"                up to at most 80 (default: 40)\n"
+			"              - range_index: also keep the items in key order,\n"
+			"                for the binary range commands (RGET...)\n"
+			"              - memory_file: keep item memory in this file, a\n"
+			"                restart after SIGTERM or SIGINT finds the items\n"
+			"                again if -m, -f and -n are unchanged\n"
+			"              - log_file: log every change of an item to this\n"
+			"                file, replayed at start; binary responses wait\n"
+			"                until their changes are on disk\n"
+			"              - ext_path: move values of idle cold items to\n"
+			"                segment files <ext_path>.<n>, read back without\n"
+			"                blocking the workers\n"
+			"              - ext_size: megabytes of those files (default: 1024)\n"
+			"              - ext_item_size: smallest value moved there\n"
+			"                (default: 512)\n"
+			"              - ext_item_age: seconds a cold item sits idle\n"
+			"                before it moves, any once memory is full\n"
+			"                (default: 3600)\n"
+			"              - ext_threads: threads reading them (default: 4)\n"
+			"              - compress_min: store values of at least this many\n"
+			"                bytes compressed (default: 0, off)\n"
+			"              - slab_automove: 0 keeps each slab class's pages,\n"
+			"                1 moves them to the classes evicting the youngest\n"
+			"                items (default: 1)\n", HASHPOWER_DEFAULT);
+}
+
+void storage_stat_settings(ADD_STAT add_stats, conn *c) {
+	append_stat("maxbytes", add_stats, c, "%llu",
+			(unsigned long long) storage_settings.maxbytes);
+	append_stat("growth_factor", add_stats, c, "%.2f",
+			storage_settings.factor);
+	append_stat("chunk_size", add_stats, c, "%d", storage_settings.chunk_size);
+	append_stat("hashpower_init", add_stats, c, "%d",
+			storage_settings.hashpower_init);
+	append_stat("hot_lru_pct", add_stats, c, "%d",
+			storage_settings.hot_lru_pct);
+	append_stat("warm_lru_pct", add_stats, c, "%d",
+			storage_settings.warm_lru_pct);
+	append_stat("range_index", add_stats, c, "%s",
+			storage_settings.range_index ? "yes" : "no");
+	append_stat("memory_file", add_stats, c, "%s",
+			storage_settings.memory_file ?
+					storage_settings.memory_file : "NULL");
+	append_stat("log_file", add_stats, c, "%s",
+			storage_settings.log_file ? storage_settings.log_file : "NULL");
+	append_stat("ext_path", add_stats, c, "%s",
+			storage_settings.ext_path ? storage_settings.ext_path : "NULL");
+	append_stat("ext_size", add_stats, c, "%llu",
+			(unsigned long long) storage_settings.ext_size);
+	append_stat("ext_item_size", add_stats, c, "%d",
+			storage_settings.ext_item_size);
+	append_stat("ext_item_age", add_stats, c, "%d",
+			storage_settings.ext_item_age);
+	append_stat("ext_threads", add_stats, c, "%d",
+			storage_settings.ext_threads);
+	append_stat("compress_min", add_stats, c, "%d",
+			storage_settings.compress_min);
+	append_stat("evictions", add_stats, c, "%s",
+			storage_settings.evict_to_free ? "on" : "off");
+	append_stat("slab_automove", add_stats, c, "%d",
+			storage_settings.slab_automove);
+}
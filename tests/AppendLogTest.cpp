@@ -0,0 +1,211 @@
+//============================================================================
+// Name        : AppendLogTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : AppendLog group commit from many threads, replay in order
+//               per hash, a torn tail cut off, and a batch failing to write
+//============================================================================
+
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <vutils/Logger.h>
+#include <vutils/AppendLog.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "AppendLogTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_RECORDS 1000
+
+static char path[64];
+
+/* a record: who appended it, and its number there */
+struct Record {
+	uint32_t thread;
+	uint32_t n;
+};
+
+/* one whenSynced() to wait for */
+struct Wait {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool done;
+	status_t err;
+};
+
+static void waitInit(Wait *w) {
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->done = false;
+	w->err = NO_ERROR;
+}
+
+static void synced(void *arg, status_t err) {
+	Wait *w = (Wait *) arg;
+
+	pthread_mutex_lock(&w->lock);
+	w->done = true;
+	w->err = err;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* appends rec and waits until it is on disk, or lost */
+static status_t appendSync(AppendLog *log, uint32_t hash, const void *rec,
+		size_t len) {
+	struct iovec iov = { (void *) rec, len };
+	uint64_t seq = log->append(hash, &iov, 1);
+	Wait w;
+	status_t err;
+
+	waitInit(&w);
+	err = log->whenSynced(seq, synced, &w);
+	if (err != WOULD_BLOCK)
+		return err;
+	pthread_mutex_lock(&w.lock);
+	while (!w.done)
+		pthread_cond_wait(&w.cond, &w.lock);
+	pthread_mutex_unlock(&w.lock);
+	return w.err;
+}
+
+static AppendLog *shared;
+
+static void *appender(void *arg) {
+	Record r;
+
+	r.thread = (uint32_t) (long) arg;
+	for (r.n = 0; r.n < LOG_TEST_RECORDS; r.n++)
+		TEST_CHECK(appendSync(shared, r.thread, &r, sizeof(r)) == NO_ERROR);
+	return NULL;
+}
+
+/*
+ * Records of a hash come in order on one replay thread, so each slot is
+ * only touched by one thread.
+ */
+static uint32_t nextOf[LOG_TEST_THREADS + 1];
+
+static void apply(const void *rec, size_t len, void *arg) {
+	Record r;
+
+	TEST_CHECK(len == sizeof(r));
+	memcpy(&r, rec, sizeof(r));
+	TEST_CHECK(r.thread <= LOG_TEST_THREADS);
+	TEST_CHECK(r.n == nextOf[r.thread]);
+	nextOf[r.thread]++;
+}
+
+static uint64_t replay(int nthreads) {
+	AppendLog log(path);
+	uint64_t count = 0;
+
+	memset(nextOf, 0, sizeof(nextOf));
+	TEST_CHECK(log.replay(nthreads, apply, NULL, &count) == NO_ERROR);
+	return count;
+}
+
+static off_t fileSize() {
+	struct stat sb;
+
+	TEST_CHECK(stat(path, &sb) == 0);
+	return sb.st_size;
+}
+
+int main() {
+	pthread_t tids[LOG_TEST_THREADS];
+	AppendLog::Stats stats;
+	uint64_t total = LOG_TEST_THREADS * LOG_TEST_RECORDS;
+
+	snprintf(path, sizeof(path), "/tmp/appendlogtest.%d.log", (int) getpid());
+	unlink(path);
+
+	/* waiting appenders share batches */
+	shared = new AppendLog(path);
+	TEST_CHECK(replay(1) == 0);
+	TEST_CHECK(shared->open() == NO_ERROR);
+	for (int i = 0; i < LOG_TEST_THREADS; i++)
+		TEST_CHECK(pthread_create(&tids[i], NULL, appender,
+				(void *) (long) i) == 0);
+	for (int i = 0; i < LOG_TEST_THREADS; i++)
+		pthread_join(tids[i], NULL);
+	shared->getStats(&stats);
+	TEST_CHECK(stats.records == total);
+	TEST_CHECK(stats.synced == total);
+	TEST_CHECK(stats.batches < stats.records);
+	TEST_CHECK(stats.largest_batch > 1);
+	TEST_CHECK(stats.write_errors == 0);
+	shared->close();
+	delete shared;
+
+	/* in order per hash, on any number of threads */
+	TEST_CHECK(replay(3) == total);
+	for (int i = 0; i < LOG_TEST_THREADS; i++)
+		TEST_CHECK(nextOf[i] == LOG_TEST_RECORDS);
+	TEST_CHECK(replay(1) == total);
+
+	/* a record cut short by a crash is cut off, the rest kept */
+	off_t size = fileSize();
+	int fd = open(path, O_WRONLY | O_APPEND);
+	uint32_t torn[4] = { 100, 1, 0, 0 };
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(write(fd, torn, sizeof(torn)) == sizeof(torn));
+	close(fd);
+	TEST_CHECK(replay(2) == total);
+	TEST_CHECK(fileSize() == size);
+
+	/*
+	 * A batch that can't be written is lost: its waiter is told, the file
+	 * cut back, and a later batch goes on after the good records.
+	 */
+	AppendLog log(path);
+	struct rlimit rl, small;
+	char big[4096];
+	Record r = { LOG_TEST_THREADS, 0 };
+	uint64_t seq;
+
+	memset(big, 'x', sizeof(big));
+	memcpy(big, &r, sizeof(r));
+	TEST_CHECK(log.open() == NO_ERROR);
+	signal(SIGXFSZ, SIG_IGN);
+	TEST_CHECK(getrlimit(RLIMIT_FSIZE, &rl) == 0);
+	small = rl;
+	small.rlim_cur = size + sizeof(big) / 2;
+	TEST_CHECK(setrlimit(RLIMIT_FSIZE, &small) == 0);
+	TEST_CHECK(appendSync(&log, r.thread, big, sizeof(big)) == -EFBIG);
+	TEST_CHECK(fileSize() == size);
+	/* asked again, it stays lost */
+	log.getStats(&stats);
+	seq = stats.records;
+	TEST_CHECK(log.whenSynced(seq, synced, NULL) == -EFBIG);
+	TEST_CHECK(setrlimit(RLIMIT_FSIZE, &rl) == 0);
+
+	TEST_CHECK(appendSync(&log, r.thread, &r, sizeof(r)) == NO_ERROR);
+	log.getStats(&stats);
+	TEST_CHECK(stats.write_errors == 1);
+	TEST_CHECK(stats.lost == 1);
+	log.close();
+	TEST_CHECK(replay(2) == total + 1);
+	TEST_CHECK(nextOf[LOG_TEST_THREADS] == 1);
+
+	unlink(path);
+	MY_LOGD("AppendLogTest passed");
+	return 0;
+}
@@ -0,0 +1,132 @@
+//============================================================================
+// Name        : ClientTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Loopback test of conn_client: a server forwarding binary
+//               requests to a backend, one of whose keys never answers
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/core/conn_base.h>
+#include <network/core/conn_client.h>
+#include <network/core/conn_wrap.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "ClientTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define CLIENT_TEST_TIMEOUT_MS 200
+
+static int backendPort;
+
+/* forwards every binary request to the backend */
+class ForwardServer: public msg_callback {
+public:
+	ForwardServer() :
+			mPool(NULL) {
+	}
+protected:
+	virtual int onServerStart() {
+		mPool = conn_client_pool_new("127.0.0.1", backendPort, 0, 0,
+				CLIENT_TEST_TIMEOUT_MS);
+		return mPool == NULL ? -1 : 0;
+	}
+	virtual void onBinaryEventDispatch(conn *c) {
+		size_t len = sizeof(protocol_binary_request_header)
+				+ c->binary_header.request.bodylen;
+		if (conn_client_request(mPool, c->thread, c->rcurr, len, onReply, c)
+				== 0)
+			conn_client_hold(c);
+		else
+			reply(c, NULL, NULL);
+	}
+	virtual void onAsciiEventDispatch(conn *c) {
+		out_string(c, "ERROR");
+	}
+private:
+	static void onReply(void *arg, const protocol_binary_response_header *rsp,
+			const char *body) {
+		conn *c = (conn *) arg;
+		reply(c, rsp, body);
+		conn_client_resume(c);
+	}
+	/* the backend's response, or ENOMEM when there is none */
+	static void reply(conn *c, const protocol_binary_response_header *rsp,
+			const char *body) {
+		size_t bodylen = rsp ? ntohl(rsp->response.bodylen) : 0;
+		protocol_binary_response_header *out;
+		char *buf = (char *) malloc(sizeof(out->bytes) + bodylen);
+
+		if (buf == NULL) {
+			write_and_free(c, NULL, 0);
+			return;
+		}
+		out = (protocol_binary_response_header *) buf;
+		if (rsp != NULL) {
+			*out = *rsp;
+			memcpy(buf + sizeof(out->bytes), body, bodylen);
+		} else {
+			memset(out, 0, sizeof(*out));
+			out->response.magic = PROTOCOL_BINARY_RES;
+			out->response.opcode = c->binary_header.request.opcode;
+			out->response.status = htons(PROTOCOL_BINARY_RESPONSE_ENOMEM);
+		}
+		out->response.opaque = c->opaque;
+		write_and_free(c, buf, sizeof(out->bytes) + bodylen);
+	}
+
+	conn_client_pool *mPool;
+};
+
+static void checkGet(int fd, const string &key, uint16_t status) {
+	protocol_binary_response_header rsp;
+	string body;
+
+	TEST_CHECK(test_send(fd, test_bin_request(PROTOCOL_BINARY_CMD_GET, key)));
+	TEST_CHECK(test_bin_response(fd, &rsp, &body));
+	TEST_CHECK(rsp.response.status == status);
+	if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS)
+		TEST_CHECK(body.substr(rsp.response.extlen) == "v:" + key);
+}
+
+int main() {
+	ForwardServer server;
+	int port = test_free_port();
+	pid_t pid;
+	uint64_t start;
+	int fd;
+
+	backendPort = test_start_backend();
+	pid = test_start_server(&server, port, NULL);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+
+	checkGet(fd, "a", PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	/* unanswered, it fails after the pool's timeout */
+	start = test_now_ms();
+	checkGet(fd, "hang", PROTOCOL_BINARY_RESPONSE_ENOMEM);
+	TEST_CHECK(test_now_ms() - start >= CLIENT_TEST_TIMEOUT_MS);
+	TEST_CHECK(test_now_ms() - start < 4 * CLIENT_TEST_TIMEOUT_MS);
+	/* and the pool reconnects for the next one */
+	checkGet(fd, "b", PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
+	close(fd);
+	test_stop_server(pid);
+	MY_LOGD("ClientTest passed");
+	return 0;
+}
@@ -0,0 +1,175 @@
+//============================================================================
+// Name        : EvictionTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : The storage engine over a small -m: stores evict the oldest
+//               items, or fail with -M, and slab_automove moves a page to
+//               the class that evicts, rescuing the items it held
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <network/storage/StorageServer.h>
+#include <network/storage/slabs.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "EvictionTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* a server of -m 4, with the extra options, and a binary and a stats conn */
+struct Server {
+	pid_t pid;
+	int fd;
+	int statFd;
+
+	Server(const char *opt1 = NULL, const char *opt2 = NULL) {
+		static StorageServer server(NULL);
+		const char *options[] = { "-m", "4", opt1, opt2, NULL };
+		int port = test_free_port();
+
+		pid = test_start_server(&server, port, options);
+		fd = test_connect(port);
+		statFd = test_connect(port);
+		TEST_CHECK(fd >= 0 && statFd >= 0);
+	}
+	~Server() {
+		close(fd);
+		close(statFd);
+		test_stop_server(pid);
+	}
+	uint16_t set(const string &key, const string &value) {
+		return test_bin_call(fd, test_bin_set(key, value));
+	}
+	/* false on a miss */
+	bool get(const string &key, string *value) {
+		string body;
+		uint16_t status = test_bin_call(fd,
+				test_bin_request(PROTOCOL_BINARY_CMD_GET, key), &body);
+
+		if (status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT)
+			return false;
+		TEST_CHECK(status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+		*value = body.substr(4);
+		return true;
+	}
+	long stat(const string &name, const string &sub = "") {
+		return test_stat(statFd, name, sub);
+	}
+};
+
+static string key(const char *prefix, int i) {
+	return prefix + to_string(i);
+}
+
+/* the value of key i, told apart from its neighbours' */
+static string value(int i, size_t size) {
+	string v = to_string(i) + ":";
+	v.resize(size, (char) ('a' + i % 26));
+	return v;
+}
+
+/* twice -m of one class: the oldest go, every store succeeds */
+static void testEviction() {
+	Server s("-o", "slab_automove=0");
+	const int n = 8000;
+	string v;
+
+	for (int i = 0; i < n; i++)
+		TEST_CHECK(s.set(key("k", i), value(i, 1000))
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(s.stat("evictions") > 0);
+	TEST_CHECK(s.stat("curr_items") + s.stat("evictions") == n);
+	TEST_CHECK(s.stat("total_malloced") <= 4 * SLAB_PAGE_SIZE);
+	TEST_CHECK(!s.get(key("k", 0), &v));
+	TEST_CHECK(s.get(key("k", n - 1), &v) && v == value(n - 1, 1000));
+
+	/* and go on evicting */
+	long evictions = s.stat("evictions");
+	for (int i = n; i < n + 100; i++)
+		TEST_CHECK(s.set(key("k", i), value(i, 1000))
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(s.stat("evictions") == evictions + 100);
+}
+
+/* with -M, stores fail once memory is used up and nothing is evicted */
+static void testNoEviction() {
+	Server s("-M");
+	uint16_t status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+	string v;
+	int i;
+
+	for (i = 0; i < 8000 && status == PROTOCOL_BINARY_RESPONSE_SUCCESS; i++)
+		status = s.set(key("k", i), value(i, 1000));
+	TEST_CHECK(status == PROTOCOL_BINARY_RESPONSE_ENOMEM);
+	TEST_CHECK(i < 8000);
+	TEST_CHECK(s.stat("evictions") == 0);
+	TEST_CHECK(s.stat("curr_items") == i - 1);
+	TEST_CHECK(s.get(key("k", 0), &v) && v == value(0, 1000));
+}
+
+/*
+ * Small items take three pages and half of them are deleted, then large
+ * items evict with the last page only: a page of the small class moves to
+ * the large one, its live items copied to the free chunks left.
+ */
+static void testAutomove() {
+	Server s;
+	vector<int> kept;
+	uint64_t start;
+	string v;
+	int i, n;
+
+	for (n = 0; s.stat(":total_pages", "slabs") < 3; n++)
+		TEST_CHECK(s.set(key("s", n), value(n, 100))
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	for (i = 0; i < n; i++) {
+		if (i % 2 == 0) {
+			kept.push_back(i);
+			continue;
+		}
+		TEST_CHECK(test_bin_call(s.fd,
+				test_bin_request(PROTOCOL_BINARY_CMD_DELETE, key("s", i)))
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	}
+
+	start = test_now_ms();
+	for (i = 0; s.stat("slabs_moved") < 1; i++) {
+		TEST_CHECK(test_now_ms() - start < 20000);
+		TEST_CHECK(s.set(key("l", i), value(i, 4000))
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+		if (i % 100 == 99)
+			usleep(10 * 1000);
+	}
+	TEST_CHECK(s.stat("evictions") > 0);
+	TEST_CHECK(s.stat("slab_reassign_rescues") > 0);
+	TEST_CHECK(s.stat("slab_reassign_evictions") == 0);
+
+	/* none of the small items was lost on the way */
+	for (int k : kept)
+		TEST_CHECK(s.get(key("s", k), &v) && v == value(k, 100));
+	TEST_CHECK(s.stat("total_malloced") <= 4 * SLAB_PAGE_SIZE);
+}
+
+int main() {
+	testEviction();
+	testNoEviction();
+	testAutomove();
+
+	MY_LOGD("EvictionTest passed");
+	return 0;
+}
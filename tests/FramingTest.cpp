@@ -0,0 +1,251 @@
+//============================================================================
+// Name        : FramingTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : framing_scan() of delimited, length prefixed and varint
+//               streams cut at every byte, malformed and oversized frames,
+//               and framing_find_delim() against a plain loop
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <network/core/conn_framing.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "FramingTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+
+static int scan(const conn_framing *f, const string &buf, conn_frame *frames,
+		int max_frames = FRAME_BATCH_MAX) {
+	return framing_scan(f, buf.data(), (int) buf.size(), frames, max_frames);
+}
+
+/*
+ * stream holds frames of the given lengths back to back. Cut after every
+ * byte, as reads may leave it, a scan finds just the frames ending before
+ * the cut, however many it may take at once.
+ */
+static void testCuts(const conn_framing *f, const string &stream,
+		const vector<int> &lens) {
+	conn_frame frames[FRAME_BATCH_MAX];
+
+	for (size_t cut = 0; cut <= stream.size(); cut++) {
+		int whole = 0, end = 0;
+		while (whole < (int) lens.size() && end + lens[whole] <= (int) cut)
+			end += lens[whole++];
+		for (int max = 1; max <= 3; max++) {
+			int n = scan(f, stream.substr(0, cut), frames, max);
+			TEST_CHECK(n == min(whole, max));
+			for (int i = 0; i < n; i++)
+				TEST_CHECK(frames[i].len == lens[i]);
+		}
+	}
+}
+
+static void testDelimiter() {
+	conn_framing f = framing_ascii;
+	conn_frame frames[FRAME_BATCH_MAX];
+	string stream = "get a\r\nget b\n\r\n\nstats\r\n";
+
+	/* the '\r' is stripped, but only right before the delimiter */
+	TEST_CHECK(scan(&f, stream + "par", frames) == 5);
+	TEST_CHECK(frames[0].len == 7 && frames[0].trailer == 2);
+	TEST_CHECK(frames[1].len == 6 && frames[1].trailer == 1);
+	TEST_CHECK(frames[2].len == 2 && frames[2].trailer == 2);
+	TEST_CHECK(frames[3].len == 1 && frames[3].trailer == 1);
+	TEST_CHECK(frames[4].len == 7 && frames[4].trailer == 2);
+	for (int i = 0; i < 5; i++)
+		TEST_CHECK(frames[i].hdrlen == 0);
+	testCuts(&f, stream, { 7, 6, 2, 1, 7 });
+
+	/* kept without strip_cr, and any byte may end a frame */
+	f.strip_cr = false;
+	TEST_CHECK(scan(&f, "a\r\n", frames) == 1 && frames[0].trailer == 1);
+	f.delim = '\0';
+	TEST_CHECK(scan(&f, string("ab\0c\0", 5), frames) == 2);
+	TEST_CHECK(frames[0].len == 3 && frames[1].len == 2);
+}
+
+/* a binary request header announcing body bytes */
+static string binHeader(uint32_t body) {
+	protocol_binary_request_header req;
+
+	memset(&req, 0, sizeof(req));
+	req.request.magic = PROTOCOL_BINARY_REQ;
+	req.request.bodylen = htonl(body);
+	return string((const char *) &req, sizeof(req));
+}
+
+static void testLengthPrefixed() {
+	conn_framing f;
+	conn_frame frames[FRAME_BATCH_MAX];
+	string stream;
+
+	stream = binHeader(0) + binHeader(5) + "hello" + binHeader(1) + "x";
+	TEST_CHECK(scan(&framing_binary, stream, frames) == 3);
+	TEST_CHECK(frames[1].hdrlen == 24 && frames[1].len == 29);
+	TEST_CHECK(frames[1].trailer == 0);
+	testCuts(&framing_binary, stream, { 24, 29, 25 });
+
+	/*
+	 * A 2 byte little endian length after a 1 byte tag, counting the
+	 * tag and itself.
+	 */
+	memset(&f, 0, sizeof(f));
+	f.type = framing_length_prefixed;
+	f.hdr_size = 3;
+	f.len_offset = 1;
+	f.len_size = 2;
+	f.len_big_endian = false;
+	f.len_adjust = -3;
+	stream = string("T\x05\x00xy", 5) + string("U\x03\x00", 3)
+			+ string("V\x04\x01", 3) + string(257, 'z');
+	TEST_CHECK(scan(&f, stream, frames) == 3);
+	TEST_CHECK(frames[0].len == 5 && frames[1].len == 3);
+	TEST_CHECK(frames[2].len == 0x104);
+	testCuts(&f, stream, { 5, 3, 0x104 });
+
+	/* a length short of the header itself */
+	TEST_CHECK(scan(&f, string("T\x02\x00", 3), frames) == -1);
+}
+
+/* LEB128 encoding of v */
+static string varint(uint64_t v) {
+	string s;
+
+	do {
+		s += (char) ((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+		v >>= 7;
+	} while (v != 0);
+	return s;
+}
+
+static void testVarint() {
+	conn_framing f;
+	conn_frame frames[FRAME_BATCH_MAX];
+	const int bodies[] = { 0, 1, 127, 128, 300, 16383, 16384 };
+	vector<int> lens;
+	string stream;
+
+	memset(&f, 0, sizeof(f));
+	f.type = framing_varint;
+	for (int body : bodies) {
+		string prefix = varint(body);
+		stream += prefix + string(body, 'b');
+		lens.push_back((int) prefix.size() + body);
+	}
+	TEST_CHECK(scan(&f, stream, frames) == 7);
+	TEST_CHECK(frames[2].hdrlen == 1 && frames[3].hdrlen == 2);
+	TEST_CHECK(frames[6].hdrlen == 3 && frames[6].len == 16387);
+	testCuts(&f, stream, lens);
+
+	/* cut inside the prefix, it waits; 10 bytes that don't end it are bad */
+	TEST_CHECK(scan(&f, "\x80", frames) == 0);
+	TEST_CHECK(scan(&f, string(9, '\x80'), frames) == 0);
+	TEST_CHECK(scan(&f, string(10, '\x80'), frames) == -1);
+	TEST_CHECK(scan(&f, string(10, '\x80') + '\x01', frames) == -1);
+
+	/* the longest prefix is fine, but not a length beyond INT32_MAX */
+	TEST_CHECK(scan(&f, string(9, '\x80') + '\x00', frames) == 1);
+	TEST_CHECK(frames[0].hdrlen == 10 && frames[0].len == 10);
+	TEST_CHECK(scan(&f, varint((uint64_t) INT32_MAX + 1), frames) == -1);
+}
+
+/* frames over max_frame are bad, once those ahead of them are handed out */
+static void testTooLarge() {
+	conn_framing f;
+	conn_frame frames[FRAME_BATCH_MAX];
+	string ok, stream;
+
+	framing_init(64);
+	TEST_CHECK(scan(&framing_ascii, string(63, 'a') + "\n", frames) == 1);
+	TEST_CHECK(scan(&framing_ascii, string(64, 'a') + "\n", frames) == -1);
+	/* a line without its end yet, bad only once it can't fit */
+	TEST_CHECK(scan(&framing_ascii, string(64, 'a'), frames) == 0);
+	TEST_CHECK(scan(&framing_ascii, string(65, 'a'), frames) == -1);
+	ok = "get a\r\n";
+	stream = ok + string(100, 'a');
+	TEST_CHECK(scan(&framing_ascii, stream, frames) == 1);
+	TEST_CHECK(scan(&framing_ascii, stream.substr(ok.size()), frames) == -1);
+
+	/* judged by the header alone, the body needn't be there */
+	TEST_CHECK(scan(&framing_binary, binHeader(40), frames) == 0);
+	TEST_CHECK(scan(&framing_binary, binHeader(41), frames) == -1);
+	TEST_CHECK(scan(&framing_binary, binHeader(0) + binHeader(41), frames)
+			== 1);
+	memset(&f, 0, sizeof(f));
+	f.type = framing_varint;
+	f.max_frame = 64;
+	TEST_CHECK(scan(&f, varint(63), frames) == 0);
+	TEST_CHECK(scan(&f, varint(64), frames) == -1);
+
+	/* unlimited, still a frame must fit in an int */
+	framing_init(0);
+	TEST_CHECK(scan(&framing_binary, binHeader(0xffffffff), frames) == -1);
+	TEST_CHECK(scan(&framing_binary, binHeader(1 << 30), frames) == 0);
+	framing_init(FRAME_SIZE_MAX_DEFAULT);
+}
+
+/*
+ * framing_find_delim() reads 32 or 16 bytes at a time where AVX2 or SSE2
+ * are built in: it must find what a plain loop finds, from any alignment,
+ * for delimiters in the vector part, the tail and across their border.
+ */
+static void testFindDelim() {
+	vector<char> area(256 + 64);
+	const char delims[] = { '\n', '\0', '\x80', '\xff' };
+
+	for (char delim : delims) {
+		for (size_t off = 0; off < 33; off++) {
+			char *buf = area.data() + off;
+			for (size_t len = 0; len <= 100; len++) {
+				/* never the delimiter, but bytes one bit off it */
+				for (size_t i = 0; i < len + 32; i++)
+					buf[i] = (char) (delim ^ (1 << (i % 8)));
+				TEST_CHECK(framing_find_delim(buf, len, delim) == NULL);
+				for (size_t at = 0; at < len; at++) {
+					buf[at] = delim;
+					TEST_CHECK(framing_find_delim(buf, len, delim)
+							== buf + at);
+					/* a later one doesn't matter, one past len isn't seen */
+					if (at + 1 < len) {
+						buf[len - 1] = delim;
+						TEST_CHECK(framing_find_delim(buf, len, delim)
+								== buf + at);
+						buf[len - 1] = (char) (delim ^ 1);
+					}
+					buf[at] = (char) (delim ^ 1);
+					buf[len] = delim;
+					TEST_CHECK(framing_find_delim(buf, len, delim) == NULL);
+					buf[len] = (char) (delim ^ 1);
+				}
+			}
+		}
+	}
+}
+
+int main() {
+	framing_init(FRAME_SIZE_MAX_DEFAULT);
+	testDelimiter();
+	testLengthPrefixed();
+	testVarint();
+	testTooLarge();
+	testFindDelim();
+
+	MY_LOGD("FramingTest passed");
+	return 0;
+}
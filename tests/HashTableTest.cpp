@@ -0,0 +1,150 @@
+//============================================================================
+// Name        : HashTableTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : ConcurrentHashTable under threads inserting, finding and
+//               removing while the expander doubles the table
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <vutils/ConcurrentHashTable.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "HashTableTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define HASH_TEST_THREADS 4
+#define HASH_TEST_KEYS 20000
+
+struct Entry {
+	HashLink link; /* first, entries are cast from their link */
+	uint32_t key;
+};
+
+static ConcurrentHashTable *table;
+static Entry entries[HASH_TEST_THREADS][HASH_TEST_KEYS];
+
+static bool equals(const HashLink *e, const void *key, size_t nkey) {
+	return nkey == sizeof(uint32_t)
+			&& ((const Entry *) e)->key == *(const uint32_t *) key;
+}
+
+/* a 32 bit mix, so that the low bits picking buckets and locks vary */
+static uint32_t mix(uint32_t key) {
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+static Entry *find(uint32_t key) {
+	uint32_t hv = mix(key);
+	HashLink *e;
+
+	table->lock(hv);
+	e = table->find(&key, sizeof(key), hv);
+	table->unlock(hv);
+	return (Entry *) e;
+}
+
+/*
+ * Inserts its own keys, each found right after, and removes every third.
+ * The keys of the threads don't overlap.
+ */
+static void *worker(void *arg) {
+	int id = (int) (long) arg;
+
+	for (uint32_t i = 0; i < HASH_TEST_KEYS; i++) {
+		Entry *e = &entries[id][i];
+		uint32_t hv;
+
+		e->key = id * HASH_TEST_KEYS + i;
+		hv = mix(e->key);
+		table->lock(hv);
+		TEST_CHECK(table->find(&e->key, sizeof(e->key), hv) == NULL);
+		table->insert(&e->link, hv);
+		table->unlock(hv);
+		TEST_CHECK(find(e->key) == e);
+
+		if (i % 3 == 0) {
+			table->lock(hv);
+			TEST_CHECK(table->remove(&e->key, sizeof(e->key), hv) == &e->link);
+			TEST_CHECK(!table->contains(&e->link, hv));
+			table->unlock(hv);
+		}
+	}
+	return NULL;
+}
+
+int main() {
+	ConcurrentHashTable::Stats stats;
+	pthread_t tids[HASH_TEST_THREADS];
+	uint64_t expected = 0;
+	uint64_t start;
+
+	/* arguments it can't take */
+	{
+		ConcurrentHashTable bad(equals);
+		TEST_CHECK(bad.init(0, 0, false) == BAD_VALUE);
+		TEST_CHECK(bad.init(4, -1, false) == BAD_VALUE);
+	}
+
+	table = new ConcurrentHashTable(equals);
+	TEST_CHECK(table->init(4, 2, true) == NO_ERROR);
+
+	for (int i = 0; i < HASH_TEST_THREADS; i++)
+		TEST_CHECK(pthread_create(&tids[i], NULL, worker,
+				(void *) (long) i) == 0);
+	for (int i = 0; i < HASH_TEST_THREADS; i++)
+		pthread_join(tids[i], NULL);
+
+	/* the expander catches up with the last inserts */
+	start = test_now_ms();
+	for (;;) {
+		table->getStats(&stats);
+		if (!stats.expanding && stats.items <= (1ULL << stats.hashpower) * 3 / 2)
+			break;
+		TEST_CHECK(test_now_ms() - start < 10000);
+		usleep(1000);
+	}
+	for (int i = 0; i < HASH_TEST_THREADS; i++)
+		for (uint32_t k = 0; k < HASH_TEST_KEYS; k++)
+			if (k % 3 != 0)
+				expected++;
+	TEST_CHECK(stats.items == expected);
+	TEST_CHECK(stats.hashpower > 4);
+	TEST_CHECK(stats.expansions >= 1);
+	TEST_CHECK(stats.moved_items > 0);
+
+	/* nothing was lost or left behind by the moves */
+	for (int i = 0; i < HASH_TEST_THREADS; i++) {
+		for (uint32_t k = 0; k < HASH_TEST_KEYS; k++) {
+			Entry *e = find(entries[i][k].key);
+			if (k % 3 == 0)
+				TEST_CHECK(e == NULL);
+			else
+				TEST_CHECK(e == &entries[i][k]);
+		}
+	}
+
+	delete table;
+	MY_LOGD("HashTableTest passed");
+	return 0;
+}
@@ -0,0 +1,150 @@
+//============================================================================
+// Name        : LZCodecTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : LZCodec round trips of sizes around its limits, output that
+//               doesn't fit, and blocks cut short or corrupted
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <vutils/LZCodec.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "LZCodecTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+static uint32_t rnd = 1;
+
+static uint8_t next() {
+	rnd = rnd * 1103515245 + 12345;
+	return (uint8_t) (rnd >> 16);
+}
+
+enum Kind {
+	ZEROS, /* one long match */
+	RANDOM, /* no match at all, long literal runs */
+	TEXT, /* short matches close by */
+	PERIODIC, /* matches overlapping their own output */
+	FAR, /* repeats further back than an offset reaches */
+	KINDS
+};
+
+static string make(Kind kind, size_t n) {
+	const char *words[] = { "{\"id\":", "\"name\":\"", "vmodule", "\",",
+			"\"tags\":[", "\"cache\"", "]}", "\n" };
+	string s;
+
+	switch (kind) {
+	case ZEROS:
+		s.assign(n, '\0');
+		break;
+	case RANDOM:
+		for (size_t i = 0; i < n; i++)
+			s += (char) next();
+		break;
+	case TEXT:
+		while (s.size() < n)
+			s += words[next() % 8];
+		break;
+	case PERIODIC:
+		for (size_t i = 0; i < n; i++)
+			s += "abc"[i % 3];
+		break;
+	case FAR:
+		s = make(RANDOM, 70000);
+		while (s.size() < n)
+			s += s.substr(0, 1000);
+		break;
+	default:
+		break;
+	}
+	s.resize(n);
+	return s;
+}
+
+/* compresses src and back, returns the block's size */
+static size_t roundTrip(const string &src) {
+	vector<char> block(LZCodec::bound(src.size()));
+	string out(src.size(), '\1');
+	size_t n;
+
+	n = LZCodec::compress(src.data(), src.size(), block.data(), block.size());
+	TEST_CHECK(n > 0 && n <= block.size());
+	TEST_CHECK(LZCodec::decompress(block.data(), n, &out[0], out.size()));
+	TEST_CHECK(out == src);
+
+	/* of another size, it doesn't decompress */
+	out.resize(src.size() + 1);
+	TEST_CHECK(!LZCodec::decompress(block.data(), n, &out[0], out.size()));
+	if (src.size() > 0)
+		TEST_CHECK(!LZCodec::decompress(block.data(), n, &out[0],
+				src.size() - 1));
+
+	/* with a byte less of room than it needs, it isn't made */
+	TEST_CHECK(LZCodec::compress(src.data(), src.size(), block.data(), n - 1)
+			== 0);
+	return n;
+}
+
+/* every cut of a block, and blocks with a byte changed, are rejected */
+static void testDamaged(const string &src) {
+	vector<char> block(LZCodec::bound(src.size()));
+	string out(src.size(), '\0');
+	size_t n, i;
+
+	n = LZCodec::compress(src.data(), src.size(), block.data(), block.size());
+	TEST_CHECK(n > 0);
+	for (i = 0; i < n; i++)
+		TEST_CHECK(!LZCodec::decompress(block.data(), i, &out[0], out.size()));
+
+	/* may still decompress to something, but never out of bounds */
+	for (i = 0; i < 1000; i++) {
+		vector<char> bad(block.begin(), block.begin() + n);
+		bad[next() % n] ^= (char) (next() | 1);
+		LZCodec::decompress(bad.data(), n, &out[0], out.size());
+	}
+}
+
+int main() {
+	const size_t sizes[] = { 0, 1, 3, 4, 11, 12, 13, 15, 16, 19, 64, 255,
+			270, 4096, 65535, 65536, 100000, 300000 };
+	size_t n;
+
+	for (int kind = 0; kind < KINDS; kind++)
+		for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			roundTrip(make((Kind) kind, sizes[i]));
+
+	/* what it is for: text shrinks a lot, random data not at all */
+	n = roundTrip(make(TEXT, 65536));
+	TEST_CHECK(n < 65536 / 2);
+	n = roundTrip(make(ZEROS, 65536));
+	TEST_CHECK(n < 65536 / 100);
+	n = roundTrip(make(RANDOM, 65536));
+	TEST_CHECK(n > 65536 && n <= LZCodec::bound(65536));
+	/* the repeats beyond 64KB back are found again once in reach */
+	n = roundTrip(make(FAR, 200000));
+	TEST_CHECK(n < 100000);
+
+	testDamaged(make(TEXT, 4096));
+	testDamaged(make(RANDOM, 300));
+	testDamaged(make(PERIODIC, 1000));
+
+	MY_LOGD("LZCodecTest passed");
+	return 0;
+}
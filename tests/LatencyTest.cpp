@@ -0,0 +1,131 @@
+//============================================================================
+// Name        : LatencyTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Log-linear latency histograms: bucket boundaries from 0
+//               through the linear and log ranges to the clamped top bucket,
+//               and the percentiles read out of them
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <network/core/conn_latency.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "LatencyTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+
+#define LAT_TEST_MAX ((1ULL << LAT_MAX_BITS) - 1)
+
+/*
+ * v is in the bucket whose top is the first at or above it: the one below
+ * ends before v, and the top is at most 1/LAT_SUB above v.
+ */
+static void checkValue(uint64_t v) {
+	int b = hist_bucket(v);
+
+	TEST_CHECK(b >= 0 && b < LAT_BUCKETS);
+	TEST_CHECK(hist_bucket_top(b) >= v);
+	TEST_CHECK(b == 0 || hist_bucket_top(b - 1) < v);
+	TEST_CHECK(hist_bucket_top(b) - v <= v / LAT_SUB);
+}
+
+static void testBuckets() {
+	/* one value per bucket while values are small */
+	for (uint64_t v = 0; v < 2 * LAT_SUB; v++) {
+		TEST_CHECK(hist_bucket(v) == (int) v);
+		TEST_CHECK(hist_bucket_top((int) v) == v);
+	}
+	/* then LAT_SUB per power of two, each twice as wide as the last */
+	TEST_CHECK(hist_bucket(2 * LAT_SUB) == 2 * LAT_SUB);
+	TEST_CHECK(hist_bucket(2 * LAT_SUB + 1) == 2 * LAT_SUB);
+	TEST_CHECK(hist_bucket(2 * LAT_SUB + 2) == 2 * LAT_SUB + 1);
+	TEST_CHECK(hist_bucket(4 * LAT_SUB - 1) == 3 * LAT_SUB - 1);
+	TEST_CHECK(hist_bucket(4 * LAT_SUB) == 3 * LAT_SUB);
+	TEST_CHECK(hist_bucket_top(3 * LAT_SUB) == 4 * LAT_SUB + 3);
+
+	/* around every power of two, and spread inside of it */
+	for (int bit = 0; bit < LAT_MAX_BITS; bit++) {
+		uint64_t p = 1ULL << bit;
+		checkValue(p - 1);
+		checkValue(p);
+		checkValue(p + 1);
+		for (uint64_t v = p; v < 2 * p; v += p / 37 + 1)
+			checkValue(v);
+	}
+	for (uint64_t v = 0; v < 1 << 16; v++)
+		checkValue(v);
+	for (int b = 1; b < LAT_BUCKETS; b++)
+		TEST_CHECK(hist_bucket_top(b) > hist_bucket_top(b - 1));
+
+	/* the last bucket ends the range, and takes whatever is above it */
+	TEST_CHECK(hist_bucket_top(LAT_BUCKETS - 1) == LAT_TEST_MAX);
+	TEST_CHECK(hist_bucket(LAT_TEST_MAX) == LAT_BUCKETS - 1);
+	TEST_CHECK(hist_bucket(LAT_TEST_MAX + 1) == LAT_BUCKETS - 1);
+	TEST_CHECK(hist_bucket(UINT64_MAX) == LAT_BUCKETS - 1);
+	TEST_CHECK(hist_bucket(LAT_TEST_MAX / 16 * 15 + 15) == LAT_BUCKETS - 1);
+	TEST_CHECK(hist_bucket(LAT_TEST_MAX / 16 * 15 + 14) == LAT_BUCKETS - 2);
+}
+
+static void testPercentiles() {
+	struct latency_hist h, merged;
+
+	memset(&h, 0, sizeof(h));
+	TEST_CHECK(hist_value_at(&h, 0.5) == 0);
+	TEST_CHECK(hist_value_at(&h, 1) == 0);
+
+	/* 1..100: a percentile reads as the top of its bucket */
+	for (uint64_t v = 1; v <= 100; v++)
+		hist_record(&h, v);
+	TEST_CHECK(h.count == 100 && h.sum_ns == 5050 && h.max_ns == 100);
+	TEST_CHECK(hist_value_at(&h, 0.001) == 1);
+	TEST_CHECK(hist_value_at(&h, 0.01) == 1);
+	TEST_CHECK(hist_value_at(&h, 0.1) == 10);
+	TEST_CHECK(hist_value_at(&h, 0.5) == hist_bucket_top(hist_bucket(50)));
+	TEST_CHECK(hist_value_at(&h, 0.5) == 51);
+	TEST_CHECK(hist_value_at(&h, 0.9) == 95);
+	/* but never above the largest value seen */
+	TEST_CHECK(hist_bucket_top(hist_bucket(99)) > 100);
+	TEST_CHECK(hist_value_at(&h, 0.99) == 100);
+	TEST_CHECK(hist_value_at(&h, 1) == 100);
+
+	/* merged, the counts add up and the max is the larger */
+	memset(&merged, 0, sizeof(merged));
+	hist_merge(&merged, &h);
+	hist_record(&h, 1000);
+	hist_merge(&merged, &h);
+	TEST_CHECK(merged.count == 201 && merged.max_ns == 1000);
+	TEST_CHECK(merged.sum_ns == 2 * 5050 + 1000);
+	TEST_CHECK(hist_value_at(&merged, 0.5) == 51);
+	TEST_CHECK(hist_value_at(&merged, 1) == 1000);
+
+	/* values over the range report the top of it */
+	memset(&h, 0, sizeof(h));
+	hist_record(&h, 0);
+	hist_record(&h, LAT_TEST_MAX * 4);
+	TEST_CHECK(hist_value_at(&h, 0.5) == 0);
+	TEST_CHECK(hist_value_at(&h, 1) == LAT_TEST_MAX);
+	TEST_CHECK(h.max_ns == LAT_TEST_MAX * 4);
+}
+
+int main() {
+	testBuckets();
+	testPercentiles();
+
+	MY_LOGD("LatencyTest passed");
+	return 0;
+}
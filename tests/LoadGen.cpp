@@ -0,0 +1,696 @@
+//============================================================================
+// Name        : LoadGen.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Load generator for servers built on network/core
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <vutils/Logger.h>
+#include <vutils/StringUtils.h>
+#include <threads/Thread.h>
+#include <network/core/conn_latency.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "LoadGen"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* A size picked uniformly from [lo, hi]. */
+struct SizeDist {
+	int lo;
+	int hi;
+};
+
+struct LoadConfig {
+	string host;
+	string port;
+	int connections;
+	int threads;
+	int depth; /* requests in flight per connection */
+	bool binary;
+	int duration; /* seconds measured */
+	int warmup; /* seconds run before measuring */
+	SizeDist keySize;
+	SizeDist valueSize;
+	int keySpace;
+	double getRatio;
+	double rate; /* requests per second over all threads, 0 is closed loop */
+	string json; /* JSON results go to this file, "-" for stdout */
+};
+
+static LoadConfig config;
+
+static uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool parseSize(const char *str, SizeDist *dist) {
+	vector<string> parts = StringUtils::Split(str, '-');
+	if (parts.size() < 1 || parts.size() > 2
+			|| !StringUtils::IsNaturalNumber(parts[0])
+			|| (parts.size() == 2 && !StringUtils::IsNaturalNumber(parts[1])))
+		return false;
+	dist->lo = atoi(parts[0].c_str());
+	dist->hi = parts.size() == 2 ? atoi(parts[1].c_str()) : dist->lo;
+	return dist->lo > 0 && dist->hi >= dist->lo;
+}
+
+/* Results of one kind of request. */
+struct OpResult {
+	uint64_t requests;
+	uint64_t misses;
+	uint64_t errors;
+	struct latency_hist *hist;
+
+	OpResult() :
+			requests(0), misses(0), errors(0) {
+		hist = (struct latency_hist *) calloc(1, sizeof(*hist));
+	}
+	~OpResult() {
+		free(hist);
+	}
+	void merge(const OpResult &other) {
+		requests += other.requests;
+		misses += other.misses;
+		errors += other.errors;
+		hist_merge(hist, other.hist);
+	}
+private:
+	OpResult(const OpResult&);
+	OpResult& operator=(const OpResult&);
+};
+
+enum {
+	OP_GET = 0, OP_SET, OP_MAX
+};
+
+/* A request sent and not answered yet. */
+struct Pending {
+	uint64_t start; /* intended send time, so queueing counts */
+	int op;
+};
+
+struct LoadConn {
+	int fd;
+	string out; /* bytes not written yet */
+	string in; /* bytes read and not parsed yet */
+	deque<Pending> pending;
+	bool wantWrite;
+};
+
+class LoadThread: public virtual CThread {
+public:
+	LoadThread(int id, int nconns);
+	~LoadThread();
+	virtual bool threadLoop();
+
+	OpResult results[OP_MAX];
+	bool failed;
+private:
+	bool connectAll();
+	uint64_t random();
+	void makeKey(string &key);
+	void issue(LoadConn *c, uint64_t start);
+	bool flush(LoadConn *c);
+	bool readSome(LoadConn *c);
+	int parseAscii(LoadConn *c, bool *miss, bool *error);
+	int parseBinary(LoadConn *c, bool *miss, bool *error);
+	void complete(LoadConn *c, uint64_t now, bool miss, bool error);
+	void updateEvents(LoadConn *c);
+
+	int mId;
+	int mEpoll;
+	vector<LoadConn> mConns;
+	uint64_t mSeed;
+	uint64_t mMeasureStart;
+	uint64_t mMeasureEnd;
+	size_t mNext; /* round robin cursor for open loop */
+	string mValue;
+};
+
+LoadThread::LoadThread(int id, int nconns) :
+		failed(false), mId(id), mEpoll(-1), mConns(nconns), mMeasureStart(0),
+		mMeasureEnd(0), mNext(0) {
+	mSeed = 0x9e3779b97f4a7c15ULL * (id + 1);
+	for (size_t i = 0; i < mConns.size(); i++)
+		mConns[i].fd = -1;
+	mValue.assign(config.valueSize.hi, 'x');
+}
+
+LoadThread::~LoadThread() {
+	for (size_t i = 0; i < mConns.size(); i++) {
+		if (mConns[i].fd >= 0)
+			close(mConns[i].fd);
+	}
+	if (mEpoll >= 0)
+		close(mEpoll);
+}
+
+uint64_t LoadThread::random() {
+	/* xorshift64* */
+	mSeed ^= mSeed >> 12;
+	mSeed ^= mSeed << 25;
+	mSeed ^= mSeed >> 27;
+	return mSeed * 2685821657736338717ULL;
+}
+
+void LoadThread::makeKey(string &key) {
+	int len = config.keySize.lo
+			+ random() % (config.keySize.hi - config.keySize.lo + 1);
+	char num[32];
+	int n = snprintf(num, sizeof(num), "%llu",
+			(unsigned long long) (random() % config.keySpace));
+
+	key.assign("key:");
+	if ((int) key.size() + n < len)
+		key.append(len - key.size() - n, '0');
+	key.append(num, n);
+}
+
+bool LoadThread::connectAll() {
+	struct addrinfo hints, *ai;
+	int one = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(config.host.c_str(), config.port.c_str(), &hints, &ai)
+			!= 0) {
+		fprintf(stderr, "Can't resolve %s:%s\n", config.host.c_str(),
+				config.port.c_str());
+		return false;
+	}
+
+	mEpoll = epoll_create1(0);
+	for (size_t i = 0; i < mConns.size(); i++) {
+		LoadConn *c = &mConns[i];
+		c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		c->wantWrite = false;
+		if (c->fd < 0 || connect(c->fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+			fprintf(stderr, "Can't connect to %s:%s: %s\n",
+					config.host.c_str(), config.port.c_str(),
+					strerror(errno));
+			freeaddrinfo(ai);
+			return false;
+		}
+		setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		epoll_ctl(mEpoll, EPOLL_CTL_ADD, c->fd, &ev);
+	}
+	freeaddrinfo(ai);
+	return true;
+}
+
+/*
+ * Queues one request on c, a get or a set depending on -g.
+ */
+void LoadThread::issue(LoadConn *c, uint64_t start) {
+	Pending p;
+	string key;
+	int vlen = 0;
+
+	p.start = start;
+	p.op = (random() % 10000) < config.getRatio * 10000 ? OP_GET : OP_SET;
+	makeKey(key);
+	if (p.op == OP_SET)
+		vlen = config.valueSize.lo
+				+ random() % (config.valueSize.hi - config.valueSize.lo + 1);
+
+	if (!config.binary) {
+		if (p.op == OP_GET) {
+			c->out.append("get ").append(key).append("\r\n");
+		} else {
+			c->out.append(StringUtils::Format("set %s 0 0 %d\r\n",
+					key.c_str(), vlen));
+			c->out.append(mValue, 0, vlen).append("\r\n");
+		}
+	} else {
+		protocol_binary_request_header req;
+		int extlen = p.op == OP_SET ? 8 : 0;
+
+		memset(&req, 0, sizeof(req));
+		req.request.magic = PROTOCOL_BINARY_REQ;
+		req.request.opcode =
+				p.op == OP_GET ? PROTOCOL_BINARY_CMD_GET : PROTOCOL_BINARY_CMD_SET;
+		req.request.keylen = htons(key.size());
+		req.request.extlen = extlen;
+		req.request.bodylen = htonl(extlen + key.size() + vlen);
+		c->out.append((const char *) req.bytes, sizeof(req.bytes));
+		/* flags and exptime, both zero */
+		c->out.append(extlen, '\0');
+		c->out.append(key);
+		c->out.append(mValue, 0, vlen);
+	}
+	c->pending.push_back(p);
+}
+
+bool LoadThread::flush(LoadConn *c) {
+	while (!c->out.empty()) {
+		ssize_t res = write(c->fd, c->out.data(), c->out.size());
+		if (res > 0) {
+			c->out.erase(0, res);
+		} else if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else if (res < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	updateEvents(c);
+	return true;
+}
+
+void LoadThread::updateEvents(LoadConn *c) {
+	bool want = !c->out.empty();
+	if (want == c->wantWrite)
+		return;
+	struct epoll_event ev;
+	ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+	ev.data.u32 = c - &mConns[0];
+	epoll_ctl(mEpoll, EPOLL_CTL_MOD, c->fd, &ev);
+	c->wantWrite = want;
+}
+
+bool LoadThread::readSome(LoadConn *c) {
+	char buf[16384];
+	for (;;) {
+		ssize_t res = read(c->fd, buf, sizeof(buf));
+		if (res > 0) {
+			c->in.append(buf, res);
+			if (res < (ssize_t) sizeof(buf))
+				return true;
+		} else if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return true;
+		} else if (res < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+}
+
+/*
+ * Returns the length of the first complete ASCII response in c->in, 0 if
+ * it is incomplete. A get answer runs until END, anything else is a line.
+ */
+int LoadThread::parseAscii(LoadConn *c, bool *miss, bool *error) {
+	size_t pos = 0;
+	bool value = false;
+
+	for (;;) {
+		size_t eol = c->in.find("\r\n", pos);
+		if (eol == string::npos)
+			return 0;
+		if (c->in.compare(pos, 6, "VALUE ") == 0) {
+			/* "VALUE <key> <flags> <bytes> [<cas>]" */
+			vector<string> tokens = StringUtils::Split(
+					c->in.substr(pos, eol - pos), ' ');
+			size_t bytes = tokens.size() >= 4 ?
+					strtoul(tokens[3].c_str(), NULL, 10) : 0;
+			if (c->in.size() < eol + 2 + bytes + 2)
+				return 0;
+			pos = eol + 2 + bytes + 2;
+			value = true;
+			continue;
+		}
+		if (value && c->in.compare(pos, 3, "END") != 0) {
+			/* garbage between values */
+			*error = true;
+			return eol + 2;
+		}
+		*miss = c->in.compare(pos, 3, "END") == 0 && !value;
+		*error = c->in.compare(pos, 5, "ERROR") == 0
+				|| c->in.compare(pos, 12, "SERVER_ERROR") == 0
+				|| c->in.compare(pos, 12, "CLIENT_ERROR") == 0;
+		return eol + 2;
+	}
+}
+
+/*
+ * Returns the length of the first complete binary response in c->in, 0 if
+ * it is incomplete.
+ */
+int LoadThread::parseBinary(LoadConn *c, bool *miss, bool *error) {
+	const unsigned char *p = (const unsigned char *) c->in.data();
+	uint32_t bodylen;
+	uint16_t status;
+
+	if (c->in.size() < sizeof(protocol_binary_response_header))
+		return 0;
+	status = (p[6] << 8) | p[7];
+	bodylen = ((uint32_t) p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+	if (c->in.size() < sizeof(protocol_binary_response_header) + bodylen)
+		return 0;
+	*miss = status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+	*error = p[0] != PROTOCOL_BINARY_RES
+			|| (status != PROTOCOL_BINARY_RESPONSE_SUCCESS && !*miss);
+	return sizeof(protocol_binary_response_header) + bodylen;
+}
+
+void LoadThread::complete(LoadConn *c, uint64_t now, bool miss, bool error) {
+	Pending p = c->pending.front();
+	c->pending.pop_front();
+	if (now < mMeasureStart || now >= mMeasureEnd)
+		return;
+
+	OpResult &r = results[p.op];
+	r.requests++;
+	if (miss)
+		r.misses++;
+	if (error)
+		r.errors++;
+	hist_record(r.hist, now - p.start);
+}
+
+bool LoadThread::threadLoop() {
+	struct epoll_event events[64];
+	uint64_t now, next = 0;
+	double interval = 0;
+	int n, i;
+
+	if (!connectAll()) {
+		failed = true;
+		return false;
+	}
+
+	now = nowNs();
+	mMeasureStart = now + (uint64_t) config.warmup * 1000000000;
+	mMeasureEnd = mMeasureStart + (uint64_t) config.duration * 1000000000;
+	if (config.rate > 0) {
+		interval = 1e9 * config.threads / config.rate;
+		next = now;
+	} else {
+		for (size_t k = 0; k < mConns.size(); k++) {
+			for (i = 0; i < config.depth; i++)
+				issue(&mConns[k], now);
+			if (!flush(&mConns[k])) {
+				failed = true;
+				return false;
+			}
+		}
+	}
+
+	while ((now = nowNs()) < mMeasureEnd) {
+		int timeout = 100;
+
+		if (config.rate > 0) {
+			/* open loop: poisson arrivals, a request waits for a free
+			 * slot but keeps its arrival time */
+			while (next <= now) {
+				size_t k;
+				for (k = 0; k < mConns.size(); k++) {
+					LoadConn *c = &mConns[(mNext + k) % mConns.size()];
+					if ((int) c->pending.size() < config.depth) {
+						issue(c, next);
+						if (!flush(c)) {
+							failed = true;
+							return false;
+						}
+						break;
+					}
+				}
+				if (k == mConns.size())
+					break;
+				mNext = (mNext + k + 1) % mConns.size();
+				double u = (random() >> 11) * (1.0 / 9007199254740992.0);
+				next += (uint64_t) (-log(1.0 - u) * interval);
+			}
+			timeout = next > now ? (int) ((next - now) / 1000000) : 0;
+		}
+
+		n = epoll_wait(mEpoll, events, 64, timeout);
+		now = nowNs();
+		for (i = 0; i < n; i++) {
+			LoadConn *c = &mConns[events[i].data.u32];
+			if ((events[i].events & EPOLLOUT) && !flush(c)) {
+				failed = true;
+				return false;
+			}
+			if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+				continue;
+			if (!readSome(c)) {
+				fprintf(stderr, "Connection closed by server\n");
+				failed = true;
+				return false;
+			}
+
+			int done = 0;
+			while (!c->pending.empty()) {
+				bool miss = false, error = false;
+				int len = config.binary ?
+						parseBinary(c, &miss, &error) :
+						parseAscii(c, &miss, &error);
+				if (len == 0)
+					break;
+				c->in.erase(0, len);
+				complete(c, now, miss, error);
+				done++;
+			}
+
+			if (config.rate == 0) {
+				while (done-- > 0)
+					issue(c, now);
+				if (!flush(c)) {
+					failed = true;
+					return false;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static void printHuman(const char *name, const OpResult &r, double secs) {
+	if (r.requests == 0)
+		return;
+	printf("%-5s %12llu req %12.0f req/s  misses %llu  errors %llu\n", name,
+			(unsigned long long) r.requests, r.requests / secs,
+			(unsigned long long) r.misses, (unsigned long long) r.errors);
+	printf("      latency us: mean %.1f p50 %.1f p90 %.1f p99 %.1f "
+			"p999 %.1f max %.1f\n", r.hist->sum_ns / 1000.0 / r.requests,
+			hist_value_at(r.hist, 0.5) / 1000.0,
+			hist_value_at(r.hist, 0.9) / 1000.0,
+			hist_value_at(r.hist, 0.99) / 1000.0,
+			hist_value_at(r.hist, 0.999) / 1000.0, r.hist->max_ns / 1000.0);
+}
+
+static void printJson(FILE *out, const char *name, const OpResult &r,
+		double secs, bool last) {
+	fprintf(out, "  \"%s\": {\"requests\": %llu, \"throughput\": %.1f, "
+			"\"misses\": %llu, \"errors\": %llu, \"latency_us\": "
+			"{\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+			"\"p999\": %.1f, \"max\": %.1f}}%s\n", name,
+			(unsigned long long) r.requests, r.requests / secs,
+			(unsigned long long) r.misses, (unsigned long long) r.errors,
+			r.requests ? r.hist->sum_ns / 1000.0 / r.requests : 0.0,
+			hist_value_at(r.hist, 0.5) / 1000.0,
+			hist_value_at(r.hist, 0.9) / 1000.0,
+			hist_value_at(r.hist, 0.99) / 1000.0,
+			hist_value_at(r.hist, 0.999) / 1000.0, r.hist->max_ns / 1000.0,
+			last ? "" : ",");
+}
+
+static void usage(void) {
+	printf("LoadGen -p <port> [options]\n"
+			"-s <host>     server address (default: 127.0.0.1)\n"
+			"-p <port>     server port (default: 11211)\n"
+			"-c <num>      connections in total (default: 16)\n"
+			"-t <num>      threads the connections are spread over (default: 4)\n"
+			"-P <num>      requests in flight per connection (default: 1)\n"
+			"-B <proto>    ascii or binary (default: ascii)\n"
+			"-d <sec>      measured duration (default: 10)\n"
+			"-w <sec>      warmup before measuring (default: 1)\n"
+			"-k <n|lo-hi>  key size, fixed or uniform (default: 16)\n"
+			"-v <n|lo-hi>  value size, fixed or uniform (default: 32)\n"
+			"-K <num>      number of distinct keys (default: 100000)\n"
+			"-g <ratio>    share of gets, the rest are sets (default: 0.9)\n"
+			"-r <rps>      open loop at this total rate, latency is measured\n"
+			"              from the intended send time (default: 0, closed loop)\n"
+			"-J <file>     also write the results as JSON to file, - for\n"
+			"              stdout (which debug builds share with the log)\n");
+}
+
+int main(int argc, char **argv) {
+	int c;
+
+	config.host = "127.0.0.1";
+	config.port = "11211";
+	config.connections = 16;
+	config.threads = 4;
+	config.depth = 1;
+	config.binary = false;
+	config.duration = 10;
+	config.warmup = 1;
+	config.keySize.lo = config.keySize.hi = 16;
+	config.valueSize.lo = config.valueSize.hi = 32;
+	config.keySpace = 100000;
+	config.getRatio = 0.9;
+	config.rate = 0;
+	config.json.clear();
+
+	while (-1 != (c = getopt(argc, argv, "s:p:c:t:P:B:d:w:k:v:K:g:r:J:h"))) {
+		switch (c) {
+		case 's':
+			config.host = optarg;
+			break;
+		case 'p':
+			config.port = optarg;
+			break;
+		case 'c':
+			config.connections = atoi(optarg);
+			break;
+		case 't':
+			config.threads = atoi(optarg);
+			break;
+		case 'P':
+			config.depth = atoi(optarg);
+			break;
+		case 'B':
+			if (strcmp(optarg, "binary") == 0) {
+				config.binary = true;
+			} else if (strcmp(optarg, "ascii") != 0) {
+				fprintf(stderr, "Invalid protocol %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			config.duration = atoi(optarg);
+			break;
+		case 'w':
+			config.warmup = atoi(optarg);
+			break;
+		case 'k':
+			if (!parseSize(optarg, &config.keySize)
+					|| config.keySize.hi > KEY_MAX_LENGTH) {
+				fprintf(stderr, "Invalid key size %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'v':
+			if (!parseSize(optarg, &config.valueSize)) {
+				fprintf(stderr, "Invalid value size %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'K':
+			config.keySpace = atoi(optarg);
+			break;
+		case 'g':
+			config.getRatio = atof(optarg);
+			break;
+		case 'r':
+			config.rate = atof(optarg);
+			break;
+		case 'J':
+			config.json = optarg;
+			break;
+		default:
+			usage();
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (config.connections < 1 || config.threads < 1 || config.depth < 1
+			|| config.duration < 1 || config.warmup < 0 || config.keySpace < 1
+			|| config.getRatio < 0 || config.getRatio > 1 || config.rate < 0) {
+		usage();
+		return 1;
+	}
+	if (config.threads > config.connections)
+		config.threads = config.connections;
+
+	vector<sp<LoadThread> > threads;
+	for (int i = 0; i < config.threads; i++) {
+		int nconns = config.connections / config.threads
+				+ (i < config.connections % config.threads ? 1 : 0);
+		sp<LoadThread> t = new LoadThread(i, nconns);
+		threads.push_back(t);
+		t->run(StringUtils::Format("LoadGen%d", i).c_str());
+	}
+
+	OpResult total[OP_MAX];
+	bool failed = false;
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i]->join();
+		failed |= threads[i]->failed;
+		for (int op = 0; op < OP_MAX; op++)
+			total[op].merge(threads[i]->results[op]);
+	}
+	if (failed)
+		return 1;
+
+	OpResult all;
+	for (int op = 0; op < OP_MAX; op++)
+		all.merge(total[op]);
+
+	double secs = config.duration;
+	if (!config.json.empty()) {
+		FILE *out = config.json == "-" ? stdout : fopen(config.json.c_str(), "w");
+		if (out == NULL) {
+			fprintf(stderr, "Can't open %s: %s\n", config.json.c_str(),
+					strerror(errno));
+			return 1;
+		}
+		fprintf(out, "{\n  \"config\": {\"host\": \"%s\", \"port\": \"%s\", "
+				"\"protocol\": \"%s\", \"connections\": %d, \"threads\": %d, "
+				"\"depth\": %d, \"duration\": %d, \"rate\": %.1f, "
+				"\"get_ratio\": %.3f, \"key_size\": [%d, %d], "
+				"\"value_size\": [%d, %d], \"key_space\": %d},\n",
+				config.host.c_str(), config.port.c_str(),
+				config.binary ? "binary" : "ascii", config.connections,
+				config.threads, config.depth, config.duration, config.rate,
+				config.getRatio, config.keySize.lo, config.keySize.hi,
+				config.valueSize.lo, config.valueSize.hi, config.keySpace);
+		printJson(out, "total", all, secs, false);
+		printJson(out, "get", total[OP_GET], secs, false);
+		printJson(out, "set", total[OP_SET], secs, true);
+		fprintf(out, "}\n");
+		if (out != stdout)
+			fclose(out);
+	}
+	printf("%s:%s %s, %d connections on %d threads, depth %d, %s\n",
+			config.host.c_str(), config.port.c_str(),
+			config.binary ? "binary" : "ascii", config.connections,
+			config.threads, config.depth,
+			config.rate > 0 ?
+					StringUtils::Format("open loop at %.0f req/s",
+							config.rate).c_str() :
+					"closed loop");
+	printHuman("total", all, secs);
+	printHuman("get", total[OP_GET], secs);
+	printHuman("set", total[OP_SET], secs);
+	return 0;
+}
@@ -0,0 +1,131 @@
+//============================================================================
+// Name        : LruTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Segmented LRU of the storage engine: new items go hot, then
+//               cold, items fetched again move to warm through the bump
+//               buffers, and eviction takes the untouched ones first
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/storage/StorageServer.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "LruTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* items set first, the first FETCHED of them are fetched twice */
+#define LRU_TEST_ITEMS 1000
+#define LRU_TEST_FETCHED 100
+
+static int fd, statFd;
+
+static string key(int i) {
+	return "key" + to_string(i);
+}
+
+static void set(int i) {
+	TEST_CHECK(test_bin_call(fd, test_bin_set(key(i), string(1000, 'v')))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+}
+
+static bool get(int i) {
+	uint16_t status = test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_GET, key(i)));
+
+	TEST_CHECK(status == PROTOCOL_BINARY_RESPONSE_SUCCESS
+			|| status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+	return status == PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+/* items of all slab classes in a segment, e.g. ":number_hot" */
+static long items(const string &name) {
+	return test_stat(statFd, name, "items");
+}
+
+/* waits for the maintainer to bring hot down to its 20% */
+static void settle() {
+	uint64_t start = test_now_ms();
+
+	while (items(":number_hot") * 5 > items(":number")) {
+		TEST_CHECK(test_now_ms() - start < 5000);
+		usleep(5 * 1000);
+	}
+}
+
+int main() {
+	StorageServer server(NULL);
+	const char *options[] = { "-m", "4", "-o", "slab_automove=0", NULL };
+	int port = test_free_port();
+	pid_t pid;
+	uint64_t start;
+	int i;
+
+	pid = test_start_server(&server, port, options);
+	fd = test_connect(port);
+	statFd = test_connect(port);
+	TEST_CHECK(fd >= 0 && statFd >= 0);
+
+	/* new items start hot, and the untouched go cold, none warm */
+	for (i = 0; i < LRU_TEST_ITEMS; i++)
+		set(i);
+	settle();
+	TEST_CHECK(items(":number") == LRU_TEST_ITEMS);
+	TEST_CHECK(items(":number_warm") == 0);
+	TEST_CHECK(items(":number_cold") >= LRU_TEST_ITEMS * 4 / 5);
+	TEST_CHECK(items(":moves_to_cold") >= LRU_TEST_ITEMS * 4 / 5);
+
+	/*
+	 * Fetched twice, cold items are queued to move to warm. Fetched once,
+	 * as the next hundred are, they stay.
+	 */
+	for (i = 0; i < LRU_TEST_FETCHED; i++)
+		TEST_CHECK(get(i) && get(i));
+	for (i = LRU_TEST_FETCHED; i < 2 * LRU_TEST_FETCHED; i++)
+		TEST_CHECK(get(i));
+	start = test_now_ms();
+	while (items(":number_warm") < LRU_TEST_FETCHED) {
+		TEST_CHECK(test_now_ms() - start < 5000);
+		usleep(5 * 1000);
+	}
+	TEST_CHECK(items(":number_warm") == LRU_TEST_FETCHED);
+	TEST_CHECK(items(":moves_to_warm") == LRU_TEST_FETCHED);
+	TEST_CHECK(test_stat(statFd, "lru_bumps") == LRU_TEST_FETCHED);
+	TEST_CHECK(test_stat(statFd, "lru_bumps_dropped") == 0);
+
+	/* more than -m holds: the cold tail goes, warm stays */
+	for (i = LRU_TEST_ITEMS; i < 5 * LRU_TEST_ITEMS; i++) {
+		set(i);
+		if (i % 200 == 199)
+			settle();
+	}
+	TEST_CHECK(test_stat(statFd, "evictions") > 0);
+	TEST_CHECK(items(":evicted") == test_stat(statFd, "evictions"));
+	TEST_CHECK(items(":number_warm") == LRU_TEST_FETCHED);
+	for (i = 0; i < LRU_TEST_FETCHED; i++)
+		TEST_CHECK(get(i));
+	for (i = LRU_TEST_FETCHED; i < LRU_TEST_ITEMS; i++)
+		TEST_CHECK(!get(i));
+	TEST_CHECK(get(5 * LRU_TEST_ITEMS - 1));
+
+	close(fd);
+	close(statFd);
+	test_stop_server(pid);
+	MY_LOGD("LruTest passed");
+	return 0;
+}
@@ -0,0 +1,436 @@
+//============================================================================
+// Name        : MicroBench.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Microbenchmarks of the core primitives
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <vutils/Logger.h>
+#include <vutils/RefBase.h>
+#include <vutils/StringUtils.h>
+#include <threads/Looper.h>
+#include <network/core/conn_base.h>
+#include <network/core/conn_queue.h>
+#include <network/core/conn_thread.h>
+#include <network/core/conn_wrap.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "MicroBench"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+using namespace std;
+using namespace vmodule;
+
+/*
+ * Every benchmark runs a fixed number of operations, REPEATS times, and
+ * reports the median and best time per operation. Results are written as
+ * tab separated "name iterations ns_per_op ns_per_op_min" lines, one per
+ * benchmark in a fixed order, so two runs can be diffed directly. The log
+ * goes to stdout in debug builds, so stdout is pointed at /dev/null while
+ * benchmarks run and results go to the original stdout or -o.
+ */
+
+#define REPEATS 5
+#define CONTENDERS 4
+#define BATCH 64
+
+static uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* keeps the compiler from dropping a result */
+static volatile uint64_t sink;
+
+/******************************* conn_queue ******************************/
+
+static void benchCqPushPop(uint64_t iters) {
+	CQ cq;
+	cq_init(&cq);
+	for (uint64_t i = 0; i < iters; i++) {
+		CQ_ITEM *item = cqi_new();
+		cq_push(&cq, item);
+		cqi_free(cq_pop(&cq));
+	}
+}
+
+struct CqContention {
+	CQ cq;
+	uint64_t perThread;
+};
+
+static void *cqProducer(void *arg) {
+	CqContention *q = (CqContention *) arg;
+	for (uint64_t i = 0; i < q->perThread; i++) {
+		CQ_ITEM *item;
+		while ((item = cqi_new()) == NULL)
+			;
+		cq_push(&q->cq, item);
+	}
+	return NULL;
+}
+
+/* CONTENDERS dispatchers feeding one worker, like accept threads would */
+static void benchCqContended(uint64_t iters) {
+	CqContention q;
+	pthread_t tids[CONTENDERS];
+	uint64_t popped = 0, total;
+
+	cq_init(&q.cq);
+	q.perThread = iters / CONTENDERS;
+	total = q.perThread * CONTENDERS;
+	for (int i = 0; i < CONTENDERS; i++)
+		pthread_create(&tids[i], NULL, cqProducer, &q);
+	while (popped < total) {
+		CQ_ITEM *item = cq_pop(&q.cq);
+		if (item != NULL) {
+			cqi_free(item);
+			popped++;
+		}
+	}
+	for (int i = 0; i < CONTENDERS; i++)
+		pthread_join(tids[i], NULL);
+}
+
+static void benchCqiNewFree(uint64_t iters) {
+	for (uint64_t i = 0; i < iters; i++)
+		cqi_free(cqi_new());
+}
+
+static void *cqiWorker(void *arg) {
+	uint64_t iters = *(uint64_t *) arg;
+	CQ_ITEM *items[BATCH];
+	for (uint64_t i = 0; i < iters; i += BATCH) {
+		for (int k = 0; k < BATCH; k++)
+			items[k] = cqi_new();
+		for (int k = 0; k < BATCH; k++)
+			cqi_free(items[k]);
+	}
+	return NULL;
+}
+
+static void benchCqiContended(uint64_t iters) {
+	pthread_t tids[CONTENDERS];
+	uint64_t perThread = iters / CONTENDERS;
+	for (int i = 0; i < CONTENDERS; i++)
+		pthread_create(&tids[i], NULL, cqiWorker, &perThread);
+	for (int i = 0; i < CONTENDERS; i++)
+		pthread_join(tids[i], NULL);
+}
+
+/******************************* conn i/o ******************************/
+
+class BenchCallback: public msg_callback_t {
+public:
+	virtual void onBinaryEventDispatch(conn *c) {
+		sink += c->cmd;
+	}
+	virtual void onAsciiEventDispatch(conn *c) {
+		sink += c->rcurr[0];
+	}
+};
+
+static BenchCallback benchCallback;
+static LIBEVENT_THREAD benchThread;
+
+/* A conn that is not registered with libevent, enough for the parser and
+ * the write path. */
+static conn *benchConn(int sfd, enum protocol prot, int rsize) {
+	conn *c = (conn *) calloc(1, sizeof(conn));
+	c->sfd = sfd;
+	c->state = conn_parse_cmd;
+	c->transport = tcp_transport;
+	c->protocol = prot;
+	c->rsize = rsize;
+	c->rbuf = (char *) malloc(rsize);
+	c->wsize = DATA_BUFFER_SIZE;
+	c->wbuf = (char *) malloc(c->wsize);
+	c->iovsize = IOV_LIST_INITIAL;
+	c->iov = (struct iovec *) malloc(sizeof(struct iovec) * c->iovsize);
+	c->msgsize = MSG_LIST_INITIAL;
+	c->msglist = (struct msghdr *) malloc(sizeof(struct msghdr) * c->msgsize);
+	c->lat_op = -1;
+	c->thread = &benchThread;
+	return c;
+}
+
+static void freeBenchConn(conn *c) {
+	free(c->rbuf);
+	free(c->wbuf);
+	free(c->iov);
+	free(c->msglist);
+	free(c);
+}
+
+/* four 64 byte iovecs per response, written to a socketpair and drained */
+static void benchTransmit(uint64_t iters) {
+	int sv[2];
+	char payload[64], drain[4096];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+	conn *c = benchConn(sv[0], ascii_prot, DATA_BUFFER_SIZE);
+	memset(payload, 'x', sizeof(payload));
+
+	for (uint64_t i = 0; i < iters; i++) {
+		c->msgcurr = 0;
+		c->msgused = 0;
+		c->iovused = 0;
+		add_msghdr(c);
+		for (int k = 0; k < 4; k++)
+			add_iov(c, payload, sizeof(payload));
+		while (transmit(c) == TRANSMIT_INCOMPLETE)
+			;
+		while (read(sv[1], drain, sizeof(drain)) > 0)
+			;
+	}
+	freeBenchConn(c);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static string asciiBatch() {
+	string buf;
+	for (int i = 0; i < BATCH; i++)
+		buf += StringUtils::Format("get key:%012d\r\n", i);
+	return buf;
+}
+
+static string binaryBatch() {
+	string buf;
+	for (int i = 0; i < BATCH; i++) {
+		string key = StringUtils::Format("key:%012d", i);
+		protocol_binary_request_header req;
+		memset(&req, 0, sizeof(req));
+		req.request.magic = PROTOCOL_BINARY_REQ;
+		req.request.opcode = PROTOCOL_BINARY_CMD_GET;
+		req.request.keylen = htons(key.size());
+		req.request.bodylen = htonl(key.size());
+		buf.append((const char *) req.bytes, sizeof(req.bytes));
+		buf.append(key);
+	}
+	return buf;
+}
+
+/* iters commands, parsed BATCH at a time from one read buffer */
+static void benchTryRead(uint64_t iters, enum protocol prot,
+		const string &batch) {
+	conn *c = benchConn(-1, prot, batch.size() + 8);
+	for (uint64_t i = 0; i < iters; i += BATCH) {
+		memcpy(c->rbuf, batch.data(), batch.size());
+		c->rcurr = c->rbuf;
+		c->rbytes = batch.size();
+		c->nframes = 0;
+		while (c->rbytes > 0 && try_read_command(c) > 0)
+			;
+	}
+	freeBenchConn(c);
+}
+
+static void benchTryReadAscii(uint64_t iters) {
+	static const string batch = asciiBatch();
+	benchTryRead(iters, ascii_prot, batch);
+}
+
+static void benchTryReadBinary(uint64_t iters) {
+	static const string batch = binaryBatch();
+	benchTryRead(iters, binary_prot, batch);
+}
+
+/******************************* threads ******************************/
+
+class PingLooper: public CLooper {
+public:
+	PingLooper() {
+		sem_init(&done, 0, 0);
+	}
+	virtual void handle(int what, void *data) {
+		sem_post(&done);
+	}
+	sem_t done;
+};
+
+static PingLooper *pingLooper;
+
+/* post to the looper thread and wait until it handled the message */
+static void benchLooperRoundTrip(uint64_t iters) {
+	for (uint64_t i = 0; i < iters; i++) {
+		pingLooper->post(1, NULL);
+		sem_wait(&pingLooper->done);
+	}
+}
+
+/******************************* vutils ******************************/
+
+static void benchLogEnabled(uint64_t iters) {
+	for (uint64_t i = 0; i < iters; i++)
+		Logger::Log(LOGDEBUG, LOG_TAG, "bench %llu", (unsigned long long) i);
+}
+
+/* an extra log level nobody enabled, filtered before formatting */
+static void benchLogDisabled(uint64_t iters) {
+	for (uint64_t i = 0; i < iters; i++)
+		Logger::Log(LOGDEBUG | (1 << LOGMASKBIT), LOG_TAG, "bench %llu",
+				(unsigned long long) i);
+}
+
+class BenchObject: virtual public RefBase {
+public:
+	int value;
+};
+
+static void benchSpCopy(uint64_t iters) {
+	sp<BenchObject> obj = new BenchObject();
+	for (uint64_t i = 0; i < iters; i++) {
+		sp<BenchObject> copy(obj);
+		sink += (uintptr_t) copy.get();
+	}
+}
+
+static void benchFormat(uint64_t iters) {
+	for (uint64_t i = 0; i < iters; i++) {
+		string s = StringUtils::Format("%s:%d:%llu", "key", (int) i,
+				(unsigned long long) i);
+		sink += s.size();
+	}
+}
+
+static void benchSplit(uint64_t iters) {
+	const string input("get key:1 key:2 key:3 key:4 key:5 key:6 key:7");
+	for (uint64_t i = 0; i < iters; i++) {
+		vector<string> tokens = StringUtils::Split(input, ' ');
+		sink += tokens.size();
+	}
+}
+
+/******************************* driver ******************************/
+
+struct Bench {
+	const char *name;
+	uint64_t iters;
+	void (*run)(uint64_t iters);
+};
+
+static const Bench benches[] = {
+	{ "cq_push_pop", 2000000, benchCqPushPop },
+	{ "cq_push_pop_contended", 2000000, benchCqContended },
+	{ "cqi_new_free", 5000000, benchCqiNewFree },
+	{ "cqi_new_free_contended", 2000000, benchCqiContended },
+	{ "transmit_socketpair_4x64", 200000, benchTransmit },
+	{ "try_read_command_ascii", 2000000, benchTryReadAscii },
+	{ "try_read_command_binary", 2000000, benchTryReadBinary },
+	{ "looper_post_roundtrip", 100000, benchLooperRoundTrip },
+	{ "logger_log_enabled", 200000, benchLogEnabled },
+	{ "logger_log_disabled", 10000000, benchLogDisabled },
+	{ "sp_copy", 10000000, benchSpCopy },
+	{ "stringutils_format", 1000000, benchFormat },
+	{ "stringutils_split", 500000, benchSplit },
+};
+
+static void usage(void) {
+	fprintf(stderr, "microbench [-f <substring>] [-s <scale>] [-o <file>]\n"
+			"-f <substring> only run benchmarks whose name contains it\n"
+			"-s <scale>     multiply iteration counts (default: 1.0)\n"
+			"-o <file>      write results to file instead of stdout\n"
+			"-l             list benchmarks\n");
+}
+
+int main(int argc, char **argv) {
+	const char *filter = NULL;
+	const char *path = NULL;
+	double scale = 1.0;
+	int c;
+
+	while (-1 != (c = getopt(argc, argv, "f:s:o:lh"))) {
+		switch (c) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 's':
+			scale = atof(optarg);
+			break;
+		case 'o':
+			path = optarg;
+			break;
+		case 'l':
+			for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+				printf("%s\n", benches[i].name);
+			return 0;
+		default:
+			usage();
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (scale <= 0) {
+		usage();
+		return 1;
+	}
+
+	FILE *out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+	if (out == NULL) {
+		perror(path);
+		return 1;
+	}
+	int devnull = open("/dev/null", O_WRONLY);
+	fflush(stdout);
+	dup2(devnull, STDOUT_FILENO);
+	close(devnull);
+
+	/* what start_server() would have set up */
+	cq_freelist_init();
+	framing_init(FRAME_SIZE_MAX_DEFAULT);
+	m_callback = &benchCallback;
+	pthread_mutex_init(&benchThread.stats.mutex, NULL);
+	pingLooper = new PingLooper();
+
+	fprintf(out, "#name\titerations\tns_per_op\tns_per_op_min\n");
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		const Bench &b = benches[i];
+		if (filter && strstr(b.name, filter) == NULL)
+			continue;
+
+		uint64_t iters = (uint64_t) (b.iters * scale);
+		if (iters < BATCH * CONTENDERS)
+			iters = BATCH * CONTENDERS;
+		/* divisible for the batched and contended ones */
+		iters -= iters % (BATCH * CONTENDERS);
+
+		b.run(iters / 10 + BATCH * CONTENDERS);
+		vector<double> samples;
+		for (int r = 0; r < REPEATS; r++) {
+			uint64_t start = nowNs();
+			b.run(iters);
+			samples.push_back((double) (nowNs() - start) / iters);
+		}
+		sort(samples.begin(), samples.end());
+		fprintf(out, "%s\t%llu\t%.2f\t%.2f\n", b.name,
+				(unsigned long long) iters, samples[REPEATS / 2], samples[0]);
+		fflush(out);
+	}
+
+	pingLooper->quit();
+	fclose(out);
+	return 0;
+}
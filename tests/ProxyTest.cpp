@@ -0,0 +1,126 @@
+//============================================================================
+// Name        : ProxyTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Loopback test of conn_proxy: binary clients spliced to a
+//               backend, one of whose keys never answers
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/core/conn_base.h>
+#include <network/core/conn_proxy.h>
+#include <network/core/conn_wrap.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "ProxyTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define PROXY_TEST_TIMEOUT_MS 200
+
+static int backendPort;
+
+/* hands every binary client to the backend with its first request */
+class ProxyServer: public msg_callback {
+protected:
+	virtual void onBinaryEventDispatch(conn *c) {
+		struct sockaddr_in addr;
+		size_t len = sizeof(protocol_binary_request_header)
+				+ c->binary_header.request.bodylen;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(backendPort);
+		if (conn_proxy_start(c, (struct sockaddr *) &addr, sizeof(addr),
+				c->rcurr, len) != 0)
+			conn_set_state(c, conn_closing);
+	}
+	virtual void onAsciiEventDispatch(conn *c) {
+		out_string(c, "ERROR");
+	}
+};
+
+static bool get(int fd, const string &key) {
+	protocol_binary_response_header rsp;
+	string body;
+
+	TEST_CHECK(test_send(fd, test_bin_request(PROTOCOL_BINARY_CMD_GET, key)));
+	if (!test_bin_response(fd, &rsp, &body))
+		return false;
+	TEST_CHECK(rsp.response.status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(body.substr(rsp.response.extlen) == "v:" + key);
+	return true;
+}
+
+/* a counter of the ascii "stats" */
+static long stat(int port, const string &name) {
+	int fd = test_connect(port);
+	string out;
+	char buf[4096];
+	size_t pos;
+
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_send(fd, "stats\r\n"));
+	while (out.find("END\r\n") == string::npos) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		out.append(buf, n);
+	}
+	close(fd);
+	pos = out.find("STAT " + name + " ");
+	TEST_CHECK(pos != string::npos);
+	return atol(out.c_str() + pos + name.size() + 6);
+}
+
+int main() {
+	ProxyServer server;
+	int port = test_free_port();
+	const char *options[] = { "-o", "proxy_timeout=200", NULL };
+	uint64_t start;
+	pid_t pid;
+	int fd;
+
+	backendPort = test_start_backend();
+	pid = test_start_server(&server, port, options);
+
+	/* the first request starts the proxy, the next ones are spliced */
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(get(fd, "a"));
+	TEST_CHECK(get(fd, "b"));
+
+	/* the client of a hung backend is closed after the timeout */
+	int hung = test_connect(port);
+	TEST_CHECK(hung >= 0);
+	start = test_now_ms();
+	TEST_CHECK(!get(hung, "hang"));
+	/* libevent's timers run on a coarse clock, a few ms either way */
+	TEST_CHECK(test_now_ms() - start >= PROXY_TEST_TIMEOUT_MS - 20);
+	TEST_CHECK(test_now_ms() - start < 4 * PROXY_TEST_TIMEOUT_MS);
+	close(hung);
+
+	/* an answering backend, idle for longer, is left alone */
+	usleep(2 * PROXY_TEST_TIMEOUT_MS * 1000);
+	TEST_CHECK(get(fd, "c"));
+	close(fd);
+	TEST_CHECK(stat(port, "proxy_timeouts") == 1);
+
+	test_stop_server(pid);
+	MY_LOGD("ProxyTest passed");
+	return 0;
+}
@@ -0,0 +1,280 @@
+//============================================================================
+// Name        : RangeTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Binary range opcodes of the storage engine with -o
+//               range_index: RGET bounds, prefixes and max_results, an RGET
+//               streamed in parts, and RSET, RDELETE, RINCR and RDECR
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <network/core/conn_utils.h>
+#include <network/storage/StorageServer.h>
+#include <network/storage/range.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "RangeTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* values of the "big" keys, over what one part of an RGET queues */
+#define RANGE_TEST_BIG_ITEMS 600
+#define RANGE_TEST_BIG_VALUE 1000
+
+static int fd;
+
+/* the key of i, e.g. "k007" */
+static string key(const char *prefix, int i) {
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%s%03d", prefix, i);
+	return buf;
+}
+
+static string value(const string &key, size_t size) {
+	string v = key + "=";
+	v.resize(size, (char) ('a' + key.size() % 26));
+	return v;
+}
+
+static void set(const string &key, const string &value) {
+	TEST_CHECK(test_bin_call(fd, test_bin_set(key, value))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+}
+
+/* false on a miss */
+static bool get(const string &key, string *value) {
+	string body;
+	uint16_t status = test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_GET, key), &body);
+
+	if (status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT)
+		return false;
+	TEST_CHECK(status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	*value = body.substr(4);
+	return true;
+}
+
+/*
+ * A range request from start to end, flags RANGE_*, max_results max, and
+ * the RSET value or RINCR/RDECR delta in tail.
+ */
+static string range(uint8_t opcode, const string &start, const string &end,
+		uint8_t flags = 0, uint32_t max = 0, const string &tail = "") {
+	char extras[8];
+	uint16_t nend = htons(end.size());
+
+	max = htonl(max);
+	memcpy(extras, &nend, 2);
+	extras[2] = 0;
+	extras[3] = flags;
+	memcpy(extras + 4, &max, 4);
+	return test_bin_request(opcode, start, end + tail,
+			string(extras, sizeof(extras)));
+}
+
+static string delta(uint64_t delta) {
+	delta = htonll(delta);
+	return string((const char *) &delta, sizeof(delta));
+}
+
+/*
+ * Sends an RGET and reads its results, in keys and values, up to the
+ * closing response. Returns the key to continue after, "" if the range
+ * was sent whole.
+ */
+static string rget(const string &req, vector<string> *keys,
+		vector<string> *values = NULL) {
+	protocol_binary_response_header rsp;
+	string body;
+
+	keys->clear();
+	if (values != NULL)
+		values->clear();
+	TEST_CHECK(test_send(fd, req));
+	for (;;) {
+		TEST_CHECK(test_bin_response(fd, &rsp, &body));
+		TEST_CHECK(rsp.response.opcode == PROTOCOL_BINARY_CMD_RGET);
+		TEST_CHECK(rsp.response.status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+		if (rsp.response.extlen == 0)
+			return body;
+		TEST_CHECK(rsp.response.extlen == 4 && rsp.response.keylen > 0);
+		keys->push_back(body.substr(4, rsp.response.keylen));
+		if (values != NULL)
+			values->push_back(body.substr(4 + rsp.response.keylen));
+	}
+}
+
+/* sends an update, returns how many keys it changed and the key in *next */
+static uint64_t update(const string &req, string *next = NULL) {
+	protocol_binary_response_header rsp;
+	string body;
+	uint64_t n;
+
+	TEST_CHECK(test_bin_call(fd, req, &body, &rsp)
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.extlen == 0);
+	TEST_CHECK(body.size() == rsp.response.keylen + sizeof(n));
+	if (next != NULL)
+		*next = body.substr(0, rsp.response.keylen);
+	memcpy(&n, body.data() + rsp.response.keylen, sizeof(n));
+	return ntohll(n);
+}
+
+/* keys from prefix first to last, first included, last not */
+static vector<string> keys(const char *prefix, int first, int last) {
+	vector<string> out;
+
+	for (int i = first; i < last; i++)
+		out.push_back(key(prefix, i));
+	return out;
+}
+
+static void testGet() {
+	vector<string> got, values;
+	string next;
+
+	/* start included, end not, unless the flags say otherwise */
+	TEST_CHECK(rget(range(PROTOCOL_BINARY_CMD_RGET, "k000", "k100"), &got,
+			&values) == "");
+	TEST_CHECK(got == keys("k", 0, 100));
+	for (size_t i = 0; i < got.size(); i++)
+		TEST_CHECK(values[i] == value(got[i], 10));
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "k010", "k020",
+			RANGE_START_EXCLUSIVE | RANGE_END_INCLUSIVE), &got);
+	TEST_CHECK(got == keys("k", 11, 21));
+	/* bounds needn't be keys, an empty start is the first key */
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "", "big002"), &got);
+	TEST_CHECK(got == keys("big", 0, 2));
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "i", "k002"), &got);
+	TEST_CHECK(got.size() == 3 && got[0] == "j" && got[2] == "k001");
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "k19", "l"), &got);
+	TEST_CHECK(got == keys("k", 190, 200));
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "k05x", "k05y"), &got);
+	TEST_CHECK(got.empty());
+
+	/* keys starting with the start key, the end key left out */
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "k1", "", RANGE_PREFIX), &got);
+	TEST_CHECK(got == keys("k", 100, 200));
+
+	/* max_results cuts it short, and tells where to go on from */
+	next = rget(range(PROTOCOL_BINARY_CMD_RGET, "k", "", RANGE_PREFIX, 50),
+			&got);
+	TEST_CHECK(got == keys("k", 0, 50));
+	TEST_CHECK(next == "k049");
+	next = rget(range(PROTOCOL_BINARY_CMD_RGET, next, "l",
+			RANGE_START_EXCLUSIVE, 150), &got);
+	TEST_CHECK(got == keys("k", 50, 200));
+	TEST_CHECK(next == "");
+}
+
+/* more than a part's worth, written out a part at a time */
+static void testGetStreamed() {
+	vector<string> got, values;
+	string v;
+
+	TEST_CHECK(rget(range(PROTOCOL_BINARY_CMD_RGET, "big", "",
+			RANGE_PREFIX), &got, &values) == "");
+	TEST_CHECK(got == keys("big", 0, RANGE_TEST_BIG_ITEMS));
+	for (size_t i = 0; i < got.size(); i++)
+		TEST_CHECK(values[i] == value(got[i], RANGE_TEST_BIG_VALUE));
+
+	/* the conn goes on with the next request once it is done */
+	TEST_CHECK(get("k000", &v) && v == value("k000", 10));
+
+	/* and a limit stops it in the middle of a part */
+	TEST_CHECK(rget(range(PROTOCOL_BINARY_CMD_RGET, "big", "", RANGE_PREFIX,
+			RANGE_TEST_BIG_ITEMS - 1), &got)
+			== key("big", RANGE_TEST_BIG_ITEMS - 2));
+	TEST_CHECK(got.size() == RANGE_TEST_BIG_ITEMS - 1);
+}
+
+static void testUpdate() {
+	protocol_binary_response_header rsp;
+	vector<string> got;
+	string next, v;
+
+	/* RSET replaces the values in range, and only those */
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RSET, "k000", "k010", 0, 0,
+			"new")) == 10);
+	TEST_CHECK(get("k009", &v) && v == "new");
+	TEST_CHECK(get("k010", &v) && v == value("k010", 10));
+
+	/* RINCR and RDECR skip what isn't a number */
+	for (int i = 0; i < 10; i++)
+		set(key("c", i), "5");
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RINCR, "c", "", RANGE_PREFIX,
+			0, delta(3))) == 10);
+	TEST_CHECK(get("c004", &v) && v == "8");
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RDECR, "c", "", RANGE_PREFIX,
+			0, delta(10))) == 10);
+	TEST_CHECK(get("c004", &v) && v == "0");
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RINCR, "k000", "k020", 0, 0,
+			delta(1))) == 0);
+
+	/* RDELETE up to max, then on from the key it stopped at */
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RDELETE, "k0", "",
+			RANGE_PREFIX, 5), &next) == 5);
+	TEST_CHECK(next == "k004");
+	TEST_CHECK(!get("k004", &v) && get("k005", &v));
+	TEST_CHECK(update(range(PROTOCOL_BINARY_CMD_RDELETE, next, "k1",
+			RANGE_START_EXCLUSIVE), &next) == 95);
+	TEST_CHECK(next == "");
+	rget(range(PROTOCOL_BINARY_CMD_RGET, "k", "", RANGE_PREFIX), &got);
+	TEST_CHECK(got == keys("k", 100, 200));
+
+	/* quiet ones answer nothing, the NOOP comes first */
+	TEST_CHECK(test_bin_call(fd, range(PROTOCOL_BINARY_CMD_RDELETEQ, "c", "",
+			RANGE_PREFIX) + test_bin_request(PROTOCOL_BINARY_CMD_NOOP, ""),
+			NULL, &rsp) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.opcode == PROTOCOL_BINARY_CMD_NOOP);
+	TEST_CHECK(!get("c000", &v));
+
+	/* an end key longer than a key can be */
+	TEST_CHECK(test_bin_call(fd, range(PROTOCOL_BINARY_CMD_RGET, "k",
+			string(KEY_MAX_LENGTH + 1, 'z')))
+			== PROTOCOL_BINARY_RESPONSE_EINVAL);
+}
+
+int main() {
+	StorageServer server(NULL);
+	const char *options[] = { "-o", "range_index", NULL };
+	int port = test_free_port();
+	pid_t pid;
+
+	pid = test_start_server(&server, port, options);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+
+	/* "k000".."k199" between "j" and "l", and the "big" values */
+	set("j", "before");
+	set("l", "after");
+	for (int i = 0; i < 200; i++)
+		set(key("k", i), value(key("k", i), 10));
+	for (int i = 0; i < RANGE_TEST_BIG_ITEMS; i++)
+		set(key("big", i), value(key("big", i), RANGE_TEST_BIG_VALUE));
+
+	testGet();
+	testGetStreamed();
+	testUpdate();
+
+	close(fd);
+	test_stop_server(pid);
+	MY_LOGD("RangeTest passed");
+	return 0;
+}
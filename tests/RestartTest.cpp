@@ -0,0 +1,175 @@
+//============================================================================
+// Name        : RestartTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Warm restart from -o memory_file: items come back with
+//               their flags, cas and expiry, the expired ones don't, and
+//               compressed ones are counted again
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/core/conn_utils.h>
+#include <network/storage/StorageServer.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "RestartTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+static int port;
+static const char *options[] = { "-m", "8", "-o", NULL, NULL };
+
+static pid_t start() {
+	static StorageServer server(NULL);
+
+	port = test_free_port();
+	return test_start_server(&server, port, options);
+}
+
+/* a SET of key with flags and exptime, its cas in *cas */
+static void set(const string &key, const string &value, uint32_t flags,
+		uint32_t exptime, uint64_t *cas = NULL) {
+	protocol_binary_response_header rsp;
+	char extras[8];
+	int fd = test_connect(port);
+
+	flags = htonl(flags);
+	exptime = htonl(exptime);
+	memcpy(extras, &flags, 4);
+	memcpy(extras + 4, &exptime, 4);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_SET, key,
+			value, string(extras, sizeof(extras))), NULL, &rsp)
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	if (cas != NULL)
+		*cas = rsp.response.cas;
+	close(fd);
+}
+
+/* false on a miss, else the value, flags and cas of key */
+static bool get(const string &key, string *value, uint32_t *flags = NULL,
+		uint64_t *cas = NULL) {
+	protocol_binary_response_header rsp;
+	string body;
+	uint16_t status;
+	int fd = test_connect(port);
+
+	TEST_CHECK(fd >= 0);
+	status = test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_GET, key),
+			&body, &rsp);
+	close(fd);
+	if (status == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT)
+		return false;
+	TEST_CHECK(status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.extlen == 4);
+	if (flags != NULL) {
+		memcpy(flags, body.data(), 4);
+		*flags = ntohl(*flags);
+	}
+	if (cas != NULL)
+		*cas = rsp.response.cas;
+	*value = body.substr(4);
+	return true;
+}
+
+static void del(const string &key) {
+	int fd = test_connect(port);
+
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_DELETE,
+			key)) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	close(fd);
+}
+
+static long stat(const string &name, const string &sub = "") {
+	int fd = test_connect(port);
+	long value;
+
+	TEST_CHECK(fd >= 0);
+	value = test_stat(fd, name, sub);
+	close(fd);
+	return value;
+}
+
+int main() {
+	char path[64], memoryFile[96];
+	string value, packed(800, 'p');
+	uint32_t flags;
+	uint64_t cas, keptCas, newCas, setMs;
+	pid_t pid;
+
+	snprintf(path, sizeof(path), "/tmp/restarttest.%d.mem", (int) getpid());
+	snprintf(memoryFile, sizeof(memoryFile),
+			"memory_file=%s,compress_min=512", path);
+	options[3] = memoryFile;
+	unlink(path);
+
+	/* a new file starts empty */
+	pid = start();
+	TEST_CHECK(stat("restored_items") == 0);
+	set("kept", "a value", 0xdeadbeef, 0, &keptCas);
+	set("later", "expires after the restart", 0, 5);
+	set("soon", "expires before it", 0, 1);
+	set("packed", packed, 0, 0);
+	TEST_CHECK(stat(":compressed_items", "slabs") == 1);
+	setMs = test_now_ms();
+	usleep(2200 * 1000);
+	test_stop_server(pid);
+
+	/* a clean stop: all but the expired item come back as they were */
+	pid = start();
+	TEST_CHECK(stat("restored_items") == 3);
+	TEST_CHECK(stat("curr_items") == 3);
+	TEST_CHECK(get("kept", &value, &flags, &cas));
+	TEST_CHECK(value == "a value");
+	TEST_CHECK(flags == 0xdeadbeef);
+	TEST_CHECK(cas == keptCas);
+	TEST_CHECK(get("later", &value));
+	TEST_CHECK(value == "expires after the restart");
+	TEST_CHECK(!get("soon", &value));
+
+	/* compressed, in the stats of the new run, and out of them once gone */
+	TEST_CHECK(stat(":compressed_items", "slabs") == 1);
+	TEST_CHECK(stat(":compressed_raw_bytes", "slabs") == (long) packed.size());
+	TEST_CHECK(get("packed", &value));
+	TEST_CHECK(value == packed);
+	del("packed");
+	TEST_CHECK(stat(":compressed_items", "slabs") == 0);
+	TEST_CHECK(stat(":compressed_bytes", "slabs") == 0);
+
+	/* cas goes on from where it was */
+	set("new", "v", 0, 0, &newCas);
+	TEST_CHECK(ntohll(newCas) > ntohll(keptCas));
+
+	/* the expiry kept its place in real time, the downtime counted */
+	while (test_now_ms() - setMs < 6200)
+		usleep(100 * 1000);
+	TEST_CHECK(!get("later", &value));
+	TEST_CHECK(get("kept", &value));
+
+	/* killed, the file isn't clean and starts empty */
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	pid = start();
+	TEST_CHECK(stat("restored_items") == 0);
+	TEST_CHECK(!get("kept", &value));
+	test_stop_server(pid);
+
+	unlink(path);
+	MY_LOGD("RestartTest passed");
+	return 0;
+}
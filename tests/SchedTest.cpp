@@ -0,0 +1,176 @@
+//============================================================================
+// Name        : SchedTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Deficit round robin of -Q and -W: two pipelining conns of
+//               one worker share it by their weights, and a conn that went
+//               idle doesn't come back with credit saved up
+//============================================================================
+
+#include <iostream>
+#include <vector>
+#include <vutils/Logger.h>
+#include <network/core/conn_utils.h>
+#include <network/storage/StorageServer.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "SchedTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* requests pipelined by the light and the heavy conn */
+#define SCHED_TEST_LIGHT_REQS 600
+#define SCHED_TEST_HEAVY_REQS 400
+#define SCHED_TEST_HEAVY_WEIGHT 4
+
+/* a conn to port from the loopback address src, a client class of -W */
+static int connect_from(int port, const char *src) {
+	struct sockaddr_in addr;
+	struct timeval tv = { 5, 0 };
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	TEST_CHECK(fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	TEST_CHECK(inet_pton(AF_INET, src, &addr.sin_addr) == 1);
+	TEST_CHECK(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	TEST_CHECK(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	return fd;
+}
+
+/* adds one to the counter all requests share */
+static string incr() {
+	char extras[20];
+	uint64_t delta = htonll(1);
+
+	memset(extras, 0, sizeof(extras));
+	memcpy(extras, &delta, sizeof(delta));
+	return test_bin_request(PROTOCOL_BINARY_CMD_INCREMENT, "counter", "",
+			string(extras, sizeof(extras)));
+}
+
+/*
+ * Reads n INCR responses. The counter they carry tells when, among the
+ * requests of both conns, each was served.
+ */
+static vector<uint64_t> served(int fd, int n) {
+	protocol_binary_response_header rsp;
+	vector<uint64_t> out;
+	string body;
+	uint64_t v;
+
+	for (int i = 0; i < n; i++) {
+		TEST_CHECK(test_bin_response(fd, &rsp, &body));
+		TEST_CHECK(rsp.response.status == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+		TEST_CHECK(body.size() == sizeof(v));
+		memcpy(&v, body.data(), sizeof(v));
+		out.push_back(ntohll(v));
+	}
+	return out;
+}
+
+/* "stats conns" field of the conn from the client at local port of fd */
+static long connStat(int statFd, int fd, const string &field) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	char peer[64];
+	string out;
+	size_t pos;
+
+	TEST_CHECK(getsockname(fd, (struct sockaddr *) &addr, &len) == 0);
+	snprintf(peer, sizeof(peer), ":addr tcp:%s:%d\r\n",
+			inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+	TEST_CHECK(test_send(statFd, "stats conns\r\n"));
+	out = test_read_until(statFd, "END\r\n");
+	pos = out.find(peer);
+	TEST_CHECK(pos != string::npos);
+	/* back to the conn's "STAT <id>" */
+	pos = out.rfind("STAT ", pos) + 5;
+	string tag = "STAT " + out.substr(pos, out.find(':', pos) - pos) + ":"
+			+ field + " ";
+	pos = out.find(tag);
+	TEST_CHECK(pos != string::npos);
+	return atol(out.c_str() + pos + tag.size());
+}
+
+int main() {
+	StorageServer server(NULL);
+	const char *options[] = { "-t", "1", "-Q", "bytes:256", "-W",
+			"127.0.0.2/32:4", NULL };
+	int port = test_free_port();
+	vector<uint64_t> heavy;
+	string light_reqs, heavy_reqs;
+	int fd, light, statFd;
+	pid_t pid;
+
+	pid = test_start_server(&server, port, options);
+	fd = test_connect(port);
+	statFd = test_connect(port);
+	light = connect_from(port, "127.0.0.1");
+	TEST_CHECK(fd >= 0 && statFd >= 0);
+	TEST_CHECK(test_bin_call(fd, test_bin_set("counter", "0"))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	close(fd);
+
+	/*
+	 * One request at a time, each visit credits the heavy conn far more
+	 * than the request costs: what is left goes once it is idle again.
+	 */
+	fd = connect_from(port, "127.0.0.2");
+	for (int i = 0; i < 100; i++)
+		TEST_CHECK(test_bin_call(fd, incr())
+				== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(connStat(statFd, fd, "sched_weight")
+			== SCHED_TEST_HEAVY_WEIGHT);
+	TEST_CHECK(connStat(statFd, fd, "sched_deficit") == 0);
+	TEST_CHECK(connStat(statFd, light, "sched_weight") == 1);
+
+	/*
+	 * Both pipelines are queued while the server is stopped, so the worker
+	 * finds them together. While the heavy conn has requests left, the
+	 * light one gets a fifth of the turns; credit saved up above would
+	 * have let the heavy conn run to its end first.
+	 */
+	for (int i = 0; i < SCHED_TEST_LIGHT_REQS; i++)
+		light_reqs += incr();
+	for (int i = 0; i < SCHED_TEST_HEAVY_REQS; i++)
+		heavy_reqs += incr();
+	kill(pid, SIGSTOP);
+	TEST_CHECK(send(light, light_reqs.data(), light_reqs.size(), MSG_DONTWAIT)
+			== (ssize_t) light_reqs.size());
+	TEST_CHECK(send(fd, heavy_reqs.data(), heavy_reqs.size(), MSG_DONTWAIT)
+			== (ssize_t) heavy_reqs.size());
+	kill(pid, SIGCONT);
+	heavy = served(fd, SCHED_TEST_HEAVY_REQS);
+	served(light, SCHED_TEST_LIGHT_REQS);
+
+	uint64_t turns = heavy.back() - heavy.front() + 1;
+	uint64_t light_turns = turns - SCHED_TEST_HEAVY_REQS;
+	MY_LOGD("light conn served %llu of %llu turns",
+			(unsigned long long) light_turns, (unsigned long long) turns);
+	TEST_CHECK(light_turns * 100 >= turns * 12);
+	TEST_CHECK(light_turns * 100 <= turns * 30);
+
+	close(fd);
+	close(light);
+	close(statFd);
+	test_stop_server(pid);
+	MY_LOGD("SchedTest passed");
+	return 0;
+}
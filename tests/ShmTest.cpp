@@ -0,0 +1,126 @@
+//============================================================================
+// Name        : ShmTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Loopback test of the shared memory transport, including a
+//               client that leaves while its conn is parked
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/core/conn_base.h>
+#include <network/core/conn_shm.h>
+#include <network/core/conn_wrap.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "ShmTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define SHM_TEST_PARK_MS 300
+
+/* echoes lines upper cased; "slow" is answered from a side thread */
+class ParkServer: public msg_callback {
+protected:
+	virtual void onBinaryEventDispatch(conn *c) {
+	}
+	virtual void onAsciiEventDispatch(conn *c) {
+		if (strcmp(c->rcurr, "slow") == 0) {
+			pthread_t tid;
+			out_string(c, "SLOW");
+			conn_worker_park(c);
+			pthread_create(&tid, NULL, sideThread, c);
+			pthread_detach(tid);
+			return;
+		}
+		for (char *p = c->rcurr; *p; p++)
+			*p = toupper(*p);
+		out_string(c, c->rcurr);
+	}
+private:
+	/* like a flash read, it owns the parked conn until it hands it back */
+	static void *sideThread(void *arg) {
+		conn *c = (conn *) arg;
+		usleep(SHM_TEST_PARK_MS * 1000);
+		if (c->state != conn_watch || c->shm == NULL)
+			abort();
+		conn_worker_resume(c);
+		return NULL;
+	}
+};
+
+/* reads until the reply ends with end */
+static string shmRead(conn_shm_client *cl, const string &end) {
+	string out;
+	char buf[4096];
+
+	while (out.size() < end.size()
+			|| out.compare(out.size() - end.size(), end.size(), end) != 0) {
+		ssize_t n = conn_shm_client_read(cl, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		out.append(buf, n);
+	}
+	return out;
+}
+
+static long stat(conn_shm_client *cl, const string &name) {
+	string out;
+	size_t pos;
+
+	TEST_CHECK(conn_shm_client_write(cl, "stats\r\n", 7) == 7);
+	out = shmRead(cl, "END\r\n");
+	pos = out.find("STAT " + name + " ");
+	TEST_CHECK(pos != string::npos);
+	return atol(out.c_str() + pos + name.size() + 6);
+}
+
+int main() {
+	ParkServer server;
+	char path[64];
+	const char *options[] = { "-s", path, "-o", "shm_size=65536", NULL };
+	conn_shm_client *cl, *gone;
+	long conns;
+	pid_t pid;
+
+	snprintf(path, sizeof(path), "/tmp/shmtest.%d.sock", (int) getpid());
+	pid = test_start_server(&server, test_free_port(), options);
+
+	cl = conn_shm_client_open(path);
+	TEST_CHECK(cl != NULL);
+	TEST_CHECK(conn_shm_client_write(cl, "hello\r\n", 7) == 7);
+	TEST_CHECK(shmRead(cl, "\r\n") == "HELLO\r\n");
+	TEST_CHECK(stat(cl, "shm_conns") == 1);
+
+	/* parked when its client leaves, closed only once handed back */
+	gone = conn_shm_client_open(path);
+	TEST_CHECK(gone != NULL);
+	TEST_CHECK(conn_shm_client_write(gone, "hello\r\n", 7) == 7);
+	TEST_CHECK(shmRead(gone, "\r\n") == "HELLO\r\n");
+	conns = stat(cl, "curr_connections");
+	TEST_CHECK(conn_shm_client_write(gone, "slow\r\n", 6) == 6);
+	usleep(SHM_TEST_PARK_MS * 1000 / 3);
+	conn_shm_client_close(gone);
+	usleep(2 * SHM_TEST_PARK_MS * 1000);
+	TEST_CHECK(stat(cl, "curr_connections") == conns - 1);
+	TEST_CHECK(conn_shm_client_write(cl, "again\r\n", 7) == 7);
+	TEST_CHECK(shmRead(cl, "\r\n") == "AGAIN\r\n");
+
+	conn_shm_client_close(cl);
+	test_stop_server(pid);
+	unlink(path);
+	MY_LOGD("ShmTest passed");
+	return 0;
+}
@@ -0,0 +1,269 @@
+//============================================================================
+// Name        : SkipListTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : ConcurrentSkipList order and seeks, and readers walking it
+//               while writers unlink: nothing retired while still seen
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <vutils/ConcurrentSkipList.h>
+#include <threads/Event.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "SkipListTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define SKIP_TEST_LIVE 0x11223344
+#define SKIP_TEST_DEAD 0xdeadbeef
+#define SKIP_TEST_KEYS 512
+#define SKIP_TEST_READERS 3
+#define SKIP_TEST_RUN_MS 1000
+
+/* the key of a node points into its value */
+struct Value {
+	uint32_t magic;
+	size_t nkey;
+	char key[16];
+	Value *dead_next;
+};
+
+/* retired values are poisoned, not freed, so a late reader sees it */
+static Value *graveyard;
+static pthread_mutex_t graveyardLock = PTHREAD_MUTEX_INITIALIZER;
+static int retired;
+
+static void retire(void *v) {
+	Value *value = (Value *) v;
+
+	value->magic = SKIP_TEST_DEAD;
+	pthread_mutex_lock(&graveyardLock);
+	value->dead_next = graveyard;
+	graveyard = value;
+	retired++;
+	pthread_mutex_unlock(&graveyardLock);
+}
+
+static int retiredCount() {
+	int n;
+
+	pthread_mutex_lock(&graveyardLock);
+	n = retired;
+	pthread_mutex_unlock(&graveyardLock);
+	return n;
+}
+
+static Value *newValue(const char *key) {
+	Value *v = (Value *) calloc(1, sizeof(Value));
+
+	TEST_CHECK(v != NULL);
+	v->magic = SKIP_TEST_LIVE;
+	v->nkey = strlen(key);
+	memcpy(v->key, key, v->nkey);
+	return v;
+}
+
+static bool insert(ConcurrentSkipList *list, Value *v) {
+	return list->insert(v->key, v->nkey, v);
+}
+
+static string nodeKey(ConcurrentSkipList::Node *n) {
+	return n ? string((const char *) n->key, n->nkey) : "(end)";
+}
+
+/* order, duplicates and seeks, on one thread */
+static void testOrder() {
+	ConcurrentSkipList list(retire);
+	const char *keys[] = { "b", "ab", "a", "abc", "c", "ba" };
+	const char *sorted[] = { "a", "ab", "abc", "b", "ba", "c" };
+	Value *values[6];
+	ConcurrentSkipList::Node *n;
+	ConcurrentSkipList::Stats stats;
+	int i;
+
+	TEST_CHECK(list.init() == NO_ERROR);
+	for (i = 0; i < 6; i++) {
+		values[i] = newValue(keys[i]);
+		TEST_CHECK(insert(&list, values[i]));
+	}
+	Value *dup = newValue("ab");
+	TEST_CHECK(!insert(&list, dup));
+	free(dup);
+
+	list.readBegin();
+	for (i = 0, n = list.seek("", 0, false); n != NULL; n = list.next(n), i++)
+		TEST_CHECK(nodeKey(n) == sorted[i]);
+	TEST_CHECK(i == 6);
+	TEST_CHECK(nodeKey(list.seek("ab", 2, false)) == "ab");
+	TEST_CHECK(nodeKey(list.seek("ab", 2, true)) == "abc");
+	TEST_CHECK(nodeKey(list.seek("abd", 3, false)) == "b");
+	TEST_CHECK(list.seek("c", 1, true) == NULL);
+	list.readEnd();
+
+	/* only with the value it maps to */
+	TEST_CHECK(!list.remove("b", 1, values[1]));
+	TEST_CHECK(list.remove("b", 1, values[0]));
+	TEST_CHECK(!list.remove("b", 1, values[0]));
+	list.readBegin();
+	TEST_CHECK(nodeKey(list.seek("abc", 3, true)) == "ba");
+	list.readEnd();
+	list.collect();
+	list.getStats(&stats);
+	TEST_CHECK(stats.nodes == 5);
+	TEST_CHECK(stats.retired == 0);
+	TEST_CHECK(stats.reclaimed == 1);
+}
+
+/* a reader standing on a node while it is unlinked */
+struct Standing {
+	ConcurrentSkipList *list;
+	CEvent *onNode;
+	CEvent *unlinked;
+	Value *seen;
+};
+
+static void *standingReader(void *arg) {
+	Standing *s = (Standing *) arg;
+	ConcurrentSkipList::Node *n;
+
+	s->list->readBegin();
+	n = s->list->seek("k", 1, false);
+	TEST_CHECK(nodeKey(n) == "k");
+	s->onNode->Set();
+	s->unlinked->Wait();
+	/* still there, and still leading on */
+	s->seen = (Value *) n->value;
+	TEST_CHECK(s->seen->magic == SKIP_TEST_LIVE);
+	TEST_CHECK(nodeKey(s->list->next(n)) == "l");
+	s->list->readEnd();
+	return NULL;
+}
+
+static void testStandingReader() {
+	ConcurrentSkipList list(retire);
+	CEvent onNode, unlinked;
+	Standing s = { &list, &onNode, &unlinked, NULL };
+	Value *k = newValue("k");
+	pthread_t tid;
+	int before;
+
+	TEST_CHECK(list.init() == NO_ERROR);
+	TEST_CHECK(insert(&list, k));
+	TEST_CHECK(insert(&list, newValue("l")));
+	TEST_CHECK(pthread_create(&tid, NULL, standingReader, &s) == 0);
+	onNode.Wait();
+
+	before = retiredCount();
+	TEST_CHECK(list.remove("k", 1, k));
+	list.collect();
+	TEST_CHECK(retiredCount() == before);
+	unlinked.Set();
+	pthread_join(tid, NULL);
+	TEST_CHECK(s.seen == k);
+
+	list.collect();
+	TEST_CHECK(retiredCount() == before + 1);
+	TEST_CHECK(k->magic == SKIP_TEST_DEAD);
+}
+
+/* readers scanning while the main thread churns the keys */
+static ConcurrentSkipList *shared;
+static bool running;
+
+static void *scanner(void *arg) {
+	uint64_t scans = 0;
+
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+		ConcurrentSkipList::Node *n, *prev = NULL;
+
+		shared->readBegin();
+		for (n = shared->seek("", 0, false); n != NULL; n = shared->next(n)) {
+			Value *v = (Value *) n->value;
+			TEST_CHECK(v->magic == SKIP_TEST_LIVE);
+			TEST_CHECK(n->key == v->key && n->nkey == v->nkey);
+			if (prev != NULL)
+				TEST_CHECK(ConcurrentSkipList::compare(prev->key, prev->nkey,
+						n->key, n->nkey) < 0);
+			prev = n;
+		}
+		shared->readEnd();
+		scans++;
+	}
+	return (void *) (long) scans;
+}
+
+static void testChurn() {
+	pthread_t tids[SKIP_TEST_READERS];
+	Value *slots[SKIP_TEST_KEYS] = { NULL };
+	ConcurrentSkipList::Stats stats;
+	uint32_t rnd = 1;
+	uint64_t start, ops = 0;
+	char key[16];
+	int live = 0;
+
+	shared = new ConcurrentSkipList(retire);
+	TEST_CHECK(shared->init() == NO_ERROR);
+	__atomic_store_n(&running, true, __ATOMIC_RELAXED);
+	for (int i = 0; i < SKIP_TEST_READERS; i++)
+		TEST_CHECK(pthread_create(&tids[i], NULL, scanner, NULL) == 0);
+
+	start = test_now_ms();
+	while (test_now_ms() - start < SKIP_TEST_RUN_MS) {
+		rnd = rnd * 1103515245 + 12345;
+		int i = (rnd >> 8) % SKIP_TEST_KEYS;
+		if (slots[i] == NULL) {
+			snprintf(key, sizeof(key), "key%05d", i);
+			slots[i] = newValue(key);
+			TEST_CHECK(insert(shared, slots[i]));
+			live++;
+		} else {
+			TEST_CHECK(shared->remove(slots[i]->key, slots[i]->nkey,
+					slots[i]));
+			slots[i] = NULL;
+			live--;
+		}
+		ops++;
+	}
+	__atomic_store_n(&running, false, __ATOMIC_RELAXED);
+	for (int i = 0; i < SKIP_TEST_READERS; i++) {
+		void *scans;
+		pthread_join(tids[i], &scans);
+		TEST_CHECK(scans != NULL);
+	}
+
+	shared->collect();
+	shared->getStats(&stats);
+	TEST_CHECK(stats.nodes == (uint64_t) live);
+	TEST_CHECK(stats.retired == 0);
+	TEST_CHECK(stats.reclaimed == (ops - live) / 2);
+	delete shared;
+}
+
+int main() {
+	testOrder();
+	testStandingReader();
+	testChurn();
+
+	while (graveyard != NULL) {
+		Value *next = graveyard->dead_next;
+		free(graveyard);
+		graveyard = next;
+	}
+	MY_LOGD("SkipListTest passed");
+	return 0;
+}
@@ -0,0 +1,302 @@
+//============================================================================
+// Name        : StorageTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Loopback test of the storage engine: binary stores, gets,
+//               deltas and deletes, a store larger than the frame cap,
+//               compressed values, and a get of a flash hit failing on a
+//               later key
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/SampleServer.h>
+#include <network/core/conn_base.h>
+#include <network/core/conn_utils.h>
+#include <network/storage/StorageServer.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "StorageTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+#define STORAGE_TEST_FRAME_MAX 1024
+#define STORAGE_TEST_SEGMENTS 16 /* FLASH_SEGMENTS */
+
+/*
+ * Behind the engine: "ref" is answered from a buffer of its own, kept with
+ * conn_add_item(), and "released" tells how many of those came back.
+ */
+class RefServer: public SampleServer {
+protected:
+	virtual void onAsciiEventDispatch(conn *c) {
+		char line[32];
+
+		if (strcmp(c->rcurr, "released") == 0) {
+			snprintf(line, sizeof(line), "RELEASED %d",
+					__atomic_load_n(&mReleased, __ATOMIC_RELAXED));
+			out_string(c, line);
+			return;
+		}
+		if (strcmp(c->rcurr, "ref") != 0) {
+			SampleServer::onAsciiEventDispatch(c);
+			return;
+		}
+		char *buf = strdup("REF\r\n");
+		c->msgcurr = 0;
+		c->msgused = 0;
+		c->iovused = 0;
+		if (buf == NULL || add_msghdr(c) != 0 || conn_add_item(c, buf) != 0) {
+			free(buf);
+			out_string(c, "SERVER_ERROR out of memory");
+			return;
+		}
+		if (add_iov(c, buf, strlen(buf)) != 0) {
+			out_string(c, "SERVER_ERROR out of memory");
+			return;
+		}
+		conn_set_state(c, conn_mwrite);
+	}
+	virtual void onItemRelease(conn *c, void *it) {
+		free(it);
+		__atomic_add_fetch(&mReleased, 1, __ATOMIC_RELAXED);
+	}
+private:
+	static int mReleased;
+};
+
+int RefServer::mReleased;
+
+/* the value of key, with the flags of its extras stripped */
+static string get(int fd, const string &key) {
+	protocol_binary_response_header rsp;
+	string body;
+
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_GET, key),
+			&body, &rsp) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.extlen == 4);
+	return body.substr(rsp.response.extlen);
+}
+
+/* an INCREMENT or DECREMENT by delta, creating the counter at initial */
+static string delta(uint8_t opcode, const string &key, uint64_t delta,
+		uint64_t initial) {
+	char extras[20];
+
+	delta = htonll(delta);
+	initial = htonll(initial);
+	memcpy(extras, &delta, 8);
+	memcpy(extras + 8, &initial, 8);
+	memset(extras + 16, 0, 4);
+	return test_bin_request(opcode, key, "", string(extras, sizeof(extras)));
+}
+
+static uint64_t counter(const string &body) {
+	uint64_t value;
+
+	TEST_CHECK(body.size() == sizeof(value));
+	memcpy(&value, body.data(), sizeof(value));
+	return ntohll(value);
+}
+
+/*
+ * A get whose later key fails after a flash hit was queued: the read goes
+ * with the error response, nothing is read into its freed items.
+ */
+static void testFlashGetError() {
+	StorageServer server(NULL);
+	int port = test_free_port();
+	char path[64], ext[128];
+	const char *options[] = { "-o", ext, NULL };
+	string value(2048, 'v'), reply;
+	uint64_t start;
+	long reads;
+	pid_t pid;
+	int fd;
+
+	snprintf(path, sizeof(path), "/tmp/storagetest.%d.ext", (int) getpid());
+	snprintf(ext, sizeof(ext), "ext_path=%s,ext_size=16,ext_item_age=0",
+			path);
+	pid = test_start_server(&server, port, options);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+
+	TEST_CHECK(test_bin_call(fd, test_bin_set("cold", value))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	close(fd);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	start = test_now_ms();
+	while (test_stat(fd, "ext_items") < 1) {
+		TEST_CHECK(test_now_ms() - start < 10000);
+		usleep(10000);
+	}
+	reads = test_stat(fd, "ext_reads");
+
+	TEST_CHECK(test_send(fd, "get cold " + string(KEY_MAX_LENGTH + 1, 'k')
+			+ "\r\n"));
+	TEST_CHECK(test_read_until(fd, "\r\n")
+			== "CLIENT_ERROR bad command line format\r\n");
+	TEST_CHECK(test_stat(fd, "ext_reads") == reads);
+
+	TEST_CHECK(test_send(fd, "get cold\r\n"));
+	reply = test_read_until(fd, "END\r\n");
+	TEST_CHECK(reply == "VALUE cold 0 2048\r\n" + value + "\r\nEND\r\n");
+	TEST_CHECK(test_stat(fd, "ext_reads") == reads + 1);
+
+	close(fd);
+	test_stop_server(pid);
+	for (int i = 0; i < STORAGE_TEST_SEGMENTS; i++) {
+		snprintf(ext, sizeof(ext), "%s.%d", path, i);
+		unlink(ext);
+	}
+}
+
+int main() {
+	RefServer next;
+	StorageServer server(&next);
+	int port = test_free_port();
+	char frameMax[16];
+	const char *options[] = { "-I", frameMax, "-m", "64", "-o",
+			"compress_min=512", NULL };
+	string packed(800, 'p');
+	protocol_binary_response_header rsp;
+	string body, reply;
+	pid_t pid;
+	int fd;
+
+	snprintf(frameMax, sizeof(frameMax), "%d", STORAGE_TEST_FRAME_MAX);
+	pid = test_start_server(&server, port, options);
+
+	/* the engine's options are its own, listed after the server's */
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_stat(fd, "max_frame_size", "settings")
+			== STORAGE_TEST_FRAME_MAX);
+	TEST_CHECK(test_stat(fd, "maxbytes", "settings") == 64 * 1024 * 1024);
+	TEST_CHECK(test_stat(fd, "compress_min", "settings") == 512);
+	TEST_CHECK(test_stat(fd, "hot_lru_pct", "settings") == 20);
+	close(fd);
+
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+
+	/* set, get, then the store commands that look at what is there */
+	TEST_CHECK(test_bin_call(fd, test_bin_set("a", "alpha"), NULL, &rsp)
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.cas != 0);
+	TEST_CHECK(get(fd, "a") == "alpha");
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_ADD, "a",
+			"other", string(8, '\0'))) == PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+	TEST_CHECK(test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_REPLACE, "b",
+			"other", string(8, '\0'))) == PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_GET, "b"))
+			== PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+
+	/* counters start at initial, then move by delta */
+	TEST_CHECK(test_bin_call(fd,
+			delta(PROTOCOL_BINARY_CMD_INCREMENT, "n", 5, 10),
+			&body) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(counter(body) == 10);
+	TEST_CHECK(test_bin_call(fd,
+			delta(PROTOCOL_BINARY_CMD_INCREMENT, "n", 5, 10),
+			&body) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(counter(body) == 15);
+	TEST_CHECK(test_bin_call(fd,
+			delta(PROTOCOL_BINARY_CMD_DECREMENT, "n", 20, 0),
+			&body) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(counter(body) == 0);
+	/* quiet, even when it creates the counter: the NOOP answers first */
+	TEST_CHECK(test_bin_call(fd,
+			delta(PROTOCOL_BINARY_CMD_INCREMENTQ, "q", 1, 7)
+			+ test_bin_request(PROTOCOL_BINARY_CMD_NOOP, ""), NULL, &rsp)
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(rsp.response.opcode == PROTOCOL_BINARY_CMD_NOOP);
+	TEST_CHECK(get(fd, "q") == "7");
+	TEST_CHECK(test_bin_call(fd,
+			delta(PROTOCOL_BINARY_CMD_INCREMENT, "a", 1, 0))
+			== PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL);
+
+	TEST_CHECK(test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_DELETE, "a"))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_DELETE, "a"))
+			== PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+
+	/* over -I the body is swallowed and the conn goes on */
+	TEST_CHECK(test_bin_call(fd, test_bin_set("big",
+			string(4 * STORAGE_TEST_FRAME_MAX, 'x')))
+			== PROTOCOL_BINARY_RESPONSE_E2BIG);
+	TEST_CHECK(test_bin_call(fd,
+			test_bin_request(PROTOCOL_BINARY_CMD_GET, "big"))
+			== PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+	TEST_CHECK(test_bin_call(fd, test_bin_set("small", "ok"))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(get(fd, "small") == "ok");
+	TEST_CHECK(test_bin_call(fd, test_bin_set("packed", packed))
+			== PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	TEST_CHECK(get(fd, "packed") == packed);
+
+	close(fd);
+
+	/* and an ascii conn sees the same items */
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_send(fd, "get small n\r\n"));
+	while (reply.find("END\r\n") == string::npos) {
+		char buf[256];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		reply.append(buf, n);
+	}
+	TEST_CHECK(reply.find("VALUE small 0 2\r\nok\r\n") != string::npos);
+	TEST_CHECK(reply.find("VALUE n 0 1\r\n0\r\n") != string::npos);
+
+	/* the next callback's references go back to it, not to the slabs */
+	reply.clear();
+	TEST_CHECK(test_send(fd, "ref\r\nref\r\nreleased\r\n"));
+	while (reply.find("RELEASED") == string::npos
+			|| reply.compare(reply.size() - 2, 2, "\r\n") != 0) {
+		char buf[256];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		reply.append(buf, n);
+	}
+	TEST_CHECK(reply == "REF\r\nREF\r\nRELEASED 2\r\n");
+
+	/* the classes count the compressed values they hold, not ever held */
+	TEST_CHECK(test_stat(fd, ":compressed_items", "slabs") == 1);
+	TEST_CHECK(test_stat(fd, ":compressed_raw_bytes", "slabs")
+			== (long) packed.size());
+	close(fd);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_bin_call(fd, test_bin_request(PROTOCOL_BINARY_CMD_DELETE,
+			"packed")) == PROTOCOL_BINARY_RESPONSE_SUCCESS);
+	close(fd);
+	fd = test_connect(port);
+	TEST_CHECK(fd >= 0);
+	TEST_CHECK(test_stat(fd, ":compressed_items", "slabs") == 0);
+
+	close(fd);
+	test_stop_server(pid);
+
+	testFlashGetError();
+	MY_LOGD("StorageTest passed");
+	return 0;
+}
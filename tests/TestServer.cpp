@@ -7,6 +7,7 @@
 #include <network/core/conn_queue.h>
 #include <network/core/conn_thread.h>
 #include <network/SampleServer.h>
+#include <network/storage/StorageServer.h>
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -34,5 +35,7 @@ int main(int argc, char **argv) {
 	MY_LOGD("environment = %s",environment);
 	putenv(environment);
 	SampleServer mSampleServer;
-	return start_server(argc, argv,&mSampleServer);
+	/* binary storage commands, everything else to the sample */
+	StorageServer mStorageServer(&mSampleServer);
+	return start_server(argc, argv,&mStorageServer);
 }
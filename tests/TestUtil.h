@@ -0,0 +1,325 @@
+//============================================================================
+// Name        : TestUtil.h
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Helpers of the loopback tests: a forked server, blocking
+//               sockets and binary protocol frames
+//============================================================================
+
+#pragma once
+
+#include <string>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <network/core/conn_base.h>
+#include <network/core/protocol_binary.h>
+
+#define TEST_CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#cond); \
+		exit(1); \
+	} \
+} while (0)
+
+static inline uint64_t test_now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* a listening socket on an unused loopback port, stored in *port */
+static inline int test_listen(int *port) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	TEST_CHECK(fd >= 0);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	TEST_CHECK(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	TEST_CHECK(listen(fd, 16) == 0);
+	TEST_CHECK(getsockname(fd, (struct sockaddr *) &addr, &len) == 0);
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+/* an unused loopback port, for the server to bind again */
+static inline int test_free_port() {
+	int port;
+	close(test_listen(&port));
+	return port;
+}
+
+/* a blocking connection to port, -1 if nothing listens; reads time out */
+static inline int test_connect(int port) {
+	struct sockaddr_in addr;
+	struct timeval tv = { 5, 0 };
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	TEST_CHECK(fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	return fd;
+}
+
+/* a blocking connection to the Unix socket at path, -1 if none listens */
+static inline int test_connect_unix(const char *path) {
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	TEST_CHECK(fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Runs start_server() with callback in a child on TCP port, plus the extra
+ * options, NULL terminated. Returns the child once the port accepts, or
+ * the Unix socket of a -s option, which replaces TCP.
+ */
+static inline pid_t test_start_server(msg_callback *callback, int port,
+		const char **extra) {
+	char portstr[16];
+	const char *argv[64] = { "testserver", "-p", portstr, "-U", "0", "-l",
+			"127.0.0.1", "-t", "2", "-B", "auto" };
+	int argc = 11;
+	const char *unixpath = NULL;
+	pid_t pid;
+
+	snprintf(portstr, sizeof(portstr), "%d", port);
+	for (; extra != NULL && *extra != NULL && argc < 63; extra++) {
+		if (strcmp(*extra, "-s") == 0)
+			unixpath = extra[1];
+		argv[argc++] = *extra;
+	}
+	argv[argc] = NULL;
+	pid = fork();
+	TEST_CHECK(pid >= 0);
+	if (pid == 0) {
+		/* a failed check of the test mustn't leave it running */
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		_exit(start_server(argc, (char **) argv, callback));
+	}
+	for (int i = 0; i < 500; i++) {
+		int fd = unixpath ? test_connect_unix(unixpath) : test_connect(port);
+		if (fd >= 0) {
+			close(fd);
+			return pid;
+		}
+		TEST_CHECK(waitpid(pid, NULL, WNOHANG) == 0);
+		usleep(10000);
+	}
+	TEST_CHECK(!"server didn't come up");
+	return -1;
+}
+
+/* SIGTERM, the server must exit cleanly */
+static inline void test_stop_server(pid_t pid) {
+	int status;
+
+	kill(pid, SIGTERM);
+	TEST_CHECK(waitpid(pid, &status, 0) == pid);
+	TEST_CHECK(WIFEXITED(status));
+}
+
+static inline bool test_send(int fd, const std::string &buf) {
+	size_t off = 0;
+
+	while (off < buf.size()) {
+		ssize_t n = write(fd, buf.data() + off, buf.size() - off);
+		if (n <= 0 && errno != EINTR)
+			return false;
+		if (n > 0)
+			off += n;
+	}
+	return true;
+}
+
+/* exactly len bytes, false on EOF, error or timeout */
+static inline bool test_recv(int fd, void *buf, size_t len) {
+	size_t off = 0;
+
+	while (off < len) {
+		ssize_t n = read(fd, (char *) buf + off, len - off);
+		if (n == 0 || (n < 0 && errno != EINTR))
+			return false;
+		if (n > 0)
+			off += n;
+	}
+	return true;
+}
+
+/* a binary request, extras then key then value */
+static inline std::string test_bin_request(uint8_t opcode,
+		const std::string &key, const std::string &value = "",
+		const std::string &extras = "", uint32_t opaque = 0) {
+	protocol_binary_request_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.request.magic = PROTOCOL_BINARY_REQ;
+	hdr.request.opcode = opcode;
+	hdr.request.keylen = htons(key.size());
+	hdr.request.extlen = extras.size();
+	hdr.request.bodylen = htonl(extras.size() + key.size() + value.size());
+	hdr.request.opaque = opaque;
+	return std::string((const char *) hdr.bytes, sizeof(hdr.bytes)) + extras
+			+ key + value;
+}
+
+/* a SET with flags and exptime 0 */
+static inline std::string test_bin_set(const std::string &key,
+		const std::string &value) {
+	return test_bin_request(PROTOCOL_BINARY_CMD_SET, key, value,
+			std::string(8, '\0'));
+}
+
+/*
+ * Reads one binary response; its header in host order, its body, extras
+ * included, into *body. False if none came.
+ */
+static inline bool test_bin_response(int fd,
+		protocol_binary_response_header *rsp, std::string *body) {
+	if (!test_recv(fd, rsp->bytes, sizeof(rsp->bytes)))
+		return false;
+	rsp->response.keylen = ntohs(rsp->response.keylen);
+	rsp->response.status = ntohs(rsp->response.status);
+	rsp->response.bodylen = ntohl(rsp->response.bodylen);
+	body->resize(rsp->response.bodylen);
+	return rsp->response.bodylen == 0
+			|| test_recv(fd, &(*body)[0], rsp->response.bodylen);
+}
+
+/* reads until the reply ends with end */
+static inline std::string test_read_until(int fd, const std::string &end) {
+	std::string out;
+	char buf[4096];
+
+	while (out.size() < end.size()
+			|| out.compare(out.size() - end.size(), end.size(), end) != 0) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		out.append(buf, n);
+	}
+	return out;
+}
+
+/* sends one binary request and returns its status, body in *body */
+static inline uint16_t test_bin_call(int fd, const std::string &req,
+		std::string *body = NULL, protocol_binary_response_header *out = NULL) {
+	protocol_binary_response_header rsp;
+	std::string tmp;
+
+	TEST_CHECK(test_send(fd, req));
+	TEST_CHECK(test_bin_response(fd, &rsp, body ? body : &tmp));
+	TEST_CHECK(rsp.response.magic == PROTOCOL_BINARY_RES);
+	if (out != NULL)
+		*out = rsp;
+	return rsp.response.status;
+}
+
+/*
+ * Over an ascii conn: the value of stat name in "stats <sub>", -1 if it
+ * isn't there. A name starting with ':' sums the lines ending in it, of
+ * every slab class such as "<id>:compressed_items", 0 if there are none.
+ */
+static inline long test_stat(int fd, const std::string &name,
+		const std::string &sub = "") {
+	std::string out, tag = name[0] == ':' ? name + " " : "STAT " + name + " ";
+	size_t pos = 0;
+	long sum = name[0] == ':' ? 0 : -1;
+
+	TEST_CHECK(test_send(fd, sub.empty() ? "stats\r\n"
+			: "stats " + sub + "\r\n"));
+	out = test_read_until(fd, "END\r\n");
+	while ((pos = out.find(tag, pos)) != std::string::npos) {
+		pos += tag.size();
+		sum = (sum < 0 ? 0 : sum) + atol(out.c_str() + pos);
+	}
+	return sum;
+}
+
+/* answers every binary request with "v:<key>", except key "hang" */
+static inline void *test_backend_conn(void *arg) {
+	int fd = (int) (long) arg;
+	protocol_binary_request_header req;
+	protocol_binary_response_header rsp;
+	std::string body;
+
+	while (test_recv(fd, req.bytes, sizeof(req.bytes))) {
+		uint16_t keylen = ntohs(req.request.keylen);
+		body.resize(ntohl(req.request.bodylen));
+		if (!body.empty() && !test_recv(fd, &body[0], body.size()))
+			break;
+		std::string key = body.substr(req.request.extlen, keylen);
+		if (key == "hang")
+			continue;
+		std::string value = std::string(4, '\0') + "v:" + key;
+		memset(&rsp, 0, sizeof(rsp));
+		rsp.response.magic = PROTOCOL_BINARY_RES;
+		rsp.response.opcode = req.request.opcode;
+		rsp.response.extlen = 4;
+		rsp.response.bodylen = htonl(value.size());
+		rsp.response.opaque = req.request.opaque;
+		if (!test_send(fd, std::string((const char *) rsp.bytes,
+				sizeof(rsp.bytes)) + value))
+			break;
+	}
+	close(fd);
+	return NULL;
+}
+
+static inline void *test_backend_accept(void *arg) {
+	int lfd = (int) (long) arg;
+	int fd;
+
+	while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+		pthread_t tid;
+		pthread_create(&tid, NULL, test_backend_conn, (void *) (long) fd);
+		pthread_detach(tid);
+	}
+	return NULL;
+}
+
+/*
+ * A backend on threads of the test, before the server is forked. Returns
+ * its port.
+ */
+static inline int test_start_backend() {
+	pthread_t tid;
+	int port;
+	int lfd = test_listen(&port);
+
+	pthread_create(&tid, NULL, test_backend_accept, (void *) (long) lfd);
+	pthread_detach(tid);
+	return port;
+}
@@ -0,0 +1,140 @@
+//============================================================================
+// Name        : TlsTest.cpp
+// Author      : jeffrey
+// Version     :
+// Copyright   : vmodule.org
+// Description : Loopback test of the TLS listener: a request over TLS, and
+//               a client that never handshakes kicked by idle_timeout
+//============================================================================
+
+#include <iostream>
+#include <vutils/Logger.h>
+#include <network/SampleServer.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include "TestUtil.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+
+#define LOG_TAG "TlsTest"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)
+#endif
+using namespace std;
+using namespace vmodule;
+
+/* a self-signed certificate for localhost and its key, as PEM files */
+static void writeCert(const string &cert, const string &key) {
+	EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	EVP_PKEY *pkey = NULL;
+	X509 *x509 = X509_new();
+	X509_NAME *name;
+	FILE *f;
+
+	TEST_CHECK(kctx != NULL && x509 != NULL);
+	TEST_CHECK(EVP_PKEY_keygen_init(kctx) == 1);
+	TEST_CHECK(EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) == 1);
+	TEST_CHECK(EVP_PKEY_keygen(kctx, &pkey) == 1);
+	X509_set_version(x509, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_getm_notBefore(x509), -60);
+	X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+	X509_set_pubkey(x509, pkey);
+	name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+			(const unsigned char *) "localhost", -1, -1, 0);
+	X509_set_issuer_name(x509, name);
+	TEST_CHECK(X509_sign(x509, pkey, EVP_sha256()) > 0);
+
+	f = fopen(cert.c_str(), "w");
+	TEST_CHECK(f != NULL && PEM_write_X509(f, x509) == 1);
+	fclose(f);
+	f = fopen(key.c_str(), "w");
+	TEST_CHECK(f != NULL
+			&& PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL) == 1);
+	fclose(f);
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	EVP_PKEY_CTX_free(kctx);
+}
+
+/* reads over ssl until the reply ends with end */
+static string tlsRead(SSL *ssl, const string &end) {
+	string out;
+	char buf[4096];
+
+	while (out.size() < end.size()
+			|| out.compare(out.size() - end.size(), end.size(), end) != 0) {
+		int n = SSL_read(ssl, buf, sizeof(buf));
+		TEST_CHECK(n > 0);
+		out.append(buf, n);
+	}
+	return out;
+}
+
+int main() {
+	SampleServer server;
+	char cert[64], key[64], tlsopt[512];
+	int port = test_free_port();
+	int tlsPort = test_free_port();
+	const char *options[] = { "-o", tlsopt, NULL };
+	SSL_CTX *ctx;
+	SSL *ssl;
+	uint64_t start;
+	pid_t pid;
+	int fd;
+	char c;
+
+	snprintf(cert, sizeof(cert), "/tmp/tlstest.%d.crt", (int) getpid());
+	snprintf(key, sizeof(key), "/tmp/tlstest.%d.key", (int) getpid());
+	writeCert(cert, key);
+	snprintf(tlsopt, sizeof(tlsopt),
+			"tls_port=%d,tls_cert=%s,tls_key=%s,idle_timeout=1", tlsPort, cert,
+			key);
+	pid = test_start_server(&server, port, options);
+
+	/* a request and its reply over TLS */
+	ctx = SSL_CTX_new(TLS_client_method());
+	TEST_CHECK(ctx != NULL);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+	fd = test_connect(tlsPort);
+	TEST_CHECK(fd >= 0);
+	ssl = SSL_new(ctx);
+	SSL_set_fd(ssl, fd);
+	TEST_CHECK(SSL_connect(ssl) == 1);
+	TEST_CHECK(SSL_write(ssl, "hello\r\n", 7) == 7);
+	TEST_CHECK(tlsRead(ssl, "\r\n") == "HELLO\r\n");
+	TEST_CHECK(SSL_write(ssl, "stats\r\n", 7) == 7);
+	TEST_CHECK(tlsRead(ssl, "END\r\n").find("STAT tls_handshakes 1\r\n")
+			!= string::npos);
+	SSL_free(ssl);
+	close(fd);
+	SSL_CTX_free(ctx);
+
+	/* a client stuck before the handshake counts as idle too */
+	fd = test_connect(tlsPort);
+	TEST_CHECK(fd >= 0);
+	struct timeval tv = { 10, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	start = test_now_ms();
+	TEST_CHECK(read(fd, &c, 1) == 0);
+	TEST_CHECK(test_now_ms() - start < 8000);
+	close(fd);
+
+	test_stop_server(pid);
+	unlink(cert);
+	unlink(key);
+	MY_LOGD("TlsTest passed");
+	return 0;
+}
@@ -0,0 +1,470 @@
+/*
+ * AppendLog.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vutils/AppendLog.h>
+#include <vutils/Logger.h>
+#include <threads/Thread.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "AppendLog"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+namespace vmodule {
+
+/*
+ * On disk a record is this header and len bytes of payload; check covers
+ * hash and payload. A len of 0 never gets written, it marks the end of a
+ * file whose tail was never filled in.
+ */
+struct RecordHeader {
+	uint32_t len;
+	uint32_t hash;
+	uint32_t check;
+};
+
+/* first batch buffers, they grow as needed */
+#define BATCH_INITIAL_SIZE (64 * 1024)
+
+/* FNV-1a */
+static uint32_t checksum(uint32_t h, const void *data, size_t len) {
+	const unsigned char *p = (const unsigned char *) data;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static uint32_t record_check(uint32_t hash, const void *payload,
+		size_t len) {
+	return checksum(checksum(2166136261u, &hash, sizeof(hash)), payload, len);
+}
+
+class LogWriter: public CThread {
+public:
+	LogWriter(AppendLog *log) :
+			mLog(log) {
+	}
+private:
+	virtual bool threadLoop() {
+		return mLog->writeBatch();
+	}
+	AppendLog *mLog;
+};
+
+/* records of the partitions of a replay, in file order */
+struct ReplayPart {
+	uint64_t *offsets;
+	size_t count;
+	size_t size;
+};
+
+class LogReplayer: public CThread {
+public:
+	LogReplayer(const char *map, const ReplayPart *part,
+			AppendLog::Apply apply, void *arg) :
+			mMap(map), mPart(part), mApply(apply), mArg(arg), mApplied(0), mCorrupt(
+					0) {
+	}
+	void replay() {
+		for (size_t i = 0; i < mPart->count; i++) {
+			const char *rec = mMap + mPart->offsets[i];
+			RecordHeader h;
+
+			memcpy(&h, rec, sizeof(h));
+			rec += sizeof(h);
+			if (record_check(h.hash, rec, h.len) != h.check) {
+				mCorrupt++;
+				continue;
+			}
+			mApply(rec, h.len, mArg);
+			mApplied++;
+		}
+	}
+	uint64_t applied() const {
+		return mApplied;
+	}
+	uint64_t corrupt() const {
+		return mCorrupt;
+	}
+private:
+	virtual bool threadLoop() {
+		replay();
+		return false;
+	}
+	const char *mMap;
+	const ReplayPart *mPart;
+	AppendLog::Apply mApply;
+	void *mArg;
+	uint64_t mApplied;
+	uint64_t mCorrupt;
+};
+
+AppendLog::AppendLog(const char *path) :
+		mPath(strdup(path)), mFd(-1), mSize(0), mBroken(NO_ERROR), mBuf(NULL), mBufLen(
+				0), mBufSize(0), mSpare(NULL), mSpareSize(0), mAppended(0), mWritten(
+				0), mSynced(0), mLostFirst(0), mLostLast(0), mLostError(NO_ERROR), mWaiters(
+				NULL), mNumWaiters(0), mMaxWaiters(0), mClosing(false) {
+	pthread_mutex_init(&mLock, NULL);
+	pthread_cond_init(&mCond, NULL);
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+AppendLog::~AppendLog() {
+	close();
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mLock);
+	free(mBuf);
+	free(mSpare);
+	free(mWaiters);
+	free(mPath);
+}
+
+status_t AppendLog::replay(int nthreads, Apply apply, void *arg,
+		uint64_t *count) {
+	ReplayPart *parts;
+	struct stat sb;
+	uint64_t off = 0, applied = 0, corrupt = 0;
+	status_t ret = NO_ERROR;
+	const char *map;
+	int fd, i;
+
+	fd = ::open(mPath, O_RDONLY);
+	if (fd < 0)
+		return errno == ENOENT ? NO_ERROR : UNKNOWN_ERROR;
+	if (fstat(fd, &sb) != 0) {
+		::close(fd);
+		return UNKNOWN_ERROR;
+	}
+	if (sb.st_size == 0) {
+		::close(fd);
+		return NO_ERROR;
+	}
+	map = (const char *) mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd,
+			0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		return UNKNOWN_ERROR;
+	madvise((void *) map, sb.st_size, MADV_SEQUENTIAL);
+
+	if (nthreads < 1)
+		nthreads = 1;
+	parts = (ReplayPart *) calloc(nthreads, sizeof(ReplayPart));
+	if (parts == NULL) {
+		munmap((void *) map, sb.st_size);
+		return NO_MEMORY;
+	}
+
+	/* find the records, only their headers are read here */
+	while (off + sizeof(RecordHeader) <= (uint64_t) sb.st_size) {
+		RecordHeader h;
+		ReplayPart *p;
+
+		memcpy(&h, map + off, sizeof(h));
+		if (h.len == 0 || h.len > sb.st_size - off - sizeof(h))
+			break;
+		p = &parts[h.hash % nthreads];
+		if (p->count == p->size) {
+			size_t size = p->size ? p->size * 2 : 1024;
+			uint64_t *offsets = (uint64_t *) realloc(p->offsets,
+					size * sizeof(uint64_t));
+			if (offsets == NULL) {
+				ret = NO_MEMORY;
+				goto out;
+			}
+			p->offsets = offsets;
+			p->size = size;
+		}
+		p->offsets[p->count++] = off;
+		off += sizeof(h) + h.len;
+	}
+
+	{
+		sp<LogReplayer> *replayers = new sp<LogReplayer> [nthreads];
+
+		for (i = 0; i < nthreads; i++) {
+			replayers[i] = new LogReplayer(map, &parts[i], apply, arg);
+			/* the last part, or one without a thread, goes here */
+			if (i == nthreads - 1
+					|| replayers[i]->run("LogReplayer") != NO_ERROR)
+				replayers[i]->replay();
+		}
+		for (i = 0; i < nthreads; i++) {
+			if (i < nthreads - 1)
+				replayers[i]->join();
+			applied += replayers[i]->applied();
+			corrupt += replayers[i]->corrupt();
+		}
+		delete[] replayers;
+	}
+	if (corrupt > 0)
+		MY_LOGE("%s: %llu damaged records skipped", mPath,
+				(unsigned long long) corrupt);
+	if (off < (uint64_t) sb.st_size) {
+		MY_LOGE("%s: cutting %llu bytes of torn tail", mPath,
+				(unsigned long long) (sb.st_size - off));
+		if (truncate(mPath, off) != 0)
+			ret = UNKNOWN_ERROR;
+	}
+	*count += applied;
+
+out:
+	for (i = 0; i < nthreads; i++)
+		free(parts[i].offsets);
+	free(parts);
+	munmap((void *) map, sb.st_size);
+	return ret;
+}
+
+status_t AppendLog::open() {
+	struct stat sb;
+
+	mFd = ::open(mPath, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (mFd < 0 || fstat(mFd, &sb) != 0) {
+		MY_LOGE("failed to open %s: %s", mPath, strerror(errno));
+		return UNKNOWN_ERROR;
+	}
+	mSize = sb.st_size;
+	if (!reserve(&mBuf, &mBufSize, BATCH_INITIAL_SIZE)
+			|| !reserve(&mSpare, &mSpareSize, BATCH_INITIAL_SIZE))
+		return NO_MEMORY;
+	mWriter = new LogWriter(this);
+	if (mWriter->run("LogWriter") != NO_ERROR) {
+		MY_LOGE("failed to start the log writer");
+		mWriter.clear();
+		return UNKNOWN_ERROR;
+	}
+	return NO_ERROR;
+}
+
+void AppendLog::close() {
+	if (mWriter == NULL)
+		return;
+	pthread_mutex_lock(&mLock);
+	mClosing = true;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mLock);
+	mWriter->join();
+	mWriter.clear();
+	::close(mFd);
+	mFd = -1;
+}
+
+/* grows *buf to need bytes, mLock held or before the writer runs */
+bool AppendLog::reserve(char **buf, size_t *size, size_t need) {
+	size_t n = *size ? *size : BATCH_INITIAL_SIZE;
+	char *p;
+
+	if (need <= *size)
+		return true;
+	while (n < need)
+		n *= 2;
+	p = (char *) realloc(*buf, n);
+	if (p == NULL)
+		return false;
+	*buf = p;
+	*size = n;
+	return true;
+}
+
+uint64_t AppendLog::append(uint32_t hash, const struct iovec *iov,
+		int iovcnt) {
+	RecordHeader h;
+	uint32_t check = checksum(2166136261u, &hash, sizeof(hash));
+	size_t len = 0;
+	uint64_t seq;
+	char *p;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		check = checksum(check, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+	h.len = len;
+	h.hash = hash;
+	h.check = check;
+
+	pthread_mutex_lock(&mLock);
+	if (!reserve(&mBuf, &mBufSize, mBufLen + sizeof(h) + len)) {
+		/* the record is lost, as if the write had failed */
+		mStats.write_errors++;
+		seq = ++mAppended;
+		lose(seq, seq, NO_MEMORY);
+		pthread_mutex_unlock(&mLock);
+		MY_LOGE("no memory for a %zu byte record", len);
+		return seq;
+	}
+	p = mBuf + mBufLen;
+	memcpy(p, &h, sizeof(h));
+	p += sizeof(h);
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	if (mBufLen == 0)
+		pthread_cond_signal(&mCond);
+	mBufLen += sizeof(h) + len;
+	seq = ++mAppended;
+	mStats.records++;
+	mStats.bytes += sizeof(h) + len;
+	pthread_mutex_unlock(&mLock);
+	return seq;
+}
+
+void AppendLog::lose(uint64_t first, uint64_t last, status_t err) {
+	if (mLostFirst == 0 || first < mLostFirst)
+		mLostFirst = first;
+	if (last > mLostLast)
+		mLostLast = last;
+	mLostError = err;
+	mStats.lost += last - first + 1;
+}
+
+status_t AppendLog::whenSynced(uint64_t seq, Synced synced, void *arg) {
+	status_t err = WOULD_BLOCK;
+
+	pthread_mutex_lock(&mLock);
+	if (mLostFirst != 0 && seq >= mLostFirst && seq <= mLostLast) {
+		err = mLostError;
+	} else if (seq <= mSynced) {
+		err = NO_ERROR;
+	} else if (mNumWaiters == mMaxWaiters) {
+		size_t n = mMaxWaiters ? mMaxWaiters * 2 : 64;
+		Waiter *w = (Waiter *) realloc(mWaiters, n * sizeof(Waiter));
+		if (w == NULL) {
+			/* can't wait then, nor tell it is there */
+			err = NO_MEMORY;
+		} else {
+			mWaiters = w;
+			mMaxWaiters = n;
+		}
+	}
+	if (err == WOULD_BLOCK) {
+		mWaiters[mNumWaiters].seq = seq;
+		mWaiters[mNumWaiters].synced = synced;
+		mWaiters[mNumWaiters].arg = arg;
+		mNumWaiters++;
+	}
+	pthread_mutex_unlock(&mLock);
+	return err;
+}
+
+bool AppendLog::writeBatch() {
+	Waiter *ready = NULL;
+	size_t len, done = 0, nready = 0, i;
+	uint64_t first, seq, records;
+	status_t err;
+	char *buf;
+
+	pthread_mutex_lock(&mLock);
+	while (mBufLen == 0 && !mClosing)
+		pthread_cond_wait(&mCond, &mLock);
+	if (mBufLen == 0) {
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	/* appends go to the other buffer while this one is written */
+	buf = mBuf;
+	len = mBufLen;
+	mBuf = mSpare;
+	mSpare = buf;
+	i = mBufSize;
+	mBufSize = mSpareSize;
+	mSpareSize = i;
+	mBufLen = 0;
+	seq = mAppended;
+	first = mWritten + 1;
+	records = seq - mWritten;
+	pthread_mutex_unlock(&mLock);
+
+	err = mBroken;
+	while (err == NO_ERROR && done < len) {
+		ssize_t n = write(mFd, buf + done, len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			MY_LOGE("failed to write %s: %s", mPath, strerror(errno));
+			break;
+		}
+		done += n;
+	}
+	if (err == NO_ERROR && fdatasync(mFd) != 0) {
+		err = -errno;
+		MY_LOGE("failed to sync %s: %s", mPath, strerror(errno));
+	}
+	if (err == NO_ERROR) {
+		mSize += len;
+	} else if (mBroken == NO_ERROR && ftruncate(mFd, mSize) != 0) {
+		/* a replay would stop at the torn batch and cut what follows */
+		MY_LOGE("failed to cut %s back: %s, no more writes", mPath,
+				strerror(errno));
+		mBroken = err;
+	}
+
+	pthread_mutex_lock(&mLock);
+	mWritten = seq;
+	mStats.batches++;
+	if (records > mStats.largest_batch)
+		mStats.largest_batch = records;
+	if (err == NO_ERROR) {
+		mSynced = seq;
+	} else {
+		mStats.write_errors++;
+		lose(first, seq, err);
+	}
+	/* the waiters done, those left stay in order at the front */
+	for (i = 0; i < mNumWaiters; i++) {
+		if (mWaiters[i].seq > seq)
+			continue;
+		if (ready == NULL) {
+			ready = (Waiter *) malloc(mNumWaiters * sizeof(Waiter));
+			if (ready == NULL)
+				break;
+		}
+		ready[nready++] = mWaiters[i];
+	}
+	if (nready > 0) {
+		size_t kept = 0;
+		for (i = 0; i < mNumWaiters; i++)
+			if (mWaiters[i].seq > seq)
+				mWaiters[kept++] = mWaiters[i];
+		mNumWaiters = kept;
+	}
+	pthread_mutex_unlock(&mLock);
+
+	/* a failed batch is not retried, its waiters get the error */
+	for (i = 0; i < nready; i++)
+		ready[i].synced(ready[i].arg, err);
+	free(ready);
+	return true;
+}
+
+void AppendLog::getStats(Stats *out) {
+	pthread_mutex_lock(&mLock);
+	*out = mStats;
+	out->synced = mSynced;
+	pthread_mutex_unlock(&mLock);
+}
+
+}
@@ -0,0 +1,269 @@
+/*
+ * ConcurrentHashTable.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#include <stdlib.h>
+#include <sched.h>
+#include <vutils/ConcurrentHashTable.h>
+#include <vutils/Logger.h>
+#include <threads/Thread.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "ConcurrentHashTable"
+
+#ifdef DEBUG_ENABLE
+#define MY_LOGD(fmt, arg...)  XLOGD(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#else
+#define MY_LOGD(fmt, arg...)
+#define MY_LOGE(fmt, arg...)  XLOGE(LOG_TAG,fmt, ##arg)//MY_LOGD(fmt, ##arg)X
+#endif
+
+namespace vmodule {
+
+#define hashsize(n) ((uint64_t)1 << (n))
+#define hashmask(n) (hashsize(n) - 1)
+
+/* the hash has 32 bits, more buckets would stay empty */
+#define HASHPOWER_MAX 32
+/* old buckets moved between two yields of the expander */
+#define EXPAND_BUCKETS_PER_YIELD 1024
+
+class HashExpander: public CThread {
+public:
+	HashExpander(ConcurrentHashTable *table) :
+			mTable(table) {
+	}
+	void wake() {
+		mWake.Set();
+	}
+	void stop() {
+		requestExit();
+		mWake.Set();
+		requestExitAndWait();
+	}
+private:
+	virtual bool threadLoop() {
+		mWake.Wait();
+		if (exitPending())
+			return false;
+		mTable->expand();
+		return true;
+	}
+	ConcurrentHashTable *mTable;
+	CEvent mWake;
+};
+
+ConcurrentHashTable::ConcurrentHashTable(KeyEquals equals) :
+		mEquals(equals), mPrimary(NULL), mOld(NULL), mHashpower(0), mExpanding(
+				false), mExpandBucket(0), mExpandRequested(false), mItems(0), mExpansions(
+				0), mMovedItems(0), mLocks(NULL), mLockMask(0) {
+}
+
+ConcurrentHashTable::~ConcurrentHashTable() {
+	if (mExpander != NULL)
+		mExpander->stop();
+	if (mLocks != NULL) {
+		for (uint32_t i = 0; i <= mLockMask; i++)
+			pthread_mutex_destroy(&mLocks[i]);
+		free(mLocks);
+	}
+	free(mPrimary);
+	free(mOld);
+}
+
+status_t ConcurrentHashTable::init(int hashpower, int lockpower, bool expand) {
+	uint32_t i, nlocks;
+
+	if (hashpower <= 0 || hashpower > HASHPOWER_MAX || lockpower < 0)
+		return BAD_VALUE;
+	if (lockpower > hashpower)
+		lockpower = hashpower;
+	mPrimary = (HashLink **) calloc(hashsize(hashpower), sizeof(HashLink *));
+	nlocks = 1 << lockpower;
+	mLocks = (pthread_mutex_t *) calloc(nlocks, sizeof(pthread_mutex_t));
+	if (mPrimary == NULL || mLocks == NULL)
+		return NO_MEMORY;
+	for (i = 0; i < nlocks; i++)
+		pthread_mutex_init(&mLocks[i], NULL);
+	mLockMask = nlocks - 1;
+	mHashpower = hashpower;
+
+	if (expand) {
+		mExpander = new HashExpander(this);
+		if (mExpander->run("HashExpander") != NO_ERROR) {
+			MY_LOGE("failed to start the hash table expander");
+			mExpander.clear();
+			return UNKNOWN_ERROR;
+		}
+	}
+	return NO_ERROR;
+}
+
+void ConcurrentHashTable::lock(uint32_t hv) {
+	pthread_mutex_lock(&mLocks[hv & mLockMask]);
+}
+
+void ConcurrentHashTable::unlock(uint32_t hv) {
+	pthread_mutex_unlock(&mLocks[hv & mLockMask]);
+}
+
+bool ConcurrentHashTable::trylock(uint32_t hv) {
+	return pthread_mutex_trylock(&mLocks[hv & mLockMask]) == 0;
+}
+
+void ConcurrentHashTable::lockAll() {
+	for (uint32_t i = 0; i <= mLockMask; i++)
+		pthread_mutex_lock(&mLocks[i]);
+}
+
+void ConcurrentHashTable::unlockAll() {
+	for (uint32_t i = mLockMask + 1; i > 0; i--)
+		pthread_mutex_unlock(&mLocks[i - 1]);
+}
+
+/*
+ * The bucket hv lives in. The caller's lock(hv) keeps the table pointers
+ * and the state of this bucket from changing under it; the lock also
+ * guards the old bucket, as locks use fewer bits than the old table.
+ */
+HashLink **ConcurrentHashTable::bucket(uint32_t hv) {
+	if (mExpanding) {
+		uint64_t oldbucket = hv & hashmask(mHashpower - 1);
+		if (oldbucket >= __atomic_load_n(&mExpandBucket, __ATOMIC_RELAXED))
+			return &mOld[oldbucket];
+	}
+	return &mPrimary[hv & hashmask(mHashpower)];
+}
+
+HashLink *ConcurrentHashTable::find(const void *key, size_t nkey,
+		uint32_t hv) {
+	HashLink *e = *bucket(hv);
+
+	while (e != NULL) {
+		if (e->hv == hv && mEquals(e, key, nkey))
+			return e;
+		e = e->next;
+	}
+	return NULL;
+}
+
+void ConcurrentHashTable::insert(HashLink *e, uint32_t hv) {
+	HashLink **head = bucket(hv);
+	uint64_t items;
+
+	e->hv = hv;
+	e->next = *head;
+	*head = e;
+
+	items = __atomic_add_fetch(&mItems, 1, __ATOMIC_RELAXED);
+	if (mExpander != NULL && !mExpanding && mHashpower < HASHPOWER_MAX
+			&& items > (hashsize(mHashpower) * 3) / 2
+			&& !__atomic_exchange_n(&mExpandRequested, true,
+					__ATOMIC_RELAXED))
+		mExpander->wake();
+}
+
+HashLink *ConcurrentHashTable::remove(const void *key, size_t nkey,
+		uint32_t hv) {
+	HashLink **pos = bucket(hv);
+
+	while (*pos != NULL && ((*pos)->hv != hv || !mEquals(*pos, key, nkey)))
+		pos = &(*pos)->next;
+	if (*pos == NULL)
+		return NULL;
+
+	HashLink *e = *pos;
+	*pos = e->next;
+	e->next = NULL;
+	__atomic_sub_fetch(&mItems, 1, __ATOMIC_RELAXED);
+	return e;
+}
+
+bool ConcurrentHashTable::contains(const HashLink *e, uint32_t hv) {
+	HashLink *pos = *bucket(hv);
+
+	while (pos != NULL && pos != e)
+		pos = pos->next;
+	return pos != NULL;
+}
+
+void ConcurrentHashTable::expand() {
+	HashLink **table;
+	uint64_t b, oldsize, moved = 0;
+	int power = mHashpower + 1;
+
+	table = (HashLink **) calloc(hashsize(power), sizeof(HashLink *));
+	if (table == NULL) {
+		MY_LOGE("no memory to grow the hash table to 2^%d buckets", power);
+		__atomic_store_n(&mExpandRequested, false, __ATOMIC_RELAXED);
+		return;
+	}
+	MY_LOGD("growing the hash table to 2^%d buckets", power);
+
+	/* everyone out while the tables swap */
+	lockAll();
+	mOld = mPrimary;
+	mPrimary = table;
+	mHashpower = power;
+	__atomic_store_n(&mExpandBucket, 0, __ATOMIC_RELAXED);
+	mExpanding = true;
+	unlockAll();
+
+	oldsize = hashsize(power - 1);
+	for (b = 0; b < oldsize; b++) {
+		lock((uint32_t) b);
+		HashLink *e = mOld[b];
+		while (e != NULL) {
+			HashLink *next = e->next;
+			HashLink **head = &mPrimary[e->hv & hashmask(power)];
+			e->next = *head;
+			*head = e;
+			e = next;
+			moved++;
+		}
+		mOld[b] = NULL;
+		__atomic_store_n(&mExpandBucket, b + 1, __ATOMIC_RELAXED);
+		unlock((uint32_t) b);
+
+		if ((b + 1) % EXPAND_BUCKETS_PER_YIELD == 0)
+			sched_yield();
+	}
+
+	lockAll();
+	mExpanding = false;
+	free(mOld);
+	mOld = NULL;
+	mExpansions++;
+	mMovedItems += moved;
+	__atomic_store_n(&mExpandRequested, false, __ATOMIC_RELAXED);
+	unlockAll();
+	MY_LOGD("hash table grown to 2^%d buckets, %llu items moved", power,
+			(unsigned long long) moved);
+
+	/* it may have filled up again meanwhile */
+	if (__atomic_load_n(&mItems, __ATOMIC_RELAXED)
+			> (hashsize(power) * 3) / 2 && power < HASHPOWER_MAX
+			&& !__atomic_exchange_n(&mExpandRequested, true, __ATOMIC_RELAXED))
+		mExpander->wake();
+}
+
+void ConcurrentHashTable::getStats(Stats *out) {
+	/* lock 0 orders us after the last table switch */
+	lock(0);
+	out->hashpower = mHashpower;
+	out->expanding = mExpanding;
+	out->expand_total = mExpanding ? hashsize(mHashpower - 1) : 0;
+	out->expand_done = mExpanding ?
+			__atomic_load_n(&mExpandBucket, __ATOMIC_RELAXED) : 0;
+	out->expansions = mExpansions;
+	out->moved_items = mMovedItems;
+	unlock(0);
+	out->items = __atomic_load_n(&mItems, __ATOMIC_RELAXED);
+}
+
+}
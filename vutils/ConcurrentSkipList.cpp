@@ -0,0 +1,275 @@
+/*
+ * ConcurrentSkipList.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <vutils/ConcurrentSkipList.h>
+
+namespace vmodule {
+
+/* enough levels for 4^20 nodes */
+#define SKIPLIST_MAX_HEIGHT 20
+/* reader threads with a slot of their own, more take the writer lock */
+#define SKIPLIST_MAX_READERS 1024
+/* one slot per cache line */
+#define SKIPLIST_SLOT_STRIDE (64 / sizeof(uint64_t))
+/* unlinked nodes gathered before trying to release them */
+#define SKIPLIST_RECLAIM_BATCH 64
+
+/*
+ * Reader threads are numbered once, for every list: a thread's slot in a
+ * list is mSlots[its number]. A reader publishes the epoch it starts in
+ * there; a node unlinked in epoch e can only have been seen by readers
+ * that started in e or before, so it is released once the epoch moved on
+ * and no reader is left in e or before.
+ */
+static __thread int tls_reader = -1;
+static int next_reader;
+
+ConcurrentSkipList::ConcurrentSkipList(Retire retire) :
+		mRetire(retire), mHead(NULL), mHeight(1), mRandom(2463534242u), mNodes(
+				0), mEpoch(1), mSlots(NULL), mRetired(NULL), mRetiredCount(0), mSinceReclaim(
+				0), mReclaimed(0) {
+	pthread_mutex_init(&mLock, NULL);
+}
+
+ConcurrentSkipList::~ConcurrentSkipList() {
+	Node *n, *next;
+
+	for (n = mRetired; n != NULL; n = next) {
+		next = n->retired_next;
+		mRetire(n->value);
+		free(n);
+	}
+	for (n = mHead; n != NULL; n = next) {
+		next = n->next[0];
+		free(n);
+	}
+	free(mSlots);
+	pthread_mutex_destroy(&mLock);
+}
+
+status_t ConcurrentSkipList::init() {
+	mHead = newNode(NULL, 0, NULL, SKIPLIST_MAX_HEIGHT);
+	mSlots = (uint64_t *) calloc(SKIPLIST_MAX_READERS * SKIPLIST_SLOT_STRIDE,
+			sizeof(uint64_t));
+	if (mHead == NULL || mSlots == NULL)
+		return NO_MEMORY;
+	return NO_ERROR;
+}
+
+int ConcurrentSkipList::compare(const void *a, size_t na, const void *b,
+		size_t nb) {
+	int r = memcmp(a, b, na < nb ? na : nb);
+
+	if (r != 0)
+		return r;
+	return na < nb ? -1 : na > nb;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::newNode(const void *key,
+		size_t nkey, void *value, int height) {
+	Node *n = (Node *) calloc(1, sizeof(Node) + height * sizeof(Node *));
+
+	if (n == NULL)
+		return NULL;
+	n->key = key;
+	n->nkey = nkey;
+	n->value = value;
+	n->height = height;
+	return n;
+}
+
+int ConcurrentSkipList::randomHeight() {
+	int height = 1;
+
+	/* xorshift32, one level more with probability 1/4 */
+	mRandom ^= mRandom << 13;
+	mRandom ^= mRandom >> 17;
+	mRandom ^= mRandom << 5;
+	for (uint32_t r = mRandom; (r & 3) == 0 && height < SKIPLIST_MAX_HEIGHT;
+			r >>= 2)
+		height++;
+	return height;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::findPreds(const void *key,
+		size_t nkey, Node **preds) {
+	Node *x = mHead;
+
+	for (int i = mHeight - 1; i >= 0; i--) {
+		while (x->next[i] != NULL
+				&& compare(x->next[i]->key, x->next[i]->nkey, key, nkey) < 0)
+			x = x->next[i];
+		preds[i] = x;
+	}
+	return x->next[0];
+}
+
+bool ConcurrentSkipList::insert(const void *key, size_t nkey, void *value) {
+	Node *preds[SKIPLIST_MAX_HEIGHT];
+	Node *n;
+	int i, height;
+
+	pthread_mutex_lock(&mLock);
+	n = findPreds(key, nkey, preds);
+	if (n != NULL && compare(n->key, n->nkey, key, nkey) == 0) {
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	height = randomHeight();
+	n = newNode(key, nkey, value, height);
+	if (n == NULL) {
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	for (i = mHeight; i < height; i++)
+		preds[i] = mHead;
+	if (height > mHeight)
+		__atomic_store_n(&mHeight, height, __ATOMIC_RELAXED);
+
+	/* the node is complete before a reader can reach it */
+	for (i = 0; i < height; i++)
+		n->next[i] = preds[i]->next[i];
+	for (i = 0; i < height; i++)
+		__atomic_store_n(&preds[i]->next[i], n, __ATOMIC_RELEASE);
+	mNodes++;
+	pthread_mutex_unlock(&mLock);
+	return true;
+}
+
+bool ConcurrentSkipList::remove(const void *key, size_t nkey, void *value) {
+	Node *preds[SKIPLIST_MAX_HEIGHT];
+	Node *n;
+
+	pthread_mutex_lock(&mLock);
+	n = findPreds(key, nkey, preds);
+	if (n == NULL || n->value != value) {
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	/* n keeps its own links, for the readers standing on it */
+	for (int i = n->height - 1; i >= 0; i--)
+		__atomic_store_n(&preds[i]->next[i], n->next[i], __ATOMIC_RELEASE);
+	mNodes--;
+	retire(n);
+	pthread_mutex_unlock(&mLock);
+	return true;
+}
+
+void ConcurrentSkipList::retire(Node *n) {
+	n->retired_epoch = __atomic_load_n(&mEpoch, __ATOMIC_SEQ_CST);
+	n->retired_next = mRetired;
+	mRetired = n;
+	mRetiredCount++;
+	if (++mSinceReclaim == SKIPLIST_RECLAIM_BATCH) {
+		mSinceReclaim = 0;
+		reclaim();
+	}
+}
+
+/*
+ * Releases the nodes no reader can see, mLock held. Moving the epoch on
+ * before looking at the slots pairs with readBegin() checking it again
+ * after publishing: a reader either shows up in its slot here or starts
+ * in the new epoch, after the nodes were unlinked.
+ */
+void ConcurrentSkipList::reclaim() {
+	uint64_t min = __atomic_add_fetch(&mEpoch, 1, __ATOMIC_SEQ_CST);
+	int i, readers = __atomic_load_n(&next_reader, __ATOMIC_SEQ_CST);
+	Node **pos, *n;
+
+	if (readers > SKIPLIST_MAX_READERS)
+		readers = SKIPLIST_MAX_READERS;
+	for (i = 0; i < readers; i++) {
+		uint64_t e = __atomic_load_n(&mSlots[i * SKIPLIST_SLOT_STRIDE],
+				__ATOMIC_SEQ_CST);
+		if (e != 0 && e < min)
+			min = e;
+	}
+
+	pos = &mRetired;
+	while ((n = *pos) != NULL) {
+		if (n->retired_epoch < min) {
+			*pos = n->retired_next;
+			mRetire(n->value);
+			free(n);
+			mRetiredCount--;
+			mReclaimed++;
+		} else {
+			pos = &n->retired_next;
+		}
+	}
+}
+
+void ConcurrentSkipList::collect() {
+	pthread_mutex_lock(&mLock);
+	if (mRetired != NULL)
+		reclaim();
+	pthread_mutex_unlock(&mLock);
+}
+
+uint64_t *ConcurrentSkipList::readerSlot() {
+	if (tls_reader < 0)
+		tls_reader = __atomic_fetch_add(&next_reader, 1, __ATOMIC_SEQ_CST);
+	if (tls_reader >= SKIPLIST_MAX_READERS)
+		return NULL;
+	return &mSlots[tls_reader * SKIPLIST_SLOT_STRIDE];
+}
+
+void ConcurrentSkipList::readBegin() {
+	uint64_t *slot = readerSlot();
+	uint64_t e;
+
+	if (slot == NULL) {
+		pthread_mutex_lock(&mLock);
+		return;
+	}
+	do {
+		e = __atomic_load_n(&mEpoch, __ATOMIC_SEQ_CST);
+		__atomic_store_n(slot, e, __ATOMIC_SEQ_CST);
+	} while (__atomic_load_n(&mEpoch, __ATOMIC_SEQ_CST) != e);
+}
+
+void ConcurrentSkipList::readEnd() {
+	uint64_t *slot = readerSlot();
+
+	if (slot == NULL) {
+		pthread_mutex_unlock(&mLock);
+		return;
+	}
+	__atomic_store_n(slot, 0, __ATOMIC_RELEASE);
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::seek(const void *key,
+		size_t nkey, bool exclusive) {
+	Node *x = mHead, *next;
+
+	for (int i = __atomic_load_n(&mHeight, __ATOMIC_RELAXED) - 1; i >= 0;
+			i--) {
+		while ((next = __atomic_load_n(&x->next[i], __ATOMIC_ACQUIRE)) != NULL) {
+			int r = compare(next->key, next->nkey, key, nkey);
+			if (r > 0 || (r == 0 && !exclusive))
+				break;
+			x = next;
+		}
+	}
+	return __atomic_load_n(&x->next[0], __ATOMIC_ACQUIRE);
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::next(Node *n) {
+	return __atomic_load_n(&n->next[0], __ATOMIC_ACQUIRE);
+}
+
+void ConcurrentSkipList::getStats(Stats *out) {
+	pthread_mutex_lock(&mLock);
+	out->nodes = mNodes;
+	out->retired = mRetiredCount;
+	out->reclaimed = mReclaimed;
+	pthread_mutex_unlock(&mLock);
+}
+
+}
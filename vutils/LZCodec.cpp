@@ -0,0 +1,195 @@
+/*
+ * LZCodec.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: jeffrey
+ */
+#include <string.h>
+#include <vutils/LZCodec.h>
+
+namespace vmodule {
+
+/* shortest match worth a sequence */
+#define LZ_MIN_MATCH 4
+/* farthest a match may be back */
+#define LZ_MAX_OFFSET 65535
+/* the last bytes are always literals, no match starts this close to the end */
+#define LZ_END_LITERALS 12
+/* log2 of the hash table's slots */
+#define LZ_HASH_LOG 12
+/* every 2^LZ_SKIP_LOG bytes without a match the search steps one further */
+#define LZ_SKIP_LOG 6
+
+static inline uint32_t read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+/* bytes equal at a and b, b running up to limit */
+static inline size_t match_length(const uint8_t *a, const uint8_t *b,
+		const uint8_t *limit) {
+	const uint8_t *start = b;
+	uint64_t diff;
+
+	while (b + 8 <= limit) {
+		diff = read64(a) ^ read64(b);
+		if (diff != 0)
+			return b - start + (__builtin_ctzll(diff) >> 3);
+		a += 8;
+		b += 8;
+	}
+	while (b < limit && *a == *b) {
+		a++;
+		b++;
+	}
+	return b - start;
+}
+
+/* a length of 15 or more continues in bytes of 255 and a last one below */
+static inline uint8_t *put_length(uint8_t *op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t) len;
+	return op;
+}
+
+/*
+ * Emits lit literals at anchor and, if mlen is not 0, a match of mlen at
+ * offset. NULL if it doesn't fit before oend.
+ */
+static uint8_t *put_sequence(uint8_t *op, uint8_t *oend,
+		const uint8_t *anchor, size_t lit, size_t offset, size_t mlen) {
+	uint8_t *token;
+
+	/* token, lengths, literals and offset, at their longest */
+	if ((size_t) (oend - op) < lit + lit / 255 + mlen / 255 + 5)
+		return NULL;
+	token = op++;
+	*token = (uint8_t) ((lit < 15 ? lit : 15) << 4);
+	if (lit >= 15)
+		op = put_length(op, lit - 15);
+	memcpy(op, anchor, lit);
+	op += lit;
+	if (mlen == 0)
+		return op;
+
+	*op++ = (uint8_t) offset;
+	*op++ = (uint8_t) (offset >> 8);
+	mlen -= LZ_MIN_MATCH;
+	*token |= (uint8_t) (mlen < 15 ? mlen : 15);
+	if (mlen >= 15)
+		op = put_length(op, mlen - 15);
+	return op;
+}
+
+size_t LZCodec::bound(size_t n) {
+	return n + n / 255 + 16;
+}
+
+size_t LZCodec::compress(const void *src, size_t n, void *dst,
+		size_t dstlen) {
+	const uint8_t *base = (const uint8_t *) src;
+	const uint8_t *end = base + n;
+	const uint8_t *ip = base, *anchor = base, *ref;
+	const uint8_t *mlimit = n > LZ_END_LITERALS ? end - LZ_END_LITERALS : base;
+	uint8_t *op = (uint8_t *) dst, *oend = op + dstlen;
+	/* positions + 1, 0 for none */
+	uint32_t table[1 << LZ_HASH_LOG];
+	size_t mlen;
+	uint32_t seq, h, pos;
+
+	memset(table, 0, sizeof(table));
+	while (ip < mlimit) {
+		seq = read32(ip);
+		h = lz_hash(seq);
+		pos = table[h];
+		table[h] = ip - base + 1;
+		ref = base + pos - 1;
+		if (pos == 0 || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+			ip += 1 + ((ip - anchor) >> LZ_SKIP_LOG);
+			continue;
+		}
+
+		/* matches stop short of the end, the block ends in literals */
+		mlen = LZ_MIN_MATCH + match_length(ref + LZ_MIN_MATCH,
+				ip + LZ_MIN_MATCH, end - LZ_END_LITERALS / 2);
+		op = put_sequence(op, oend, anchor, ip - anchor, ip - ref, mlen);
+		if (op == NULL)
+			return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+	op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+	return op != NULL ? op - (uint8_t *) dst : 0;
+}
+
+bool LZCodec::decompress(const void *src, size_t n, void *dst,
+		size_t dstlen) {
+	const uint8_t *ip = (const uint8_t *) src, *iend = ip + n;
+	uint8_t *op = (uint8_t *) dst, *oend = op + dstlen;
+	size_t lit, mlen, offset;
+	uint8_t token, b;
+
+	while (ip < iend) {
+		token = *ip++;
+		lit = token >> 4;
+		if (lit == 15) {
+			do {
+				if (ip >= iend)
+					return false;
+				b = *ip++;
+				lit += b;
+			} while (b == 255);
+		}
+		if ((size_t) (iend - ip) < lit || (size_t) (oend - op) < lit)
+			return false;
+		memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+		/* the last sequence */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - (uint8_t *) dst))
+			return false;
+		mlen = (token & 15) + LZ_MIN_MATCH;
+		if ((token & 15) == 15) {
+			do {
+				if (ip >= iend)
+					return false;
+				b = *ip++;
+				mlen += b;
+			} while (b == 255);
+		}
+		if ((size_t) (oend - op) < mlen)
+			return false;
+		if (offset >= mlen) {
+			memcpy(op, op - offset, mlen);
+			op += mlen;
+		} else {
+			/* overlapping, repeats the last offset bytes */
+			for (; mlen > 0; mlen--, op++)
+				*op = *(op - offset);
+		}
+	}
+	return op == oend;
+}
+
+}